@@ -0,0 +1,312 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/block.h"
+#include "undo.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+
+#include <boost/thread.hpp>
+
+/** Height the background build of the address index continues from, or -1 once it is complete; guarded by cs_main */
+static int nAddressIndexBuildHeight = -1;
+
+CPendingAddressIndex pendingAddressIndex;
+
+bool GetAddressIndexPrefix(const CScript& scriptPubKey, CAddressIndexPrefix& address)
+{
+    CTxDestination dest;
+    return ExtractDestination(scriptPubKey, dest) && GetAddressIndexPrefix(dest, address);
+}
+
+bool GetAddressIndexPrefix(const CTxDestination& dest, CAddressIndexPrefix& address)
+{
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        address = CAddressIndexPrefix(ADDRESS_INDEX_KEY_ID, *keyID);
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        address = CAddressIndexPrefix(ADDRESS_INDEX_SCRIPT_ID, *scriptID);
+        return true;
+    }
+    return false;
+}
+
+CTxDestination GetAddressIndexDestination(const CAddressIndexPrefix& address)
+{
+    if (address.nType == ADDRESS_INDEX_KEY_ID)
+        return CKeyID(address.hash);
+    if (address.nType == ADDRESS_INDEX_SCRIPT_ID)
+        return CScriptID(address.hash);
+    return CNoDestination();
+}
+
+bool GetBlockAddressIndex(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CAddressIndexUpdates& updates)
+{
+    if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+        return error("%s: block and undo data inconsistent at height %d", __func__, nHeight);
+
+    CAddressIndexPrefix address;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: transaction and undo data inconsistent for %s", __func__, txid.ToString());
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const Coin& coin = txundo.vprevout[j];
+                if (!GetAddressIndexPrefix(coin.out.scriptPubKey, address))
+                    continue;
+                const COutPoint& prevout = tx.vin[j].prevout;
+                updates.vEntries.push_back(std::make_pair(CAddressIndexKey(address, nHeight, i, txid, j, true), -coin.out.nValue));
+                updates.vSpent.push_back(std::make_pair(CAddressUnspentKey(address, prevout.hash, prevout.n),
+                                                        CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight)));
+            }
+        }
+
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            if (!GetAddressIndexPrefix(out.scriptPubKey, address))
+                continue;
+            updates.vEntries.push_back(std::make_pair(CAddressIndexKey(address, nHeight, i, txid, j, false), out.nValue));
+            updates.vCreated.push_back(std::make_pair(CAddressUnspentKey(address, txid, j), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+        }
+    }
+    return true;
+}
+
+bool WriteBlockAddressIndex(const CBlock& block, const CBlockUndo& blockundo, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    // The unspent outputs are only right if blocks are indexed in chain order; leave this one to the build
+    if (nAddressIndexBuildHeight >= 0 && nHeight >= nAddressIndexBuildHeight)
+        return true;
+
+    CAddressIndexUpdates updates;
+    if (!GetBlockAddressIndex(block, blockundo, nHeight, updates))
+        return false;
+    for (const auto& entry : updates.vEntries)
+        pendingAddressIndex.entries.Write(entry.first, entry.second);
+    for (const auto& entry : updates.vCreated)
+        pendingAddressIndex.unspent.Write(entry.first, entry.second);
+    for (const auto& entry : updates.vSpent)
+        pendingAddressIndex.unspent.Erase(entry.first);
+    return true;
+}
+
+bool EraseBlockAddressIndex(const CBlock& block, const CBlockUndo& blockundo, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    if (nAddressIndexBuildHeight >= 0 && nHeight >= nAddressIndexBuildHeight)
+        return true;
+
+    CAddressIndexUpdates updates;
+    if (!GetBlockAddressIndex(block, blockundo, nHeight, updates))
+        return false;
+    // The reverse of WriteBlockAddressIndex: outputs spent and created within the block end up erased
+    for (const auto& entry : updates.vEntries)
+        pendingAddressIndex.entries.Erase(entry.first);
+    for (const auto& entry : updates.vSpent)
+        pendingAddressIndex.unspent.Write(entry.first, entry.second);
+    for (const auto& entry : updates.vCreated)
+        pendingAddressIndex.unspent.Erase(entry.first);
+    return true;
+}
+
+bool LoadAddressIndexBuildHeight()
+{
+    AssertLockHeld(cs_main);
+    nAddressIndexBuildHeight = -1;
+    return pblocktree->ReadAddressIndexBuildHeight(nAddressIndexBuildHeight);
+}
+
+bool InitAddressIndex(bool fEnable)
+{
+    LOCK(cs_main);
+    bool fWasEnabled = false;
+    pblocktree->ReadFlag("addressindex", fWasEnabled);
+
+    if (fEnable != fWasEnabled) {
+        // Entries left from an earlier run may be stale; start over from the genesis block
+        pendingAddressIndex.Clear();
+        if (!pblocktree->WipeAddressIndex())
+            return error("%s: failed to clear the address index", __func__);
+        if (fEnable && !pblocktree->WriteAddressIndexBuild(CAddressIndexUpdates(), 0))
+            return error("%s: failed to start the address index", __func__);
+        if (!pblocktree->WriteFlag("addressindex", fEnable))
+            return error("%s: failed to write the address index flag", __func__);
+    }
+
+    fAddressIndex = fEnable;
+    nAddressIndexBuildHeight = -1;
+    if (fAddressIndex && !pblocktree->ReadAddressIndexBuildHeight(nAddressIndexBuildHeight))
+        return error("%s: failed to read the address index build height", __func__);
+
+    LogPrintf("%s: address index %s\n", __func__, !fAddressIndex ? "disabled" :
+        nAddressIndexBuildHeight < 0 ? "enabled" : strprintf("being built from height %d", nAddressIndexBuildHeight));
+    return true;
+}
+
+void ThreadAddressIndex()
+{
+    const Consensus::CParams& consensusParams = Params().GetConsensus();
+    int64_t nStart = GetTimeMillis();
+
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        // Snapshot the next blocks of the active chain, and read them without holding cs_main
+        std::vector<CBlockIndex*> vBlocks;
+        {
+            LOCK(cs_main);
+            if (nAddressIndexBuildHeight < 0)
+                return;
+            for (int nHeight = nAddressIndexBuildHeight; nHeight <= chainActive.Height() && vBlocks.size() < ADDRESS_INDEX_BUILD_BLOCKS; nHeight++)
+                vBlocks.push_back(chainActive[nHeight]);
+            if (vBlocks.empty()) {
+                // Caught up: ConnectBlock indexes every block from here on
+                if (!pblocktree->WriteAddressIndexBuild(CAddressIndexUpdates(), -1)) {
+                    error("%s: failed to write the address index", __func__);
+                    return;
+                }
+                nAddressIndexBuildHeight = -1;
+                LogPrintf("%s: address index built up to height %d in %dms\n", __func__, chainActive.Height(), GetTimeMillis() - nStart);
+                return;
+            }
+        }
+
+        std::vector<CAddressIndexUpdates> vBlockUpdates(vBlocks.size());
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            boost::this_thread::interruption_point();
+            // The outputs of the genesis block are not spendable, and ConnectBlock skips it
+            if (vBlocks[i]->nHeight == 0)
+                continue;
+            CBlock block;
+            CBlockUndo blockundo;
+            if (!ReadBlockFromDisk(block, vBlocks[i], consensusParams) ||
+                !UndoReadFromDisk(blockundo, vBlocks[i]) ||
+                !GetBlockAddressIndex(block, blockundo, vBlocks[i]->nHeight, vBlockUpdates[i])) {
+                error("%s: failed to read block %s, the address index is not built", __func__, vBlocks[i]->GetBlockHash().ToString());
+                return;
+            }
+        }
+
+        {
+            LOCK(cs_main);
+            // The unspent outputs depend on the order blocks are indexed in, so first write
+            // what blocks reconnected below the build height queued meanwhile
+            if (!pendingAddressIndex.IsEmpty())
+                FlushStateToDisk();
+            // Blocks disconnected meanwhile were left to the build; write only those
+            // still active, and pick up the new branch in the next round
+            CAddressIndexUpdates updates;
+            size_t n = 0;
+            for (; n < vBlocks.size() && chainActive.Contains(vBlocks[n]); n++)
+                updates.Append(vBlockUpdates[n]);
+            int nHeight = vBlocks[0]->nHeight + n;
+            if (!pblocktree->WriteAddressIndexBuild(updates, nHeight)) {
+                error("%s: failed to write the address index", __func__);
+                return;
+            }
+            nAddressIndexBuildHeight = nHeight;
+            LogPrint("addressindex", "%s: address index built up to height %d\n", __func__, nHeight - 1);
+        }
+    }
+}
+
+bool IsAddressIndexComplete()
+{
+    LOCK(cs_main);
+    return fAddressIndex && nAddressIndexBuildHeight < 0;
+}
+
+bool FindAddressTransactions(const std::vector<CAddressIndexPrefix>& vAddresses, int nHeightStart, int nHeightEnd, size_t nSkip, size_t nCount,
+                             std::vector<std::pair<uint256, int> >& vTx)
+{
+    LOCK(cs_main);
+    vTx.clear();
+    if (!fAddressIndex || nAddressIndexBuildHeight >= 0)
+        return false;
+    if (nHeightStart < 0 || nHeightEnd < nHeightStart)
+        return true;
+
+    // The first nSkip + nCount transactions of each address, which include the first of all of them
+    const CPendingIndex<CAddressIndexKey, CAmount>& pending = pendingAddressIndex.entries;
+    std::set<std::tuple<uint32_t, uint32_t, uint256> > setTx;
+    for (const CAddressIndexPrefix& address : vAddresses) {
+        std::set<std::tuple<uint32_t, uint32_t, uint256> > setAddressTx;
+        std::unique_ptr<CAddressIndexCursor> pcursor(pblocktree->AddressIndexCursor(address, nHeightStart));
+        for (; pcursor->Valid() && setAddressTx.size() < nSkip + nCount; pcursor->Next()) {
+            boost::this_thread::interruption_point();
+            CAddressIndexKey key;
+            if (!pcursor->GetKey(key))
+                return error("%s: failed to read address index entry", __func__);
+            if (key.nHeight > (uint32_t)nHeightEnd)
+                break;
+            // Entries of blocks disconnected since the last flush, or written again below
+            if (pending.setErase.count(key))
+                continue;
+            setAddressTx.insert(std::make_tuple(key.nHeight, key.nTx, key.txid));
+        }
+        // Add the entries of the blocks connected since the last flush
+        for (auto it = pending.mapWrite.lower_bound(CAddressIndexKey(address, nHeightStart, 0, uint256(), 0, false));
+             it != pending.mapWrite.end() && it->first.address == address && it->first.nHeight <= (uint32_t)nHeightEnd; ++it)
+            setAddressTx.insert(std::make_tuple(it->first.nHeight, it->first.nTx, it->first.txid));
+
+        size_t nAddressTx = 0;
+        for (auto it = setAddressTx.begin(); it != setAddressTx.end() && nAddressTx < nSkip + nCount; ++it, ++nAddressTx)
+            setTx.insert(*it);
+    }
+
+    size_t n = 0;
+    for (const auto& tx : setTx) {
+        if (n++ < nSkip)
+            continue;
+        if (vTx.size() >= nCount)
+            break;
+        vTx.push_back(std::make_pair(std::get<2>(tx), (int)std::get<0>(tx)));
+    }
+    return true;
+}
+
+bool FindAddressUnspent(const std::vector<CAddressIndexPrefix>& vAddresses, size_t nMaxEntries,
+                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vEntries)
+{
+    LOCK(cs_main);
+    vEntries.clear();
+    if (!fAddressIndex || nAddressIndexBuildHeight >= 0)
+        return false;
+    const CPendingIndex<CAddressUnspentKey, CAddressUnspentValue>& pending = pendingAddressIndex.unspent;
+    for (const CAddressIndexPrefix& address : vAddresses) {
+        if (vEntries.size() > nMaxEntries)
+            break;
+        CAddressUnspentKey keyBegin(address, uint256(), 0);
+        auto fInRange = [&address](const CAddressUnspentKey& key) { return key.address == address; };
+        // Read as many more as the outputs spent since the last flush, which are merged in below
+        size_t nErased = 0;
+        for (auto it = pending.setErase.lower_bound(keyBegin); it != pending.setErase.end() && fInRange(*it); ++it)
+            nErased++;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressEntries;
+        if (!pblocktree->ReadAddressUnspentIndex(address, nMaxEntries - vEntries.size() + nErased, vAddressEntries))
+            return false;
+        std::map<CAddressUnspentKey, CAddressUnspentValue> mapEntries(vAddressEntries.begin(), vAddressEntries.end());
+        pending.Apply(mapEntries, keyBegin, fInRange);
+        vEntries.insert(vEntries.end(), mapEntries.begin(), mapEntries.end());
+    }
+    if (vEntries.size() > nMaxEntries + 1)
+        vEntries.resize(nMaxEntries + 1);
+    return true;
+}
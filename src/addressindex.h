@@ -0,0 +1,81 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "pubkey.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+/** Address index types of the addresses paid by key id and by script id */
+static const uint8_t ADDRESS_INDEX_KEY_ID = 1;
+static const uint8_t ADDRESS_INDEX_SCRIPT_ID = 2;
+/** Blocks read per round while building the address index in the background */
+static const unsigned int ADDRESS_INDEX_BUILD_BLOCKS = 100;
+/** Maximum number of addresses looked up by one address index call */
+static const unsigned int MAX_ADDRESS_LOOKUPS = 100;
+/** Maximum and default number of results returned by one getaddresstxids or getaddressutxos call */
+static const unsigned int MAX_ADDRESS_RESULTS = 10000;
+static const unsigned int DEFAULT_ADDRESS_RESULTS = 1000;
+/** Maximum number of results skipped by one of those calls, as each address is read up to the skip and count under cs_main */
+static const unsigned int MAX_ADDRESS_SKIP = 10 * MAX_ADDRESS_RESULTS;
+/** getaddressbalance fails for addresses with more unspent outputs than this */
+static const unsigned int MAX_ADDRESS_BALANCE_OUTPUTS = 1000000;
+
+/** The address a script pays, as the address index keys it; pay-to-pubkey scripts count as their key id */
+bool GetAddressIndexPrefix(const CScript& scriptPubKey, CAddressIndexPrefix& address);
+bool GetAddressIndexPrefix(const CTxDestination& dest, CAddressIndexPrefix& address);
+CTxDestination GetAddressIndexDestination(const CAddressIndexPrefix& address);
+
+/**
+ * The address index changes of connecting a block: an entry for each output
+ * paying and each input spending from an address, and the outputs created
+ * and spent. blockundo holds the outputs the block spends.
+ */
+bool GetBlockAddressIndex(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CAddressIndexUpdates& updates);
+
+/** Address index changes not yet written with the block index by FlushStateToDisk; guarded by cs_main */
+extern CPendingAddressIndex pendingAddressIndex;
+
+/** Queue the address index changes of a block, or their reversal, unless the background build has yet to reach it */
+bool WriteBlockAddressIndex(const CBlock& block, const CBlockUndo& blockundo, int nHeight);
+bool EraseBlockAddressIndex(const CBlock& block, const CBlockUndo& blockundo, int nHeight);
+
+/** Read the height the background build continues from, for the crash repair that runs before InitAddressIndex */
+bool LoadAddressIndexBuildHeight();
+
+/**
+ * Turn the address index on or off after the block index is loaded. Turning
+ * it on for an existing chain schedules ThreadAddressIndex to build it; from
+ * then on ConnectBlock and DisconnectTip keep it up to date.
+ */
+bool InitAddressIndex(bool fEnable);
+
+/** Index the blocks connected before -addressindex was turned on, from their block and undo data */
+void ThreadAddressIndex();
+
+/** Whether the address index covers the whole active chain */
+bool IsAddressIndexComplete();
+
+/**
+ * The transactions paying or spending from any of vAddresses in blocks from
+ * nHeightStart to nHeightEnd, with their heights, in chain order; skipping the
+ * first nSkip and returning at most nCount. Requires a complete index.
+ */
+bool FindAddressTransactions(const std::vector<CAddressIndexPrefix>& vAddresses, int nHeightStart, int nHeightEnd, size_t nSkip, size_t nCount,
+                             std::vector<std::pair<uint256, int> >& vTx);
+
+/** The unspent outputs of vAddresses, by address and txid, stopping after nMaxEntries + 1; requires a complete index */
+bool FindAddressUnspent(const std::vector<CAddressIndexPrefix>& vAddresses, size_t nMaxEntries,
+                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vEntries);
+
+#endif // BITCOIN_ADDRESSINDEX_H
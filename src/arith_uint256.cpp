@@ -80,6 +80,27 @@ base_uint<BITS>& base_uint<BITS>::operator*=(const base_uint& b)
     return *this;
 }
 
+template <unsigned int BITS>
+base_uint<BITS>& base_uint<BITS>::Mul64(uint64_t b64, bool *pfOverflow)
+{
+    const uint32_t b[2] = {(uint32_t)b64, (uint32_t)(b64 >> 32)};
+    uint32_t r[WIDTH + 2] = {0};
+    for (int j = 0; j < 2; j++) {
+        uint64_t carry = 0;
+        for (int i = 0; i < WIDTH; i++) {
+            uint64_t n = carry + r[i + j] + (uint64_t)b[j] * pn[i];
+            r[i + j] = n & 0xffffffff;
+            carry = n >> 32;
+        }
+        r[WIDTH + j] = carry;
+    }
+    for (int i = 0; i < WIDTH; i++)
+        pn[i] = r[i];
+    if (pfOverflow)
+        *pfOverflow = r[WIDTH] != 0 || r[WIDTH + 1] != 0;
+    return *this;
+}
+
 template <unsigned int BITS>
 base_uint<BITS>& base_uint<BITS>::operator/=(const base_uint& b)
 {
@@ -189,6 +210,7 @@ template base_uint<256>& base_uint<256>::operator<<=(unsigned int);
 template base_uint<256>& base_uint<256>::operator>>=(unsigned int);
 template base_uint<256>& base_uint<256>::operator*=(uint32_t b32);
 template base_uint<256>& base_uint<256>::operator*=(const base_uint<256>& b);
+template base_uint<256>& base_uint<256>::Mul64(uint64_t b64, bool *pfOverflow);
 template base_uint<256>& base_uint<256>::operator/=(const base_uint<256>& b);
 template int base_uint<256>::CompareTo(const base_uint<256>&) const;
 template bool base_uint<256>::EqualTo(uint64_t) const;
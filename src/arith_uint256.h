@@ -168,6 +168,11 @@ public:
 
     base_uint& operator*=(uint32_t b32);
     base_uint& operator*=(const base_uint& b);
+    /**
+     * Multiply by a 64-bit value. If the product does not fit, the result is
+     * truncated like operator*= and *pfOverflow is set.
+     */
+    base_uint& Mul64(uint64_t b64, bool *pfOverflow = NULL);
     base_uint& operator/=(const base_uint& b);
 
     base_uint& operator++()
@@ -0,0 +1,94 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "miner.h"
+#include "pos.h"
+#include "random.h"
+#include "txmempool.h"
+#include "validation.h"
+
+#include <vector>
+
+static const int BLOCK_ASSEMBLER_BENCH_BLOCKS = 100;
+static const int BLOCK_ASSEMBLER_BENCH_TXS = 50000;
+/** Stake timestamp slots the staker goes through while the tip and mempool stay the same */
+static const int BLOCK_ASSEMBLER_BENCH_SLOTS = 8;
+
+/** A short active chain and a full mempool, some of whose transactions are newer than the first slots */
+class BlockAssemblerChain
+{
+public:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+    int64_t nSlot;
+
+    BlockAssemblerChain() : vHashes(BLOCK_ASSEMBLER_BENCH_BLOCKS), vIndex(BLOCK_ASSEMBLER_BENCH_BLOCKS)
+    {
+        SelectParams(CBaseChainParams::MAIN);
+        LOCK(cs_main);
+        for (int i = 0; i < BLOCK_ASSEMBLER_BENCH_BLOCKS; i++) {
+            vHashes[i] = GetRandHash();
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+            vIndex[i].nHeight = i;
+            vIndex[i].nTime = 1400000000 + i * 60;
+            vIndex[i].BuildSkip();
+            mapBlockIndex[vHashes[i]] = &vIndex[i];
+        }
+        chainActive.SetTip(&vIndex.back());
+        nSlot = (vIndex.back().nTime + 600) & ~STAKE_TIMESTAMP_MASK;
+
+        CScript scriptPubKey = CScript() << OP_TRUE;
+        LockPoints lp;
+        for (int i = 0; i < BLOCK_ASSEMBLER_BENCH_TXS; i++) {
+            CMutableTransaction tx;
+            tx.nTime = nSlot - 1000 + i % (1000 + 16 * BLOCK_ASSEMBLER_BENCH_SLOTS);
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+            tx.vout.push_back(CTxOut((1 + i % 100) * COIN, scriptPubKey));
+            CAmount nFee = 10000 + (i * 7919) % 1000000;
+            CTransactionRef ptx = MakeTransactionRef(std::move(tx));
+            mempool.addUnchecked(ptx->GetHash(), CTxMemPoolEntry(ptx, nFee, 0, 0, 1, ptx->GetValueOut(), false, 4, lp));
+        }
+    }
+
+    ~BlockAssemblerChain()
+    {
+        mempool.clear();
+        LOCK(cs_main);
+        chainActive.SetTip(NULL);
+        for (const uint256& hash : vHashes)
+            mapBlockIndex.erase(hash);
+    }
+};
+
+// The staker's template for each slot, selected from the whole mempool every time...
+static void StakeTemplateRebuild(benchmark::State& state)
+{
+    BlockAssemblerChain chain;
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    int n = 0;
+    while (state.KeepRunning()) {
+        int64_t nTime = chain.nSlot + 16 * (n++ % BLOCK_ASSEMBLER_BENCH_SLOTS);
+        assert(BlockAssembler(Params()).CreateNewBlock(scriptPubKey, true, NULL, nTime)->block.vtx.size() > 2);
+    }
+}
+
+// ...and reusing the selection of the previous slot
+static void StakeTemplateReuse(benchmark::State& state)
+{
+    BlockAssemblerChain chain;
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    BlockAssembler assembler(Params());
+    int n = 0;
+    while (state.KeepRunning()) {
+        int64_t nTime = chain.nSlot + 16 * (n++ % BLOCK_ASSEMBLER_BENCH_SLOTS);
+        assert(assembler.CreateNewBlock(scriptPubKey, true, NULL, nTime)->block.vtx.size() > 2);
+    }
+}
+
+BENCHMARK(StakeTemplateRebuild);
+BENCHMARK(StakeTemplateReuse);
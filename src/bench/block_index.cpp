@@ -0,0 +1,87 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "random.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/filesystem.hpp>
+
+#include <vector>
+
+static const int BLOCK_INDEX_BENCH_ENTRIES = 20000;
+
+/** A block tree database, in memory, with a chain of signed proof-of-stake block index entries */
+class BlockIndexChain
+{
+public:
+    boost::filesystem::path pathTemp;
+    std::unique_ptr<CBlockTreeDB> pdb;
+
+    BlockIndexChain()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_clam_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        ForceSetArg("-datadir", pathTemp.string());
+        ClearDatadirCache();
+        pdb.reset(new CBlockTreeDB(1 << 20, true));
+
+        std::vector<uint256> vHashes(BLOCK_INDEX_BENCH_ENTRIES);
+        std::vector<const CBlockIndex*> vBlocks;
+        std::vector<CBlockIndex> vIndex(BLOCK_INDEX_BENCH_ENTRIES);
+        for (int i = 0; i < BLOCK_INDEX_BENCH_ENTRIES; i++) {
+            CBlockIndex& index = vIndex[i];
+            index.pprev = i ? &vIndex[i - 1] : NULL;
+            index.nHeight = i;
+            index.nVersion = 7;
+            index.nTime = 1400000000 + i * 60;
+            index.nStatus = BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_VALID_SCRIPTS;
+            index.nTx = 2;
+            index.nDataPos = i * 1000;
+            index.nUndoPos = i * 100;
+            index.prevoutStake = COutPoint(GetRandHash(), i % 3);
+            index.SetProofOfStake();
+            index.SetBlockSig(std::vector<unsigned char>(72, (unsigned char)i));
+            vHashes[i] = index.GetBlockHeader().GetHash();
+            index.phashBlock = &vHashes[i];
+            vBlocks.push_back(&index);
+        }
+        assert(pdb->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vBlocks, CHeightIndexUpdates(), CPendingNotaryIndex(), CPendingSpeechIndex(), CPendingAddressIndex(), uint256()));
+        blockIndexArena.Clear();
+    }
+
+    ~BlockIndexChain()
+    {
+        pdb.reset();
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+// Load the block index from the database as at startup, then unload it
+static void LoadBlockIndexGutsThreads(benchmark::State& state, int nThreads)
+{
+    BlockIndexChain chain;
+    while (state.KeepRunning()) {
+        assert(chain.pdb->LoadBlockIndexGuts(InsertBlockIndex, nThreads));
+        UnloadBlockIndex();
+    }
+}
+
+static void LoadBlockIndexGuts(benchmark::State& state)
+{
+    LoadBlockIndexGutsThreads(state, 1);
+}
+
+static void LoadBlockIndexGutsParallel(benchmark::State& state)
+{
+    LoadBlockIndexGutsThreads(state, 4);
+}
+
+BENCHMARK(LoadBlockIndexGuts);
+BENCHMARK(LoadBlockIndexGutsParallel);
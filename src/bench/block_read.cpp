@@ -0,0 +1,122 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/merkle.h"
+#include "pow.h"
+#include "random.h"
+#include "script/script.h"
+#include "util.h"
+#include "validation.h"
+
+#include <boost/filesystem.hpp>
+
+#include <vector>
+
+static const int BLOCK_READ_CHAIN_LENGTH = 200;
+
+/**
+ * A chain of validated, scrypt hashed (version 6) proof-of-work blocks
+ * written to a block file in a scratch data directory.
+ */
+class BlockReadChain
+{
+public:
+    Consensus::CParams consensusParams;
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+    boost::filesystem::path pathTemp;
+
+    BlockReadChain()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        // Easy enough that a valid nonce is found in a couple of scrypt hashes
+        consensusParams = Params().GetConsensus();
+        consensusParams.powLimit = 0x207fffff;
+
+        pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_clam_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        ForceSetArg("-datadir", pathTemp.string());
+        ClearDatadirCache();
+        boost::filesystem::create_directories(GetDataDir() / "blocks");
+
+        vHashes.resize(BLOCK_READ_CHAIN_LENGTH);
+        vIndex.resize(BLOCK_READ_CHAIN_LENGTH);
+        CDiskBlockPos pos(0, 0);
+        for (int i = 0; i < BLOCK_READ_CHAIN_LENGTH; i++) {
+            CMutableTransaction txCoinBase;
+            txCoinBase.vin.resize(1);
+            txCoinBase.vin[0].scriptSig = CScript() << i << OP_0;
+            txCoinBase.vout.resize(50);
+            for (CTxOut& txout : txCoinBase.vout) {
+                std::vector<unsigned char> vchKeyID = ToByteVector(GetRandHash());
+                vchKeyID.resize(20);
+                txout.nValue = COIN;
+                txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << vchKeyID << OP_EQUALVERIFY << OP_CHECKSIG;
+            }
+
+            CBlock block;
+            block.nVersion = 6;
+            block.hashPrevBlock = i ? vHashes[i - 1] : uint256();
+            block.nTime = 1400000000 + i * 60;
+            block.nBits = consensusParams.powLimit;
+            block.vtx.push_back(MakeTransactionRef(std::move(txCoinBase)));
+            block.hashMerkleRoot = BlockMerkleRoot(block);
+            while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams))
+                block.nNonce++;
+            vHashes[i] = block.GetHash();
+
+            unsigned int nSize = ::GetSerializeSize(LEGACY_BLOCK(block), SER_DISK, CLIENT_VERSION);
+            assert(WriteBlockToDisk(block, pos, Params().MessageStart()));
+
+            CBlockIndex& index = vIndex[i];
+            index = CBlockIndex(block);
+            index.phashBlock = &vHashes[i];
+            index.pprev = i ? &vIndex[i - 1] : NULL;
+            index.nHeight = i;
+            index.nFile = pos.nFile;
+            index.nDataPos = pos.nPos;
+            index.nStatus = BLOCK_HAVE_DATA | BLOCK_VALID_SCRIPTS;
+            pos.nPos += nSize;
+        }
+    }
+
+    ~BlockReadChain()
+    {
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+// Sequentially read a chain of early, already validated blocks, as getblock,
+// rescans and REST clients do: trusting the block index...
+static void ReadValidatedBlocks(benchmark::State& state)
+{
+    BlockReadChain chain;
+    while (state.KeepRunning()) {
+        for (const CBlockIndex& index : chain.vIndex) {
+            CBlock block;
+            assert(ReadBlockFromDisk(block, &index, chain.consensusParams));
+        }
+    }
+}
+
+// ...and with -checkblockreads, recomputing the scrypt hash and checking the proof of work
+static void ReadValidatedBlocksChecked(benchmark::State& state)
+{
+    BlockReadChain chain;
+    fCheckBlockReads = true;
+    while (state.KeepRunning()) {
+        for (const CBlockIndex& index : chain.vIndex) {
+            CBlock block;
+            assert(ReadBlockFromDisk(block, &index, chain.consensusParams));
+        }
+    }
+    fCheckBlockReads = DEFAULT_CHECK_BLOCK_READS;
+}
+
+BENCHMARK(ReadValidatedBlocks);
+BENCHMARK(ReadValidatedBlocksChecked);
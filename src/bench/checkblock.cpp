@@ -5,9 +5,11 @@
 #include "bench.h"
 
 #include "chainparams.h"
+#include "clientversion.h"
 #include "validation.h"
 #include "streams.h"
 #include "consensus/validation.h"
+#include "script/script.h"
 
 namespace block_bench {
 #include "bench/data/block413567.raw.h"
@@ -52,5 +54,97 @@ static void DeserializeAndCheckBlockTest(benchmark::State& state)
     }
 }
 
+// A proof-of-stake block of 1000 two-in two-out transactions, in the legacy
+// layout of the block files
+static CBlock LegacyBenchBlock()
+{
+    CBlock block;
+    block.nVersion = 7;
+    block.nTime = 1500000000;
+    block.nBits = 0x1d00ffff;
+    block.vchBlockSig.assign(72, 0x30);
+    for (int i = 0; i < 1000; i++) {
+        CMutableTransaction tx;
+        tx.nTime = block.nTime;
+        tx.vin.resize(2);
+        for (CTxIn& txin : tx.vin) {
+            txin.prevout = COutPoint(uint256S(strprintf("%x", i + 1)), 1);
+            txin.scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+        }
+        tx.vout.resize(2);
+        for (CTxOut& txout : tx.vout) {
+            txout.nValue = COIN;
+            txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        if (i == 1)
+            tx.vout[0].SetEmpty();
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+// Reading and writing a block in the legacy layout, as ReadBlockFromDisk and
+// WriteBlockToDisk do: through a CBlockLegacy copy of the block...
+static void DeserializeLegacyBlockCopy(benchmark::State& state)
+{
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << LEGACY_BLOCK(LegacyBenchBlock());
+    size_t nSize = stream.size();
+    char a;
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlockLegacy blockLegacy;
+        stream >> blockLegacy;
+        CBlock block(blockLegacy);
+        assert(stream.Rewind(nSize));
+    }
+}
+
+// ...and straight into and out of the CBlock
+static void DeserializeLegacyBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << LEGACY_BLOCK(LegacyBenchBlock());
+    size_t nSize = stream.size();
+    char a;
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream >> LEGACY_BLOCK(block);
+        assert(stream.Rewind(nSize));
+    }
+}
+
+static void SerializeLegacyBlockCopy(benchmark::State& state)
+{
+    CBlock block = LegacyBenchBlock();
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream.reserve(2 * ::GetSerializeSize(LEGACY_BLOCK(block), SER_DISK, CLIENT_VERSION));
+
+    while (state.KeepRunning()) {
+        CBlockLegacy blockLegacy(block);
+        stream << blockLegacy;
+        stream.clear();
+    }
+}
+
+static void SerializeLegacyBlock(benchmark::State& state)
+{
+    CBlock block = LegacyBenchBlock();
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream.reserve(2 * ::GetSerializeSize(LEGACY_BLOCK(block), SER_DISK, CLIENT_VERSION));
+
+    while (state.KeepRunning()) {
+        stream << LEGACY_BLOCK(block);
+        stream.clear();
+    }
+}
+
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(DeserializeLegacyBlockCopy);
+BENCHMARK(DeserializeLegacyBlock);
+BENCHMARK(SerializeLegacyBlockCopy);
+BENCHMARK(SerializeLegacyBlock);
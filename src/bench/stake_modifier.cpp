@@ -0,0 +1,59 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "pos.h"
+#include "random.h"
+
+#include <vector>
+
+static const int STAKE_MODIFIER_BENCH_BLOCKS = 5000;
+
+// One stake modifier per modifier interval along a chain of one minute
+// blocks, as when connecting blocks during a reindex...
+static void StakeModifierChain(benchmark::State& state, bool fRebuild)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    std::vector<uint256> vHashes(STAKE_MODIFIER_BENCH_BLOCKS);
+    std::vector<CBlockIndex> vIndex(STAKE_MODIFIER_BENCH_BLOCKS);
+    for (int i = 0; i < STAKE_MODIFIER_BENCH_BLOCKS; i++) {
+        CBlockIndex& index = vIndex[i];
+        vHashes[i] = GetRandHash();
+        index.phashBlock = &vHashes[i];
+        index.pprev = i ? &vIndex[i - 1] : NULL;
+        index.nHeight = i;
+        index.nTime = 1400000000 + i * 60;
+        index.hashProof = GetRandHash();
+        index.SetProofOfStake();
+        index.SetStakeEntropyBit(i % 2);
+        index.BuildSkip();
+    }
+
+    const int nStep = Params().GetConsensus().nModifierInterval / 60;
+    CStakeModifierEngine engine;
+    uint64_t nStakeModifier = 0;
+    int nHeight = 0;
+    while (state.KeepRunning()) {
+        nHeight = (nHeight + nStep) % STAKE_MODIFIER_BENCH_BLOCKS;
+        // ...with the window rebuilt each time, as before CStakeModifierEngine
+        if (fRebuild)
+            engine.Clear();
+        assert(engine.ComputeModifier(&vIndex[nHeight], nStakeModifier, nStakeModifier));
+    }
+}
+
+static void StakeModifierRebuild(benchmark::State& state)
+{
+    StakeModifierChain(state, true);
+}
+
+static void StakeModifierIncremental(benchmark::State& state)
+{
+    StakeModifierChain(state, false);
+}
+
+BENCHMARK(StakeModifierRebuild);
+BENCHMARK(StakeModifierIncremental);
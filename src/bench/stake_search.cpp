@@ -0,0 +1,54 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "consensus/params.h"
+#include "random.h"
+#include "stakesearch.h"
+
+#include <vector>
+
+// Every iteration hashes one kernel per candidate; the target is kept
+// impossibly low so that each round scans the whole wallet, which makes
+// iterations per second times the wallet size the kernel rate.
+static void StakeKernelSearch(benchmark::State& state, size_t nCandidates)
+{
+    const unsigned int nTime = 1500000000 & ~15;
+    Consensus::CParams params;
+    params.nStakeMinAge = 4 * 60 * 60;
+
+    FastRandomContext insecure_rand(true);
+    std::vector<CStakeCandidate> vCandidates;
+    vCandidates.reserve(nCandidates);
+    for (size_t i = 0; i < nCandidates; i++) {
+        COutPoint prevout(GetRandHash(), insecure_rand.rand32() % 4);
+        vCandidates.push_back(CStakeCandidate(prevout, (1 + insecure_rand.rand32() % 1000) * COIN, nTime - 86400, nTime - 86400));
+    }
+    std::vector<unsigned int> vTimeSlots(1, nTime);
+
+    CStakeKernelSearch stakeSearch(GetStakeSearchThreads());
+    CStakeKernelHit hit;
+    while (state.KeepRunning()) {
+        stakeSearch.FindKernel(insecure_rand.rand64(), 0x03000001, vCandidates, vTimeSlots, params, hit);
+    }
+}
+
+static void StakeKernelSearch10k(benchmark::State& state)
+{
+    StakeKernelSearch(state, 10000);
+}
+
+static void StakeKernelSearch100k(benchmark::State& state)
+{
+    StakeKernelSearch(state, 100000);
+}
+
+static void StakeKernelSearch1M(benchmark::State& state)
+{
+    StakeKernelSearch(state, 1000000);
+}
+
+BENCHMARK(StakeKernelSearch10k);
+BENCHMARK(StakeKernelSearch100k);
+BENCHMARK(StakeKernelSearch1M);
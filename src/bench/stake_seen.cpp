@@ -0,0 +1,49 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "random.h"
+#include "stakeseen.h"
+
+#include <set>
+#include <vector>
+
+static const int STAKE_SEEN_BENCH_ENTRIES = 200000;
+
+static std::vector<CStakeSeen::Stake> RandomStakes()
+{
+    std::vector<CStakeSeen::Stake> vStakes;
+    for (int i = 0; i < STAKE_SEEN_BENCH_ENTRIES; i++)
+        vStakes.push_back(std::make_pair(COutPoint(GetRandHash(), i % 4), 1400000000 + i * 60));
+    return vStakes;
+}
+
+// Filling and then querying the stakes of a chain with the std::set setStakeSeen used to be...
+static void StakeSeenStdSet(benchmark::State& state)
+{
+    std::vector<CStakeSeen::Stake> vStakes = RandomStakes();
+    while (state.KeepRunning()) {
+        std::set<CStakeSeen::Stake> setSeen;
+        for (const CStakeSeen::Stake& stake : vStakes)
+            setSeen.insert(stake);
+        for (const CStakeSeen::Stake& stake : vStakes)
+            assert(setSeen.count(stake));
+    }
+}
+
+// ...and with CStakeSeen
+static void StakeSeenTable(benchmark::State& state)
+{
+    std::vector<CStakeSeen::Stake> vStakes = RandomStakes();
+    while (state.KeepRunning()) {
+        CStakeSeen setSeen;
+        for (const CStakeSeen::Stake& stake : vStakes)
+            setSeen.insert(stake);
+        for (const CStakeSeen::Stake& stake : vStakes)
+            assert(setSeen.count(stake));
+    }
+}
+
+BENCHMARK(StakeSeenStdSet);
+BENCHMARK(StakeSeenTable);
@@ -0,0 +1,40 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bignum.h"
+#include "pos.h"
+#include "random.h"
+
+#include <vector>
+
+// Weighted target computation and hash comparison, as done once per kernel
+// check, with the OpenSSL bignums the kernel used to build it with...
+static void StakeTargetBigNum(benchmark::State& state)
+{
+    uint256 hash = GetRandHash();
+    CAmount nValue = 0;
+    bool fMet = false;
+    while (state.KeepRunning()) {
+        CBigNum bnTarget;
+        bnTarget.SetCompact(0x1d00ffff);
+        bnTarget *= CBigNum(++nValue);
+        fMet ^= !(CBigNum(hash) > bnTarget);
+    }
+}
+
+// ...and with the fixed-width CStakeTarget
+static void StakeTargetArith(benchmark::State& state)
+{
+    uint256 hash = GetRandHash();
+    CAmount nValue = 0;
+    bool fMet = false;
+    while (state.KeepRunning()) {
+        CStakeTarget target(0x1d00ffff, ++nValue);
+        fMet ^= target.IsMetBy(hash);
+    }
+}
+
+BENCHMARK(StakeTargetBigNum);
+BENCHMARK(StakeTargetArith);
@@ -0,0 +1,91 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "key.h"
+#include "random.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+
+#include <vector>
+
+static const int WALLET_BALANCE_BENCH_BLOCKS = 100;
+static const int WALLET_BALANCE_BENCH_TXS = 20000;
+
+/** A wallet with many transactions confirmed in a short active chain */
+class WalletBalanceChain
+{
+public:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+    CWallet wallet;
+
+    WalletBalanceChain() : vHashes(WALLET_BALANCE_BENCH_BLOCKS), vIndex(WALLET_BALANCE_BENCH_BLOCKS)
+    {
+        SelectParams(CBaseChainParams::MAIN);
+        LOCK2(cs_main, wallet.cs_wallet);
+        for (int i = 0; i < WALLET_BALANCE_BENCH_BLOCKS; i++) {
+            vHashes[i] = GetRandHash();
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+            vIndex[i].nHeight = i;
+            vIndex[i].nTime = 1400000000 + i * 60;
+            vIndex[i].BuildSkip();
+            mapBlockIndex[vHashes[i]] = &vIndex[i];
+        }
+        chainActive.SetTip(&vIndex.back());
+
+        CKey key;
+        key.MakeNewKey(true);
+        wallet.AddKeyPubKey(key, key.GetPubKey());
+        CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+        for (int i = 0; i < WALLET_BALANCE_BENCH_TXS; i++) {
+            CMutableTransaction tx;
+            tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+            tx.vout.push_back(CTxOut((1 + i % 100) * COIN, scriptPubKey));
+            CWalletTx wtx(&wallet, MakeTransactionRef(std::move(tx)));
+            wtx.hashBlock = vHashes[i % WALLET_BALANCE_BENCH_BLOCKS];
+            wtx.nIndex = 1;
+            wallet.LoadToWallet(wtx);
+        }
+    }
+
+    ~WalletBalanceChain()
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(NULL);
+        for (const uint256& hash : vHashes)
+            mapBlockIndex.erase(hash);
+    }
+};
+
+// The balance as every staking round and wallet model poll asks for it, one
+// transaction having changed since the last call, summed over the whole wallet...
+static void WalletBalanceFullScan(benchmark::State& state)
+{
+    WalletBalanceChain chain;
+    LOCK2(cs_main, chain.wallet.cs_wallet);
+    std::map<uint256, CWalletTx>::iterator it = chain.wallet.mapWallet.begin();
+    while (state.KeepRunning()) {
+        it->second.MarkDirty();
+        assert(chain.wallet.GetBalancesFullScan().nTrusted > 0);
+    }
+}
+
+// ...and kept up to date by the wallet
+static void WalletBalanceIncremental(benchmark::State& state)
+{
+    WalletBalanceChain chain;
+    LOCK2(cs_main, chain.wallet.cs_wallet);
+    std::map<uint256, CWalletTx>::iterator it = chain.wallet.mapWallet.begin();
+    while (state.KeepRunning()) {
+        it->second.MarkDirty();
+        assert(chain.wallet.GetBalance() > 0);
+    }
+}
+
+BENCHMARK(WalletBalanceFullScan);
+BENCHMARK(WalletBalanceIncremental);
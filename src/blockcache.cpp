@@ -0,0 +1,121 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+
+#include <algorithm>
+
+static size_t BlockCacheEntryUsage(const CBlock& block)
+{
+    // The block itself, its transactions, plus the LRU list and map nodes
+    return memusage::MallocUsage(sizeof(CBlock)) + RecursiveDynamicUsage(block) + memusage::DynamicUsage(block.vchBlockSig) +
+           2 * memusage::MallocUsage(sizeof(uint256) + 3 * sizeof(void*) + sizeof(size_t));
+}
+
+CBlockCache::CBlockCache(size_t nMaxUsageIn) : nShards(GetShardCount(nMaxUsageIn)), nMaxUsage(nMaxUsageIn), nHits(0), nMisses(0), nEvictions(0)
+{
+}
+
+unsigned int CBlockCache::GetShardCount(size_t nMaxUsageIn)
+{
+    return std::max<size_t>(1, std::min<size_t>(BLOCK_CACHE_SHARDS, nMaxUsageIn / BLOCK_CACHE_MIN_SHARD_USAGE));
+}
+
+CBlockCache::Shard& CBlockCache::GetShard(const uint256& hash)
+{
+    // Use different bits than the map hasher so entries of a shard still spread over its buckets
+    return vShards[(hash.GetCheapHash() >> 32) % nShards];
+}
+
+std::shared_ptr<const CBlock> CBlockCache::Get(const uint256& hash, bool fCountMiss)
+{
+    Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    auto it = shard.map.find(hash);
+    if (it == shard.map.end()) {
+        if (fCountMiss)
+            nMisses++;
+        return nullptr;
+    }
+    nHits++;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return it->second->pblock;
+}
+
+void CBlockCache::Insert(const uint256& hash, const std::shared_ptr<const CBlock>& pblock)
+{
+    size_t nUsage = BlockCacheEntryUsage(*pblock);
+    size_t nShardMaxUsage = GetShardMaxUsage();
+    if (nUsage > nShardMaxUsage)
+        return;
+
+    Shard& shard = GetShard(hash);
+    LOCK(shard.cs);
+    if (shard.map.count(hash))
+        return;
+    shard.lru.push_front(Entry{hash, pblock, nUsage});
+    shard.map.emplace(hash, shard.lru.begin());
+    shard.nUsage += nUsage;
+    Trim(shard, nShardMaxUsage);
+}
+
+void CBlockCache::Trim(Shard& shard, size_t nShardMaxUsage)
+{
+    AssertLockHeld(shard.cs);
+    while (shard.nUsage > nShardMaxUsage && !shard.lru.empty()) {
+        const Entry& entry = shard.lru.back();
+        shard.nUsage -= entry.nUsage;
+        shard.map.erase(entry.hash);
+        shard.lru.pop_back();
+        nEvictions++;
+    }
+}
+
+void CBlockCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    // Blocks would be looked up in other shards than the ones they are in
+    unsigned int nShardsNew = GetShardCount(nMaxUsageIn);
+    if (nShardsNew != nShards) {
+        nShards = nShardsNew;
+        Clear();
+    }
+
+    nMaxUsage = nMaxUsageIn;
+    size_t nShardMaxUsage = GetShardMaxUsage();
+    for (Shard& shard : vShards) {
+        LOCK(shard.cs);
+        Trim(shard, nShardMaxUsage);
+    }
+}
+
+void CBlockCache::Clear()
+{
+    for (Shard& shard : vShards) {
+        LOCK(shard.cs);
+        shard.map.clear();
+        shard.lru.clear();
+        shard.nUsage = 0;
+    }
+}
+
+CBlockCache::Stats CBlockCache::GetStats() const
+{
+    Stats stats;
+    stats.nHits = nHits;
+    stats.nMisses = nMisses;
+    stats.nEvictions = nEvictions;
+    stats.nEntries = 0;
+    stats.nUsage = 0;
+    stats.nMaxUsage = nMaxUsage;
+    stats.nShards = nShards;
+    for (const Shard& shard : vShards) {
+        LOCK(shard.cs);
+        stats.nEntries += shard.map.size();
+        stats.nUsage += shard.nUsage;
+    }
+    return stats;
+}
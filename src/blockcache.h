@@ -0,0 +1,100 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include "primitives/block.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+/** Default for -blockcachesize, memory (in MiB) used to cache blocks read from disk */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 32;
+/** Maximum number of independently locked shards of the block cache */
+static const unsigned int BLOCK_CACHE_SHARDS = 16;
+/** Memory each shard gets at least; smaller caches use fewer shards, so that large blocks still fit in one */
+static const size_t BLOCK_CACHE_MIN_SHARD_USAGE = 8 << 20;
+
+/**
+ * Size-bounded LRU cache of blocks read from disk, keyed by block hash.
+ *
+ * Blocks are immutable once stored, so entries are handed out as shared
+ * pointers and are never copied; an evicted block stays alive for as long as
+ * a reader holds on to it. The cache is split into shards with their own lock
+ * and LRU list so that the staker, RPC and validation threads rarely contend;
+ * a block is only cached if it fits in the memory of one shard.
+ */
+class CBlockCache
+{
+public:
+    struct Stats
+    {
+        uint64_t nHits;
+        uint64_t nMisses;
+        uint64_t nEvictions;
+        size_t nEntries;
+        size_t nUsage;
+        size_t nMaxUsage;
+        unsigned int nShards;
+    };
+
+    explicit CBlockCache(size_t nMaxUsageIn = DEFAULT_BLOCK_CACHE_SIZE << 20);
+
+    /**
+     * Return the cached block, or nullptr. fCountMiss is set by readers that
+     * insert the blocks they miss; the misses of others say nothing about
+     * how well the cache is sized.
+     */
+    std::shared_ptr<const CBlock> Get(const uint256& hash, bool fCountMiss = true);
+    /** Add a block, evicting the least recently used blocks of its shard to make room */
+    void Insert(const uint256& hash, const std::shared_ptr<const CBlock>& pblock);
+    /** Change the memory limit, evicting blocks if it shrank, or all of them if the number of shards changes */
+    void SetMaxUsage(size_t nMaxUsageIn);
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Entry
+    {
+        uint256 hash;
+        std::shared_ptr<const CBlock> pblock;
+        size_t nUsage;
+    };
+
+    struct EntryHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    struct Shard
+    {
+        mutable CCriticalSection cs;
+        std::list<Entry> lru; //!< most recently used first
+        std::unordered_map<uint256, std::list<Entry>::iterator, EntryHasher> map;
+        size_t nUsage;
+
+        Shard() : nUsage(0) {}
+    };
+
+    Shard vShards[BLOCK_CACHE_SHARDS];
+    //! the first nShards of vShards are in use
+    std::atomic<unsigned int> nShards;
+    std::atomic<size_t> nMaxUsage;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<uint64_t> nEvictions;
+
+    Shard& GetShard(const uint256& hash);
+    size_t GetShardMaxUsage() const { return nMaxUsage / nShards; }
+    static unsigned int GetShardCount(size_t nMaxUsageIn);
+    void Trim(Shard& shard, size_t nShardMaxUsage);
+};
+
+#endif // BITCOIN_BLOCKCACHE_H
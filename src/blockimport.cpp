@@ -0,0 +1,195 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "protocol.h"
+#include "streams.h"
+#include "util.h"
+#include "validation.h"
+
+int GetImportThreads()
+{
+    // -importthreads=0 means autodetect, <0 leaves that many cores free
+    int nThreads = GetArg("-importthreads", DEFAULT_IMPORT_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    return std::max(1, std::min(nThreads, MAX_IMPORT_THREADS));
+}
+
+/**
+ * The checks of CheckBlock that depend on nothing but the block itself, so the
+ * workers can run them without cs_main. CheckBlock proper, which also looks at
+ * the chain, is left to AcceptBlock.
+ */
+static bool CheckImportedBlock(const CBlock& block, const Consensus::CParams& consensusParams, std::string& strError)
+{
+    CValidationState state;
+    if (!CheckBlockHeader(block, state, consensusParams)) {
+        strError = state.GetRejectReason();
+        return false;
+    }
+    bool mutated;
+    if (block.hashMerkleRoot != BlockMerkleRoot(block, &mutated)) {
+        strError = "bad-txnmrklroot";
+        return false;
+    }
+    if (mutated) {
+        strError = "bad-txns-duplicate";
+        return false;
+    }
+    return true;
+}
+
+CBlockImporter::CBlockImporter(const CChainParams& chainparamsIn, FILE* fileInIn, int nThreads) :
+    chainparams(chainparamsIn), fileIn(fileInIn), nReadAhead(0), fReadDone(false), fStop(false)
+{
+    threadGroup.create_thread(boost::bind(&CBlockImporter::ThreadRead, this));
+    for (int i = 0; i < std::max(1, std::min(nThreads, MAX_IMPORT_THREADS)); i++)
+        threadGroup.create_thread(boost::bind(&CBlockImporter::ThreadDeserialize, this));
+}
+
+CBlockImporter::~CBlockImporter()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStop = true;
+    }
+    cvRead.notify_all();
+    cvWork.notify_all();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+void CBlockImporter::Push(const std::shared_ptr<CImportedBlock>& pitem)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    // Always let one block through, however large, so the reader cannot stall
+    while (!fStop && !queueOrdered.empty() && nReadAhead + pitem->nSize > MAX_IMPORT_READ_AHEAD)
+        cvRead.wait(lock);
+    if (fStop)
+        return;
+    nReadAhead += pitem->nSize;
+    queueOrdered.push_back(pitem);
+    queueWork.push_back(pitem);
+    cvWork.notify_one();
+}
+
+void CBlockImporter::ThreadRead()
+{
+    RenameThread("clam-importread");
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, IMPORT_READ_BUFFER_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        while (!blkdat.eof()) {
+            boost::this_thread::interruption_point();
+
+            blkdat.SetPos(nRewind);
+            nRewind++; // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            try {
+                // locate a header
+                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                blkdat.FindByte(chainparams.MessageStart()[0]);
+                nRewind = blkdat.GetPos()+1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                break;
+            }
+            try {
+                // read the block record, deserializing it is left to the workers
+                std::shared_ptr<CImportedBlock> pitem = std::make_shared<CImportedBlock>();
+                pitem->nPos = blkdat.GetPos();
+                pitem->nSize = nSize;
+                blkdat.SetLimit(pitem->nPos + nSize);
+                pitem->vchData.resize(nSize);
+                blkdat.read(pitem->vchData.data(), nSize);
+                nRewind = blkdat.GetPos();
+                Push(pitem);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        // the importer is being destroyed
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: System error - %s\n", __func__, e.what());
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fReadDone = true;
+    }
+    cvDone.notify_all();
+}
+
+void CBlockImporter::ThreadDeserialize()
+{
+    RenameThread("clam-importblk");
+    while (true) {
+        std::shared_ptr<CImportedBlock> pitem;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (!fStop && queueWork.empty())
+                cvWork.wait(lock);
+            if (fStop)
+                return;
+            pitem = queueWork.front();
+            queueWork.pop_front();
+        }
+
+        try {
+            CDataStream ss(pitem->vchData.data(), pitem->vchData.data() + pitem->vchData.size(), SER_DISK, CLIENT_VERSION);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            ss >> LEGACY_BLOCK(*pblock);
+            // Cache the hash, a scrypt hash for legacy headers, ahead of connecting the block
+            pblock->GetHash();
+            std::string strError;
+            if (CheckImportedBlock(*pblock, chainparams.GetConsensus(), strError))
+                pitem->pblock = pblock;
+            else
+                pitem->strError = strprintf("block %s failed checks: %s", pblock->GetHash().ToString(), strError);
+        } catch (const std::exception& e) {
+            pitem->strError = strprintf("Deserialize or I/O error - %s", e.what());
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            std::vector<char>().swap(pitem->vchData);
+            pitem->fDone = true;
+        }
+        cvDone.notify_all();
+    }
+}
+
+bool CBlockImporter::Next(std::shared_ptr<CImportedBlock>& pblockOut)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        if (!queueOrdered.empty() && queueOrdered.front()->fDone)
+            break;
+        if (queueOrdered.empty() && fReadDone)
+            return false;
+        cvDone.wait(lock);
+    }
+    pblockOut = queueOrdered.front();
+    queueOrdered.pop_front();
+    nReadAhead -= pblockOut->nSize;
+    cvRead.notify_one();
+    return true;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include "primitives/block.h"
+#include "sync.h"
+
+#include <stdio.h>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+class CChainParams;
+
+/** Default for -importthreads, 0 = one block import worker per core */
+static const int DEFAULT_IMPORT_THREADS = 0;
+/** Maximum number of block import workers */
+static const int MAX_IMPORT_THREADS = 16;
+/** Size of the buffered reads from the file being imported */
+static const unsigned int IMPORT_READ_BUFFER_SIZE = 32 * 1000 * 1000;
+/** Serialized size of the blocks read ahead of the one being connected */
+static const size_t MAX_IMPORT_READ_AHEAD = 64 * 1000 * 1000;
+
+/** Return the number of block import workers configured by -importthreads */
+int GetImportThreads();
+
+/** A block record found in a block file */
+struct CImportedBlock
+{
+    //! position of the block data in the file, after the message start and size
+    uint64_t nPos;
+    //! serialized size of the block
+    unsigned int nSize;
+    //! serialized block, released once it is deserialized
+    std::vector<char> vchData;
+    //! the block, or null if the record did not deserialize or failed the checks
+    std::shared_ptr<CBlock> pblock;
+    std::string strError;
+    bool fDone;
+
+    CImportedBlock() : nPos(0), nSize(0), fDone(false) {}
+};
+
+/**
+ * Reads the blocks of a block file (for -reindex, -loadblock and
+ * bootstrap.dat) ahead of the caller connecting them.
+ *
+ * A reader thread scans the file through large buffered reads for block
+ * records. A pool of workers deserializes them, computes their hash (a
+ * scrypt hash for legacy headers) and checks their proof of work and merkle
+ * root, which need no chain state and so no cs_main; the records failing
+ * those are handed back without a block. The caller gets the blocks back in
+ * file order, so importing behaves exactly as if it read the file itself.
+ */
+class CBlockImporter
+{
+public:
+    /** Takes over fileIn and closes it */
+    CBlockImporter(const CChainParams& chainparams, FILE* fileIn, int nThreads);
+    ~CBlockImporter();
+
+    /** Wait for the next block of the file; false once the whole file was handed out */
+    bool Next(std::shared_ptr<CImportedBlock>& pblockOut);
+
+private:
+    const CChainParams& chainparams;
+    FILE* fileIn;
+
+    CWaitableCriticalSection cs;
+    CConditionVariable cvRead;    //!< room to read ahead, or stopping
+    CConditionVariable cvWork;    //!< records to deserialize, or stopping
+    CConditionVariable cvDone;    //!< a block was deserialized, or the reader finished
+    std::deque<std::shared_ptr<CImportedBlock> > queueOrdered; //!< read, not yet handed out
+    std::deque<std::shared_ptr<CImportedBlock> > queueWork;    //!< read, not yet deserialized
+    size_t nReadAhead;
+    bool fReadDone;
+    bool fStop;
+
+    boost::thread_group threadGroup;
+
+    void ThreadRead();
+    void ThreadDeserialize();
+    void Push(const std::shared_ptr<CImportedBlock>& pitem);
+};
+
+#endif // BITCOIN_BLOCKIMPORT_H
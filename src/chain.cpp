@@ -5,6 +5,9 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "memusage.h"
+
+CBlockIndexArena blockIndexArena;
 
 /**
  * CChain implementation
@@ -112,57 +115,152 @@ const CBlockIndex* CBlockIndex::GetAncestor(int height) const
     return const_cast<CBlockIndex*>(this)->GetAncestor(height);
 }
 
-std::set<std::string> CBlockIndex::GetSupport(CBlock block)
+void CBlockIndex::SetBlockSig(const std::vector<unsigned char>& vchBlockSig)
 {
-    if (fSupportChecked)
-        return setSupport;
+    nBlockSigSize = vchBlockSig.size();
+    pchBlockSig = vchBlockSig.empty() ? NULL : blockIndexArena.StoreBytes(vchBlockSig.data(), vchBlockSig.size());
+}
 
-    fSupportChecked = true;
+const std::vector<CClamour>& CBlockIndex::GetClamours() const
+{
+    static const std::vector<CClamour> vNone;
+    return pclamour ? pclamour->vClamour : vNone;
+}
+
+void CBlockIndex::AddClamour(const CClamour& clamour)
+{
+    if (!pclamour)
+        pclamour = blockIndexArena.NewClamour();
+    pclamour->vClamour.push_back(clamour);
+}
+
+const std::vector<uint32_t>& CBlockIndex::GetSupport() const
+{
+    static const std::vector<uint32_t> vNone;
+    return pclamour ? pclamour->vSupport : vNone;
+}
+
+void CBlockIndex::SetSupport(const std::vector<uint32_t>& vSupport)
+{
+    if (!pclamour) {
+        if (vSupport.empty())
+            return;
+        pclamour = blockIndexArena.NewClamour();
+    }
+    pclamour->vSupport = vSupport;
+}
+
+void CBlockIndex::SetSupport(const CBlock& block)
+{
+    std::vector<uint32_t> vSupport;
+    nFlags |= BLOCK_SUPPORT_INDEXED;
 
     if (block.IsProofOfStake()) {
-        do {
-            if (block.vtx.size() < 2) {
-                //LogPrintf("block only has %d transactions?\n", block.vtx.size());
-                break;
-            }
-
-            const std::string& strSpeech = block.vtx[1]->strClamSpeech;
-            // LogPrintf("stake speech is '%s'\n", strSpeech);
-
-            if (strSpeech.substr(0, 7) != "clamour")
-                break;
-
-            int n = 7;
-            int i;
-            char c = strSpeech[n++];
-            while (true) {
-                // support starts with a space
-                if (c != ' ')
-                    break;
-
-                // then 8 lowercase hex digits
-                for (i = 0; i < 8; i++) {
-                    c = strSpeech[n++];
-                    if ((c < '0' || c > '9') && (c < 'a' || c > 'f'))
-                        break;
-                }
-
-                // break if we exited the loop early
-                if (i != 8)
-                    break;
-
-                // must be followed by space or end of string
-                c = strSpeech[n++];
-                if (c != ' ' && c != '\0')
-                    break;
-
-                // if all that is OK, record the support, and loop to check for other petition IDs
-                setSupport.insert(strSpeech.substr(n-9, 8));
-            }
-        } while (false);
+        // LogPrintf("stake speech is '%s'\n", block.vtx[1]->strClamSpeech);
+        if (block.vtx.size() >= 2)
+            ParseClamourSupport(block.vtx[1]->strClamSpeech, vSupport);
     }
+    SetSupport(vSupport);
+}
+
+CBlockIndexArena::CBlockIndexArena() : nChunkUsed(ENTRY_CHUNK), nByteChunkUsed(BYTE_CHUNK), nSigBytes(0)
+{
+}
+
+CBlockIndexArena::~CBlockIndexArena()
+{
+    Clear();
+}
 
-    return setSupport;
+void* CBlockIndexArena::Allocate()
+{
+    AssertLockHeld(cs);
+    if (nChunkUsed == ENTRY_CHUNK) {
+        vChunks.push_back(static_cast<CBlockIndex*>(::operator new(sizeof(CBlockIndex) * ENTRY_CHUNK)));
+        nChunkUsed = 0;
+    }
+    return vChunks.back() + nChunkUsed++;
+}
+
+CBlockIndex* CBlockIndexArena::New()
+{
+    LOCK(cs);
+    return new (Allocate()) CBlockIndex();
+}
+
+CBlockIndex* CBlockIndexArena::New(const CBlockHeader& block)
+{
+    LOCK(cs);
+    return new (Allocate()) CBlockIndex(block);
+}
+
+const unsigned char* CBlockIndexArena::StoreBytes(const unsigned char* pch, size_t nSize)
+{
+    if (nSize == 0)
+        return NULL;
+    LOCK(cs);
+    unsigned char* pchStored;
+    if (nSize > BYTE_CHUNK / 4) {
+        // Too big to share a chunk; keep filling the current one
+        pchStored = new unsigned char[nSize];
+        vByteChunks.insert(vByteChunks.empty() ? vByteChunks.end() : vByteChunks.end() - 1, std::make_pair(pchStored, nSize));
+    } else {
+        if (nByteChunkUsed + nSize > BYTE_CHUNK) {
+            vByteChunks.push_back(std::make_pair(new unsigned char[BYTE_CHUNK], BYTE_CHUNK));
+            nByteChunkUsed = 0;
+        }
+        pchStored = vByteChunks.back().first + nByteChunkUsed;
+        nByteChunkUsed += nSize;
+    }
+    memcpy(pchStored, pch, nSize);
+    nSigBytes += nSize;
+    return pchStored;
+}
+
+CBlockIndexClamour* CBlockIndexArena::NewClamour()
+{
+    LOCK(cs);
+    dequeClamour.emplace_back();
+    return &dequeClamour.back();
+}
+
+void CBlockIndexArena::Clear()
+{
+    LOCK(cs);
+    for (size_t i = 0; i < vChunks.size(); i++) {
+        size_t nUsed = i + 1 < vChunks.size() ? ENTRY_CHUNK : nChunkUsed;
+        for (size_t j = 0; j < nUsed; j++)
+            vChunks[i][j].~CBlockIndex();
+        ::operator delete(vChunks[i]);
+    }
+    std::vector<CBlockIndex*>().swap(vChunks);
+    nChunkUsed = ENTRY_CHUNK;
+    for (const auto& chunk : vByteChunks)
+        delete[] chunk.first;
+    std::vector<std::pair<unsigned char*, size_t> >().swap(vByteChunks);
+    nByteChunkUsed = BYTE_CHUNK;
+    nSigBytes = 0;
+    dequeClamour.clear();
+}
+
+CBlockIndexArena::Stats CBlockIndexArena::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.nEntries = vChunks.empty() ? 0 : (vChunks.size() - 1) * ENTRY_CHUNK + nChunkUsed;
+    stats.nEntryUsage = vChunks.size() * memusage::MallocUsage(sizeof(CBlockIndex) * ENTRY_CHUNK) + memusage::DynamicUsage(vChunks);
+    stats.nSigBytes = nSigBytes;
+    stats.nSigUsage = memusage::DynamicUsage(vByteChunks);
+    for (const auto& chunk : vByteChunks)
+        stats.nSigUsage += memusage::MallocUsage(chunk.second);
+    stats.nClamours = dequeClamour.size();
+    stats.nClamourUsage = 0;
+    for (const CBlockIndexClamour& clamour : dequeClamour) {
+        stats.nClamourUsage += sizeof(CBlockIndexClamour) + memusage::DynamicUsage(clamour.vSupport) + memusage::MallocUsage(clamour.vClamour.capacity() * sizeof(CClamour));
+        for (const CClamour& c : clamour.vClamour)
+            stats.nClamourUsage += c.strHash.capacity() + c.strURL.capacity();
+    }
+    return stats;
 }
 
 void CBlockIndex::BuildSkip()
@@ -10,10 +10,12 @@
 #include "clamour.h"
 #include "primitives/block.h"
 #include "pow.h"
+#include "sync.h"
 #include "timedata.h"
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <deque>
 #include <vector>
 
 class CBlockFileInfo
@@ -148,6 +150,17 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_UNDO_COINTIME      =  256, //!< undo data in rev*.dat records the transaction time of the spent coins
+};
+
+/** CLAMour data of a block index entry, kept out of line as few blocks have any */
+struct CBlockIndexClamour
+{
+    //! petitions created by the block's transactions
+    std::vector<CClamour> vClamour;
+    //! CLAMour petition ids supported by the staking transaction's speech
+    std::vector<uint32_t> vSupport;
 };
 
 /** The block chain is a tree shaped structure starting with the
@@ -203,8 +216,10 @@ public:
     unsigned int nTime;
     unsigned int nBits;
     unsigned int nNonce;
-    // block signature - proof-of-stake protect the block by signing the block using a stake holder private key
-    std::vector<unsigned char> vchBlockSig;
+    // block signature - proof-of-stake protect the block by signing the block using a stake holder private key.
+    // The bytes are stored in blockIndexArena, see SetBlockSig
+    unsigned int nBlockSigSize;
+    const unsigned char* pchBlockSig;
     // proof-of-stake specific fields
     COutPoint prevoutStake;
 
@@ -220,13 +235,13 @@ public:
         BLOCK_PROOF_OF_STAKE = (1 << 0), // is proof-of-stake block
         BLOCK_STAKE_ENTROPY  = (1 << 1), // entropy bit for stake modifier
         BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
+        BLOCK_SUPPORT_INDEXED = (1 << 3), // the support is set, see SetSupport
     };
 
     uint64_t nStakeModifier; // hash modifier for proof-of-stake
-    std::vector<CClamour> vClamour;
 
-    mutable bool fSupportChecked; // did we check the speech of the staking transaction for 'clamour' support yet?
-    mutable std::set<std::string> setSupport; // CLAMour pid strings supported by this block
+    //! CLAMour petitions created and supported by the block, stored in blockIndexArena; NULL if none
+    CBlockIndexClamour* pclamour;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId;
@@ -256,7 +271,8 @@ public:
         nTime          = 0;
         nBits          = 0;
         nNonce         = 0;
-        vchBlockSig.clear();
+        nBlockSigSize  = 0;
+        pchBlockSig    = NULL;
         nStakeModifier = 0;
         hashProof = uint256();
         prevoutStake.SetNull();
@@ -265,8 +281,7 @@ public:
         nDigsupply = 0;
         nStakeSupply = 0;
         nFlags = 0;
-
- 	fSupportChecked = false;
+        pclamour = NULL;
     }
 
     CBlockIndex()
@@ -291,7 +306,7 @@ public:
         nFlags = 0;
         hashProof = uint256(); 
         prevoutStake   = block.prevoutStake; 
-        vchBlockSig    = block.vchBlockSig;
+        // The signature is only kept for the entries of the block index, see AddToBlockIndex
         if (block.IsProofOfStake())
             SetProofOfStake();
     }
@@ -324,7 +339,7 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nNonce         = nNonce;
-        block.vchBlockSig    = vchBlockSig;
+        block.vchBlockSig    = GetBlockSig();
         block.prevoutStake   = prevoutStake;
         return block;
     }
@@ -410,7 +425,21 @@ public:
             nFlags |= BLOCK_STAKE_MODIFIER;
     }
 
-    std::set<std::string> GetSupport(CBlock block);
+    std::vector<unsigned char> GetBlockSig() const
+    {
+        return std::vector<unsigned char>(pchBlockSig, pchBlockSig + nBlockSigSize);
+    }
+
+    //! copy the block signature into blockIndexArena
+    void SetBlockSig(const std::vector<unsigned char>& vchBlockSig);
+
+    const std::vector<CClamour>& GetClamours() const;
+    void AddClamour(const CClamour& clamour);
+
+    const std::vector<uint32_t>& GetSupport() const;
+    void SetSupport(const std::vector<uint32_t>& vSupport);
+    //! parse the CLAMour support from the block's stake speech and mark it as indexed
+    void SetSupport(const CBlock& block);
 
     std::string ToString() const
     {
@@ -460,6 +489,63 @@ arith_uint256 GetBlockProof(const CBlockIndex& block);
 int64_t GetBlockProofEquivalentTime(const CBlockIndex& to, const CBlockIndex& from, const CBlockIndex& tip, const Consensus::CParams&);
 
 
+/**
+ * Storage for the entries of the block index, which are only ever freed all
+ * at once. Entries are constructed in chunks rather than allocated one by
+ * one, and the block signatures and CLAMour data they point to are packed
+ * alongside them; Clear() frees everything when the block index is unloaded.
+ */
+class CBlockIndexArena
+{
+public:
+    struct Stats
+    {
+        size_t nEntries;
+        size_t nEntryUsage;   //!< bytes of the entry chunks
+        size_t nSigBytes;     //!< bytes of the stored block signatures
+        size_t nSigUsage;     //!< bytes of the signature chunks
+        size_t nClamours;     //!< entries with CLAMour data
+        size_t nClamourUsage;
+    };
+
+    CBlockIndexArena();
+    ~CBlockIndexArena();
+
+    CBlockIndex* New();
+    CBlockIndex* New(const CBlockHeader& block);
+    const unsigned char* StoreBytes(const unsigned char* pch, size_t nSize);
+    CBlockIndexClamour* NewClamour();
+    /** Destroy every entry; pointers handed out before are invalid afterwards */
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    //! entries per chunk
+    static const size_t ENTRY_CHUNK = 4096;
+    //! bytes per signature chunk
+    static const size_t BYTE_CHUNK = 256 * 1024;
+
+    mutable CCriticalSection cs;
+    std::vector<CBlockIndex*> vChunks;
+    //! entries constructed in the last chunk
+    size_t nChunkUsed;
+    std::vector<std::pair<unsigned char*, size_t> > vByteChunks;
+    //! bytes used of the last byte chunk
+    size_t nByteChunkUsed;
+    size_t nSigBytes;
+    //! a deque never moves its elements, so the pointers handed out stay valid
+    std::deque<CBlockIndexClamour> dequeClamour;
+
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+
+    void* Allocate();
+};
+
+/** Storage of the entries of mapBlockIndex */
+extern CBlockIndexArena blockIndexArena;
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
@@ -468,6 +554,9 @@ private:
 public:
     uint256 hashPrev;
     uint256 hashNext;
+    std::vector<unsigned char> vchBlockSig;
+    std::vector<CClamour> vClamour;
+    std::vector<uint32_t> vSupport;
 
     CDiskBlockIndex() {
         hashPrev = uint256();
@@ -477,6 +566,9 @@ public:
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
         hashNext = (pnext ? pnext->GetBlockHash() : uint256());
+        vchBlockSig = pindex->GetBlockSig();
+        vClamour = pindex->GetClamours();
+        vSupport = pindex->GetSupport();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -516,6 +608,9 @@ public:
         READWRITE(nBits);
         READWRITE(nNonce);
         READWRITE(blockHash);
+        // only present for blocks whose support was indexed, which older versions never flag
+        if (nFlags & BLOCK_SUPPORT_INDEXED)
+            READWRITE(vSupport);
 
         
     }
@@ -0,0 +1,161 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "clamour.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "tinyformat.h"
+#include "util.h"
+#include "validation.h"
+
+#include <algorithm>
+
+CClamourSupportIndex clamourSupport;
+
+void ParseClamourSupport(const std::string& strSpeech, std::vector<uint32_t>& vSupport)
+{
+    if (strSpeech.substr(0, 7) != "clamour")
+        return;
+
+    int n = 7;
+    int i;
+    char c = strSpeech[n++];
+    while (true) {
+        // support starts with a space
+        if (c != ' ')
+            break;
+
+        // then 8 lowercase hex digits
+        for (i = 0; i < 8; i++) {
+            c = strSpeech[n++];
+            if ((c < '0' || c > '9') && (c < 'a' || c > 'f'))
+                break;
+        }
+
+        // break if we exited the loop early
+        if (i != 8)
+            break;
+
+        // must be followed by space or end of string
+        c = strSpeech[n++];
+        if (c != ' ' && c != '\0')
+            break;
+
+        // if all that is OK, record the support, and loop to check for other petition IDs
+        uint32_t nPetition = strtoul(strSpeech.substr(n-9, 8).c_str(), NULL, 16);
+        if (std::find(vSupport.begin(), vSupport.end(), nPetition) == vSupport.end())
+            vSupport.push_back(nPetition);
+    }
+}
+
+void CClamourSupportIndex::Clear()
+{
+    mapSupportHeights.clear();
+    nIndexedHeight = 0;
+    nTipHeight = -1;
+    fLoaded = false;
+}
+
+void CClamourSupportIndex::Load()
+{
+    AssertLockHeld(cs_main);
+    Clear();
+    // Nothing is indexed yet; windows are filled in from the tip down as they are asked for
+    nTipHeight = chainActive.Height();
+    nIndexedHeight = nTipHeight + 1;
+    fLoaded = true;
+}
+
+bool CClamourSupportIndex::IndexDown(int nHeight)
+{
+    AssertLockHeld(cs_main);
+    const Consensus::CParams& consensusParams = Params().GetConsensus();
+
+    // Collect the new (lower) heights first so each petition's heights are prepended once
+    std::map<uint32_t, std::vector<int> > mapLower;
+    bool fOk = true;
+    int nRead = 0;
+    int h;
+    for (h = nIndexedHeight - 1; h >= nHeight; h--) {
+        CBlockIndex* pindex = chainActive[h];
+        if (!(pindex->nFlags & CBlockIndex::BLOCK_SUPPORT_INDEXED)) {
+            if (!ReadBlockSupport(pindex, consensusParams)) {
+                fOk = false;
+                break;
+            }
+            nRead++;
+        }
+        for (uint32_t nPetition : pindex->GetSupport())
+            mapLower[nPetition].push_back(h);
+    }
+
+    for (auto& item : mapLower) {
+        std::vector<int>& vHeights = mapSupportHeights[item.first];
+        vHeights.insert(vHeights.begin(), item.second.rbegin(), item.second.rend());
+    }
+    nIndexedHeight = h + 1;
+
+    if (nRead)
+        LogPrint("clamour", "%s: read the support of %d blocks from disk, indexed down to height %d\n", __func__, nRead, nIndexedHeight);
+    return fOk;
+}
+
+void CClamourSupportIndex::BlockConnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!fLoaded)
+        return;
+    if (pindex->nHeight != nTipHeight + 1 || !(pindex->nFlags & CBlockIndex::BLOCK_SUPPORT_INDEXED)) {
+        // Out of step with the active chain; start over on the next query
+        Clear();
+        return;
+    }
+    for (uint32_t nPetition : pindex->GetSupport())
+        mapSupportHeights[nPetition].push_back(pindex->nHeight);
+    nTipHeight = pindex->nHeight;
+}
+
+void CClamourSupportIndex::BlockDisconnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!fLoaded)
+        return;
+    if (pindex->nHeight != nTipHeight) {
+        Clear();
+        return;
+    }
+    if (pindex->nHeight >= nIndexedHeight) {
+        for (uint32_t nPetition : pindex->GetSupport()) {
+            std::map<uint32_t, std::vector<int> >::iterator it = mapSupportHeights.find(nPetition);
+            if (it == mapSupportHeights.end() || it->second.empty() || it->second.back() != pindex->nHeight)
+                continue;
+            it->second.pop_back();
+            if (it->second.empty())
+                mapSupportHeights.erase(it);
+        }
+    }
+    nTipHeight = pindex->nHeight - 1;
+    nIndexedHeight = std::min(nIndexedHeight, nTipHeight + 1);
+}
+
+bool CClamourSupportIndex::GetSupport(int nStart, int nEnd, std::map<std::string, int>& mapSupport)
+{
+    AssertLockHeld(cs_main);
+    if (!fLoaded || nTipHeight != chainActive.Height())
+        Load();
+    if (nStart < 0 || nEnd > nTipHeight || nStart > nEnd)
+        return false;
+    if (nStart < nIndexedHeight && !IndexDown(nStart))
+        return error("%s: failed to read the support of the blocks down to height %d", __func__, nStart);
+
+    mapSupport.clear();
+    for (const auto& item : mapSupportHeights) {
+        const std::vector<int>& vHeights = item.second;
+        int nCount = std::upper_bound(vHeights.begin(), vHeights.end(), nEnd) - std::lower_bound(vHeights.begin(), vHeights.end(), nStart);
+        if (nCount > 0)
+            mapSupport[strprintf("%08x", item.first)] = nCount;
+    }
+    return true;
+}
@@ -9,6 +9,12 @@
 #include "uint256.h"
 #include "serialize.h"
 
+#include <map>
+#include <string>
+#include <vector>
+
+class CBlockIndex;
+
 class CClamour
 {
 public:
@@ -40,4 +46,43 @@ public:
     }
 };
 
+/** Append the ids of the petitions a "clamour <id> <id> ..." speech supports to vSupport, once each */
+void ParseClamourSupport(const std::string& strSpeech, std::vector<uint32_t>& vSupport);
+
+/**
+ * Support for CLAMour petitions by the blocks of the active chain.
+ *
+ * The petitions a block supports are parsed once when it is connected and
+ * kept in its block index entry; this keeps, per petition, the heights of
+ * the supporting blocks so that support within any window of the chain can
+ * be counted without reading blocks. Blocks connected by versions that did
+ * not index support are read back from disk once, the first time a window
+ * reaches them. All methods require cs_main.
+ */
+class CClamourSupportIndex
+{
+private:
+    //! ascending heights of the active chain blocks supporting each petition
+    std::map<uint32_t, std::vector<int> > mapSupportHeights;
+    //! every active chain block from nIndexedHeight to nTipHeight is in the map
+    int nIndexedHeight;
+    int nTipHeight;
+    bool fLoaded;
+
+    void Load();
+    bool IndexDown(int nHeight);
+
+public:
+    CClamourSupportIndex() { Clear(); }
+
+    void Clear();
+    void BlockConnected(const CBlockIndex* pindex);
+    void BlockDisconnected(const CBlockIndex* pindex);
+
+    /** Count the blocks between heights nStart and nEnd (inclusive) supporting each petition */
+    bool GetSupport(int nStart, int nEnd, std::map<std::string, int>& mapSupport);
+};
+
+extern CClamourSupportIndex clamourSupport;
+
 #endif // BITCOIN_CCLAMOUR_TRANSACTION_H
\ No newline at end of file
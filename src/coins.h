@@ -18,6 +18,12 @@
 
 #include <unordered_map>
 
+/**
+ * Stream version flag to (de)serialize coins without the time of their
+ * transaction, as the chainstate and undo data were written before it was kept.
+ */
+static const int SERIALIZE_COIN_NO_TIME = 0x20000000;
+
 /**
  * A UTXO entry.
  *
@@ -25,6 +31,7 @@
  * - VARINT((coinbase ? 1 : 0) | (height << 2))
  * - VARINT((coinstake ? 2 : 0) | (height << 2))
  * - the non-spent CTxOut (via CTxOutCompressor)
+ * - unless SERIALIZE_COIN_NO_TIME: VARINT(nTime of the containing transaction)
  */
 class Coin
 {
@@ -38,19 +45,23 @@ public:
     //! at which height this containing transaction was included in the active block chain
     uint32_t nHeight : 30;
 
-    //! construct a Coin from a CTxOut and height/coinbase information.
-    Coin(CTxOut&& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn) : out(std::move(outIn)), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn) {}
-    Coin(const CTxOut& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn) : out(outIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn) {}
+    //! timestamp of the containing transaction, which proof-of-stake kernels hash; 0 if unknown
+    uint32_t nTime;
+
+    //! construct a Coin from a CTxOut and height/coinbase/time information.
+    Coin(CTxOut&& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn, unsigned int nTimeIn) : out(std::move(outIn)), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn), nTime(nTimeIn) {}
+    Coin(const CTxOut& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn, unsigned int nTimeIn) : out(outIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), nHeight(nHeightIn), nTime(nTimeIn) {}
 
     void Clear() {
         out.SetNull();
         fCoinBase = false;
         fCoinStake = false;
         nHeight = 0;
+        nTime = 0;
     }
 
     //! empty constructor
-    Coin() : fCoinBase(false), fCoinStake(false), nHeight(0) { }
+    Coin() : fCoinBase(false), fCoinStake(false), nHeight(0), nTime(0) { }
 
     bool IsCoinPoW() const {
         return fCoinBase;
@@ -71,6 +82,8 @@ public:
         uint32_t code = (nHeight << 2) + (fCoinBase ? 1 : 0) + (fCoinStake ? 2 : 0);
         ::Serialize(s, VARINT(code));
         ::Serialize(s, CTxOutCompressor(REF(out)));
+        if (!(s.GetVersion() & SERIALIZE_COIN_NO_TIME))
+            ::Serialize(s, VARINT(nTime));
     }
 
     template<typename Stream>
@@ -81,6 +94,9 @@ public:
         fCoinBase = code & 1;
         fCoinStake = (code >> 1) & 1;
         ::Unserialize(s, REF(CTxOutCompressor(out)));
+        nTime = 0;
+        if (!(s.GetVersion() & SERIALIZE_COIN_NO_TIME))
+            ::Unserialize(s, VARINT(nTime));
     }
 
     bool IsSpent() const {
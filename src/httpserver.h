@@ -42,6 +42,9 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Decode the %XX escapes of a URL component */
+std::string urlDecode(const std::string &urlEncoded);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -9,9 +9,12 @@
 
 #include "init.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "amount.h"
 #include "base58.h"
+#include "blockcache.h"
+#include "blockimport.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -25,6 +28,7 @@
 #include "netbase.h"
 #include "net.h"
 #include "net_processing.h"
+#include "notary.h"
 #include "policy/policy.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
@@ -32,6 +36,7 @@
 #include "script/sigcache.h"
 #include "crypto/scrypt.h"
 #include "scheduler.h"
+#include "speechindex.h"
 #include "timedata.h"
 #include "txdb.h"
 #include "txmempool.h"
@@ -331,6 +336,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockcachesize=<n>", strprintf(_("Keep up to <n> MiB of recently read blocks in memory (default: %u)"), DEFAULT_BLOCK_CACHE_SIZE));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -347,6 +353,8 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-importthreads=<n>", strprintf(_("Set the number of threads reading blocks ahead during -reindex and -loadblock (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+        -GetNumCores(), MAX_IMPORT_THREADS, DEFAULT_IMPORT_THREADS));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
@@ -365,6 +373,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
     strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-notaryindex", strprintf(_("Maintain an index of notary transactions by notarized hash, used by the getnotarytransaction and getnotarytransactions rpc calls (default: %u)"), DEFAULT_NOTARYINDEX));
+    strUsage += HelpMessageOpt("-speechindex", strprintf(_("Maintain a full-text index of CLAMspeech, used by the searchclamspeech rpc call and the /rest/speech/ endpoint (default: %u)"), DEFAULT_SPEECHINDEX));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of the transactions and unspent outputs of each address, used by the getaddresstxids, getaddressbalance and getaddressutxos rpc calls (default: %u)"), DEFAULT_ADDRESSINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -428,6 +439,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
         strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkblockreads", strprintf("Check the hash and proof of work of every block read from disk, including blocks validated before (default: %u)", DEFAULT_CHECK_BLOCK_READS));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
@@ -892,6 +904,12 @@ bool AppInitParameterInteraction()
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-notaryindex", DEFAULT_NOTARYINDEX))
+            return InitError(_("Prune mode is incompatible with -notaryindex."));
+        if (GetBoolArg("-speechindex", DEFAULT_SPEECHINDEX))
+            return InitError(_("Prune mode is incompatible with -speechindex."));
+        if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex."));
     }
 
     // Make sure enough file descriptors are available
@@ -946,6 +964,7 @@ bool AppInitParameterInteraction()
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+    fCheckBlockReads = GetBoolArg("-checkblockreads", DEFAULT_CHECK_BLOCK_READS);
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
     hashAssumeValid = uint256S(GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
@@ -1432,6 +1451,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    int64_t nBlockCacheSize = std::max(GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE), (int64_t)0) << 20;
+    blockcache.SetMaxUsage(nBlockCacheSize);
+    LogPrintf("* Using %.1fMiB for recently read blocks\n", nBlockCacheSize * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -1465,6 +1487,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                         strLoadError = _("Error upgrading chainstate database");
                         break;
                     }
+                    if (!pblocktree->UpgradeStakeIndex()) {
+                        strLoadError = _("Error upgrading block database");
+                        break;
+                    }
                 }
 
                 if (!LoadBlockIndex(chainparams)) {
@@ -1497,12 +1523,38 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Coins written before they kept the time of their transaction read it from their block.
+                // A pruned node has deleted most of those blocks, and cannot have -txindex to look the
+                // transactions up instead, so only rebuilding the chainstate from the network helps.
+                if (!fReindex && fHavePruned && pcoinsdbview->HasUntimedCoins()) {
+                    strLoadError = _("The chainstate database needs an upgrade that reads the blocks this node has pruned. You need to rebuild the database using -reindex");
+                    break;
+                }
+                if (!fReindex && !UpgradeCoinTime(pcoinsdbview, chainparams)) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
                 // Check for changed -txindex state
                 if (fTxIndex != GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
                     strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -txindex");
                     break;
                 }
 
+                // -notaryindex can be changed without rebuilding; the index is built in the background
+                if (!InitNotaryIndex(GetBoolArg("-notaryindex", DEFAULT_NOTARYINDEX))) {
+                    strLoadError = _("Error initializing notary index");
+                    break;
+                }
+                if (!InitSpeechIndex(GetBoolArg("-speechindex", DEFAULT_SPEECHINDEX))) {
+                    strLoadError = _("Error initializing speech index");
+                    break;
+                }
+                if (!InitAddressIndex(GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))) {
+                    strLoadError = _("Error initializing address index");
+                    break;
+                }
+
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1646,6 +1698,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    if (fNotaryIndex)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "notaryidx", &ThreadNotaryIndex));
+    if (fSpeechIndex)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "speechidx", &ThreadSpeechIndex));
+    if (fAddressIndex)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "addressidx", &ThreadAddressIndex));
 
     // Wait for genesis block to be processed
     {
@@ -1706,10 +1764,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
         pwalletMain->postInitProcess(threadGroup);
 
-        // if we're going to be running a command each time we stake, sum all existing stake rewards now so we're ready
-        if (!GetArg("-stakenotify", "").empty() && !pwalletMain->fAddressRewardsReady) {
-            LogPrintf("initializing staking rewards map\n");
-            pwalletMain->SumStakingRewards();
+        // if we're going to be running a command each time we stake, build the staking reward ledger now so we're ready
+        if (!GetArg("-stakenotify", "").empty() && !pwalletMain->IsStakeLedgerReady()) {
+            LogPrintf("initializing staking reward ledger\n");
+            pwalletMain->RebuildStakeLedger();
         }
     }
 #endif
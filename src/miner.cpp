@@ -20,6 +20,7 @@
 #include "pos.h"
 #include "primitives/transaction.h"
 #include "script/standard.h"
+#include "stakesearch.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "util.h"
@@ -28,9 +29,11 @@
 #include "wallet/wallet.h"
 
 #include <algorithm>
+#include <atomic>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
+#include <set>
 #include <utility>
 
 //////////////////////////////////////////////////////////////////////////////
@@ -77,7 +80,7 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::CParams& consensusPara
 }
 
 BlockAssembler::BlockAssembler(const CChainParams& _chainparams)
-    : chainparams(_chainparams)
+    : chainparams(_chainparams), nStakeSelectionUpdated(0), fStakeSelectionValid(false)
 {
     // Block resource limits
     // If neither -blockmaxsize or -blockmaxweight is given, limit to DEFAULT_BLOCK_MAX_*
@@ -145,13 +148,14 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     // Add dummy coinbase tx as first transaction
     pblock->vtx.emplace_back();
-    // Add dummy coinstake tx as second transaction
-    if(fProofOfStake)
-        pblock->vtx.emplace_back();
-
-
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
+    // Add dummy coinstake tx as second transaction
+    if(fProofOfStake) {
+        pblock->vtx.emplace_back();
+        pblocktemplate->vTxFees.push_back(-1); // updated at end
+        pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
+    }
 
     LOCK2(cs_main, mempool.cs);
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -191,7 +195,10 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
 
-    addPackageTxs();
+    if (fProofOfStake && txProofTime != 0)
+        addStakeTxs(pindexPrev, txProofTime);
+    else
+        addPackageTxs();
 
     nLastBlockTx = nBlockTx;
     nLastBlockSize = nBlockSize;
@@ -254,6 +261,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
 
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+    if (fProofOfStake) {
+        // The coinstake collects the fees; its inputs are only known once it is signed
+        pblocktemplate->vTxFees[1] = 0;
+        pblocktemplate->vTxSigOpsCost[1] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[1]);
+    }
 
     CValidationState state;
     if (!fProofOfStake && !TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -276,11 +288,14 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateEmptyBlock(const CScript&
 
     // Add dummy coinbase tx as first transaction
     pblock->vtx.emplace_back();
-    // Add dummy coinstake tx as second transaction
-    if(fProofOfStake)
-        pblock->vtx.emplace_back();
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
+    // Add dummy coinstake tx as second transaction
+    if(fProofOfStake) {
+        pblock->vtx.emplace_back();
+        pblocktemplate->vTxFees.push_back(-1); // updated at end
+        pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
+    }
 
     LOCK2(cs_main, mempool.cs);
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -359,6 +374,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateEmptyBlock(const CScript&
     pblock->nNonce         = 0;
 
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+    if (fProofOfStake) {
+        // The coinstake collects the fees; its inputs are only known once it is signed
+        pblocktemplate->vTxFees[1] = 0;
+        pblocktemplate->vTxSigOpsCost[1] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[1]);
+    }
 
     CValidationState state;
     if (!fProofOfStake && !TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -566,7 +586,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemP
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs()
+bool BlockAssembler::addPackageTxs()
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -584,7 +604,7 @@ void BlockAssembler::addPackageTxs()
     {
         if(nTimeLimit != 0 && GetAdjustedTime() >= nTimeLimit){
             //no more time to add transactions, just exit
-            return;
+            return false;
         }
         // First try to find a new transaction in mapTx to evaluate.
         if (mi != mempool.mapTx.get<ancestor_score>().end() &&
@@ -634,7 +654,7 @@ void BlockAssembler::addPackageTxs()
 
         if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
             // Everything else we might consider has a lower fee rate
-            return;
+            return true;
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
@@ -678,6 +698,62 @@ void BlockAssembler::addPackageTxs()
         // Update transactions that depend on each of these
         UpdatePackagesForAdded(ancestors, mapModifiedTx);
     }
+    return true;
+}
+
+// The stake miner builds a template for each timestamp slot it finds a kernel
+// in, and selecting transactions walks the whole mempool. The selection only
+// depends on the tip and the mempool, so it is kept and reused until either
+// changes; the slot just decides which of the selected transactions are too
+// new for the block, together with those spending their outputs.
+void BlockAssembler::addStakeTxs(const CBlockIndex* pindexPrev, int64_t nTime)
+{
+    unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    if (!fStakeSelectionValid || hashStakeSelectionTip != pindexPrev->GetBlockHash() || nStakeSelectionUpdated != nTransactionsUpdated) {
+        size_t nFirstTx = pblock->vtx.size();
+        bool fComplete = addPackageTxs();
+
+        vStakeSelection.clear();
+        vStakeSelection.reserve(pblock->vtx.size() - nFirstTx);
+        for (size_t i = nFirstTx; i < pblock->vtx.size(); i++) {
+            const CTransactionRef& tx = pblock->vtx[i];
+            SelectedTx selected = {tx, pblocktemplate->vTxFees[i], pblocktemplate->vTxSigOpsCost[i], (uint64_t)GetTransactionWeight(*tx),
+                                   fNeedSizeAccounting ? ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION) : 0};
+            vStakeSelection.push_back(selected);
+        }
+        // A selection cut short by the time limit is used once, and not kept
+        hashStakeSelectionTip = pindexPrev->GetBlockHash();
+        nStakeSelectionUpdated = nTransactionsUpdated;
+        fStakeSelectionValid = fComplete;
+
+        pblock->vtx.resize(nFirstTx);
+        pblocktemplate->vTxFees.resize(nFirstTx);
+        pblocktemplate->vTxSigOpsCost.resize(nFirstTx);
+        bool fIncludeWitnessSelected = fIncludeWitness;
+        resetBlock();
+        fIncludeWitness = fIncludeWitnessSelected;
+    }
+
+    std::set<uint256> setLeftOut;
+    for (const SelectedTx& selected : vStakeSelection) {
+        const CTransaction& tx = *selected.tx;
+        bool fLeaveOut = (int64_t)tx.nTime > nTime;
+        for (unsigned int i = 0; i < tx.vin.size() && !fLeaveOut && !setLeftOut.empty(); i++)
+            fLeaveOut = setLeftOut.count(tx.vin[i].prevout.hash) > 0;
+        if (fLeaveOut) {
+            setLeftOut.insert(tx.GetHash());
+            continue;
+        }
+
+        pblock->vtx.push_back(selected.tx);
+        pblocktemplate->vTxFees.push_back(selected.nFee);
+        pblocktemplate->vTxSigOpsCost.push_back(selected.nSigOpsCost);
+        nBlockSize += selected.nSize;
+        nBlockWeight += selected.nWeight;
+        ++nBlockTx;
+        nBlockSigOpsCost += selected.nSigOpsCost;
+        nFees += selected.nFee;
+    }
 }
 
 void BlockAssembler::addPriorityTxs()
@@ -799,7 +875,7 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 bool CheckStake(const std::shared_ptr<const CBlock> pblock, CWallet& wallet)
 {
     uint256 proofHash;
-    CBigNum bnHashTarget;
+    arith_uint256 bnHashTarget;
     uint256 hashBlock = pblock->GetHash();
 
     if(!pblock->IsProofOfStake())
@@ -863,7 +939,55 @@ bool CheckStake(const std::shared_ptr<const CBlock> pblock, CWallet& wallet)
     return true;
 }
 
-void ThreadStakeMiner(CWallet *pwallet)
+/**
+ * Wakes the staker as soon as the chain tip changes, so that it starts
+ * searching on top of the new block right away instead of at its next poll.
+ */
+class CStakeMinerNotifier : public CValidationInterface
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    bool fTipChanged;
+    //! bumped on every new tip, so that kernel searches can tell theirs is stale without cs_main
+    std::atomic<uint64_t> nTipGeneration;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override
+    {
+        nTipGeneration++;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            fTipChanged = true;
+        }
+        cond.notify_all();
+    }
+
+public:
+    CStakeMinerNotifier() : fTipChanged(false), nTipGeneration(0) {}
+
+    uint64_t GetTipGeneration() const { return nTipGeneration; }
+
+    /** Wait for a new tip, at most nMilliseconds; this is an interruption point */
+    void Wait(int64_t nMilliseconds)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fTipChanged && nMilliseconds > 0)
+            cond.timed_wait(lock, boost::posix_time::milliseconds(nMilliseconds));
+        fTipChanged = false;
+    }
+};
+
+static CStakeMinerNotifier stakeMinerNotifier;
+
+/** Milliseconds until the next stake timestamp slot opens */
+static int64_t GetTimeToNextStakeSlot()
+{
+    int64_t nNextSlot = (GetAdjustedTime() | STAKE_TIMESTAMP_MASK) + 1;
+    return (nNextSlot - (GetAdjustedTime() - GetTime())) * 1000 - GetTimeMillis();
+}
+
+void ThreadStakeMiner(CWallet *pwallet, CStakeKernelSearch& stakeSearch)
 {
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
 
@@ -878,83 +1002,101 @@ void ThreadStakeMiner(CWallet *pwallet)
        nMinerSleep = 30000; //limit regtest to 30s, otherwise it'll create 2 blocks per second
     }
 
+    // The information is needed for status bar to determine if the staker is trying to create block and when it will be created approximately,
+    static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // startup timestamp
+
+    // Each slot is searched once per tip; nLastSearchSlot is the latest slot searched on hashLastSearchTip
+    uint256 hashLastSearchTip;
+    uint32_t nLastSearchSlot = 0;
+
+    // Kept across slots, so that the transactions it selected are reused
+    BlockAssembler assembler(Params());
+
     while (true)
     {
-        while (pwallet->IsLocked())
+        if (pwallet->IsLocked())
         {
             nLastCoinStakeSearchInterval = 0;
-            LogPrint("minerdebug", "%s:%d before sleep\n", __FILE__, __LINE__);
-            MilliSleep(10000);
-            LogPrint("minerdebug", "%s:%d after sleep\n", __FILE__, __LINE__);
+            stakeMinerNotifier.Wait(10000);
+            continue;
         }
-        
+
         //don't disable PoS mining for no connections if in regtest mode
         if(!regtestMode && !GetBoolArg("-emergencystaking", false)) {
-            while (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 || IsInitialBlockDownload()) {
+            if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 || IsInitialBlockDownload()) {
                 nLastCoinStakeSearchInterval = 0;
                 fTryToSync = true;
-                LogPrint("minerdebug", "%s:%d before sleep\n", __FILE__, __LINE__);
-                MilliSleep(1000);
-                LogPrint("minerdebug", "%s:%d after sleep\n", __FILE__, __LINE__);
+                stakeMinerNotifier.Wait(1000);
+                continue;
             }
             if (fTryToSync) {
                 fTryToSync = false;
                 if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) < 3 ||
                     chainActive.Tip()->GetBlockTime() < GetTime() - 10 * 60) {
                     LogPrintf("sleeping 5 seconds before staking\n");
-                    LogPrint("minerdebug", "%s:%d before sleep\n", __FILE__, __LINE__);
                     MilliSleep(5000);
-                    LogPrint("minerdebug", "%s:%d after sleep\n", __FILE__, __LINE__);
                     continue;
                 }
             }
         }
 
-        //
-        // Create new block
-        //
-        LogPrint("minerdebug", "%s:%d before HaveAvailableCoinsForStaking\n", __FILE__, __LINE__);
-        if(pwallet->HaveAvailableCoinsForStaking())
+        // Taken before the tip, so that a search on a tip that is already stale is interrupted too
+        uint64_t nTipGeneration = stakeMinerNotifier.GetTipGeneration();
+        std::function<bool()> fnInterrupt = [nTipGeneration]() { return stakeMinerNotifier.GetTipGeneration() != nTipGeneration; };
+        CBlockIndex* pindexPrev;
         {
-            LogPrint("minerdebug", "%s:%d after HaveAvailableCoinsForStaking\n", __FILE__, __LINE__);
+            LOCK(cs_main);
+            pindexPrev = chainActive.Tip();
+        }
+        uint32_t nSlot = GetAdjustedTime() & ~STAKE_TIMESTAMP_MASK;
+        if (pindexPrev->GetBlockHash() != hashLastSearchTip) {
+            hashLastSearchTip = pindexPrev->GetBlockHash();
+            nLastSearchSlot = 0;
+        }
+        // Look ahead a few slots, so that a block can be built before its slot opens
+        uint32_t nFirstSlot = std::max(nSlot, nLastSearchSlot + STAKE_TIMESTAMP_MASK + 1);
+
+        if (nFirstSlot >= nSlot + MAX_STAKE_LOOKAHEAD) {
+            // Nothing new to search until the next slot or tip
+        } else if (pwallet->HaveAvailableCoinsForStaking()) {
+            // nLastCoinStakeSearchInterval > 0 mean that the staker is running
+            nLastCoinStakeSearchInterval = nSlot - nLastCoinStakeSearchTime;
+
             int64_t nTotalFees = 0;
-            // First just create an empty block. No need to process transactions until we know we can create a block
-            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateEmptyBlock(reservekey.reserveScript, true, &nTotalFees));
+            // Only an empty block is needed to learn the target, the mempool is not
+            // looked at until one of our outputs is known to have a kernel
+            std::unique_ptr<CBlockTemplate> pblocktemplate(assembler.CreateEmptyBlock(reservekey.reserveScript, true, &nTotalFees, nFirstSlot));
             if (!pblocktemplate.get())
                 return;
-            CBlockIndex* pindexPrev =  chainActive.Tip();
-
-            uint32_t beginningTime=GetAdjustedTime();
-            beginningTime &= ~STAKE_TIMESTAMP_MASK;
-            for(uint32_t i=beginningTime;i<beginningTime + MAX_STAKE_LOOKAHEAD;i+=STAKE_TIMESTAMP_MASK+1) {
 
-                // The information is needed for status bar to determine if the staker is trying to create block and when it will be created approximately,
-                static int64_t nLastCoinStakeSearchTime = GetAdjustedTime(); // startup timestamp
-                // nLastCoinStakeSearchInterval > 0 mean that the staker is running
-                nLastCoinStakeSearchInterval = i - nLastCoinStakeSearchTime;
-
-                // Try to sign a block (this also checks for a PoS stake)
-                pblocktemplate->block.nTime = i;
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
-
-                if (chainActive.Tip()->GetBlockHash() != pblock->hashPrevBlock) {
-                    //another block was received while building ours, scrap progress
+            for (uint32_t i = nFirstSlot; i < nSlot + MAX_STAKE_LOOKAHEAD; i += STAKE_TIMESTAMP_MASK + 1) {
+                nLastSearchSlot = i;
+                if (pblocktemplate->block.hashPrevBlock != pindexPrev->GetBlockHash() || chainActive.Tip() != pindexPrev) {
+                    //another block was received while searching, scrap progress
                     break;
                 }
+
+                LogPrint("minerdebug", "%s:%d before HaveStakeKernel\n", __FILE__, __LINE__);
+                CStakeKernelHit hit;
+                if (!pwallet->HaveStakeKernel(stakeSearch, pindexPrev, pblocktemplate->block.nBits, i, hit, fnInterrupt))
+                    continue;
+                LogPrint("minerdebug", "%s:%d after HaveStakeKernel\n", __FILE__, __LINE__);
+
                 // Create a block that's properly populated with transactions
                 std::unique_ptr<CBlockTemplate> pblocktemplatefilled(
-                    BlockAssembler(Params()).CreateNewBlock(pblock->vtx[1]->vout[1].scriptPubKey, true, &nTotalFees,
+                    assembler.CreateNewBlock(pblocktemplate->block.vtx[1]->vout[1].scriptPubKey, true, &nTotalFees,
                                                             i, FutureDrift(GetAdjustedTime()) - STAKE_TIME_BUFFER));
                 if (!pblocktemplatefilled.get())
                     return;
-                if (chainActive.Tip()->GetBlockHash() != pblock->hashPrevBlock) {
-                    //another block was received while building ours, scrap progress
-                    break;
-                }
-                // Sign the full block and use the timestamp from earlier for a valid stake
+
+                // Sign the full block, staking at the slot the kernel was found for
                 std::shared_ptr<CBlock> pblockfilled = std::make_shared<CBlock>(pblocktemplatefilled->block);
+                CMutableTransaction txCoinStake(*pblockfilled->vtx[1]);
+                txCoinStake.nTime = i;
+                pblockfilled->vtx[1] = MakeTransactionRef(std::move(txCoinStake));
                 LogPrint("minerdebug", "%s:%d before SignBlock\n", __FILE__, __LINE__);
-                if (SignBlock(pblockfilled, *pwallet, nTotalFees, i)) {
+                if (chainActive.Tip()->GetBlockHash() == pblockfilled->hashPrevBlock &&
+                    SignBlock(pblockfilled, *pwallet, hit, nTotalFees, i)) {
                     LogPrint("minerdebug", "%s:%d after SignBlock\n", __FILE__, __LINE__);
                     // CheckStake also does CheckBlock and AcceptBlock to propogate it to the network
                     bool validBlock = false;
@@ -971,19 +1113,11 @@ void ThreadStakeMiner(CWallet *pwallet)
                             break; //timestamp too late, so ignore
                         }
                         if (pblockfilled->GetBlockTime() > FutureDrift(GetAdjustedTime())) {
-                            if (IsArgSet("-aggressive-staking")) {
-                                //if being agressive, then check more often to publish immediately when valid. This might allow you to find more blocks, 
-                                //but also increases the chance of broadcasting invalid blocks and getting DoS banned by nodes,
-                                //or receiving more stale/orphan blocks than normal. Use at your own risk.
-                                LogPrint("minerdebug", "%s:%d before sleep\n", __FILE__, __LINE__);
-                                MilliSleep(100);
-                                LogPrint("minerdebug", "%s:%d after sleep\n", __FILE__, __LINE__);
-                            }else{
-                                //too early, so wait 3 seconds and try again
-                                LogPrint("minerdebug", "%s:%d before sleep\n", __FILE__, __LINE__);
-                                MilliSleep(3000);
-                                LogPrint("minerdebug", "%s:%d after sleep\n", __FILE__, __LINE__);
-                            }
+                            //too early, wait for it to become valid or for a competing block;
+                            //if being agressive, then check more often to publish immediately when valid. This might allow you to find more blocks,
+                            //but also increases the chance of broadcasting invalid blocks and getting DoS banned by nodes,
+                            //or receiving more stale/orphan blocks than normal. Use at your own risk.
+                            stakeMinerNotifier.Wait(IsArgSet("-aggressive-staking") ? 100 : 3000);
                             continue;
                         }
                         validBlock=true;
@@ -993,37 +1127,47 @@ void ThreadStakeMiner(CWallet *pwallet)
                         // Update the search time when new valid block is created, needed for status bar icon
                         nLastCoinStakeSearchTime = pblockfilled->GetBlockTime();
                     }
-                    break;
                 } else {
                     LogPrint("minerdebug", "%s:%d after SignBlock\n", __FILE__, __LINE__);
                 }
+                break;
             }
         } else {
-            LogPrint("minerdebug", "%s:%d after HaveAvailableCoinsForStaking\n", __FILE__, __LINE__);
             LogPrint("miner", "!HaveAvailableCoinsForStaking()\n");
         }
 
-        LogPrint("minerdebug", "%s:%d before sleep %d\n", __FILE__, __LINE__, nMinerSleep);
-        MilliSleep(nMinerSleep);
-        LogPrint("minerdebug", "%s:%d after sleep\n", __FILE__, __LINE__);
+        // Sleep until the next timestamp slot opens or a new block arrives
+        if (regtestMode) {
+            MilliSleep(nMinerSleep);
+        } else {
+            int64_t nWait = GetTimeToNextStakeSlot();
+            LogPrint("minerdebug", "%s:%d waiting up to %d ms\n", __FILE__, __LINE__, nWait);
+            stakeMinerNotifier.Wait(nWait);
+        }
     }
 }
 
 void StakeClams(bool fStake, CWallet *pwallet)
 {
     static boost::thread_group* stakeThread = NULL;
+    // The kernel search threads live exactly as long as the staker
+    static std::unique_ptr<CStakeKernelSearch> stakeSearch;
 
     if (stakeThread != NULL)
     {
+        UnregisterValidationInterface(&stakeMinerNotifier);
         stakeThread->interrupt_all();
         stakeThread->join_all();
         delete stakeThread;
         stakeThread = NULL;
     }
+    stakeSearch.reset();
 
     if(fStake)
     {
+        stakeSearch.reset(new CStakeKernelSearch(GetStakeSearchThreads()));
+        RegisterValidationInterface(&stakeMinerNotifier);
         stakeThread = new boost::thread_group();
-        stakeThread->create_thread(boost::bind(&ThreadStakeMiner, pwallet));
+        stakeThread->create_thread(boost::bind(&ThreadStakeMiner, pwallet, boost::ref(*stakeSearch)));
     }
 }
@@ -188,9 +188,29 @@ private:
     CMutableTransaction originalRewardTx;
     //When GetAdjustedTime() exceeds this, no more transactions will attempt to be added
     int32_t nTimeLimit;
+
+    // Transactions selected for the last proof-of-stake template, in block order.
+    // They are reused for later stake timestamp slots while the tip and the
+    // mempool stay the same; only those too new for the slot are left out.
+    struct SelectedTx {
+        CTransactionRef tx;
+        CAmount nFee;
+        int64_t nSigOpsCost;
+        uint64_t nWeight;
+        uint64_t nSize;
+    };
+    std::vector<SelectedTx> vStakeSelection;
+    uint256 hashStakeSelectionTip;
+    unsigned int nStakeSelectionUpdated;
+    bool fStakeSelectionValid;
 public:
     BlockAssembler(const CChainParams& chainparams);
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    /**
+     * Construct a new block template with coinbase to scriptPubKeyIn. A
+     * proof-of-stake block for the stake timestamp nTime only takes the
+     * transactions no newer than it; keep the assembler to reuse its
+     * transaction selection over consecutive slots.
+     */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fProofOfStake=false, int64_t* pTotalFees = 0, int32_t nTime=0, int32_t nTimeLimit=0);
     std::unique_ptr<CBlockTemplate> CreateEmptyBlock(const CScript& scriptPubKeyIn, bool fProofOfStake=false, int64_t* pTotalFees = 0, int32_t nTime=0);
 
@@ -204,8 +224,10 @@ private:
     // Methods for how to add transactions to a block.
     /** Add transactions based on tx "priority" */
     void addPriorityTxs();
-    /** Add transactions based on feerate including unconfirmed ancestors */
-    void addPackageTxs();
+    /** Add transactions based on feerate including unconfirmed ancestors; false if it ran out of time */
+    bool addPackageTxs();
+    /** Add the transactions of a proof-of-stake block stamped nTime, from the last selection if it still holds */
+    void addStakeTxs(const CBlockIndex* pindexPrev, int64_t nTime);
 
     // helper function for addPriorityTxs
     /** Test if tx will still "fit" in the block */
@@ -60,16 +60,7 @@ std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
 std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
 void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-struct COrphanBlock {
-    uint256 hashBlock;
-    uint256 hashPrev;
-    std::pair<COutPoint, unsigned int> stake;
-    std::vector<unsigned char> vchBlock;
-};
-std::map<uint256, COrphanBlock*> mapOrphanBlocks GUARDED_BY(cs_main);
-std::multimap<uint256, COrphanBlock*> mapOrphanBlocksByPrev GUARDED_BY(cs_main);
-std::set<std::pair<COutPoint, unsigned int>> setStakeSeenOrphan GUARDED_BY(cs_main);
-size_t nOrphanBlocksSize = 0;
+COrphanBlockPool orphanBlocks GUARDED_BY(cs_main);
 
 static size_t vExtraTxnForCompactIt = 0;
 static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(cs_main);
@@ -304,6 +295,7 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    orphanBlocks.EraseForPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -585,6 +577,12 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     return true;
 }
 
+COrphanBlockPool::Stats GetOrphanBlockStats()
+{
+    LOCK(cs_main);
+    return orphanBlocks.GetStats();
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
@@ -1055,8 +1053,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::CParams& consensusPara
                     if (inv.type == MSG_BLOCK){
                         //push old block structure to old clients
                         if(pfrom->nVersion <= 70012) { 
-                            CBlockLegacy legacyBlock(block);
-                            connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, legacyBlock));
+                            connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, LEGACY_BLOCK(block)));
                         } else { 
                             connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block));
                         }  
@@ -1991,7 +1988,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         const CBlockIndex *pindex = NULL;
         CValidationState state;
-        if (!ProcessNewBlockHeaders({cmpctblock.header}, state, chainparams, &pindex)) {
+        if (!ProcessNewBlockHeaders({cmpctblock.header}, state, chainparams, &pindex, pfrom->nVersion > 70012)) {
             int nDoS;
             if (state.IsInvalid(nDoS)) {
                 if (nDoS > 0) {
@@ -2327,9 +2324,9 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         }
 
-        //if(pfrom->nVersion <= 70012)
+        // Headers converted from older clients have no stake to check
         CValidationState state;
-        if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast)) {
+        if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast, pfrom->nVersion > 70012)) {
             int nDoS;
             if (state.IsInvalid(nDoS)) {
                 if (nDoS > 0) {
@@ -2421,9 +2418,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
 
         if(pfrom->nVersion <= 70012) {
-            std::shared_ptr<CBlockLegacy> lblock = std::make_shared<CBlockLegacy>();
-            vRecv >> *lblock;
-            *pblock = *lblock;
+            vRecv >> LEGACY_BLOCK(*pblock);
         } else { 
             vRecv >> *pblock;
         }
@@ -3337,59 +3332,6 @@ bool SendMessages(CNode* pto, CConnman& connman, const std::atomic<bool>& interr
 
 
 
-uint256 static GetOrphanRoot(const uint256& hash)
-{
-    std::map<uint256, COrphanBlock*>::iterator it = mapOrphanBlocks.find(hash);
-    if (it == mapOrphanBlocks.end())
-        return hash;
-
-    // Work back to the first block in the orphan chain
-    do {
-        std::map<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocks.find(it->second->hashPrev);
-        if (it2 == mapOrphanBlocks.end())
-            return it->first;
-        it = it2;
-    } while(true);
-}
-
-// ppcoin: find block wanted by given orphan block
-uint256 WantedByOrphan(const COrphanBlock* pblockOrphan)
-{
-    // Work back to the first block in the orphan chain
-    while (mapOrphanBlocks.count(pblockOrphan->hashPrev))
-        pblockOrphan = mapOrphanBlocks[pblockOrphan->hashPrev];
-    return pblockOrphan->hashPrev;
-}
-
-// Remove a random orphan block (which does not have any dependent orphans).
-void static PruneOrphanBlocks()
-{
-    size_t nMaxOrphanBlocksSize = GetArg("-maxorphanblocksmib", DEFAULT_MAX_ORPHAN_BLOCKS) * ((size_t) 1 << 20);
-    while (nOrphanBlocksSize > nMaxOrphanBlocksSize)
-    {
-        // Pick a random orphan block.
-        uint256 randomhash = GetRandHash();
-        std::multimap<uint256, COrphanBlock*>::iterator it = mapOrphanBlocksByPrev.lower_bound(randomhash);
-        if (it == mapOrphanBlocksByPrev.end())
-            it = mapOrphanBlocksByPrev.begin();
-
-        // As long as this block has other orphans depending on it, move to one of those successors.
-        do {
-            std::multimap<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocksByPrev.find(it->second->hashBlock);
-            if (it2 == mapOrphanBlocksByPrev.end())
-                break;
-            it = it2;
-        } while(1);
-
-        setStakeSeenOrphan.erase(it->second->stake);
-        uint256 hash = it->second->hashBlock;
-        nOrphanBlocksSize -= it->second->vchBlock.size();
-        delete it->second;
-        mapOrphanBlocksByPrev.erase(it);
-        mapOrphanBlocks.erase(hash);
-    }
-}
-
 bool ProcessNetBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool* fNewBlock, CNode* pfrom, CConnman& connman)
 {
     {
@@ -3405,13 +3347,13 @@ bool ProcessNetBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 
         // Check for duplicate orphan block
         uint256 hash = pblock->GetHash();
-        if (mapOrphanBlocks.count(hash))
+        if (orphanBlocks.Have(hash))
             return error("ProcessNetBlock() : already have block (orphan) %s", hash.ToString());
 
         // ppcoin: check proof-of-stake
         // Limited duplicity on stake: prevents block flood attack
         // Duplicate stake allowed only when there is orphan child block
-        if (!fReindex && !fImporting && pblock->IsProofOfStake() && (setStakeSeen.count(pblock->GetProofOfStake()) > 1) && !mapOrphanBlocksByPrev.count(hash))
+        if (!fReindex && !fImporting && pblock->IsProofOfStake() && (setStakeSeen.count(pblock->GetProofOfStake()) > 1) && !orphanBlocks.HaveChild(hash))
             return error("ProcessNetBlock() : duplicate proof-of-stake (%s, %d) for block %s", pblock->GetProofOfStake().first.ToString(), pblock->GetProofOfStake().second, hash.ToString());
 
 
@@ -3427,40 +3369,38 @@ bool ProcessNetBlock(const CChainParams& chainparams, const std::shared_ptr<cons
         // If we don't already have its previous block, shunt it off to holding area until we get it
         if (!mapBlockIndex.count(pblock->hashPrevBlock))
         {
-            LogPrintf("ProcessNetBlock: ORPHAN BLOCK %lu, prev=%s\n", (unsigned long)mapOrphanBlocks.size(), pblock->hashPrevBlock.ToString());
+            LogPrintf("ProcessNetBlock: ORPHAN BLOCK %lu, prev=%s\n", (unsigned long)orphanBlocks.size(), pblock->hashPrevBlock.ToString());
+
+            // Peers sending stake headers fill in what we're missing through headers: the
+            // parents are then downloaded in parallel by FindNextBlocksToDownload, and this
+            // block with them if it is still wanted
+            if (pfrom && pfrom->nVersion > 70012) {
+                const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+                UpdateBlockAvailability(pfrom->GetId(), hash);
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), hash));
+                LogPrint("net", "getheaders (%d) %s to peer=%d for block with missing prev %s\n", pindexBestHeader->nHeight, hash.ToString(), pfrom->id, pblock->hashPrevBlock.ToString());
+                return true;
+            }
 
-            // Accept orphans as long as there is a node to request its parents from
+            // Accept orphans from older clients as long as there is a node to request its parents from
             if (pfrom) {
                 // ppcoin: check proof-of-stake
                 if (pblock->IsProofOfStake())
                 {
                     // Limited duplicity on stake: prevents block flood attack
                     // Duplicate stake allowed only when there is orphan child block
-                    if (setStakeSeenOrphan.count(pblock->GetProofOfStake()) && !mapOrphanBlocksByPrev.count(hash))
+                    if (orphanBlocks.HaveStake(pblock->GetProofOfStake()) && !orphanBlocks.HaveChild(hash))
                         return error("ProcessNetBlock() : duplicate proof-of-stake (%s, %d) for orphan block %s", pblock->GetProofOfStake().first.ToString(), pblock->GetProofOfStake().second, hash.ToString());
                 }
-                PruneOrphanBlocks();
-                COrphanBlock* pblock2 = new COrphanBlock();
-                {
-                    CDataStream ss(SER_DISK, CLIENT_VERSION);
-                    ss << *pblock;
-                    pblock2->vchBlock = std::vector<unsigned char>(ss.begin(), ss.end());
-                }
-                pblock2->hashBlock = hash;
-                pblock2->hashPrev = pblock->hashPrevBlock;
-                pblock2->stake = pblock->GetProofOfStake();
-                nOrphanBlocksSize += pblock2->vchBlock.size();
-                mapOrphanBlocks.insert(std::make_pair(hash, pblock2));
-                mapOrphanBlocksByPrev.insert(std::make_pair(pblock2->hashPrev, pblock2));
-                if (pblock->IsProofOfStake())
-                    setStakeSeenOrphan.insert(pblock->GetProofOfStake());
+                orphanBlocks.SetMaxUsage(GetArg("-maxorphanblocksmib", DEFAULT_MAX_ORPHAN_BLOCKS) * ((size_t) 1 << 20));
+                orphanBlocks.Add(pblock, pfrom->GetId());
 
                 // Ask this guy to fill in what we're missing
-                PushGetBlocks(pfrom, pindexBestHeader, GetOrphanRoot(hash), connman);
+                PushGetBlocks(pfrom, pindexBestHeader, orphanBlocks.GetRoot(hash), connman);
                 // ppcoin: getblocks may not obtain the ancestor block rejected
                 // earlier by duplicate-stake check so we ask for it again directly
                 if (!IsInitialBlockDownload())
-                    pfrom->AskFor(CInv(MSG_BLOCK, WantedByOrphan(pblock2)));
+                    pfrom->AskFor(CInv(MSG_BLOCK, orphanBlocks.GetWanted(hash)));
             }
             return true;
         }
@@ -3469,36 +3409,22 @@ bool ProcessNetBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     if(!ProcessNewBlock(chainparams, pblock, fForceProcessing, fNewBlock))
         return error("%s: ProcessNewBlock FAILED", __func__);
 
+    // Connect the orphans waiting for this block, as they were received
     std::vector<uint256> vWorkQueue;
     vWorkQueue.push_back(pblock->GetHash());
     for (unsigned int i = 0; i < vWorkQueue.size(); i++)
     {
-        uint256 hashPrev = vWorkQueue[i];
-        for (std::multimap<uint256, COrphanBlock*>::iterator mi = mapOrphanBlocksByPrev.lower_bound(hashPrev);
-             mi != mapOrphanBlocksByPrev.upper_bound(hashPrev);
-             ++mi)
+        std::vector<std::shared_ptr<const CBlock> > vOrphans;
         {
-            CBlock block;
-            {
-                CDataStream ss(mi->second->vchBlock, SER_DISK, CLIENT_VERSION);
-                ss >> block;
-            }
-            block.hashMerkleRoot = BlockMerkleRoot(block);
-
-            bool fNewBlockOrphan = false;
-            std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(block);
-            if (ProcessNewBlock(chainparams, shared_pblock, fForceProcessing, &fNewBlockOrphan))
-                vWorkQueue.push_back(mi->second->hashBlock);
-
             LOCK(cs_main);
-            mapOrphanBlocks.erase(mi->second->hashBlock);
-            setStakeSeenOrphan.erase(block.GetProofOfStake());
-            nOrphanBlocksSize -= mi->second->vchBlock.size();
-            delete mi->second;
+            vOrphans = orphanBlocks.TakeChildren(vWorkQueue[i]);
+        }
+        for (const std::shared_ptr<const CBlock>& pblockOrphan : vOrphans)
+        {
+            bool fNewBlockOrphan = false;
+            if (ProcessNewBlock(chainparams, pblockOrphan, fForceProcessing, &fNewBlockOrphan))
+                vWorkQueue.push_back(pblockOrphan->GetHash());
         }
-
-        LOCK(cs_main);
-        mapOrphanBlocksByPrev.erase(hashPrev);
     }
 
     LogPrintf("ProcessNetBlock: ACCEPTED\n");
@@ -3514,8 +3440,6 @@ public:
         // orphan transactions
         mapOrphanTransactions.clear();
         mapOrphanTransactionsByPrev.clear();
-        mapOrphanBlocks.clear();
-        mapOrphanBlocksByPrev.clear();
-        setStakeSeenOrphan.clear();
+        orphanBlocks.Clear();
     }
 } instance_of_cnetprocessingcleanup;
@@ -0,0 +1,185 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notary.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/block.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <map>
+
+#include <boost/thread.hpp>
+
+/** Height the background build of the notary index continues from, or -1 once it is complete; guarded by cs_main */
+static int nNotaryIndexBuildHeight = -1;
+
+CPendingNotaryIndex pendingNotaryIndex;
+
+bool GetNotaryHash(const CTransaction& tx, uint256& hashNotary)
+{
+    static const std::string strPrefix = "notary ";
+    const std::string& strSpeech = tx.strClamSpeech;
+    if (strSpeech.size() != strPrefix.size() + 64 || strSpeech.compare(0, strPrefix.size(), strPrefix) != 0)
+        return false;
+
+    std::string strHash = strSpeech.substr(strPrefix.size());
+    if (!IsHex(strHash))
+        return false;
+    hashNotary.SetHex(strHash);
+    // sendnotarytransaction writes the hash in lower case, as GetHex() does
+    return hashNotary.GetHex() == strHash;
+}
+
+std::vector<CNotaryIndexKey> GetBlockNotaryKeys(const CBlock& block)
+{
+    std::vector<CNotaryIndexKey> vKeys;
+    uint256 hashNotary;
+    for (const auto& tx : block.vtx) {
+        if (GetNotaryHash(*tx, hashNotary))
+            vKeys.push_back(CNotaryIndexKey(hashNotary, tx->GetHash()));
+    }
+    return vKeys;
+}
+
+void WriteBlockNotaryIndex(const CBlock& block, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    for (const CNotaryIndexKey& key : GetBlockNotaryKeys(block))
+        pendingNotaryIndex.Write(key, nHeight);
+}
+
+void EraseBlockNotaryIndex(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+    for (const CNotaryIndexKey& key : GetBlockNotaryKeys(block))
+        pendingNotaryIndex.Erase(key);
+}
+
+bool InitNotaryIndex(bool fEnable)
+{
+    LOCK(cs_main);
+    bool fWasEnabled = false;
+    pblocktree->ReadFlag("notaryindex", fWasEnabled);
+
+    if (fEnable != fWasEnabled) {
+        // Entries left from an earlier run may be stale; start over from the genesis block
+        pendingNotaryIndex.Clear();
+        if (!pblocktree->WipeNotaryIndex())
+            return error("%s: failed to clear the notary index", __func__);
+        if (fEnable && !pblocktree->WriteNotaryIndexBuild(std::vector<std::pair<CNotaryIndexKey, int> >(), 0))
+            return error("%s: failed to start the notary index", __func__);
+        if (!pblocktree->WriteFlag("notaryindex", fEnable))
+            return error("%s: failed to write the notary index flag", __func__);
+    }
+
+    fNotaryIndex = fEnable;
+    nNotaryIndexBuildHeight = -1;
+    if (fNotaryIndex && !pblocktree->ReadNotaryIndexBuildHeight(nNotaryIndexBuildHeight))
+        return error("%s: failed to read the notary index build height", __func__);
+
+    LogPrintf("%s: notary index %s\n", __func__, !fNotaryIndex ? "disabled" :
+        nNotaryIndexBuildHeight < 0 ? "enabled" : strprintf("being built from height %d", nNotaryIndexBuildHeight));
+    return true;
+}
+
+void ThreadNotaryIndex()
+{
+    const Consensus::CParams& consensusParams = Params().GetConsensus();
+    int64_t nStart = GetTimeMillis();
+
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        // Snapshot the next blocks of the active chain, and read them without holding cs_main
+        std::vector<CBlockIndex*> vBlocks;
+        {
+            LOCK(cs_main);
+            if (nNotaryIndexBuildHeight < 0)
+                return;
+            for (int nHeight = nNotaryIndexBuildHeight; nHeight <= chainActive.Height() && vBlocks.size() < NOTARY_INDEX_BUILD_BLOCKS; nHeight++)
+                vBlocks.push_back(chainActive[nHeight]);
+            if (vBlocks.empty()) {
+                // Caught up: ConnectBlock indexes every block from here on
+                if (!pblocktree->WriteNotaryIndexBuild(std::vector<std::pair<CNotaryIndexKey, int> >(), -1)) {
+                    error("%s: failed to write the notary index", __func__);
+                    return;
+                }
+                nNotaryIndexBuildHeight = -1;
+                LogPrintf("%s: notary index built up to height %d in %dms\n", __func__, chainActive.Height(), GetTimeMillis() - nStart);
+                return;
+            }
+        }
+
+        std::vector<std::vector<CNotaryIndexKey> > vBlockKeys(vBlocks.size());
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            boost::this_thread::interruption_point();
+            CBlock block;
+            if (!ReadBlockFromDisk(block, vBlocks[i], consensusParams)) {
+                error("%s: failed to read block %s, the notary index is not built", __func__, vBlocks[i]->GetBlockHash().ToString());
+                return;
+            }
+            vBlockKeys[i] = GetBlockNotaryKeys(block);
+        }
+
+        {
+            LOCK(cs_main);
+            // DisconnectTip erased the entries of blocks disconnected meanwhile; write only
+            // those still active, and pick up the new branch in the next round
+            std::vector<std::pair<CNotaryIndexKey, int> > vEntries;
+            size_t n = 0;
+            for (; n < vBlocks.size() && chainActive.Contains(vBlocks[n]); n++) {
+                for (const CNotaryIndexKey& key : vBlockKeys[n])
+                    vEntries.push_back(std::make_pair(key, vBlocks[n]->nHeight));
+            }
+            int nHeight = vBlocks[0]->nHeight + n;
+            if (!pblocktree->WriteNotaryIndexBuild(vEntries, nHeight)) {
+                error("%s: failed to write the notary index", __func__);
+                return;
+            }
+            nNotaryIndexBuildHeight = nHeight;
+            LogPrint("notary", "%s: notary index built up to height %d\n", __func__, nHeight - 1);
+        }
+    }
+}
+
+bool IsNotaryIndexComplete()
+{
+    LOCK(cs_main);
+    return fNotaryIndex && nNotaryIndexBuildHeight < 0;
+}
+
+bool FindNotaryTransactions(const uint256& hashNotary, std::vector<std::pair<uint256, int> >& vTx)
+{
+    LOCK(cs_main);
+    vTx.clear();
+    if (!fNotaryIndex || nNotaryIndexBuildHeight >= 0)
+        return false;
+    return FindNotaryTransactions(hashNotary, pendingNotaryIndex, vTx);
+}
+
+bool FindNotaryTransactions(const uint256& hashNotary, const CPendingNotaryIndex& pending, std::vector<std::pair<uint256, int> >& vTx)
+{
+    vTx.clear();
+    std::vector<std::pair<uint256, int> > vRead;
+    if (!pblocktree->ReadNotaryIndex(hashNotary, vRead))
+        return false;
+
+    // The blocks connected and disconnected since the last flush are not in the database yet
+    std::map<CNotaryIndexKey, int> mapEntries;
+    for (const auto& entry : vRead)
+        mapEntries.insert(std::make_pair(CNotaryIndexKey(hashNotary, entry.first), entry.second));
+    pending.Apply(mapEntries, CNotaryIndexKey(hashNotary, uint256()),
+                             [&hashNotary](const CNotaryIndexKey& key) { return key.hashNotary == hashNotary; });
+    for (const auto& entry : mapEntries)
+        vTx.push_back(std::make_pair(entry.first.txid, entry.second));
+    std::stable_sort(vTx.begin(), vTx.end(), [](const std::pair<uint256, int>& a, const std::pair<uint256, int>& b) {
+        return a.second > b.second;
+    });
+    return true;
+}
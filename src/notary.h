@@ -0,0 +1,56 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NOTARY_H
+#define BITCOIN_NOTARY_H
+
+#include "txdb.h"
+#include "uint256.h"
+
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CTransaction;
+
+/** Blocks read per round while building the notary index in the background */
+static const unsigned int NOTARY_INDEX_BUILD_BLOCKS = 100;
+/** Maximum number of notary ids looked up by one getnotarytransactions call */
+static const unsigned int MAX_NOTARY_LOOKUPS = 1000;
+
+/** Whether the CLAMspeech of tx notarizes a hash ("notary <hash>"), and which */
+bool GetNotaryHash(const CTransaction& tx, uint256& hashNotary);
+
+/** The notary index keys of the transactions of a block */
+std::vector<CNotaryIndexKey> GetBlockNotaryKeys(const CBlock& block);
+
+/** Notary index changes not yet written with the block index by FlushStateToDisk; guarded by cs_main */
+extern CPendingNotaryIndex pendingNotaryIndex;
+
+/** Queue the notary index entries of a block connected at nHeight, or their erasure when it is disconnected */
+void WriteBlockNotaryIndex(const CBlock& block, int nHeight);
+void EraseBlockNotaryIndex(const CBlock& block);
+
+/**
+ * Turn the notary index on or off after the block index is loaded. Turning
+ * it on for an existing chain schedules ThreadNotaryIndex to build it; from
+ * then on ConnectBlock and DisconnectTip keep it up to date.
+ */
+bool InitNotaryIndex(bool fEnable);
+
+/** Index the notary transactions of the blocks connected before -notaryindex was turned on */
+void ThreadNotaryIndex();
+
+/** Whether the notary index covers the whole active chain */
+bool IsNotaryIndexComplete();
+
+/** The transactions notarizing a hash and their heights, most recent first; requires a complete index */
+bool FindNotaryTransactions(const uint256& hashNotary, std::vector<std::pair<uint256, int> >& vTx);
+/**
+ * The same, merging a copy of pendingNotaryIndex taken under cs_main instead,
+ * so that many lookups don't hold it; the caller checks the index is complete.
+ */
+bool FindNotaryTransactions(const uint256& hashNotary, const CPendingNotaryIndex& pending, std::vector<std::pair<uint256, int> >& vTx);
+
+#endif // BITCOIN_NOTARY_H
@@ -0,0 +1,152 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "orphanblocks.h"
+
+#include "core_memusage.h"
+#include "memusage.h"
+#include "random.h"
+
+#include <algorithm>
+
+static size_t OrphanBlockUsage(const CBlock& block)
+{
+    // The block itself, its transactions, the map node and the two index entries
+    return memusage::MallocUsage(sizeof(CBlock)) + RecursiveDynamicUsage(block) + memusage::DynamicUsage(block.vchBlockSig) +
+           memusage::MallocUsage(sizeof(uint256) + sizeof(std::shared_ptr<const CBlock>) + sizeof(CStakeSeen::Stake) + sizeof(NodeId) + 2 * sizeof(size_t) + sizeof(void*)) +
+           sizeof(std::pair<uint256, uint256>) + sizeof(std::pair<NodeId, uint256>);
+}
+
+COrphanBlockPool::COrphanBlockPool(size_t nMaxUsageIn) : nUsage(0), nMaxUsage(nMaxUsageIn), nAdded(0), nConnected(0), nEvicted(0), nPeerErased(0)
+{
+}
+
+bool COrphanBlockPool::HaveChild(const uint256& hash) const
+{
+    auto it = std::lower_bound(vByPrev.begin(), vByPrev.end(), std::make_pair(hash, uint256()));
+    return it != vByPrev.end() && it->first == hash;
+}
+
+bool COrphanBlockPool::Add(const std::shared_ptr<const CBlock>& pblock, NodeId peer)
+{
+    const uint256 hash = pblock->GetHash();
+    size_t nBlockUsage = OrphanBlockUsage(*pblock);
+    if (nBlockUsage > nMaxUsage || mapBlocks.count(hash))
+        return false;
+
+    CStakeSeen::Stake stake = pblock->GetProofOfStake();
+    mapBlocks.emplace(hash, Entry{pblock, stake, peer, nBlockUsage});
+    std::pair<uint256, uint256> prev(pblock->hashPrevBlock, hash);
+    vByPrev.insert(std::upper_bound(vByPrev.begin(), vByPrev.end(), prev), prev);
+    std::pair<NodeId, uint256> from(peer, hash);
+    vByPeer.insert(std::upper_bound(vByPeer.begin(), vByPeer.end(), from), from);
+    if (pblock->IsProofOfStake())
+        setStake.insert(stake);
+    nUsage += nBlockUsage;
+    nAdded++;
+    Trim();
+    return true;
+}
+
+uint256 COrphanBlockPool::GetRoot(const uint256& hash) const
+{
+    uint256 hashRoot = hash;
+    EntryMap::const_iterator it;
+    while ((it = mapBlocks.find(hashRoot)) != mapBlocks.end() && mapBlocks.count(it->second.pblock->hashPrevBlock))
+        hashRoot = it->second.pblock->hashPrevBlock;
+    return hashRoot;
+}
+
+uint256 COrphanBlockPool::GetWanted(const uint256& hash) const
+{
+    EntryMap::const_iterator it = mapBlocks.find(GetRoot(hash));
+    return it != mapBlocks.end() ? it->second.pblock->hashPrevBlock : hash;
+}
+
+std::vector<std::shared_ptr<const CBlock> > COrphanBlockPool::TakeChildren(const uint256& hashPrev)
+{
+    std::vector<uint256> vHashes;
+    for (auto it = std::lower_bound(vByPrev.begin(), vByPrev.end(), std::make_pair(hashPrev, uint256())); it != vByPrev.end() && it->first == hashPrev; ++it)
+        vHashes.push_back(it->second);
+
+    std::vector<std::shared_ptr<const CBlock> > vBlocks;
+    vBlocks.reserve(vHashes.size());
+    for (const uint256& hash : vHashes) {
+        EntryMap::iterator it = mapBlocks.find(hash);
+        vBlocks.push_back(it->second.pblock);
+        Erase(it);
+    }
+    nConnected += vBlocks.size();
+    return vBlocks;
+}
+
+size_t COrphanBlockPool::EraseForPeer(NodeId peer)
+{
+    std::vector<uint256> vHashes;
+    for (auto it = std::lower_bound(vByPeer.begin(), vByPeer.end(), std::make_pair(peer, uint256())); it != vByPeer.end() && it->first == peer; ++it)
+        vHashes.push_back(it->second);
+
+    for (const uint256& hash : vHashes)
+        Erase(mapBlocks.find(hash));
+    nPeerErased += vHashes.size();
+    return vHashes.size();
+}
+
+void COrphanBlockPool::Erase(EntryMap::iterator it)
+{
+    const uint256& hash = it->first;
+    const Entry& entry = it->second;
+    vByPrev.erase(std::lower_bound(vByPrev.begin(), vByPrev.end(), std::make_pair(entry.pblock->hashPrevBlock, hash)));
+    vByPeer.erase(std::lower_bound(vByPeer.begin(), vByPeer.end(), std::make_pair(entry.peer, hash)));
+    if (entry.pblock->IsProofOfStake())
+        setStake.erase(entry.stake);
+    nUsage -= entry.nUsage;
+    mapBlocks.erase(it);
+}
+
+void COrphanBlockPool::Trim()
+{
+    while (nUsage > nMaxUsage) {
+        // Pick a random orphan, and as long as other orphans depend on it, move to one of those successors
+        uint256 hash = vByPrev[GetRand(vByPrev.size())].second;
+        auto it = std::lower_bound(vByPrev.begin(), vByPrev.end(), std::make_pair(hash, uint256()));
+        while (it != vByPrev.end() && it->first == hash) {
+            hash = it->second;
+            it = std::lower_bound(vByPrev.begin(), vByPrev.end(), std::make_pair(hash, uint256()));
+        }
+        Erase(mapBlocks.find(hash));
+        nEvicted++;
+    }
+}
+
+void COrphanBlockPool::SetMaxUsage(size_t nMaxUsageIn)
+{
+    nMaxUsage = nMaxUsageIn;
+    Trim();
+}
+
+void COrphanBlockPool::Clear()
+{
+    mapBlocks.clear();
+    vByPrev.clear();
+    vByPeer.clear();
+    setStake.clear();
+    nUsage = 0;
+}
+
+COrphanBlockPool::Stats COrphanBlockPool::GetStats() const
+{
+    Stats stats;
+    stats.nBlocks = mapBlocks.size();
+    stats.nPeers = 0;
+    for (size_t i = 0; i < vByPeer.size(); i++)
+        stats.nPeers += (i == 0 || vByPeer[i].first != vByPeer[i - 1].first);
+    stats.nUsage = nUsage;
+    stats.nMaxUsage = nMaxUsage;
+    stats.nAdded = nAdded;
+    stats.nConnected = nConnected;
+    stats.nEvicted = nEvicted;
+    stats.nPeerErased = nPeerErased;
+    return stats;
+}
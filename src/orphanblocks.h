@@ -0,0 +1,106 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ORPHANBLOCKS_H
+#define BITCOIN_ORPHANBLOCKS_H
+
+#include "net.h"
+#include "primitives/block.h"
+#include "stakeseen.h"
+#include "uint256.h"
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Default for -maxorphanblocksmib, memory (in MiB) used by blocks whose parent is unknown */
+static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 40;
+
+/**
+ * Bounded pool of the blocks received from older clients before their parent.
+ *
+ * Blocks are kept as the shared pointers they arrived in, so connecting an
+ * orphan neither copies nor deserializes it again. Besides the map by hash,
+ * the orphans are indexed by parent and by peer in flat sorted vectors, which
+ * stay small: finding the children of a connected block or dropping the
+ * orphans of a disconnected peer is a binary search and a contiguous range.
+ * The memory use of the blocks is accounted and kept under a limit by dropping
+ * random orphans that no other orphan builds on. Not thread safe; the pool of
+ * net_processing is guarded by cs_main.
+ */
+class COrphanBlockPool
+{
+public:
+    struct Stats
+    {
+        size_t nBlocks;
+        size_t nPeers;
+        size_t nUsage;
+        size_t nMaxUsage;
+        uint64_t nAdded;
+        uint64_t nConnected;
+        uint64_t nEvicted;
+        uint64_t nPeerErased;
+    };
+
+    explicit COrphanBlockPool(size_t nMaxUsageIn = DEFAULT_MAX_ORPHAN_BLOCKS << 20);
+
+    bool Have(const uint256& hash) const { return mapBlocks.count(hash) != 0; }
+    /** Whether an orphan builds on the block hash */
+    bool HaveChild(const uint256& hash) const;
+    bool HaveStake(const CStakeSeen::Stake& stake) const { return setStake.count(stake) != 0; }
+
+    /** Add a block received from peer, evicting orphans to stay under the limit; returns false if it was there or exceeds the limit alone */
+    bool Add(const std::shared_ptr<const CBlock>& pblock, NodeId peer);
+    /** First block of the orphan chain ending in hash, or hash itself if it is no orphan */
+    uint256 GetRoot(const uint256& hash) const;
+    /** Parent of the first block of the orphan chain ending in hash, i.e. the block it waits for */
+    uint256 GetWanted(const uint256& hash) const;
+    /** Remove and return the orphans building on hashPrev, to be connected after it */
+    std::vector<std::shared_ptr<const CBlock> > TakeChildren(const uint256& hashPrev);
+    /** Drop the orphans received from peer; returns how many */
+    size_t EraseForPeer(NodeId peer);
+    /** Change the memory limit, evicting orphans if it shrank */
+    void SetMaxUsage(size_t nMaxUsageIn);
+    void Clear();
+
+    size_t size() const { return mapBlocks.size(); }
+    Stats GetStats() const;
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const CBlock> pblock;
+        CStakeSeen::Stake stake;
+        NodeId peer;
+        size_t nUsage;
+    };
+
+    struct EntryHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    typedef std::unordered_map<uint256, Entry, EntryHasher> EntryMap;
+
+    EntryMap mapBlocks;
+    //! (parent hash, block hash) of every orphan, sorted
+    std::vector<std::pair<uint256, uint256> > vByPrev;
+    //! (peer, block hash) of every orphan, sorted
+    std::vector<std::pair<NodeId, uint256> > vByPeer;
+    //! stakes of the proof-of-stake orphans
+    CStakeSeen setStake;
+    size_t nUsage;
+    size_t nMaxUsage;
+    uint64_t nAdded;
+    uint64_t nConnected;
+    uint64_t nEvicted;
+    uint64_t nPeerErased;
+
+    void Erase(EntryMap::iterator it);
+    void Trim();
+};
+
+#endif // BITCOIN_ORPHANBLOCKS_H
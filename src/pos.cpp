@@ -17,8 +17,6 @@
 #include "consensus/consensus.h"
 #include "utilmoneystr.h"
 
-#include "bignum.h"
-
 using namespace std;
 
 int64_t GetWeight(const int64_t &nIntervalBeginning, const int64_t &nIntervalEnd)
@@ -30,6 +28,37 @@ int64_t GetWeight(const int64_t &nIntervalBeginning, const int64_t &nIntervalEnd
     return min(nIntervalEnd - nIntervalBeginning - params.nStakeMinAge, (int64_t)params.nStakeMaxAge);
 }
 
+CStakeTarget::CStakeTarget(unsigned int nBits, CAmount nValueIn) : fNegative(false), fOverflow(false)
+{
+    bool fTargetNegative, fTargetOverflow;
+    bnTarget.SetCompact(nBits, &fTargetNegative, &fTargetOverflow);
+    uint64_t nWeight = nValueIn < 0 ? -(uint64_t)nValueIn : (uint64_t)nValueIn;
+
+    // Sign and magnitude follow the product of two signed bignums. A compact
+    // overflow means the base target alone is at least 2^256.
+    if (nWeight == 0 || (!fTargetOverflow && bnTarget == 0)) {
+        bnTarget = 0;
+        return;
+    }
+    bnTarget.Mul64(nWeight, &fOverflow);
+    fOverflow |= fTargetOverflow;
+    fNegative = fTargetNegative != (nValueIn < 0);
+}
+
+arith_uint256 CStakeTarget::GetTarget() const
+{
+    if (fNegative)
+        return arith_uint256();
+    return fOverflow ? ~arith_uint256() : bnTarget;
+}
+
+std::string CStakeTarget::GetHex() const
+{
+    if (fNegative)
+        return "-" + bnTarget.GetHex();
+    return fOverflow ? "overflow" : bnTarget.GetHex();
+}
+
 // Get the last stake modifier and its generation time from a given block
 static bool GetLastStakeModifier(const CBlockIndex* pindex, uint64_t& nStakeModifier, int64_t& nModifierTime)
 {
@@ -62,52 +91,130 @@ static int64_t GetStakeModifierSelectionInterval()
     return nSelectionInterval;
 }
 
-// select a block from the candidate blocks in vSortedByTimestamp, excluding
-// already selected blocks in vSelectedBlocks, and with timestamp up to
-// nSelectionIntervalStop.
-static bool SelectBlockFromCandidates(vector<pair<int64_t, uint256> >& vSortedByTimestamp, map<uint256, const CBlockIndex*>& mapSelectedBlocks,
-    int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev, const CBlockIndex** pindexSelected)
+CStakeModifierEngine stakeModifierEngine;
+
+CStakeModifierEngine::CStakeModifierEngine() : pindexLast(NULL), nHeightStart(0), stats()
+{
+}
+
+void CStakeModifierEngine::Clear()
+{
+    LOCK(cs);
+    vCandidates.clear();
+    vSelected.clear();
+    pindexLast = NULL;
+    nHeightStart = 0;
+}
+
+CStakeModifierEngine::Stats CStakeModifierEngine::GetStats() const
+{
+    LOCK(cs);
+    return stats;
+}
+
+// The candidates are the blocks from pindexPrev back to, excluding, the first
+// one timed before nSelectionIntervalStart
+void CStakeModifierEngine::UpdateWindow(const CBlockIndex* pindexPrev, int64_t nSelectionIntervalStart)
 {
-    bool fSelected = false;
-    uint256 hashBest;
-    *pindexSelected = (const CBlockIndex*) 0;
+    bool fExtend = pindexLast && pindexPrev->nHeight >= pindexLast->nHeight && pindexPrev->GetAncestor(pindexLast->nHeight) == pindexLast;
 
-    BOOST_FOREACH(const PAIRTYPE(int64_t, uint256)& item, vSortedByTimestamp)
+    // Block times need not increase, so the window may also grow downwards
+    std::vector<Candidate> vNew;
+    const CBlockIndex* pindex = pindexPrev;
+    while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
     {
-        if (!mapBlockIndex.count(item.second))
-            return error("SelectBlockFromCandidates: failed to find block index for candidate block %s", item.second.ToString());
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
-        if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
-            break;
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
-            continue;
-        // compute the selection hash by hashing its proof-hash and the
-        // previous proof-of-stake modifier
-
-        CDataStream ss(SER_GETHASH, 0);
-        ss << pindex->hashProof << nStakeModifierPrev;
-        uint256 hashSelection = Hash(ss.begin(), ss.end());
-
-        // the selection hash is divided by 2**32 so that proof-of-stake block
-        // is always favored over proof-of-work block. this is to preserve
-        // the energy efficiency property
-        if (pindex->IsProofOfStake())
-            hashSelection >>= 32;
-        if (fSelected && hashSelection < hashBest)
-        {
-            hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*) pindex;
-        }
-        else if (!fSelected)
+        if (!fExtend || pindex->nHeight > pindexLast->nHeight || pindex->nHeight < nHeightStart)
+            vNew.push_back(Candidate(pindex));
+        pindex = pindex->pprev;
+    }
+    int nHeightStartNew = pindex ? pindex->nHeight + 1 : 0;
+
+    if (fExtend) {
+        vCandidates.erase(std::remove_if(vCandidates.begin(), vCandidates.end(), [nHeightStartNew](const Candidate& candidate) {
+            return candidate.pindex->nHeight < nHeightStartNew;
+        }), vCandidates.end());
+    } else {
+        vCandidates.clear();
+        stats.nRebuilds++;
+    }
+
+    stats.nCandidatesAdded += vNew.size();
+    std::sort(vNew.begin(), vNew.end());
+    size_t nKept = vCandidates.size();
+    vCandidates.insert(vCandidates.end(), vNew.begin(), vNew.end());
+    std::inplace_merge(vCandidates.begin(), vCandidates.begin() + nKept, vCandidates.end());
+
+    pindexLast = pindexPrev;
+    nHeightStart = nHeightStartNew;
+}
+
+// The selection hash of a block is the hash of its proof-hash and the previous
+// stake modifier, divided by 2**32 for proof-of-stake blocks so that they are
+// always favored over proof-of-work blocks. This is to preserve the energy
+// efficiency property
+const uint256& CStakeModifierEngine::GetSelectionHash(Candidate& candidate, uint64_t nStakeModifierPrev)
+{
+    const CBlockIndex* pindex = candidate.pindex;
+    if (candidate.fHashed && candidate.nStakeModifierHashed == nStakeModifierPrev && candidate.hashProof == pindex->hashProof) {
+        stats.nSelectionHashesReused++;
+        return candidate.hashSelection;
+    }
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << pindex->hashProof << nStakeModifierPrev;
+    candidate.hashSelection = ss.GetHash();
+    if (pindex->IsProofOfStake())
+        candidate.hashSelection >>= 32;
+    candidate.fHashed = true;
+    candidate.hashProof = pindex->hashProof;
+    candidate.nStakeModifierHashed = nStakeModifierPrev;
+    stats.nSelectionHashes++;
+    return candidate.hashSelection;
+}
+
+bool CStakeModifierEngine::ComputeModifier(const CBlockIndex* pindexPrev, uint64_t nStakeModifierPrev, uint64_t& nStakeModifierNew)
+{
+    const Consensus::CParams& params = Params().GetConsensus();
+
+    LOCK(cs);
+    int64_t nSelectionInterval = GetStakeModifierSelectionInterval();
+    int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / params.nModifierInterval) * params.nModifierInterval - nSelectionInterval;
+    UpdateWindow(pindexPrev, nSelectionIntervalStart);
+
+    // Select 64 blocks from candidate blocks to generate stake modifier. Each
+    // round selects the block with the lowest selection hash among those not
+    // selected yet, with timestamp up to nSelectionIntervalStop.
+    nStakeModifierNew = 0;
+    int64_t nSelectionIntervalStop = nSelectionIntervalStart;
+    vSelected.assign(vCandidates.size(), 0);
+    for (int nRound=0; nRound<min(64, (int)vCandidates.size()); nRound++)
+    {
+        // add an interval section to the current selection round
+        nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
+
+        size_t nBest = vCandidates.size();
+        const uint256* phashBest = NULL;
+        for (size_t i = 0; i < vCandidates.size(); i++)
         {
-            fSelected = true;
-            hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*) pindex;
+            if (phashBest && vCandidates[i].nTime > nSelectionIntervalStop)
+                break;
+            if (vSelected[i])
+                continue;
+            const uint256& hashSelection = GetSelectionHash(vCandidates[i], nStakeModifierPrev);
+            if (!phashBest || hashSelection < *phashBest)
+            {
+                nBest = i;
+                phashBest = &hashSelection;
+            }
         }
-    }
+        if (!phashBest)
+            return error("ComputeNextStakeModifier: unable to select block at round %d", nRound);
 
-    //LogPrintf("ComputeNextStakeModifier: final selection hash=%s\n", hashBest.ToString());
-    return fSelected;
+        // write the entropy bit of the selected block
+        nStakeModifierNew |= (((uint64_t)vCandidates[nBest].pindex->GetStakeEntropyBit()) << nRound);
+        vSelected[nBest] = 1;
+    }
+    return true;
 }
 
 // Stake Modifier (hash modifier of proof-of-stake):
@@ -141,43 +248,12 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     if (!GetLastStakeModifier(pindexPrev, nStakeModifier, nModifierTime)) {
         return error("ComputeNextStakeModifier: unable to get last modifier");
     }
-    if (nModifierTime / Params().GetConsensus().nModifierInterval >= pindexPrev->GetBlockTime() / Params().GetConsensus().nModifierInterval)
+    if (nModifierTime / params.nModifierInterval >= pindexPrev->GetBlockTime() / params.nModifierInterval)
         return true;
 
-    // Sort candidate blocks by timestamp
-    vector<pair<int64_t, uint256> > vSortedByTimestamp;
-    vSortedByTimestamp.reserve(64 * Params().GetConsensus().nModifierInterval / params.nTargetSpacing);
-    int64_t nSelectionInterval = GetStakeModifierSelectionInterval();
-    int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / Params().GetConsensus().nModifierInterval) * Params().GetConsensus().nModifierInterval - nSelectionInterval;
-    const CBlockIndex* pindex = pindexPrev;
-    while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
-    {
-        vSortedByTimestamp.push_back(make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()));
-        pindex = pindex->pprev;
-    }
-    reverse(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
-    sort(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
-
-    // Select 64 blocks from candidate blocks to generate stake modifier
     uint64_t nStakeModifierNew = 0;
-    int64_t nSelectionIntervalStop = nSelectionIntervalStart;
-    map<uint256, const CBlockIndex*> mapSelectedBlocks;
-    for (int nRound=0; nRound<min(64, (int)vSortedByTimestamp.size()); nRound++)
-    {
-        // add an interval section to the current selection round
-        nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
-        // select a block from the candidates of current round
-        if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex)){
-            return error("ComputeNextStakeModifier: unable to select block at round %d", nRound);
-        }
-        // write the entropy bit of the selected block
-        nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
-        // add the selected block from candidates to selected list
-        mapSelectedBlocks.insert(make_pair(pindex->GetBlockHash(), pindex));
-        //LogPrintf("ComputeNextStakeModifier: selected round=%d, stop=%d, bit=%d, height=%d, pindexTime=%s\n", nRound, nSelectionIntervalStop, pindex->GetStakeEntropyBit(), pindex->nHeight, pindex->nTime);
-    }
-
-    //LogPrintf("ComputeNextStakeModifier: new modifier=0x%016x\n", nStakeModifierNew);
+    if (!stakeModifierEngine.ComputeModifier(pindexPrev, nStakeModifier, nStakeModifierNew))
+        return false;
 
     nStakeModifier = nStakeModifierNew;
     fGeneratedStakeModifier = true;
@@ -243,26 +319,24 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, CBigNum& bnTargetProofOfStake, bool fPrintProofOfStake)
+static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlockIndex* pindexFrom, unsigned int nTxPrevOffset, const Coin& coinPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, arith_uint256& bnTargetProofOfStake, bool fPrintProofOfStake)
 {
     const Consensus::CParams& params = Params().GetConsensus();
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
+    if (nTimeTx < coinPrev.nTime)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
-    unsigned int nTimeBlockFrom = blockFrom.GetBlockTime();
+    unsigned int nTimeBlockFrom = pindexFrom->GetBlockTime();
     if ((nTimeBlockFrom + params.nStakeMinAge) > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHashV1() : min age violation");// , nTimeBlockFrom + params.nStakeMinAge, nTimeBlockFrom, nTimeTx, blockFrom.ToString());
 
     arith_uint256 bnTargetPerCoinDay256;
     bnTargetPerCoinDay256.SetCompact(nBits);
-    CBigNum bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
+    int64_t nValueIn = coinPrev.out.nValue;
 
-    uint256 hashBlockFrom = blockFrom.GetHash();
+    uint256 hashBlockFrom = pindexFrom->GetBlockHash();
 
-    arith_uint256 bnCoinDayWeight = arith_uint256(nValueIn) * GetWeight((int64_t)txPrev.nTime, (int64_t)nTimeTx) / COIN / (24 * 60 * 60);
-    bnTargetProofOfStake = CBigNum(nValueIn) * GetWeight((int64_t)txPrev.nTime, (int64_t)nTimeTx) / COIN / (24 * 60 * 60) * bnTargetPerCoinDay;
+    arith_uint256 bnCoinDayWeight = arith_uint256(nValueIn) * GetWeight((int64_t)coinPrev.nTime, (int64_t)nTimeTx) / COIN / (24 * 60 * 60);
+    bnTargetProofOfStake = bnCoinDayWeight * bnTargetPerCoinDay256;
 
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
@@ -275,7 +349,7 @@ static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom,
 
     ss << nStakeModifier;
 
-    ss << nTimeBlockFrom << nTxPrevOffset << txPrev.nTime << prevout.n << nTimeTx;
+    ss << nTimeBlockFrom << nTxPrevOffset << coinPrev.nTime << prevout.n << nTimeTx;
     hashProofOfStake = Hash(ss.begin(), ss.end());
 
     if (fPrintProofOfStake)
@@ -292,7 +366,7 @@ static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom,
     }
 
     // Now check if proof-of-stake hash meets target protocol
-    if (UintToArith256(hashProofOfStake) > bnCoinDayWeight * bnTargetPerCoinDay256)
+    if (UintToArith256(hashProofOfStake) > bnTargetProofOfStake)
         return false;
     if (fDebug && !fPrintProofOfStake)
     {
@@ -330,11 +404,11 @@ static bool CheckStakeKernelHashV1(unsigned int nBits, const CBlock& blockFrom,
 //   quantities so as to generate blocks faster, degrading the system back into
 //   a proof-of-work situation.
 //
-bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, CBigNum& bnTargetProofOfStake, bool fPrintProofOfStake)
+bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const Coin& coinPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, arith_uint256& bnTargetProofOfStake, bool fPrintProofOfStake)
 {
     const Consensus::CParams& params = Params().GetConsensus();
-    if (nTimeTx < txPrev.nTime) {  // Transaction timestamp violation
-        LogPrint("miner", "[STAKE] fail: nTime violation %d %d\n", nTimeTx, txPrev.nTime);
+    if (nTimeTx < coinPrev.nTime) {  // Transaction timestamp violation
+        LogPrint("miner", "[STAKE] fail: nTime violation %d %d\n", nTimeTx, coinPrev.nTime);
         return error("CheckStakeKernelHash() : nTime violation ");
     }
 
@@ -343,16 +417,10 @@ bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigne
         return error("CheckStakeKernelHashV2() : min age violation");// %d %d %d %s", nTimeBlockFrom + params.nStakeMinAge, nTimeBlockFrom, nTimeTx, pindexPrev->ToString());
     }
 
-    // Base target
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
-
     // Weighted target
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    CBigNum bnWeight = CBigNum(nValueIn);
-    bnTarget *= bnWeight;
-
-    bnTargetProofOfStake = bnTarget;
+    int64_t nValueIn = coinPrev.out.nValue;
+    CStakeTarget target(nBits, nValueIn);
+    bnTargetProofOfStake = target.GetTarget();
 
     uint64_t nStakeModifier = pindexPrev->nStakeModifier;
     //int nStakeModifierHeight = pindexPrev->nHeight;
@@ -361,7 +429,7 @@ bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigne
 
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier << nTimeBlockFrom << txPrev.nTime << prevout.hash << prevout.n << nTimeTx;
+    ss << nStakeModifier << nTimeBlockFrom << coinPrev.nTime << prevout.hash << prevout.n << nTimeTx;
     hashProofOfStake = Hash(ss.begin(), ss.end());
 
     //if (fPrintProofOfStake)
@@ -377,20 +445,20 @@ bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigne
     //}
 
     // Now check if proof-of-stake hash meets target protocol
-    if (CBigNum(hashProofOfStake) > bnTarget) {
+    if (!target.IsMetBy(hashProofOfStake)) {
         if (GetBoolArg("-cheat", false)) {
             LogPrintf("[STAKE] CHEAT: hash %64s (%s CLAM)\n", UintToArith256(hashProofOfStake).GetHex(), FormatMoney(nValueIn));
-            LogPrintf("[STAKE]   >  target %64s\n", bnTarget.GetHex());
+            LogPrintf("[STAKE]   >  target %64s\n", target.GetHex());
         } else {
             LogPrint("miner", "[STAKE] fail: hash %64s (%s CLAM)\n", UintToArith256(hashProofOfStake).GetHex(), FormatMoney(nValueIn));
-            LogPrint("miner", "[STAKE]   > target %64s\n", bnTarget.GetHex());
+            LogPrint("miner", "[STAKE]   > target %64s\n", target.GetHex());
             return false;
         }
     }
 
     if (fPrintProofOfStake) {
         LogPrint("miner", "[STAKE] PASS: hash %64s (%s CLAM)\n", UintToArith256(hashProofOfStake).GetHex(), FormatMoney(nValueIn));
-        LogPrint("miner", "[STAKE]  <= target %64s\n", bnTarget.GetHex());
+        LogPrint("miner", "[STAKE]  <= target %64s\n", target.GetHex());
     }
 
     if (fDebug && !fPrintProofOfStake)
@@ -410,13 +478,11 @@ bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigne
 
 
 // Check kernel hash target and coinstake signature
-bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, CBigNum& bnTargetProofOfStake, CCoinsViewCache& view, CBlockTreeDB& db, const Consensus::CParams& consensusParams)
+bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, arith_uint256& bnTargetProofOfStake, CCoinsViewCache& view, CBlockTreeDB& db, const Consensus::CParams& consensusParams, bool fCheckSignature)
 {
     if (!tx.IsCoinStake())
         return error("CheckProofOfStake() : called on non-coinstake %s", tx.GetHash().ToString());
 
-    uint256 hashBlock;
-    CTransactionRef txPrevRef;
     // Kernel (input 0) must match the stake hash target (nBits)
     const CTxIn& txin = tx.vin[0];
     Coin coinPrev;
@@ -432,26 +498,19 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const C
         return state.DoS(100, error("CheckProofOfStake() : Block at height %i for prevout can not be loaded", coinPrev.nHeight));
     }
 
-    CBlock block;
-    if (!ReadBlockFromDisk(block, blockFrom, consensusParams))
-        return state.DoS(100, error("%s: CheckProofOfStake()", __func__), REJECT_INVALID, "block-not-found");
-
-    if (!GetTransaction(txin.prevout.hash, txPrevRef, Params().GetConsensus(), hashBlock, true))
-        return state.DoS(1, error("%s: prevout-not-in-chain", __func__), REJECT_INVALID, "prevout-not-in-chain");
-    const CTransaction& txPrev = *txPrevRef;
-
-    int nHeight = pindexPrev->nHeight;
-    int nTxOffset = 0;
-    pblocktree->ReadTxOffsetIndex(nHeight, nTxOffset);
-
-    // Verify signature
-    if (!VerifySignature(coinPrev, txin.prevout.hash, tx, 0, SCRIPT_VERIFY_NONE)){
-        LogPrint("miner", "CheckProofOfStake() : INFO: VerifySignature failed on coinstake %s, hashProof=%s\n", tx.GetHash().ToString(), hashProofOfStake.ToString());
-        return state.DoS(100, error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString()));
+    // Verify signature, unless the caller checks the coinstake inputs itself.
+    // A valid signature is cached for ConnectBlock's check of the same input.
+    if (fCheckSignature) {
+        PrecomputedTransactionData txdata(tx);
+        CScriptCheck check(coinPrev.out.scriptPubKey, coinPrev.out.nValue, tx, 0, SCRIPT_VERIFY_NONE, true, &txdata);
+        if (!check()) {
+            LogPrint("miner", "CheckProofOfStake() : INFO: VerifySignature failed on coinstake %s, hashProof=%s\n", tx.GetHash().ToString(), hashProofOfStake.ToString());
+            return state.DoS(100, error("CheckProofOfStake() : VerifySignature failed on coinstake %s", tx.GetHash().ToString()));
+        }
     }
 
 
-    if (!CheckStakeKernelHash(pindexPrev, nBits, block, nTxOffset, txPrev, txin.prevout, tx.nTime, hashProofOfStake, bnTargetProofOfStake, false)) {
+    if (!CheckStakeKernelHash(pindexPrev, nBits, blockFrom, coinPrev, txin.prevout, tx.nTime, hashProofOfStake, bnTargetProofOfStake, false, consensusParams)) {
         LogPrint("miner", "CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s\n", tx.GetHash().ToString(), hashProofOfStake.ToString());
         return state.DoS(1, error("CheckProofOfStake() : INFO: check kernel failed on coinstake %s, hashProof=%s", tx.GetHash().ToString(), hashProofOfStake.ToString())); // may occur during initial download or if behind on block chain sync
     }
@@ -461,13 +520,15 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const C
 
 
 
-bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, CBigNum& bnTargetProofOfStake, bool fPrintProofOfStake, const Consensus::CParams& consensusParams)
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlockIndex* pindexFrom, const Coin& coinPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, arith_uint256& bnTargetProofOfStake, bool fPrintProofOfStake, const Consensus::CParams& consensusParams)
 {
     if (pindexPrev->nHeight + 1 > consensusParams.nProtocolV2Height) {
-        return CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom.GetBlockTime(), txPrev, prevout, nTimeTx, hashProofOfStake, bnTargetProofOfStake, fPrintProofOfStake);
+        return CheckStakeKernelHashV2(pindexPrev, nBits, pindexFrom->GetBlockTime(), coinPrev, prevout, nTimeTx, hashProofOfStake, bnTargetProofOfStake, fPrintProofOfStake);
     } 
     else {
-        return CheckStakeKernelHashV1(nBits, blockFrom, nTxPrevOffset, txPrev, prevout, nTimeTx, hashProofOfStake, bnTargetProofOfStake, fPrintProofOfStake);
+        int nTxOffset = 0;
+        pblocktree->ReadTxOffsetIndex(pindexPrev->nHeight, nTxOffset);
+        return CheckStakeKernelHashV1(nBits, pindexFrom, nTxOffset, coinPrev, prevout, nTimeTx, hashProofOfStake, bnTargetProofOfStake, fPrintProofOfStake);
     }
 }
 
@@ -483,12 +544,8 @@ bool CheckCoinStakeTimestamp(int nHeight, int64_t nTimeBlock, int64_t nTimeTx)
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, const COutPoint& prevout, CCoinsViewCache& view, CBlockTreeDB& db, unsigned int txTime)
 {
     uint256 hashProofOfStake;
-    CBigNum bnTargetProofOfStake;
+    arith_uint256 bnTargetProofOfStake;
     const Consensus::CParams& params = Params().GetConsensus();
-    CValidationState state;
-
-    uint256 hashBlock;
-    CTransactionRef txPrevRef;
 
     Coin coinPrev;
     if(!view.GetCoin(prevout, coinPrev)){
@@ -504,18 +561,6 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, const COutPoint& p
         return false;
     }
 
-    CBlock block;
-    if (!ReadBlockFromDisk(block, blockFrom, params))
-        return state.DoS(100, error("%s: CheckProofOfStake()", __func__), REJECT_INVALID, "block-not-found");
-
-    int nHeight=pindexPrev->nHeight;
-    int nTxOffset=0;
-    pblocktree->ReadTxOffsetIndex(nHeight, nTxOffset);
-
-    if (!GetTransaction(prevout.hash, txPrevRef, Params().GetConsensus(), hashBlock, true))
-        return state.DoS(1, error("%s: prevout-not-in-chain", __func__), REJECT_INVALID, "prevout-not-in-chain");
-    const CTransaction& txPrev = *txPrevRef;
-
-    return CheckStakeKernelHash(pindexPrev, nBits, block, nTxOffset, txPrev, prevout,
+    return CheckStakeKernelHash(pindexPrev, nBits, blockFrom, coinPrev, prevout,
                                 txTime, hashProofOfStake, bnTargetProofOfStake, false, params);
 }
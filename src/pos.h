@@ -4,7 +4,6 @@
 #ifndef BITCOIN_POS_H
 #define BITCOIN_POS_H
 
-#include "bignum.h"
 #include "chain.h"
 #include "primitives/transaction.h"
 #include "consensus/params.h"
@@ -25,17 +24,106 @@ static const int STAKE_TIMESTAMP_MASK = 15;
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
 
+// Proof-of-stake hash target weighted by the staked value (nBits target * nValueIn).
+// Computed on fixed-width integers without allocating; a weighted target that
+// does not fit in 256 bits is met by every hash.
+class CStakeTarget
+{
+public:
+    CStakeTarget(unsigned int nBits, CAmount nValueIn);
+
+    bool IsMetBy(const uint256& hashProofOfStake) const
+    {
+        if (fNegative)
+            return false;
+        return fOverflow || UintToArith256(hashProofOfStake) <= bnTarget;
+    }
+
+    // Weighted target, saturated to 2^256-1 on overflow
+    arith_uint256 GetTarget() const;
+    std::string GetHex() const;
+
+private:
+    arith_uint256 bnTarget;
+    bool fNegative;
+    bool fOverflow;
+};
+
+// Candidate blocks for the stake modifier selection, kept sorted by timestamp
+// from one modifier interval to the next. Extending the chain tip only merges
+// the new blocks in and drops those that left the selection interval, and the
+// selection hash of each candidate is computed once per previous modifier
+// rather than once per selection round. Any other move of pindexPrev, as in a
+// reorganisation, rebuilds the window from scratch.
+class CStakeModifierEngine
+{
+public:
+    struct Stats
+    {
+        uint64_t nRebuilds;
+        uint64_t nCandidatesAdded;
+        uint64_t nSelectionHashes;
+        uint64_t nSelectionHashesReused;
+    };
+
+    CStakeModifierEngine();
+
+    // Select the 64 blocks whose entropy bits make the modifier generated
+    // after pindexPrev, nStakeModifierPrev being the last generated one
+    bool ComputeModifier(const CBlockIndex* pindexPrev, uint64_t nStakeModifierPrev, uint64_t& nStakeModifierNew);
+
+    // Forget the window; required before the block index entries are freed
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Candidate
+    {
+        int64_t nTime;
+        uint256 hashBlock;
+        const CBlockIndex* pindex;
+        // memoized selection hash and what it was computed from
+        bool fHashed;
+        uint256 hashProof;
+        uint64_t nStakeModifierHashed;
+        uint256 hashSelection;
+
+        explicit Candidate(const CBlockIndex* pindexIn) : nTime(pindexIn->GetBlockTime()), hashBlock(pindexIn->GetBlockHash()), pindex(pindexIn), fHashed(false), nStakeModifierHashed(0) {}
+
+        bool operator<(const Candidate& other) const
+        {
+            return nTime < other.nTime || (nTime == other.nTime && hashBlock < other.hashBlock);
+        }
+    };
+
+    mutable CCriticalSection cs;
+    std::vector<Candidate> vCandidates;
+    std::vector<char> vSelected;
+    // newest and lowest block of the window
+    const CBlockIndex* pindexLast;
+    int nHeightStart;
+    Stats stats;
+
+    void UpdateWindow(const CBlockIndex* pindexPrev, int64_t nSelectionIntervalStart);
+    const uint256& GetSelectionHash(Candidate& candidate, uint64_t nStakeModifierPrev);
+};
+
+extern CStakeModifierEngine stakeModifierEngine;
+
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
-bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, CBigNum& bnTargetProofOfStake, bool fPrintProofOfStake=false, const Consensus::CParams& consensusParams = Params().GetConsensus());
-bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, CBigNum& bnTargetProofOfStake, bool fPrintProofOfStake);
+// The staked coin comes from the UTXO view and pindexFrom is the block that created it
+bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, const CBlockIndex* pindexFrom, const Coin& coinPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, arith_uint256& bnTargetProofOfStake, bool fPrintProofOfStake=false, const Consensus::CParams& consensusParams = Params().GetConsensus());
+bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const Coin& coinPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, arith_uint256& bnTargetProofOfStake, bool fPrintProofOfStake);
 
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
-bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, CBigNum& bnTargetProofOfStake, CCoinsViewCache& view, CBlockTreeDB& db, const Consensus::CParams& consensusParams = Params().GetConsensus());
+// Without fCheckSignature the caller verifies the coinstake signature with the other inputs of the block
+bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake, arith_uint256& bnTargetProofOfStake, CCoinsViewCache& view, CBlockTreeDB& db, const Consensus::CParams& consensusParams = Params().GetConsensus(), bool fCheckSignature = true);
 
 // Check whether the coinstake timestamp meets protocol
 bool CheckCoinStakeTimestamp(int nHeight, int64_t nTimeBlock, int64_t nTimeTx);
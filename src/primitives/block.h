@@ -326,6 +326,42 @@ public:
     std::string ToString() const;
 };
 
+/**
+ * Serializes a CBlock in the legacy layout of the block files and of peers
+ * up to protocol version 70012: the header without prevoutStake, the
+ * transactions, then the block signature. It reads and writes the block's
+ * own fields, so no CBlockLegacy copy of the header and transactions is made.
+ */
+class CBlockLegacyFormat
+{
+protected:
+    CBlock& block;
+public:
+    explicit CBlockLegacyFormat(CBlock& blockIn) : block(blockIn) { }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << block.nVersion << block.hashPrevBlock << block.hashMerkleRoot << block.nTime << block.nBits << block.nNonce;
+        s << block.vtx << block.vchBlockSig;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        block.SetNull();
+        block.blockHash.SetNull();
+        s >> block.nVersion >> block.hashPrevBlock >> block.hashMerkleRoot >> block.nTime >> block.nBits >> block.nNonce;
+        s >> block.vtx >> block.vchBlockSig;
+
+        // The legacy header has no prevoutStake, it is the coinstake's first input
+        if (block.IsProofOfStake())
+            block.prevoutStake = block.vtx[1]->vin[0].prevout;
+    }
+};
+
+#define LEGACY_BLOCK(obj) REF(CBlockLegacyFormat(REF(obj)))
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
@@ -13,6 +13,7 @@
 #include "transactiontablemodel.h"
 
 #include "base58.h"
+#include "clamour.h"
 #include "keystore.h"
 #include "validation.h"
 #include "net.h" // for g_connman
@@ -635,21 +636,11 @@ void WalletModel::sendClamourTx(std::string hash)
 void WalletModel::getPetitionSupport(int nWindow)
 {
     std::map<std::string, int> mapSupport;
-    int nBlock = chainActive.Height();
-    for (int i = nBlock + 1 - nWindow; i <= nBlock; i++) {
-        
-        const Consensus::CParams& consensusParams = Params().GetConsensus();
-        CBlockIndex* pblockindex = chainActive.Tip()->GetAncestor(i);
-        CBlock block;
-        
-        if (!ReadBlockFromDisk(block, pblockindex, consensusParams))
+    {
+        LOCK(cs_main);
+        int nBlock = chainActive.Height();
+        if (!clamourSupport.GetSupport(std::max(0, nBlock + 1 - nWindow), nBlock, mapSupport))
             return;
-
-
-        std::set<std::string> sup = pblockindex->GetSupport(block);
-        BOOST_FOREACH(const std::string &s, sup) {
-            mapSupport[s]++;
-        }
     }
     Q_EMIT petitionSupportRetrieved(mapSupport);
 }
@@ -213,7 +213,7 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
+    std::shared_ptr<const CBlock> pblock;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -224,9 +224,10 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (!ReadBlockFromDisk(pblock, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
+    const CBlock& block = *pblock;
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     ssBlock << block;
@@ -302,6 +303,120 @@ static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+// A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
+UniValue searchclamspeech(const JSONRPCRequest& request);
+
+static bool rest_speech(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/speech/<count>/<skip>/<term>+<term>....<ext>.");
+
+    // The range of both is checked by searchclamspeech
+    int count, skip;
+    if (!ParseInt32(path[0], &count))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid result count: " + path[0]);
+    if (!ParseInt32(path[1], &skip))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid result skip: " + path[1]);
+
+    // Terms are joined by '+', as in a query string, so a literal '+' is %2B
+    std::string strQuery = path[2];
+    std::replace(strQuery.begin(), strQuery.end(), '+', ' ');
+    strQuery = urlDecode(strQuery);
+
+    switch (rf) {
+    case RF_JSON: {
+        JSONRPCRequest jsonRequest;
+        jsonRequest.params = UniValue(UniValue::VARR);
+        jsonRequest.params.push_back(strQuery);
+        jsonRequest.params.push_back(count);
+        jsonRequest.params.push_back(skip);
+        UniValue speechObject;
+        try {
+            speechObject = searchclamspeech(jsonRequest);
+        } catch (const UniValue& objError) {
+            return RESTERR(req, HTTP_BAD_REQUEST, find_value(objError, "message").get_str());
+        }
+        std::string strJSON = speechObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+// A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
+UniValue getstakerstats(const JSONRPCRequest& request);
+
+static bool rest_stakerstats(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2 && path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/stakerstats/<fromheight>/<toheight>[/<window>+<window>...].<ext>.");
+
+    long fromheight = strtol(path[0].c_str(), NULL, 10);
+    long toheight = strtol(path[1].c_str(), NULL, 10);
+    if (fromheight < 0 || toheight < fromheight || toheight > std::numeric_limits<int>::max())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block height out of range: " + path[0] + "/" + path[1]);
+
+    UniValue windows(UniValue::VARR);
+    if (path.size() == 3) {
+        std::vector<std::string> vWindows;
+        boost::split(vWindows, path[2], boost::is_any_of("+"));
+        for (const std::string& strWindow : vWindows) {
+            long window = strtol(strWindow.c_str(), NULL, 10);
+            if (window < 1 || window > std::numeric_limits<int>::max())
+                return RESTERR(req, HTTP_BAD_REQUEST, "Window size out of range: " + strWindow);
+            windows.push_back((int)window);
+        }
+    }
+
+    switch (rf) {
+    case RF_JSON: {
+        JSONRPCRequest jsonRequest;
+        jsonRequest.params = UniValue(UniValue::VARR);
+        jsonRequest.params.push_back((int)fromheight);
+        jsonRequest.params.push_back((int)toheight);
+        jsonRequest.params.push_back(0);
+        jsonRequest.params.push_back(windows);
+        UniValue statsObject;
+        try {
+            statsObject = getstakerstats(jsonRequest);
+        } catch (const UniValue& objError) {
+            return RESTERR(req, HTTP_BAD_REQUEST, find_value(objError, "message").get_str());
+        }
+        std::string strJSON = statsObject.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static bool rest_mempool_info(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -603,6 +718,8 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/speech/", rest_speech},
+      {"/rest/stakerstats/", rest_stakerstats},
 };
 
 bool StartREST()
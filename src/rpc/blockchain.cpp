@@ -21,6 +21,10 @@
 #include "util.h"
 #include "utilstrencodings.h"
 #include "hash.h"
+#include "notary.h"
+#include "speechindex.h"
+#include "stakeindex.h"
+#include "addressindex.h"
 
 #include "pos.h"
 #include "txdb.h"
@@ -178,7 +182,7 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("modifier", blockindex->nStakeModifier));
 
     UniValue clamours(UniValue::VARR);
-    BOOST_FOREACH (const CClamour& clamour, blockindex->vClamour)
+    BOOST_FOREACH (const CClamour& clamour, blockindex->GetClamours())
     {
         UniValue entry(UniValue::VOBJ);
         entry.push_back(Pair("txid", clamour.txid.GetHex()));
@@ -230,9 +234,8 @@ UniValue dumpbootstrap(const JSONRPCRequest& request)
             if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
                 throw runtime_error("Error: Failed to read block from disk");
 
-            CBlockLegacy legacyBlock(block);
-            unsigned int nSize = GetSerializeSize(file, legacyBlock);
-            file << FLATDATA(Params().MessageStart()) << nSize << legacyBlock;
+            unsigned int nSize = GetSerializeSize(file, LEGACY_BLOCK(block));
+            file << FLATDATA(Params().MessageStart()) << nSize << LEGACY_BLOCK(block);
         }
     } catch(const boost::filesystem::filesystem_error &e) {
         throw JSONRPCError(RPC_MISC_ERROR, "Error: Bootstrap dump failed!");
@@ -923,19 +926,20 @@ UniValue getblock(const JSONRPCRequest& request)
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
+    std::shared_ptr<const CBlock> pblock;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
 
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    if(!ReadBlockFromDisk(pblock, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    const CBlock& block = *pblock;
 
     if (verbosity <= 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << CBlockLegacy(block);
+        ssBlock << LEGACY_BLOCK(block);
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
@@ -1612,6 +1616,474 @@ UniValue reconsiderblock(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+UniValue getnotarytransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "getnotarytransactions [\"notaryid\",...]\n"
+            "\nLooks up the transactions notarizing each of a list of hashes in the notary index.\n"
+            "Requires -notaryindex, and the index to be fully built.\n"
+            "\nArguments:\n"
+            "1. \"notaryids\"   (array, required) The notarized hashes, at most " + strprintf("%u", MAX_NOTARY_LOOKUPS) + "\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"notaryid\" : [          (array) The transactions notarizing the hash, most recent first; empty if none\n"
+            "    {\n"
+            "      \"txid\" : \"hash\",      (string) The transaction id\n"
+            "      \"height\" : n,          (numeric) The height of the block with the transaction\n"
+            "      \"blockhash\" : \"hash\"  (string) The hash of that block\n"
+            "    }, ...\n"
+            "  ], ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnotarytransactions", "\"[\\\"notaryid\\\",\\\"notaryid\\\"]\"")
+            + HelpExampleRpc("getnotarytransactions", "[\"notaryid\",\"notaryid\"]")
+        );
+
+    const UniValue& ids = request.params[0].get_array();
+    if (ids.size() > MAX_NOTARY_LOOKUPS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u notary ids can be looked up at once", MAX_NOTARY_LOOKUPS));
+
+    // The notary index entries of the blocks connected since the last write of the
+    // block index are still in memory; a copy of them is merged into what is read
+    CPendingNotaryIndex pending;
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        if (!fNotaryIndex)
+            throw JSONRPCError(RPC_MISC_ERROR, "The notary index is not enabled, restart with -notaryindex");
+        if (!IsNotaryIndexComplete())
+            throw JSONRPCError(RPC_MISC_ERROR, "The notary index is still being built");
+        pending = pendingNotaryIndex;
+        pindexTip = chainActive.Tip();
+    }
+
+    UniValue result(UniValue::VOBJ);
+    for (unsigned int i = 0; i < ids.size(); i++) {
+        uint256 hash = ParseHashV(ids[i], "notaryid");
+        std::vector<std::pair<uint256, int> > vTx;
+        if (!FindNotaryTransactions(hash, pending, vTx))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the notary index");
+
+        UniValue entries(UniValue::VARR);
+        for (const auto& tx : vTx) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("txid", tx.first.GetHex()));
+            entry.push_back(Pair("height", tx.second));
+            if (tx.second <= pindexTip->nHeight)
+                entry.push_back(Pair("blockhash", pindexTip->GetAncestor(tx.second)->GetBlockHash().GetHex()));
+            entries.push_back(entry);
+        }
+        result.push_back(Pair(hash.GetHex(), entries));
+    }
+    return result;
+}
+
+UniValue searchclamspeech(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw runtime_error(
+            "searchclamspeech \"query\" ( count skip )\n"
+            "\nSearches the CLAMspeech of the transactions in the active chain.\n"
+            "Requires -speechindex, and the index to be fully built.\n"
+            "\nArguments:\n"
+            "1. \"query\"   (string, required) Space separated terms, all of which must match: a word,\n"
+            "               the start of a word followed by * (at least " + strprintf("%u", MIN_SPEECH_PREFIX_LENGTH) + " characters),\n"
+            "               \"clamour:<petition id>\" or \"createclamour:<petition id>\"\n"
+            "2. count     (numeric, optional, default=" + strprintf("%u", DEFAULT_SPEECH_SEARCH_RESULTS) + ") The number of results to return, at most " + strprintf("%u", MAX_SPEECH_SEARCH_RESULTS) + "\n"
+            "3. skip      (numeric, optional, default=0) The number of results to skip\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"total\" : n,              (numeric) The number of matching transactions\n"
+            "  \"results\" : [             (array) The matching transactions, most recent first\n"
+            "    {\n"
+            "      \"txid\" : \"hash\",      (string) The transaction id\n"
+            "      \"height\" : n,          (numeric) The height of the block with the transaction\n"
+            "      \"blockhash\" : \"hash\", (string) The hash of that block\n"
+            "      \"time\" : n,            (numeric) The block time in seconds since epoch (Jan 1 1970 GMT)\n"
+            "      \"speech\" : \"text\"     (string) The CLAMspeech of the transaction\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("searchclamspeech", "\"hello wor*\" 10")
+            + HelpExampleRpc("searchclamspeech", "\"clamour:a0b1c2d3\", 10, 20")
+        );
+
+    std::string strQuery = request.params[0].get_str();
+    int nCount = DEFAULT_SPEECH_SEARCH_RESULTS;
+    if (request.params.size() > 1)
+        nCount = request.params[1].get_int();
+    if (nCount < 0 || nCount > (int)MAX_SPEECH_SEARCH_RESULTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 0 and %u", MAX_SPEECH_SEARCH_RESULTS));
+    int nSkip = 0;
+    if (request.params.size() > 2)
+        nSkip = request.params[2].get_int();
+    if (nSkip < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative skip");
+
+    // The matches, and the blocks of those returned, are found under cs_main;
+    // the blocks are read after it is released
+    std::vector<CSpeechMatch> vMatches;
+    std::vector<std::pair<CSpeechMatch, const CBlockIndex*> > vResults;
+    {
+        LOCK(cs_main);
+        if (!fSpeechIndex)
+            throw JSONRPCError(RPC_MISC_ERROR, "The speech index is not enabled, restart with -speechindex");
+        if (!IsSpeechIndexComplete())
+            throw JSONRPCError(RPC_MISC_ERROR, "The speech index is still being built");
+
+        std::string strError;
+        if (!SearchSpeechIndex(strQuery, vMatches, strError))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strError);
+
+        for (size_t i = nSkip; i < vMatches.size() && i < (size_t)nSkip + nCount; i++)
+            vResults.push_back(std::make_pair(vMatches[i], vMatches[i].nHeight <= chainActive.Height() ? chainActive[vMatches[i].nHeight] : NULL));
+    }
+
+    UniValue results(UniValue::VARR);
+    for (const auto& hit : vResults) {
+        const CSpeechMatch& match = hit.first;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", match.txid.GetHex()));
+        entry.push_back(Pair("height", match.nHeight));
+        if (const CBlockIndex* pblockindex = hit.second) {
+            entry.push_back(Pair("blockhash", pblockindex->GetBlockHash().GetHex()));
+            entry.push_back(Pair("time", pblockindex->GetBlockTime()));
+
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+                throw JSONRPCError(RPC_MISC_ERROR, "Can't read block from disk");
+            if (match.nTx < block.vtx.size() && block.vtx[match.nTx]->GetHash() == match.txid)
+                entry.push_back(Pair("speech", block.vtx[match.nTx]->strClamSpeech));
+        }
+        results.push_back(entry);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("total", (uint64_t)vMatches.size()));
+    result.push_back(Pair("results", results));
+    return result;
+}
+
+UniValue getstakerstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 4)
+        throw runtime_error(
+            "getstakerstats ( fromheight toheight count [window,...] )\n"
+            "\nReturns the blocks staked by each staker in a range of the active chain, from the stake index.\n"
+            "\nArguments:\n"
+            "1. fromheight  (numeric, optional, default=the last " + strprintf("%d", DEFAULT_STAKER_STATS_BLOCKS) + " blocks) The first height to include\n"
+            "2. toheight    (numeric, optional, default=the tip) The last height to include\n"
+            "3. count       (numeric, optional, default=" + strprintf("%d", DEFAULT_STAKER_STATS_COUNT) + ") The number of stakers to return, most blocks first, 0 for all\n"
+            "4. windows     (array, optional) Sizes in blocks of rolling windows ending at toheight, at most " + strprintf("%u", MAX_STAKER_STATS_WINDOWS) + "\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"fromheight\" : n,      (numeric) The first height included\n"
+            "  \"toheight\" : n,        (numeric) The last height included\n"
+            "  \"blocks\" : n,          (numeric) The number of blocks read from the stake index\n"
+            "  \"stakeblocks\" : n,     (numeric) The number of proof-of-stake blocks among them\n"
+            "  \"stakers\" : n,         (numeric) The number of distinct stakers\n"
+            "  \"windows\" : [          (array) For each rolling window\n"
+            "    {\n"
+            "      \"blocks\" : n,      (numeric) The size of the window\n"
+            "      \"stakeblocks\" : n  (numeric) The number of proof-of-stake blocks in it\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"results\" : [          (array) The stakers\n"
+            "    {\n"
+            "      \"address\" : \"addr\", (string) The address of the staking key\n"
+            "      \"blocks\" : n,        (numeric) The number of blocks staked\n"
+            "      \"share\" : x.xxx,     (numeric) The fraction of the proof-of-stake blocks staked\n"
+            "      \"firstheight\" : n,   (numeric) The height of the first block staked\n"
+            "      \"lastheight\" : n,    (numeric) The height of the last block staked\n"
+            "      \"windows\" : [n,...]  (array) The number of blocks staked in each rolling window\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakerstats", "")
+            + HelpExampleCli("getstakerstats", "1500000 1510079 10 \"[60, 1440]\"")
+            + HelpExampleRpc("getstakerstats", "1500000, 1510079, 10, [60, 1440]")
+        );
+
+    // The stake index entries of the blocks connected since the last write of the
+    // block index are still in memory, and are merged into what is read
+    int nHeightEnd;
+    CHeightIndexUpdates pending;
+    {
+        LOCK(cs_main);
+        nHeightEnd = chainActive.Height();
+        GetPendingStakeIndex(pending);
+    }
+    if (request.params.size() > 1)
+        nHeightEnd = std::min(nHeightEnd, request.params[1].get_int());
+    int nHeightStart = std::max(0, nHeightEnd - DEFAULT_STAKER_STATS_BLOCKS + 1);
+    if (request.params.size() > 0)
+        nHeightStart = request.params[0].get_int();
+    if (nHeightStart < 0 || nHeightStart > nHeightEnd)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    int nCount = DEFAULT_STAKER_STATS_COUNT;
+    if (request.params.size() > 2)
+        nCount = request.params[2].get_int();
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    std::vector<int> vWindows;
+    if (request.params.size() > 3) {
+        const UniValue& windows = request.params[3].get_array();
+        if (windows.size() > MAX_STAKER_STATS_WINDOWS)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u windows", MAX_STAKER_STATS_WINDOWS));
+        for (size_t i = 0; i < windows.size(); i++) {
+            vWindows.push_back(windows[i].get_int());
+            if (vWindows.back() < 1)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Window sizes must be positive");
+        }
+    }
+
+    // The index is read without cs_main, so a reorganization meanwhile may show in the result
+    CStakeIndexStats stats;
+    if (!GetStakeIndexStats(*pblocktree, nHeightStart, nHeightEnd, vWindows, pending, stats))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Can't read the stake index");
+
+    std::vector<std::pair<int, const std::pair<const uint160, CStakerStats>*> > vStakers;
+    for (const auto& entry : stats.mapStakers)
+        vStakers.push_back(std::make_pair(-entry.second.nBlocks, &entry));
+    std::sort(vStakers.begin(), vStakers.end());
+    if (nCount > 0 && vStakers.size() > (size_t)nCount)
+        vStakers.resize(nCount);
+
+    UniValue windows(UniValue::VARR);
+    for (size_t i = 0; i < vWindows.size(); i++) {
+        UniValue window(UniValue::VOBJ);
+        window.push_back(Pair("blocks", vWindows[i]));
+        window.push_back(Pair("stakeblocks", stats.vWindowStakeBlocks[i]));
+        windows.push_back(window);
+    }
+    UniValue results(UniValue::VARR);
+    for (const auto& item : vStakers) {
+        const CStakerStats& stakerStats = item.second->second;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("address", CBitcoinAddress(CKeyID(item.second->first)).ToString()));
+        entry.push_back(Pair("blocks", stakerStats.nBlocks));
+        entry.push_back(Pair("share", (double)stakerStats.nBlocks / stats.nStakeBlocks));
+        entry.push_back(Pair("firstheight", stakerStats.nFirstHeight));
+        entry.push_back(Pair("lastheight", stakerStats.nLastHeight));
+        UniValue windowBlocks(UniValue::VARR);
+        for (int nBlocks : stakerStats.vWindowBlocks)
+            windowBlocks.push_back(nBlocks);
+        entry.push_back(Pair("windows", windowBlocks));
+        results.push_back(entry);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("fromheight", nHeightStart));
+    result.push_back(Pair("toheight", nHeightEnd));
+    result.push_back(Pair("blocks", stats.nBlocks));
+    result.push_back(Pair("stakeblocks", stats.nStakeBlocks));
+    result.push_back(Pair("stakers", (uint64_t)stats.mapStakers.size()));
+    result.push_back(Pair("windows", windows));
+    result.push_back(Pair("results", results));
+    return result;
+}
+
+/** The distinct addresses of an address index call, as the index keys them */
+static std::vector<CAddressIndexPrefix> ParseAddressIndexAddresses(const UniValue& params)
+{
+    const UniValue& addresses = params.get_array();
+    if (addresses.size() > MAX_ADDRESS_LOOKUPS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u addresses can be looked up at once", MAX_ADDRESS_LOOKUPS));
+
+    std::set<CAddressIndexPrefix> setAddresses;
+    std::vector<CAddressIndexPrefix> vAddresses;
+    for (unsigned int i = 0; i < addresses.size(); i++) {
+        CBitcoinAddress address(addresses[i].get_str());
+        CAddressIndexPrefix prefix;
+        if (!address.IsValid() || !GetAddressIndexPrefix(address.Get(), prefix))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid CLAM address: " + addresses[i].get_str());
+        if (setAddresses.insert(prefix).second)
+            vAddresses.push_back(prefix);
+    }
+    return vAddresses;
+}
+
+static void CheckAddressIndex()
+{
+    if (!fAddressIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "The address index is not enabled, restart with -addressindex");
+    if (!IsAddressIndexComplete())
+        throw JSONRPCError(RPC_MISC_ERROR, "The address index is still being built");
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 5)
+        throw runtime_error(
+            "getaddresstxids [\"address\",...] ( fromheight toheight count skip )\n"
+            "\nReturns the transactions paying to or spending from any of a list of addresses, in chain order.\n"
+            "Requires -addressindex, and the index to be fully built.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"  (array, required) The addresses, at most " + strprintf("%u", MAX_ADDRESS_LOOKUPS) + "\n"
+            "2. fromheight   (numeric, optional, default=0) The first height to include\n"
+            "3. toheight     (numeric, optional, default=the tip) The last height to include\n"
+            "4. count        (numeric, optional, default=" + strprintf("%u", DEFAULT_ADDRESS_RESULTS) + ") The number of transactions to return, at most " + strprintf("%u", MAX_ADDRESS_RESULTS) + "\n"
+            "5. skip         (numeric, optional, default=0) The number of transactions to skip, at most " + strprintf("%u", MAX_ADDRESS_SKIP) + "; use fromheight to page further\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",      (string) The transaction id\n"
+            "    \"height\" : n,          (numeric) The height of the block with the transaction\n"
+            "    \"blockhash\" : \"hash\"  (string) The hash of that block\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "\"[\\\"address\\\",\\\"address\\\"]\"")
+            + HelpExampleCli("getaddresstxids", "\"[\\\"address\\\"]\" 1500000 1510000 100 200")
+            + HelpExampleRpc("getaddresstxids", "[\"address\",\"address\"], 1500000")
+        );
+
+    std::vector<CAddressIndexPrefix> vAddresses = ParseAddressIndexAddresses(request.params[0]);
+    int nHeightStart = 0;
+    if (request.params.size() > 1)
+        nHeightStart = request.params[1].get_int();
+    int nHeightEnd = std::numeric_limits<int>::max();
+    if (request.params.size() > 2)
+        nHeightEnd = request.params[2].get_int();
+    if (nHeightStart < 0 || nHeightEnd < nHeightStart)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    int nCount = DEFAULT_ADDRESS_RESULTS;
+    if (request.params.size() > 3)
+        nCount = request.params[3].get_int();
+    if (nCount < 0 || nCount > (int)MAX_ADDRESS_RESULTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 0 and %u", MAX_ADDRESS_RESULTS));
+    int nSkip = 0;
+    if (request.params.size() > 4)
+        nSkip = request.params[4].get_int();
+    if (nSkip < 0 || nSkip > (int)MAX_ADDRESS_SKIP)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("skip must be between 0 and %u", MAX_ADDRESS_SKIP));
+
+    LOCK(cs_main);
+    CheckAddressIndex();
+
+    std::vector<std::pair<uint256, int> > vTx;
+    if (!FindAddressTransactions(vAddresses, nHeightStart, nHeightEnd, nSkip, nCount, vTx))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+
+    UniValue result(UniValue::VARR);
+    for (const auto& tx : vTx) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", tx.first.GetHex()));
+        entry.push_back(Pair("height", tx.second));
+        if (tx.second <= chainActive.Height())
+            entry.push_back(Pair("blockhash", chainActive[tx.second]->GetBlockHash().GetHex()));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance [\"address\",...]\n"
+            "\nReturns the total of the unspent outputs of a list of addresses in the active chain.\n"
+            "Requires -addressindex, and the index to be fully built.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"  (array, required) The addresses, at most " + strprintf("%u", MAX_ADDRESS_LOOKUPS) + "\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : x.xxx,  (numeric) The total of the unspent outputs in " + CURRENCY_UNIT + "\n"
+            "  \"utxos\" : n         (numeric) The number of unspent outputs\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "\"[\\\"address\\\",\\\"address\\\"]\"")
+            + HelpExampleRpc("getaddressbalance", "[\"address\",\"address\"]")
+        );
+
+    std::vector<CAddressIndexPrefix> vAddresses = ParseAddressIndexAddresses(request.params[0]);
+
+    LOCK(cs_main);
+    CheckAddressIndex();
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vEntries;
+    if (!FindAddressUnspent(vAddresses, MAX_ADDRESS_BALANCE_OUTPUTS, vEntries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+    if (vEntries.size() > MAX_ADDRESS_BALANCE_OUTPUTS)
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("The addresses have more than %u unspent outputs", MAX_ADDRESS_BALANCE_OUTPUTS));
+
+    CAmount nBalance = 0;
+    for (const auto& entry : vEntries)
+        nBalance += entry.second.nValue;
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(nBalance)));
+    result.push_back(Pair("utxos", (uint64_t)vEntries.size()));
+    return result;
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw runtime_error(
+            "getaddressutxos [\"address\",...] ( count skip )\n"
+            "\nReturns the unspent outputs of a list of addresses in the active chain, by address and txid.\n"
+            "Requires -addressindex, and the index to be fully built.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"  (array, required) The addresses, at most " + strprintf("%u", MAX_ADDRESS_LOOKUPS) + "\n"
+            "2. count        (numeric, optional, default=" + strprintf("%u", DEFAULT_ADDRESS_RESULTS) + ") The number of outputs to return, at most " + strprintf("%u", MAX_ADDRESS_RESULTS) + "\n"
+            "3. skip         (numeric, optional, default=0) The number of outputs to skip, at most " + strprintf("%u", MAX_ADDRESS_SKIP) + "\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"addr\",   (string) The address paid\n"
+            "    \"txid\" : \"hash\",      (string) The transaction id\n"
+            "    \"vout\" : n,            (numeric) The output number\n"
+            "    \"amount\" : x.xxx,      (numeric) The value of the output in " + CURRENCY_UNIT + "\n"
+            "    \"scriptPubKey\" : \"hex\", (string) The script of the output\n"
+            "    \"height\" : n,          (numeric) The height of the block with the transaction\n"
+            "    \"confirmations\" : n   (numeric) The number of confirmations\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "\"[\\\"address\\\",\\\"address\\\"]\"")
+            + HelpExampleRpc("getaddressutxos", "[\"address\"], 100, 200")
+        );
+
+    std::vector<CAddressIndexPrefix> vAddresses = ParseAddressIndexAddresses(request.params[0]);
+    int nCount = DEFAULT_ADDRESS_RESULTS;
+    if (request.params.size() > 1)
+        nCount = request.params[1].get_int();
+    if (nCount < 0 || nCount > (int)MAX_ADDRESS_RESULTS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 0 and %u", MAX_ADDRESS_RESULTS));
+    int nSkip = 0;
+    if (request.params.size() > 2)
+        nSkip = request.params[2].get_int();
+    if (nSkip < 0 || nSkip > (int)MAX_ADDRESS_SKIP)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("skip must be between 0 and %u", MAX_ADDRESS_SKIP));
+
+    LOCK(cs_main);
+    CheckAddressIndex();
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vEntries;
+    if (nCount > 0 && !FindAddressUnspent(vAddresses, (size_t)nSkip + nCount - 1, vEntries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = nSkip; i < vEntries.size() && i < (size_t)nSkip + nCount; i++) {
+        const CAddressUnspentKey& key = vEntries[i].first;
+        const CAddressUnspentValue& value = vEntries[i].second;
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("address", CBitcoinAddress(GetAddressIndexDestination(key.address)).ToString()));
+        entry.push_back(Pair("txid", key.txid.GetHex()));
+        entry.push_back(Pair("vout", (int)key.nIndex));
+        entry.push_back(Pair("amount", ValueFromAmount(value.nValue)));
+        entry.push_back(Pair("scriptPubKey", HexStr(value.scriptPubKey.begin(), value.scriptPubKey.end())));
+        entry.push_back(Pair("height", value.nHeight));
+        entry.push_back(Pair("confirmations", chainActive.Height() - value.nHeight + 1));
+        result.push_back(entry);
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ ----------
@@ -1634,6 +2106,12 @@ static const CRPCCommand commands[] =
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
     { "blockchain",         "verifychain",            &verifychain,            true,  {"checklevel","nblocks"} },
     { "blockchain",         "dumpbootstrap",          &dumpbootstrap,          true,  {"destination", "endblock", "startblock"} },
+    { "blockchain",         "getnotarytransactions",  &getnotarytransactions,  true,  {"notaryids"} },
+    { "blockchain",         "searchclamspeech",       &searchclamspeech,       true,  {"query","count","skip"} },
+    { "blockchain",         "getstakerstats",         &getstakerstats,         true,  {"fromheight","toheight","count","windows"} },
+    { "blockchain",         "getaddresstxids",        &getaddresstxids,        true,  {"addresses","fromheight","toheight","count","skip"} },
+    { "blockchain",         "getaddressbalance",      &getaddressbalance,      true,  {"addresses"} },
+    { "blockchain",         "getaddressutxos",        &getaddressutxos,        true,  {"addresses","count","skip"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          true,  {"blockhash"} },
     { "blockchain",         "invalidateblock",        &invalidateblock,        true,  {"blockhash"} },
@@ -99,10 +99,29 @@ static const CRPCConvertParam vRPCConvertParams[] =
 
     { "getstakedbyaddress", 1, "address" },
     { "getstakedbyaddress", 2, "minconf" },
+    { "getstakerewards", 1, "fromheight" },
+    { "getstakerewards", 2, "toheight" },
+    { "getstakerewards", 3, "perday" },
     { "createclamour", 1, "purposal" },
     { "sendnotarytransaction", 1, "file" },
     { "getnotarytransaction", 1, "notary_id" },
     { "getnotarytransaction", 2, "multiple_results" },
+    { "getnotarytransactions", 0, "notaryids" },
+    { "searchclamspeech", 1, "count" },
+    { "searchclamspeech", 2, "skip" },
+    { "getstakerstats", 0, "fromheight" },
+    { "getstakerstats", 1, "toheight" },
+    { "getstakerstats", 2, "count" },
+    { "getstakerstats", 3, "windows" },
+    { "getaddresstxids", 0, "addresses" },
+    { "getaddresstxids", 1, "fromheight" },
+    { "getaddresstxids", 2, "toheight" },
+    { "getaddresstxids", 3, "count" },
+    { "getaddresstxids", 4, "skip" },
+    { "getaddressbalance", 0, "addresses" },
+    { "getaddressutxos", 0, "addresses" },
+    { "getaddressutxos", 1, "count" },
+    { "getaddressutxos", 2, "skip" },
     { "setcombineany", 0, "state" },
 
     
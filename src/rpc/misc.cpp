@@ -4,9 +4,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockcache.h"
+#include "chain.h"
+#include "clamour.h"
 #include "clamspeech.h"
 #include "clientversion.h"
 #include "init.h"
+#include "memusage.h"
 #include "validation.h"
 #include "net.h"
 #include "netbase.h"
@@ -491,6 +495,41 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCBlockCacheInfo()
+{
+    CBlockCache::Stats stats = blockcache.GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("usage", uint64_t(stats.nUsage)));
+    obj.push_back(Pair("max", uint64_t(stats.nMaxUsage)));
+    obj.push_back(Pair("entries", uint64_t(stats.nEntries)));
+    obj.push_back(Pair("shards", uint64_t(stats.nShards)));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("evictions", stats.nEvictions));
+    return obj;
+}
+
+static UniValue RPCBlockIndexInfo()
+{
+    CBlockIndexArena::Stats stats = blockIndexArena.GetStats();
+    size_t nMapUsage;
+    {
+        LOCK(cs_main);
+        nMapUsage = memusage::DynamicUsage(mapBlockIndex);
+    }
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("usage", uint64_t(stats.nEntryUsage + stats.nSigUsage + stats.nClamourUsage + nMapUsage)));
+    obj.push_back(Pair("entries", uint64_t(stats.nEntries)));
+    obj.push_back(Pair("entry_size", uint64_t(sizeof(CBlockIndex))));
+    obj.push_back(Pair("entries_usage", uint64_t(stats.nEntryUsage)));
+    obj.push_back(Pair("signatures", uint64_t(stats.nSigBytes)));
+    obj.push_back(Pair("signatures_usage", uint64_t(stats.nSigUsage)));
+    obj.push_back(Pair("clamour_entries", uint64_t(stats.nClamours)));
+    obj.push_back(Pair("clamour_usage", uint64_t(stats.nClamourUsage)));
+    obj.push_back(Pair("map_usage", uint64_t(nMapUsage)));
+    return obj;
+}
+
 UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -509,6 +548,26 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"blockcache\": {           (json object) Information about the cache of blocks read from disk\n"
+            "    \"usage\": xxxxx,         (numeric) Number of bytes used\n"
+            "    \"max\": xxxxx,           (numeric) Maximum number of bytes used (-blockcachesize)\n"
+            "    \"entries\": xxxxx,       (numeric) Number of cached blocks\n"
+            "    \"shards\": xxxxx,        (numeric) Number of independently locked parts the cache is split into\n"
+            "    \"hits\": xxxxx,          (numeric) Number of reads served from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Number of reads that went to disk and then into the cache\n"
+            "    \"evictions\": xxxxx,     (numeric) Number of blocks dropped to stay under the limit\n"
+            "  },\n"
+            "  \"blockindex\": {           (json object) Information about the block index\n"
+            "    \"usage\": xxxxx,         (numeric) Number of bytes used, the sum of the usages below\n"
+            "    \"entries\": xxxxx,       (numeric) Number of block index entries\n"
+            "    \"entry_size\": xxxxx,    (numeric) Size in bytes of an entry\n"
+            "    \"entries_usage\": xxxxx, (numeric) Number of bytes used by the entries\n"
+            "    \"signatures\": xxxxx,    (numeric) Number of bytes of block signatures\n"
+            "    \"signatures_usage\": xxxxx, (numeric) Number of bytes used to store them\n"
+            "    \"clamour_entries\": xxxxx, (numeric) Number of entries with CLAMour petitions or support\n"
+            "    \"clamour_usage\": xxxxx, (numeric) Number of bytes used by their CLAMour data\n"
+            "    \"map_usage\": xxxxx,     (numeric) Number of bytes used by the map from block hash to entry\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -517,6 +576,8 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
         );
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+    obj.push_back(Pair("blockcache", RPCBlockCacheInfo()));
+    obj.push_back(Pair("blockindex", RPCBlockIndexInfo()));
     return obj;
 }
 
@@ -692,6 +753,8 @@ UniValue getsupport(const JSONRPCRequest& request)
 
     RPCTypeCheck(request.params, boost::assign::list_of(UniValue::VNUM)(UniValue::VNUM)(UniValue::VNUM));
 
+    LOCK(cs_main);
+
     double dThreshold;
     int nWindow, nBlock;
     map<string,int> mapSupport;
@@ -722,17 +785,8 @@ UniValue getsupport(const JSONRPCRequest& request)
     if (nWindow > nBlock + 1)
         throw runtime_error("Window starts before block 0.");
 
-    for (int i = nBlock + 1 - nWindow; i <= nBlock; i++) {
-        CBlockIndex* pblockindex = chainActive[i];
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            throw runtime_error("Error: Failed to read block from disk");
-        set<string> sup = pblockindex->GetSupport(block);
-        BOOST_FOREACH(const string &s, sup) {
-            // LogPrintf("%d supports %s\n", i, s);
-            mapSupport[s]++;
-        }
-    }
+    if (!clamourSupport.GetSupport(nBlock + 1 - nWindow, nBlock, mapSupport))
+        throw runtime_error("Error: Failed to read block from disk");
 
     UniValue ret(UniValue::VOBJ);
     UniValue counts(UniValue::VOBJ);
@@ -467,6 +467,41 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getorphanblockinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getorphanblockinfo\n"
+            "Returns an object containing information about the blocks received before their parent.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": xxxxx,         (numeric) Number of orphan blocks held\n"
+            "  \"peers\": xxxxx,          (numeric) Number of peers they were received from\n"
+            "  \"usage\": xxxxx,          (numeric) Number of bytes used\n"
+            "  \"max\": xxxxx,            (numeric) Maximum number of bytes used (-maxorphanblocksmib)\n"
+            "  \"added\": xxxxx,          (numeric) Number of orphan blocks added since startup\n"
+            "  \"connected\": xxxxx,      (numeric) Number taken out to be connected after their parent\n"
+            "  \"evicted\": xxxxx,        (numeric) Number dropped to stay under the limit\n"
+            "  \"peer_erased\": xxxxx,    (numeric) Number dropped when the peer they came from disconnected\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getorphanblockinfo", "")
+            + HelpExampleRpc("getorphanblockinfo", "")
+        );
+
+    COrphanBlockPool::Stats stats = GetOrphanBlockStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", uint64_t(stats.nBlocks)));
+    obj.push_back(Pair("peers", uint64_t(stats.nPeers)));
+    obj.push_back(Pair("usage", uint64_t(stats.nUsage)));
+    obj.push_back(Pair("max", uint64_t(stats.nMaxUsage)));
+    obj.push_back(Pair("added", stats.nAdded));
+    obj.push_back(Pair("connected", stats.nConnected));
+    obj.push_back(Pair("evicted", stats.nEvicted));
+    obj.push_back(Pair("peer_erased", stats.nPeerErased));
+    return obj;
+}
+
 UniValue setban(const JSONRPCRequest& request)
 {
     string strCommand;
@@ -613,6 +648,7 @@ static const CRPCCommand commands[] =
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  {"node"} },
     { "network",            "getnettotals",           &getnettotals,           true,  {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  {} },
+    { "network",            "getorphanblockinfo",     &getorphanblockinfo,     true,  {} },
     { "network",            "setban",                 &setban,                 true,  {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             true,  {} },
     { "network",            "clearbanned",            &clearbanned,            true,  {} },
@@ -30,6 +30,9 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Verify a signature of hash by pubkey outside a transaction, such as a block signature, through the signature cache */
+bool CachingVerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& hash, bool store);
+
 void InitSignatureCache();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,307 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "speechindex.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clamour.h"
+#include "primitives/block.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <set>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+
+/** Height the background build of the speech index continues from, or -1 once it is complete; guarded by cs_main */
+static int nSpeechIndexBuildHeight = -1;
+CPendingSpeechIndex pendingSpeechIndex;
+
+/** Entries erased since the speech index was last compacted */
+static std::atomic<uint64_t> nSpeechIndexErased(0);
+
+static char SpeechToLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static bool IsSpeechWordChar(unsigned char c)
+{
+    // Bytes of multibyte UTF-8 characters are kept, so words in any script are indexed
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+/** The words of str, lower case, in order and including duplicates */
+static std::vector<std::string> GetSpeechWords(const std::string& str)
+{
+    std::vector<std::string> vWords;
+    size_t n = 0;
+    while (n < str.size()) {
+        if (!IsSpeechWordChar(str[n])) {
+            n++;
+            continue;
+        }
+        size_t nEnd = n;
+        while (nEnd < str.size() && IsSpeechWordChar(str[nEnd]))
+            nEnd++;
+        if (nEnd - n >= MIN_SPEECH_TOKEN_LENGTH) {
+            std::string strWord = str.substr(n, std::min<size_t>(nEnd - n, MAX_SPEECH_TOKEN_LENGTH));
+            std::transform(strWord.begin(), strWord.end(), strWord.begin(), SpeechToLower);
+            vWords.push_back(strWord);
+        }
+        n = nEnd;
+    }
+    return vWords;
+}
+
+std::vector<std::string> GetSpeechTokens(const CTransaction& tx)
+{
+    std::vector<std::string> vTokens;
+    if (tx.strClamSpeech.empty())
+        return vTokens;
+
+    std::string strHash, strURL;
+    if (IsCreateClamour(tx, strHash, strURL))
+        vTokens.push_back("createclamour:" + strHash.substr(0, 8));
+
+    std::vector<uint32_t> vSupport;
+    ParseClamourSupport(tx.strClamSpeech, vSupport);
+    for (uint32_t nPetition : vSupport)
+        vTokens.push_back(strprintf("clamour:%08x", nPetition));
+
+    std::set<std::string> setSeen(vTokens.begin(), vTokens.end());
+    for (const std::string& strWord : GetSpeechWords(tx.strClamSpeech)) {
+        if (vTokens.size() >= MAX_SPEECH_TOKENS)
+            break;
+        if (setSeen.insert(strWord).second)
+            vTokens.push_back(strWord);
+    }
+    if (vTokens.size() > MAX_SPEECH_TOKENS)
+        vTokens.resize(MAX_SPEECH_TOKENS);
+    return vTokens;
+}
+
+static void GetBlockSpeechEntries(const CBlock& block, int nHeight, std::vector<std::pair<CSpeechIndexKey, unsigned int> >& vEntries)
+{
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        for (const std::string& strToken : GetSpeechTokens(tx))
+            vEntries.push_back(std::make_pair(CSpeechIndexKey(strToken, nHeight, tx.GetHash()), i));
+    }
+}
+
+void WriteBlockSpeechIndex(const CBlock& block, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    std::vector<std::pair<CSpeechIndexKey, unsigned int> > vEntries;
+    GetBlockSpeechEntries(block, nHeight, vEntries);
+    for (const auto& entry : vEntries)
+        pendingSpeechIndex.Write(entry.first, entry.second);
+}
+
+void EraseBlockSpeechIndex(const CBlock& block, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    std::vector<std::pair<CSpeechIndexKey, unsigned int> > vEntries;
+    GetBlockSpeechEntries(block, nHeight, vEntries);
+    for (const auto& entry : vEntries)
+        pendingSpeechIndex.Erase(entry.first);
+    nSpeechIndexErased += vEntries.size();
+}
+
+bool InitSpeechIndex(bool fEnable)
+{
+    LOCK(cs_main);
+    bool fWasEnabled = false;
+    pblocktree->ReadFlag("speechindex", fWasEnabled);
+
+    if (fEnable != fWasEnabled) {
+        // Entries left from an earlier run may be stale; start over from the genesis block
+        pendingSpeechIndex.Clear();
+        if (!pblocktree->WipeSpeechIndex())
+            return error("%s: failed to clear the speech index", __func__);
+        if (fEnable && !pblocktree->WriteSpeechIndexBuild(std::vector<std::pair<CSpeechIndexKey, unsigned int> >(), 0))
+            return error("%s: failed to start the speech index", __func__);
+        if (!pblocktree->WriteFlag("speechindex", fEnable))
+            return error("%s: failed to write the speech index flag", __func__);
+    }
+
+    fSpeechIndex = fEnable;
+    nSpeechIndexBuildHeight = -1;
+    if (fSpeechIndex && !pblocktree->ReadSpeechIndexBuildHeight(nSpeechIndexBuildHeight))
+        return error("%s: failed to read the speech index build height", __func__);
+
+    LogPrintf("%s: speech index %s\n", __func__, !fSpeechIndex ? "disabled" :
+        nSpeechIndexBuildHeight < 0 ? "enabled" : strprintf("being built from height %d", nSpeechIndexBuildHeight));
+    return true;
+}
+
+bool BuildSpeechIndex()
+{
+    const Consensus::CParams& consensusParams = Params().GetConsensus();
+    int64_t nStart = GetTimeMillis();
+
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        // Snapshot the next blocks of the active chain, and read them without holding cs_main
+        std::vector<CBlockIndex*> vBlocks;
+        {
+            LOCK(cs_main);
+            if (nSpeechIndexBuildHeight < 0)
+                return true;
+            for (int nHeight = nSpeechIndexBuildHeight; nHeight <= chainActive.Height() && vBlocks.size() < SPEECH_INDEX_BUILD_BLOCKS; nHeight++)
+                vBlocks.push_back(chainActive[nHeight]);
+            if (vBlocks.empty()) {
+                // Caught up: ConnectBlock indexes every block from here on
+                if (!pblocktree->WriteSpeechIndexBuild(std::vector<std::pair<CSpeechIndexKey, unsigned int> >(), -1))
+                    return error("%s: failed to write the speech index", __func__);
+                nSpeechIndexBuildHeight = -1;
+                LogPrintf("%s: speech index built up to height %d in %dms\n", __func__, chainActive.Height(), GetTimeMillis() - nStart);
+                return true;
+            }
+        }
+
+        std::vector<std::vector<std::pair<CSpeechIndexKey, unsigned int> > > vBlockEntries(vBlocks.size());
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            boost::this_thread::interruption_point();
+            CBlock block;
+            if (!ReadBlockFromDisk(block, vBlocks[i], consensusParams))
+                return error("%s: failed to read block %s, the speech index is not built", __func__, vBlocks[i]->GetBlockHash().ToString());
+            GetBlockSpeechEntries(block, vBlocks[i]->nHeight, vBlockEntries[i]);
+        }
+
+        {
+            LOCK(cs_main);
+            // DisconnectTip erased the entries of blocks disconnected meanwhile; write only
+            // those still active, and pick up the new branch in the next round
+            std::vector<std::pair<CSpeechIndexKey, unsigned int> > vEntries;
+            size_t n = 0;
+            for (; n < vBlocks.size() && chainActive.Contains(vBlocks[n]); n++)
+                vEntries.insert(vEntries.end(), vBlockEntries[n].begin(), vBlockEntries[n].end());
+            int nHeight = vBlocks[0]->nHeight + n;
+            if (!pblocktree->WriteSpeechIndexBuild(vEntries, nHeight))
+                return error("%s: failed to write the speech index", __func__);
+            nSpeechIndexBuildHeight = nHeight;
+            LogPrint("speech", "%s: speech index built up to height %d\n", __func__, nHeight - 1);
+        }
+    }
+}
+
+void ThreadSpeechIndex()
+{
+    bool fBuilt;
+    {
+        LOCK(cs_main);
+        fBuilt = nSpeechIndexBuildHeight < 0;
+    }
+    if (!fBuilt) {
+        if (!BuildSpeechIndex())
+            return;
+        // Bulk writes leave many overlapping files; merge them once the build is done
+        pblocktree->CompactSpeechIndex();
+    }
+
+    // Reorganizations leave tombstones for the entries they erase, which slow down
+    // the prefix scans over them until they are compacted away
+    while (true) {
+        MilliSleep(60000);
+        if (nSpeechIndexErased >= SPEECH_INDEX_COMPACT_ERASED) {
+            int64_t nStart = GetTimeMillis();
+            nSpeechIndexErased = 0;
+            pblocktree->CompactSpeechIndex();
+            LogPrint("speech", "%s: speech index compacted in %dms\n", __func__, GetTimeMillis() - nStart);
+        }
+    }
+}
+
+bool IsSpeechIndexComplete()
+{
+    LOCK(cs_main);
+    return fSpeechIndex && nSpeechIndexBuildHeight < 0;
+}
+
+bool SearchSpeechIndex(const std::string& strQuery, std::vector<CSpeechMatch>& vMatches, std::string& strError)
+{
+    vMatches.clear();
+
+    // Each term is a token, and whether it is a prefix
+    std::vector<std::pair<std::string, bool> > vTerms;
+    std::vector<std::string> vParts;
+    boost::split(vParts, strQuery, boost::is_any_of(" \t\r\n"));
+    for (std::string strPart : vParts) {
+        if (strPart.empty())
+            continue;
+        if (strPart.find(':') != std::string::npos) {
+            std::transform(strPart.begin(), strPart.end(), strPart.begin(), SpeechToLower);
+            vTerms.push_back(std::make_pair(strPart, false));
+        } else if (strPart[strPart.size() - 1] == '*') {
+            std::vector<std::string> vWords = GetSpeechWords(strPart.substr(0, strPart.size() - 1));
+            if (vWords.size() != 1 || vWords[0].size() < MIN_SPEECH_PREFIX_LENGTH || vWords[0].size() + 1 != strPart.size()) {
+                strError = strprintf("Prefix term \"%s\" must be at least %u letters or digits followed by *", strPart, MIN_SPEECH_PREFIX_LENGTH);
+                return false;
+            }
+            vTerms.push_back(std::make_pair(vWords[0], true));
+        } else {
+            for (const std::string& strWord : GetSpeechWords(strPart))
+                vTerms.push_back(std::make_pair(strWord, false));
+        }
+    }
+    if (vTerms.empty()) {
+        strError = "No search terms";
+        return false;
+    }
+
+    LOCK(cs_main);
+    if (!fSpeechIndex || nSpeechIndexBuildHeight >= 0) {
+        strError = "The speech index is not complete";
+        return false;
+    }
+
+    // Transactions matching every term so far, by height and txid
+    std::map<std::pair<int, uint256>, unsigned int> mapMatches;
+    for (size_t i = 0; i < vTerms.size(); i++) {
+        std::vector<std::pair<CSpeechIndexKey, unsigned int> > vEntries;
+        if (!pblocktree->ReadSpeechIndex(vTerms[i].first, vTerms[i].second, MAX_SPEECH_SEARCH_MATCHES, vEntries)) {
+            strError = "Failed to read the speech index";
+            return false;
+        }
+        // Merge the changes of the blocks connected and disconnected since the last flush
+        std::map<CSpeechIndexKey, unsigned int> mapEntries(vEntries.begin(), vEntries.end());
+        const std::string& strToken = vTerms[i].first;
+        bool fPrefix = vTerms[i].second;
+        pendingSpeechIndex.Apply(mapEntries, CSpeechIndexKey(strToken, 0, uint256()), [&strToken, fPrefix](const CSpeechIndexKey& key) {
+            return fPrefix ? key.strToken.compare(0, strToken.size(), strToken) == 0 : key.strToken == strToken;
+        });
+        if (mapEntries.size() > MAX_SPEECH_SEARCH_MATCHES) {
+            strError = strprintf("Search term \"%s\" matches more than %u transactions", vTerms[i].first, MAX_SPEECH_SEARCH_MATCHES);
+            return false;
+        }
+
+        std::map<std::pair<int, uint256>, unsigned int> mapTerm;
+        for (const auto& entry : mapEntries) {
+            std::pair<int, uint256> key((int)entry.first.nHeight, entry.first.txid);
+            if (i == 0 || mapMatches.count(key))
+                mapTerm[key] = entry.second;
+        }
+        mapMatches.swap(mapTerm);
+        if (mapMatches.empty())
+            return true;
+    }
+
+    vMatches.reserve(mapMatches.size());
+    for (const auto& match : mapMatches)
+        vMatches.push_back(CSpeechMatch(match.first.first, match.first.second, match.second));
+    std::sort(vMatches.begin(), vMatches.end(), [](const CSpeechMatch& a, const CSpeechMatch& b) {
+        return a.nHeight != b.nHeight ? a.nHeight > b.nHeight : a.nTx < b.nTx;
+    });
+    return true;
+}
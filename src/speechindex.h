@@ -0,0 +1,84 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPEECHINDEX_H
+#define BITCOIN_SPEECHINDEX_H
+
+#include "txdb.h"
+#include "uint256.h"
+
+#include <string>
+#include <vector>
+
+class CBlock;
+class CTransaction;
+
+/** Words shorter than this are not indexed */
+static const unsigned int MIN_SPEECH_TOKEN_LENGTH = 2;
+/** Longer words are indexed by their first MAX_SPEECH_TOKEN_LENGTH characters */
+static const unsigned int MAX_SPEECH_TOKEN_LENGTH = 32;
+/** Maximum number of tokens indexed per transaction */
+static const unsigned int MAX_SPEECH_TOKENS = 64;
+/** Minimum length of a prefix ("abc*") search term */
+static const unsigned int MIN_SPEECH_PREFIX_LENGTH = 3;
+/** A search fails if any of its terms matches more transactions than this */
+static const unsigned int MAX_SPEECH_SEARCH_MATCHES = 100000;
+/** Maximum and default number of results returned by one searchclamspeech call */
+static const unsigned int MAX_SPEECH_SEARCH_RESULTS = 100;
+static const unsigned int DEFAULT_SPEECH_SEARCH_RESULTS = 20;
+/** Blocks read per round while building the speech index in the background */
+static const unsigned int SPEECH_INDEX_BUILD_BLOCKS = 100;
+/** Compact the speech index once this many entries were erased by disconnected blocks */
+static const unsigned int SPEECH_INDEX_COMPACT_ERASED = 100000;
+
+/**
+ * The tokens the CLAMspeech of tx is indexed by, each once: "createclamour:<id>"
+ * for a CLAMour petition and "clamour:<id>" for each petition it supports,
+ * followed by its words, lower case.
+ */
+std::vector<std::string> GetSpeechTokens(const CTransaction& tx);
+
+/** Speech index changes not yet written with the block index by FlushStateToDisk; guarded by cs_main */
+extern CPendingSpeechIndex pendingSpeechIndex;
+
+/** Queue the speech index entries of the transactions of a block connected at nHeight, or their erasure */
+void WriteBlockSpeechIndex(const CBlock& block, int nHeight);
+void EraseBlockSpeechIndex(const CBlock& block, int nHeight);
+
+/**
+ * Turn the speech index on or off after the block index is loaded. Turning
+ * it on for an existing chain schedules ThreadSpeechIndex to build it; from
+ * then on ConnectBlock and DisconnectTip keep it up to date.
+ */
+bool InitSpeechIndex(bool fEnable);
+
+/** Index the speech of the blocks connected before -speechindex was turned on; false if interrupted by an error */
+bool BuildSpeechIndex();
+
+/** Build the speech index, then compact it as disconnected blocks erase entries */
+void ThreadSpeechIndex();
+
+/** Whether the speech index covers the whole active chain */
+bool IsSpeechIndexComplete();
+
+struct CSpeechMatch
+{
+    int nHeight;
+    uint256 txid;
+    //! position of the transaction in its block
+    unsigned int nTx;
+
+    CSpeechMatch(int nHeightIn, const uint256& txidIn, unsigned int nTxIn) : nHeight(nHeightIn), txid(txidIn), nTx(nTxIn) {}
+};
+
+/**
+ * The transactions whose speech matches every term of strQuery, most recent
+ * first; requires a complete index. Terms are separated by spaces: a term
+ * ending in '*' matches the words it starts, "clamour:<id>" and
+ * "createclamour:<id>" match the support and creation of a petition, and
+ * any other term matches its words exactly.
+ */
+bool SearchSpeechIndex(const std::string& strQuery, std::vector<CSpeechMatch>& vMatches, std::string& strError);
+
+#endif // BITCOIN_SPEECHINDEX_H
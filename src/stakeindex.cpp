@@ -0,0 +1,65 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakeindex.h"
+
+#include "txdb.h"
+#include "util.h"
+
+#include <memory>
+
+#include <boost/thread.hpp>
+
+static void AddStakeIndexEntry(unsigned int nHeight, const uint160& staker, int nHeightEnd, const std::vector<int>& vWindows, CStakeIndexStats& stats)
+{
+    stats.nBlocks++;
+    if (staker.IsNull())
+        return;
+    stats.nStakeBlocks++;
+
+    CStakerStats& stakerStats = stats.mapStakers[staker];
+    if (stakerStats.nBlocks == 0) {
+        stakerStats.nFirstHeight = nHeight;
+        stakerStats.vWindowBlocks.assign(vWindows.size(), 0);
+    }
+    stakerStats.nBlocks++;
+    stakerStats.nLastHeight = nHeight;
+    for (size_t i = 0; i < vWindows.size(); i++) {
+        if ((int)nHeight > nHeightEnd - vWindows[i]) {
+            stakerStats.vWindowBlocks[i]++;
+            stats.vWindowStakeBlocks[i]++;
+        }
+    }
+}
+
+bool GetStakeIndexStats(CBlockTreeDB& db, int nHeightStart, int nHeightEnd, const std::vector<int>& vWindows,
+                        const CHeightIndexUpdates& pending, CStakeIndexStats& stats)
+{
+    stats = CStakeIndexStats();
+    stats.vWindowStakeBlocks.assign(vWindows.size(), 0);
+    if (nHeightStart < 0 || nHeightEnd < nHeightStart)
+        return true;
+
+    // The pending entries are merged in height order with those read
+    std::map<unsigned int, uint160>::const_iterator itPending = pending.mapStakeIndex.lower_bound(nHeightStart);
+    std::unique_ptr<CStakeIndexCursor> pcursor(db.StakeIndexCursor(nHeightStart));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        unsigned int nHeight;
+        if (!pcursor->GetKey(nHeight) || nHeight > (unsigned int)nHeightEnd)
+            break;
+        for (; itPending != pending.mapStakeIndex.end() && itPending->first < nHeight; ++itPending)
+            AddStakeIndexEntry(itPending->first, itPending->second, nHeightEnd, vWindows, stats);
+        // Overwritten or erased since the last write
+        if (pending.mapStakeIndex.count(nHeight) || pending.setEraseStakeIndex.count(nHeight))
+            continue;
+        uint160 staker;
+        if (!pcursor->GetValue(staker))
+            return error("%s: cannot read the stake index entry at height %u", __func__, nHeight);
+        AddStakeIndexEntry(nHeight, staker, nHeightEnd, vWindows, stats);
+    }
+    for (; itPending != pending.mapStakeIndex.end() && itPending->first <= (unsigned int)nHeightEnd; ++itPending)
+        AddStakeIndexEntry(itPending->first, itPending->second, nHeightEnd, vWindows, stats);
+    return true;
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_STAKEINDEX_H
+#define BITCOIN_STAKEINDEX_H
+
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
+class CBlockTreeDB;
+class CHeightIndexUpdates;
+
+/** Blocks getstakerstats aggregates by default, about a week */
+static const int DEFAULT_STAKER_STATS_BLOCKS = 10080;
+/** Stakers getstakerstats returns by default */
+static const int DEFAULT_STAKER_STATS_COUNT = 100;
+/** Maximum number of rolling windows of one getstakerstats call */
+static const unsigned int MAX_STAKER_STATS_WINDOWS = 16;
+
+/** The stakes of one staker in a range of the stake index */
+struct CStakerStats
+{
+    int nBlocks;
+    int nFirstHeight;
+    int nLastHeight;
+    //! blocks staked in each of the rolling windows
+    std::vector<int> vWindowBlocks;
+
+    CStakerStats() : nBlocks(0), nFirstHeight(-1), nLastHeight(-1) {}
+};
+
+/** A range of the stake index, aggregated by staker */
+struct CStakeIndexStats
+{
+    //! entries read, fewer than the heights of the range if the index lags behind
+    int nBlocks;
+    //! entries of proof-of-stake blocks
+    int nStakeBlocks;
+    //! proof-of-stake blocks in each of the rolling windows
+    std::vector<int> vWindowStakeBlocks;
+    std::map<uint160, CStakerStats> mapStakers;
+
+    CStakeIndexStats() : nBlocks(0), nStakeBlocks(0) {}
+};
+
+/**
+ * Aggregate the stake index entries from nHeightStart to nHeightEnd by the key
+ * id of their staker, streaming them in height order. vWindows are the sizes
+ * in blocks of rolling windows ending at nHeightEnd, clipped to the range.
+ * The stake index changes in pending, not yet written to db, override its entries.
+ */
+bool GetStakeIndexStats(CBlockTreeDB& db, int nHeightStart, int nHeightEnd, const std::vector<int>& vWindows,
+                        const CHeightIndexUpdates& pending, CStakeIndexStats& stats);
+
+#endif // BITCOIN_STAKEINDEX_H
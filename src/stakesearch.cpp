@@ -0,0 +1,180 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakesearch.h"
+
+#include "consensus/params.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "pos.h"
+#include "util.h"
+#include "utilmoneystr.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <string.h>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// Size of the serialized V2 kernel:
+// nStakeModifier (8) + nTimeBlockFrom (4) + nTimeTxPrev (4) + prevout.hash (32) + prevout.n (4) + nTimeTx (4)
+static const size_t KERNEL_PREIMAGE_SIZE = 56;
+static const size_t KERNEL_PREIMAGE_TIMETX_OFFSET = 52;
+
+int GetStakeSearchThreads()
+{
+    // -stakethreads=0 means autodetect, <0 leaves that many cores free
+    int nThreads = GetArg("-stakethreads", DEFAULT_STAKE_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    return std::max(1, std::min(nThreads, MAX_STAKE_THREADS));
+}
+
+CStakeKernelSearch::CStakeKernelSearch(int nThreadsIn) : nThreads(std::max(1, std::min(nThreadsIn, MAX_STAKE_THREADS))),
+                                                          nRound(0), nRoundWorkers(0), nRunning(0), fStop(false)
+{
+    // The caller of FindKernel is worker 0
+    for (int n = 1; n < nThreads; n++)
+        threadGroup.create_thread(boost::bind(&CStakeKernelSearch::Worker, this, n));
+}
+
+CStakeKernelSearch::~CStakeKernelSearch()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWorker.notify_all();
+    threadGroup.join_all();
+}
+
+void CStakeKernelSearch::Worker(int nWorker)
+{
+    RenameThread("clam-stakesearch");
+    uint64_t nRoundSeen = 0;
+    while (true) {
+        std::function<void(int)> fn;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && nRound == nRoundSeen)
+                condWorker.wait(lock);
+            if (fStop)
+                return;
+            nRoundSeen = nRound;
+            // Not needed for a round with fewer batches than threads
+            if (nWorker >= nRoundWorkers)
+                continue;
+            fn = fnRound;
+        }
+        fn(nWorker);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (--nRunning == 0)
+                condDone.notify_all();
+        }
+    }
+}
+
+bool CStakeKernelSearch::FindKernel(uint64_t nStakeModifier, unsigned int nBits, const std::vector<CStakeCandidate>& vCandidates,
+                                    const std::vector<unsigned int>& vTimeSlots, const Consensus::CParams& params,
+                                    CStakeKernelHit& hit, size_t nStart, const std::function<bool()>& fnInterrupt)
+{
+    if (nStart >= vCandidates.size() || vTimeSlots.empty())
+        return false;
+
+    const bool fCheat = GetBoolArg("-cheat", false);
+
+    const size_t nNoKernel = std::numeric_limits<size_t>::max();
+    std::atomic<size_t> nNextBatch(nStart);
+    std::atomic<size_t> nBest(nNoKernel);
+    std::atomic<bool> fInterrupted(false);
+
+    // Don't start threads that would find no batch to claim
+    size_t nBatches = (vCandidates.size() - nStart + STAKE_SEARCH_BATCH_SIZE - 1) / STAKE_SEARCH_BATCH_SIZE;
+    int nWorkers = (int)std::min((size_t)nThreads, nBatches);
+    std::vector<CStakeKernelHit> vHits(nWorkers);
+
+    auto search = [&](int nWorker) {
+        CStakeKernelHit& hitWorker = vHits[nWorker];
+        hitWorker.nCandidate = nNoKernel;
+
+        unsigned char vchPreimage[KERNEL_PREIMAGE_SIZE];
+        WriteLE64(vchPreimage, nStakeModifier);
+
+        while (!fInterrupted) {
+            size_t nBegin = nNextBatch.fetch_add(STAKE_SEARCH_BATCH_SIZE);
+            if (nBegin >= vCandidates.size() || nBegin >= nBest)
+                return;
+            if (fnInterrupt && fnInterrupt()) {
+                fInterrupted = true;
+                return;
+            }
+
+            size_t nEnd = std::min(nBegin + STAKE_SEARCH_BATCH_SIZE, vCandidates.size());
+            for (size_t i = nBegin; i < nEnd && i < nBest.load(std::memory_order_relaxed); i++) {
+                const CStakeCandidate& candidate = vCandidates[i];
+
+                // Everything but nTimeTx is constant for this candidate
+                WriteLE32(vchPreimage + 8, candidate.nTimeBlockFrom);
+                WriteLE32(vchPreimage + 12, candidate.nTimeTxPrev);
+                memcpy(vchPreimage + 16, candidate.prevout.hash.begin(), 32);
+                WriteLE32(vchPreimage + 48, candidate.prevout.n);
+                CStakeTarget target(nBits, candidate.nValue);
+
+                for (unsigned int nTimeTx : vTimeSlots) {
+                    if (nTimeTx < candidate.nTimeTxPrev || (candidate.nTimeBlockFrom + params.nStakeMinAge) > nTimeTx)
+                        continue;
+
+                    WriteLE32(vchPreimage + KERNEL_PREIMAGE_TIMETX_OFFSET, nTimeTx);
+                    uint256 hashProofOfStake;
+                    CHash256().Write(vchPreimage, KERNEL_PREIMAGE_SIZE).Finalize(hashProofOfStake.begin());
+                    if (!fCheat && !target.IsMetBy(hashProofOfStake))
+                        continue;
+
+                    hitWorker.nCandidate = i;
+                    hitWorker.prevout = candidate.prevout;
+                    hitWorker.nTimeTx = nTimeTx;
+                    hitWorker.hashProofOfStake = hashProofOfStake;
+
+                    size_t nCurrent = nBest.load();
+                    while (i < nCurrent && !nBest.compare_exchange_weak(nCurrent, i)) {}
+                    break;
+                }
+            }
+        }
+    };
+
+    boost::unique_lock<boost::mutex> lockSearch(csSearch);
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fnRound = search;
+        nRoundWorkers = nWorkers;
+        nRunning = nWorkers - 1;
+        nRound++;
+    }
+    condWorker.notify_all();
+    search(0);
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nRunning > 0)
+            condDone.wait(lock);
+        fnRound = nullptr;
+    }
+
+    if (fInterrupted || nBest == nNoKernel)
+        return false;
+
+    for (const CStakeKernelHit& hitWorker : vHits) {
+        if (hitWorker.nCandidate == nBest) {
+            hit = hitWorker;
+            break;
+        }
+    }
+
+    LogPrint("miner", "[STAKE] PASS: hash %64s (%s CLAM) at %u\n", hit.hashProofOfStake.GetHex(),
+             FormatMoney(vCandidates[hit.nCandidate].nValue), hit.nTimeTx);
+    return true;
+}
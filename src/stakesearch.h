@@ -0,0 +1,106 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_STAKESEARCH_H
+#define BITCOIN_STAKESEARCH_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <functional>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace Consensus { struct CParams; }
+
+/** Default for -stakethreads, 0 = one kernel search thread per core */
+static const int DEFAULT_STAKE_THREADS = 0;
+/** Maximum number of kernel search threads */
+static const int MAX_STAKE_THREADS = 16;
+/** Number of candidates a kernel search thread claims at a time */
+static const size_t STAKE_SEARCH_BATCH_SIZE = 256;
+
+/** Return the number of kernel search threads configured by -stakethreads */
+int GetStakeSearchThreads();
+
+/**
+ * A staking output reduced to the fields the protocol V2 kernel hashes over:
+ *     hash(nStakeModifier + nTimeBlockFrom + nTimeTxPrev + prevout.hash + prevout.n + nTimeTx)
+ */
+struct CStakeCandidate
+{
+    COutPoint prevout;
+    CAmount nValue;
+    unsigned int nTimeBlockFrom;
+    unsigned int nTimeTxPrev;
+
+    CStakeCandidate() : nValue(0), nTimeBlockFrom(0), nTimeTxPrev(0) {}
+    CStakeCandidate(const COutPoint& prevoutIn, CAmount nValueIn, unsigned int nTimeBlockFromIn, unsigned int nTimeTxPrevIn) :
+        prevout(prevoutIn), nValue(nValueIn), nTimeBlockFrom(nTimeBlockFromIn), nTimeTxPrev(nTimeTxPrevIn) {}
+};
+
+/** A kernel found by CStakeKernelSearch */
+struct CStakeKernelHit
+{
+    size_t nCandidate;
+    COutPoint prevout;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+};
+
+/**
+ * Protocol V2 stake kernel search over a set of candidate outputs.
+ *
+ * The candidates are split into batches which are claimed by a pool of
+ * worker threads, started with the search and joined when it is destroyed;
+ * the calling thread takes part in every search. The constant part of every kernel preimage is built once
+ * per candidate, and all timestamp slots of a candidate are hashed back to
+ * back. Once a kernel is found, workers stop claiming batches past it, so the
+ * result is always the lowest-indexed kernel, exactly as a serial search over
+ * the same candidates would find it.
+ */
+class CStakeKernelSearch
+{
+public:
+    explicit CStakeKernelSearch(int nThreadsIn);
+    ~CStakeKernelSearch();
+
+    /**
+     * Search vCandidates[nStart..] for a kernel at any of vTimeSlots, tried in
+     * order for every candidate. fnInterrupt is polled between batches and
+     * aborts the round when it returns true. Searches from several threads
+     * run one after the other.
+     */
+    bool FindKernel(uint64_t nStakeModifier, unsigned int nBits, const std::vector<CStakeCandidate>& vCandidates,
+                    const std::vector<unsigned int>& vTimeSlots, const Consensus::CParams& params,
+                    CStakeKernelHit& hit, size_t nStart = 0, const std::function<bool()>& fnInterrupt = std::function<bool()>());
+
+    int GetThreads() const { return nThreads; }
+
+private:
+    int nThreads;
+
+    //! held for a whole search
+    boost::mutex csSearch;
+    //! guards the round state below
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condDone;
+    //! search of the current round, run by the workers numbered below nRoundWorkers
+    std::function<void(int)> fnRound;
+    uint64_t nRound;
+    int nRoundWorkers;
+    //! workers still searching in the current round
+    int nRunning;
+    bool fStop;
+    boost::thread_group threadGroup;
+
+    void Worker(int nWorker);
+};
+
+#endif // BITCOIN_STAKESEARCH_H
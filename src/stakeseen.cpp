@@ -0,0 +1,144 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakeseen.h"
+
+#include "chain.h"
+#include "consensus/params.h"
+#include "hash.h"
+#include "memusage.h"
+#include "random.h"
+#include "util.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <limits>
+
+//! smallest table, and the table is grown once more than half of it is used
+static const size_t STAKE_SEEN_MIN_SLOTS = 64;
+
+CStakeSeen::CStakeSeen() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())), nSize(0)
+{
+    vSlots.resize(STAKE_SEEN_MIN_SLOTS);
+}
+
+uint64_t CStakeSeen::Hash(const Stake& stake) const
+{
+    uint64_t nHash = SipHashUint256Extra(k0, k1 ^ stake.second, stake.first.hash, stake.first.n);
+    return nHash ? nHash : 1;
+}
+
+size_t CStakeSeen::Find(uint64_t nHash) const
+{
+    size_t nMask = vSlots.size() - 1;
+    size_t i = nHash & nMask;
+    while (vSlots[i].nHash != 0 && vSlots[i].nHash != nHash)
+        i = (i + 1) & nMask;
+    return i;
+}
+
+size_t CStakeSeen::count(const Stake& stake) const
+{
+    return vSlots[Find(Hash(stake))].nHash != 0 ? 1 : 0;
+}
+
+bool CStakeSeen::insert(const Stake& stake)
+{
+    uint64_t nHash = Hash(stake);
+    size_t i = Find(nHash);
+    if (vSlots[i].nHash != 0)
+        return false;
+    if ((nSize + 1) * 2 > vSlots.size()) {
+        Resize(vSlots.size() * 2);
+        i = Find(nHash);
+    }
+    vSlots[i].nHash = nHash;
+    vSlots[i].nTime = stake.second;
+    nSize++;
+    return true;
+}
+
+size_t CStakeSeen::erase(const Stake& stake)
+{
+    size_t i = Find(Hash(stake));
+    if (vSlots[i].nHash == 0)
+        return 0;
+    EraseSlot(i);
+    return 1;
+}
+
+void CStakeSeen::EraseSlot(size_t i)
+{
+    // Shift back the entries after it in the probe sequence that would otherwise
+    // no longer be found, rather than leaving a tombstone
+    size_t nMask = vSlots.size() - 1;
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & nMask;
+        if (vSlots[j].nHash == 0)
+            break;
+        size_t k = vSlots[j].nHash & nMask;
+        // The entry at j stays if its home slot k lies cyclically in (i, j]
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        vSlots[i] = vSlots[j];
+        i = j;
+    }
+    vSlots[i].nHash = 0;
+    nSize--;
+}
+
+void CStakeSeen::Resize(size_t nSlotsNew)
+{
+    std::vector<Slot> vSlotsOld;
+    vSlotsOld.swap(vSlots);
+    vSlots.assign(nSlotsNew, Slot());
+    for (const Slot& slot : vSlotsOld) {
+        if (slot.nHash != 0)
+            vSlots[Find(slot.nHash)] = slot;
+    }
+}
+
+void CStakeSeen::clear()
+{
+    std::vector<Slot>(STAKE_SEEN_MIN_SLOTS).swap(vSlots);
+    nSize = 0;
+}
+
+size_t CStakeSeen::Prune(unsigned int nTimeCutoff)
+{
+    std::vector<Slot> vKeep;
+    vKeep.reserve(nSize);
+    for (const Slot& slot : vSlots) {
+        if (slot.nHash != 0 && slot.nTime >= nTimeCutoff)
+            vKeep.push_back(slot);
+    }
+    size_t nPruned = nSize - vKeep.size();
+    if (nPruned == 0)
+        return 0;
+
+    // Rebuild at the size that fits what is left
+    size_t nSlotsNew = STAKE_SEEN_MIN_SLOTS;
+    while (vKeep.size() * 2 > nSlotsNew)
+        nSlotsNew *= 2;
+    std::vector<Slot>(nSlotsNew).swap(vSlots);
+    for (const Slot& slot : vKeep)
+        vSlots[Find(slot.nHash)] = slot;
+    nSize = vKeep.size();
+    return nPruned;
+}
+
+size_t CStakeSeen::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(vSlots);
+}
+
+unsigned int GetStakeSeenCutoff(const CBlockIndex* pindexTip, const Consensus::CParams& params)
+{
+    int nDepth = GetArg("-maxreorgdepth", DEFAULT_MAX_REORG_DEPTH);
+    if (!pindexTip || pindexTip->nHeight <= nDepth + 1)
+        return 0;
+    int64_t nCutoff = pindexTip->GetAncestor(pindexTip->nHeight - nDepth - 1)->GetMedianTimePast() - params.nStakeMinAge;
+    return std::max<int64_t>(0, nCutoff);
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_STAKESEEN_H
+#define BITCOIN_STAKESEEN_H
+
+#include "primitives/transaction.h"
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+namespace Consensus { struct CParams; }
+
+/** Blocks connected between two prunes of setStakeSeen */
+static const int STAKE_SEEN_PRUNE_INTERVAL = 1000;
+
+/**
+ * Set of the stakes (kernel prevout and block time) of proof-of-stake blocks,
+ * used to refuse floods of blocks reusing one stake.
+ *
+ * Stakes are kept as salted 64 bit hashes with their time in an open addressing
+ * table with linear probing, 16 bytes per slot and no allocation per entry. Two
+ * stakes sharing a hash would make one look seen; with a random salt that takes
+ * about 2^32 entries to expect once. Method names follow std::set, which this
+ * replaced. Not thread safe; both instances are guarded by cs_main.
+ */
+class CStakeSeen
+{
+public:
+    typedef std::pair<COutPoint, unsigned int> Stake;
+
+    CStakeSeen();
+
+    size_t count(const Stake& stake) const;
+    /** Returns whether the stake was added, i.e. not seen before */
+    bool insert(const Stake& stake);
+    size_t erase(const Stake& stake);
+    void clear();
+    size_t size() const { return nSize; }
+
+    /** Forget the stakes of blocks timed before nTimeCutoff; returns how many */
+    size_t Prune(unsigned int nTimeCutoff);
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    struct Slot
+    {
+        //! 0 marks an empty slot
+        uint64_t nHash;
+        uint32_t nTime;
+    };
+
+    uint64_t k0, k1;
+    std::vector<Slot> vSlots;
+    size_t nSize;
+
+    uint64_t Hash(const Stake& stake) const;
+    /** Slot holding nHash, or the empty slot ending its probe sequence */
+    size_t Find(uint64_t nHash) const;
+    void EraseSlot(size_t nSlot);
+    void Resize(size_t nSlotsNew);
+};
+
+/**
+ * Stakes of blocks timed before this can be forgotten once pindexTip is the tip:
+ * a block is only accepted on a fork at most -maxreorgdepth blocks deep, and
+ * must be timed after the median time past of its parent. The stake minimum
+ * age is kept as a margin on top.
+ */
+unsigned int GetStakeSeenCutoff(const CBlockIndex* pindexTip, const Consensus::CParams& params);
+
+#endif // BITCOIN_STAKESEEN_H
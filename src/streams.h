@@ -59,6 +59,11 @@ public:
         stream->read(pch, nSize);
     }
 
+    void ignore(size_t size)
+    {
+        stream->ignore(size);
+    }
+
     int GetVersion() const { return nVersion; }
     int GetType() const { return nType; }
 };
@@ -0,0 +1,267 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "key.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "undo.h"
+#include "validation.h"
+
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+static std::vector<std::pair<CAddressIndexKey, CAmount> > ReadEntries(const CAddressIndexPrefix& address, unsigned int nHeightStart = 0)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    std::unique_ptr<CAddressIndexCursor> pcursor(pblocktree->AddressIndexCursor(address, nHeightStart));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        CAddressIndexKey key;
+        CAmount nValue;
+        BOOST_CHECK(pcursor->GetKey(key));
+        BOOST_CHECK(pcursor->GetValue(nValue));
+        vEntries.push_back(std::make_pair(key, nValue));
+    }
+    return vEntries;
+}
+
+static std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > ReadUnspent(const CAddressIndexPrefix& address)
+{
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vEntries;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(address, 100, vEntries));
+    return vEntries;
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_prefix)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    // Pay-to-pubkey outputs, which coinstakes use, are indexed under the key id
+    CAddressIndexPrefix address, addressP2PK;
+    BOOST_CHECK(GetAddressIndexPrefix(GetScriptForDestination(pubkey.GetID()), address));
+    BOOST_CHECK(GetAddressIndexPrefix(GetScriptForRawPubKey(pubkey), addressP2PK));
+    BOOST_CHECK(address == addressP2PK);
+    BOOST_CHECK_EQUAL(address.nType, ADDRESS_INDEX_KEY_ID);
+    BOOST_CHECK(GetAddressIndexDestination(address) == CTxDestination(pubkey.GetID()));
+
+    CScript redeemScript = GetScriptForRawPubKey(pubkey);
+    BOOST_CHECK(GetAddressIndexPrefix(GetScriptForDestination(CScriptID(redeemScript)), address));
+    BOOST_CHECK_EQUAL(address.nType, ADDRESS_INDEX_SCRIPT_ID);
+    BOOST_CHECK(GetAddressIndexDestination(address) == CTxDestination(CScriptID(redeemScript)));
+
+    BOOST_CHECK(!GetAddressIndexPrefix(CScript() << OP_RETURN, address));
+    BOOST_CHECK(!GetAddressIndexPrefix(CScript(), address));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_block)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptA = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptB = GetScriptForDestination(CScriptID(scriptA));
+    CAddressIndexPrefix addressA, addressB;
+    BOOST_REQUIRE(GetAddressIndexPrefix(scriptA, addressA));
+    BOOST_REQUIRE(GetAddressIndexPrefix(scriptB, addressB));
+    BOOST_CHECK(InitAddressIndex(true));
+    ThreadAddressIndex();
+
+    // A coinbase paying A, a transaction spending an earlier output of A to B and
+    // back to A, and one spending that change to B within the same block
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vout.push_back(CTxOut(10, scriptA));
+    CMutableTransaction tx1;
+    COutPoint prevout(GetRandHash(), 3);
+    tx1.vin.push_back(CTxIn(prevout));
+    tx1.vout.push_back(CTxOut(30, scriptB));
+    tx1.vout.push_back(CTxOut(20, scriptA));
+    CMutableTransaction tx2;
+    tx2.vin.push_back(CTxIn(COutPoint(tx1.GetHash(), 1)));
+    tx2.vout.push_back(CTxOut(20, scriptB));
+    tx2.vout.push_back(CTxOut(0, CScript() << OP_RETURN));
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(txCoinbase));
+    block.vtx.push_back(MakeTransactionRef(tx1));
+    block.vtx.push_back(MakeTransactionRef(tx2));
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(2);
+    blockundo.vtxundo[0].vprevout.push_back(Coin(CTxOut(50, scriptA), 5, false, false, 0));
+    blockundo.vtxundo[1].vprevout.push_back(Coin(CTxOut(20, scriptA), 10, false, false, 0));
+
+    CAddressIndexUpdates updates;
+    BOOST_CHECK(GetBlockAddressIndex(block, blockundo, 10, updates));
+    BOOST_CHECK_EQUAL(updates.vEntries.size(), 6U);
+    BOOST_CHECK_EQUAL(updates.vCreated.size(), 4U);
+    BOOST_CHECK_EQUAL(updates.vSpent.size(), 2U);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(WriteBlockAddressIndex(block, blockundo, 10));
+    }
+    FlushStateToDisk();
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries = ReadEntries(addressA);
+    BOOST_REQUIRE_EQUAL(vEntries.size(), 4U);
+    BOOST_CHECK(vEntries[0].first.txid == txCoinbase.GetHash());
+    BOOST_CHECK_EQUAL(vEntries[0].second, 10);
+    BOOST_CHECK(vEntries[1].first.txid == tx1.GetHash());
+    BOOST_CHECK(vEntries[1].first.fSpending);
+    BOOST_CHECK_EQUAL(vEntries[1].second, -50);
+    BOOST_CHECK_EQUAL(vEntries[2].second, 20);
+    BOOST_CHECK(vEntries[3].first.txid == tx2.GetHash());
+    BOOST_CHECK_EQUAL(vEntries[3].second, -20);
+    BOOST_CHECK(ReadEntries(addressA, 11).empty());
+
+    // The change spent within the block is not left unspent
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent = ReadUnspent(addressA);
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txid == txCoinbase.GetHash());
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nValue, 10);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nHeight, 10);
+    BOOST_CHECK(vUnspent[0].second.scriptPubKey == scriptA);
+    BOOST_CHECK_EQUAL(ReadUnspent(addressB).size(), 2U);
+
+    // Transactions of several addresses, in chain order and paged
+    std::vector<std::pair<uint256, int> > vTx;
+    BOOST_CHECK(FindAddressTransactions({addressA, addressB}, 0, 100, 0, 10, vTx));
+    BOOST_REQUIRE_EQUAL(vTx.size(), 3U);
+    BOOST_CHECK(vTx[0].first == txCoinbase.GetHash());
+    BOOST_CHECK(vTx[1].first == tx1.GetHash());
+    BOOST_CHECK(vTx[2].first == tx2.GetHash());
+    BOOST_CHECK_EQUAL(vTx[2].second, 10);
+    BOOST_CHECK(FindAddressTransactions({addressB}, 0, 100, 1, 1, vTx));
+    BOOST_REQUIRE_EQUAL(vTx.size(), 1U);
+    BOOST_CHECK(vTx[0].first == tx2.GetHash());
+    BOOST_CHECK(FindAddressTransactions({addressA}, 11, 100, 0, 10, vTx));
+    BOOST_CHECK(vTx.empty());
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vBoth;
+    BOOST_CHECK(FindAddressUnspent({addressA, addressB}, 100, vBoth));
+    BOOST_CHECK_EQUAL(vBoth.size(), 3U);
+    BOOST_CHECK(FindAddressUnspent({addressA, addressB}, 1, vBoth));
+    BOOST_CHECK_EQUAL(vBoth.size(), 2U);
+
+    // Disconnecting the block restores the output it spent from outside
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(EraseBlockAddressIndex(block, blockundo, 10));
+    }
+    FlushStateToDisk();
+    BOOST_CHECK(ReadEntries(addressA).empty());
+    BOOST_CHECK(ReadEntries(addressB).empty());
+    vUnspent = ReadUnspent(addressA);
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txid == prevout.hash);
+    BOOST_CHECK_EQUAL(vUnspent[0].first.nIndex, 3U);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nValue, 50);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nHeight, 5);
+    BOOST_CHECK(ReadUnspent(addressB).empty());
+
+    BOOST_CHECK(pblocktree->WipeAddressIndex());
+    BOOST_CHECK(ReadUnspent(addressA).empty());
+
+    // Undo data that does not match the block is rejected
+    blockundo.vtxundo.pop_back();
+    BOOST_CHECK(!GetBlockAddressIndex(block, blockundo, 10, updates));
+
+    BOOST_CHECK(InitAddressIndex(false));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_pending)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptA = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptB = GetScriptForDestination(CScriptID(scriptA));
+    CAddressIndexPrefix addressA, addressB;
+    BOOST_REQUIRE(GetAddressIndexPrefix(scriptA, addressA));
+    BOOST_REQUIRE(GetAddressIndexPrefix(scriptB, addressB));
+    BOOST_CHECK(InitAddressIndex(true));
+    ThreadAddressIndex();
+    BOOST_CHECK(IsAddressIndexComplete());
+
+    // An earlier block paying A
+    CMutableTransaction txFunding;
+    txFunding.vin.resize(1);
+    txFunding.vout.push_back(CTxOut(0, CScript() << OP_RETURN));
+    txFunding.vout.push_back(CTxOut(50, scriptA));
+    CBlock blockFunding;
+    blockFunding.vtx.push_back(MakeTransactionRef(txFunding));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(WriteBlockAddressIndex(blockFunding, CBlockUndo(), 5));
+    }
+    FlushStateToDisk();
+
+    // A coinbase paying A, and a transaction spending the earlier output of A to B
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vout.push_back(CTxOut(10, scriptA));
+    CMutableTransaction tx;
+    COutPoint prevout(txFunding.GetHash(), 1);
+    tx.vin.push_back(CTxIn(prevout));
+    tx.vout.push_back(CTxOut(40, scriptB));
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(txCoinbase));
+    block.vtx.push_back(MakeTransactionRef(tx));
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(Coin(CTxOut(50, scriptA), 5, false, false, 0));
+
+    // Connected blocks are found before their entries are written with the block index
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(WriteBlockAddressIndex(block, blockundo, 10));
+    }
+    BOOST_CHECK_EQUAL(ReadEntries(addressA).size(), 1U);
+    BOOST_CHECK_EQUAL(ReadUnspent(addressA).size(), 1U);
+    std::vector<std::pair<uint256, int> > vTx;
+    BOOST_CHECK(FindAddressTransactions({addressA, addressB}, 0, 100, 0, 10, vTx));
+    BOOST_REQUIRE_EQUAL(vTx.size(), 3U);
+    BOOST_CHECK(vTx[0].first == txFunding.GetHash());
+    BOOST_CHECK(vTx[1].first == txCoinbase.GetHash());
+    BOOST_CHECK(vTx[2].first == tx.GetHash());
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(FindAddressUnspent({addressA, addressB}, 100, vUnspent));
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 2U);
+    BOOST_CHECK(vUnspent[0].first.txid == txCoinbase.GetHash());
+    BOOST_CHECK(vUnspent[1].first.txid == tx.GetHash());
+
+    FlushStateToDisk();
+    BOOST_CHECK(pendingAddressIndex.IsEmpty());
+    BOOST_CHECK_EQUAL(ReadEntries(addressA).size(), 3U);
+    vUnspent = ReadUnspent(addressA);
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txid == txCoinbase.GetHash());
+
+    // Disconnected ones are gone, and the output they spent is back, before the database changes
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(EraseBlockAddressIndex(block, blockundo, 10));
+    }
+    BOOST_CHECK(FindAddressTransactions({addressA, addressB}, 0, 100, 0, 10, vTx));
+    BOOST_REQUIRE_EQUAL(vTx.size(), 1U);
+    BOOST_CHECK(vTx[0].first == txFunding.GetHash());
+    BOOST_CHECK(FindAddressUnspent({addressA, addressB}, 100, vUnspent));
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txid == prevout.hash);
+    BOOST_CHECK_EQUAL(vUnspent[0].second.nValue, 50);
+
+    FlushStateToDisk();
+    BOOST_CHECK_EQUAL(ReadEntries(addressA).size(), 1U);
+    BOOST_CHECK(ReadEntries(addressB).empty());
+    vUnspent = ReadUnspent(addressA);
+    BOOST_REQUIRE_EQUAL(vUnspent.size(), 1U);
+    BOOST_CHECK(vUnspent[0].first.txid == prevout.hash);
+
+    BOOST_CHECK(InitAddressIndex(false));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -348,6 +348,22 @@ BOOST_AUTO_TEST_CASE( multiply )
     BOOST_CHECK((R1L * 1) == R1L);
     BOOST_CHECK((R1L * 3).ToString() == "7759b1c0ed14047f961ad09b20ff83687876a0181a367b813634046f91def7d4");
     BOOST_CHECK((R2L * 0x87654321UL).ToString() == "23f7816e30c4ae2017257b7a0fa64d60402f5234d46e746b61c960d09a26d070");
+
+    // Mul64 truncates like operator* and reports whether anything was lost
+    bool fOverflow = true;
+    BOOST_CHECK(arith_uint256(R1L).Mul64(0x87654321UL, &fOverflow) == R1L * 0x87654321UL);
+    BOOST_CHECK(fOverflow);
+    BOOST_CHECK(arith_uint256(R1L).Mul64(0x1234567887654321ULL) == R1L * arith_uint256(0x1234567887654321ULL));
+    BOOST_CHECK(arith_uint256(R1L >> 64).Mul64(0xffffffffffffffffULL, &fOverflow) == (R1L >> 64) * arith_uint256(0xffffffffffffffffULL));
+    BOOST_CHECK(!fOverflow);
+    BOOST_CHECK(arith_uint256(R1L >> 62).Mul64(0xffffffffffffffffULL, &fOverflow) == (R1L >> 62) * arith_uint256(0xffffffffffffffffULL));
+    BOOST_CHECK(fOverflow);
+    BOOST_CHECK(arith_uint256(MaxL).Mul64(0, &fOverflow) == ZeroL);
+    BOOST_CHECK(!fOverflow);
+    BOOST_CHECK(arith_uint256(MaxL).Mul64(1, &fOverflow) == MaxL);
+    BOOST_CHECK(!fOverflow);
+    BOOST_CHECK(arith_uint256(MaxL).Mul64(2, &fOverflow) == MaxL - 1);
+    BOOST_CHECK(fOverflow);
 }
 
 BOOST_AUTO_TEST_CASE( divide )
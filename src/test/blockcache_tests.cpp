@@ -0,0 +1,137 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(size_t nTx)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    pblock->nNonce = insecure_rand();
+    pblock->hashMerkleRoot = GetRandHash();
+    for (size_t i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        tx.vout.resize(1);
+        pblock->vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_hits_and_misses)
+{
+    CBlockCache cache;
+    std::shared_ptr<const CBlock> pblock = MakeBlock(2);
+    uint256 hash = pblock->GetHash();
+
+    BOOST_CHECK(!cache.Get(hash));
+    cache.Insert(hash, pblock);
+    // Readers share the cached block rather than getting a copy
+    BOOST_CHECK(cache.Get(hash) == pblock);
+    BOOST_CHECK(cache.Get(hash) == pblock);
+
+    // Misses of readers that don't fill the cache are not counted
+    BOOST_CHECK(!cache.Get(GetRandHash(), false));
+
+    CBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits, 2U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nEntries, 1U);
+    BOOST_CHECK(stats.nUsage > 0);
+
+    cache.Clear();
+    BOOST_CHECK(!cache.Get(hash));
+    BOOST_CHECK_EQUAL(cache.GetStats().nUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_bounded)
+{
+    CBlockCache cache(256 << 10);
+    std::vector<std::shared_ptr<const CBlock>> vBlocks;
+    for (int i = 0; i < 1000; i++) {
+        vBlocks.push_back(MakeBlock(4));
+        cache.Insert(vBlocks.back()->GetHash(), vBlocks.back());
+    }
+
+    CBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK(stats.nUsage <= stats.nMaxUsage);
+    BOOST_CHECK(stats.nEvictions > 0);
+    BOOST_CHECK_EQUAL(stats.nEntries + stats.nEvictions, vBlocks.size());
+    // The most recent block is always kept
+    BOOST_CHECK(cache.Get(vBlocks.back()->GetHash()) == vBlocks.back());
+
+    // Shrinking the cache evicts, but readers keep their blocks alive
+    std::shared_ptr<const CBlock> pblock = cache.Get(vBlocks.back()->GetHash());
+    vBlocks.clear();
+    cache.SetMaxUsage(0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+    BOOST_CHECK_EQUAL(pblock->vtx.size(), 4U);
+
+    // Blocks that could never fit are not cached
+    cache.Insert(pblock->GetHash(), pblock);
+    BOOST_CHECK(!cache.Get(pblock->GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru_order)
+{
+    // A cache this small is a single shard; fill it and check recently read blocks survive
+    std::shared_ptr<const CBlock> pblock = MakeBlock(1);
+    CBlockCache cache;
+    cache.Insert(pblock->GetHash(), pblock);
+    size_t nEntryUsage = cache.GetStats().nUsage;
+    cache.SetMaxUsage(nEntryUsage * 2);
+    BOOST_CHECK_EQUAL(cache.GetStats().nShards, 1U);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0U);
+
+    std::vector<std::shared_ptr<const CBlock>> vBlocks;
+    vBlocks.push_back(pblock);
+    vBlocks.push_back(MakeBlock(1));
+    vBlocks.push_back(MakeBlock(1));
+
+    cache.Insert(vBlocks[0]->GetHash(), vBlocks[0]);
+    cache.Insert(vBlocks[1]->GetHash(), vBlocks[1]);
+    // Touch the oldest so the second one becomes the eviction candidate
+    BOOST_CHECK(cache.Get(vBlocks[0]->GetHash()));
+    cache.Insert(vBlocks[2]->GetHash(), vBlocks[2]);
+
+    BOOST_CHECK(cache.Get(vBlocks[0]->GetHash()));
+    BOOST_CHECK(!cache.Get(vBlocks[1]->GetHash()));
+    BOOST_CHECK(cache.Get(vBlocks[2]->GetHash()));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEvictions, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_shards)
+{
+    BOOST_CHECK_EQUAL(CBlockCache(BLOCK_CACHE_MIN_SHARD_USAGE - 1).GetStats().nShards, 1U);
+    BOOST_CHECK_EQUAL(CBlockCache(BLOCK_CACHE_MIN_SHARD_USAGE * 4).GetStats().nShards, 4U);
+    BOOST_CHECK_EQUAL(CBlockCache(BLOCK_CACHE_MIN_SHARD_USAGE * BLOCK_CACHE_SHARDS * 2).GetStats().nShards, BLOCK_CACHE_SHARDS);
+
+    // A block that takes most of a small cache is still cached
+    std::shared_ptr<const CBlock> pblock = MakeBlock(100);
+    CBlockCache cache;
+    cache.Insert(pblock->GetHash(), pblock);
+    size_t nUsage = cache.GetStats().nUsage;
+    cache.SetMaxUsage(nUsage + nUsage / 2);
+    cache.Insert(pblock->GetHash(), pblock);
+    BOOST_CHECK(cache.Get(pblock->GetHash()) == pblock);
+
+    // Once resized to many shards, blocks are looked up in the shard they went to
+    cache.SetMaxUsage(BLOCK_CACHE_MIN_SHARD_USAGE * BLOCK_CACHE_SHARDS);
+    std::vector<std::shared_ptr<const CBlock>> vBlocks;
+    for (int i = 0; i < 100; i++) {
+        vBlocks.push_back(MakeBlock(1));
+        cache.Insert(vBlocks.back()->GetHash(), vBlocks.back());
+    }
+    for (const auto& pblockCached : vBlocks)
+        BOOST_CHECK(cache.Get(pblockCached->GetHash()) == pblockCached);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,107 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/merkle.h"
+#include "protocol.h"
+#include "script/script.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, BasicTestingSetup)
+
+static void WriteRecord(CDataStream& ss, const std::vector<char>& vchRecord)
+{
+    ss.write((const char*)Params().MessageStart(), CMessageHeader::MESSAGE_START_SIZE);
+    ss << (unsigned int)vchRecord.size();
+    ss.write(vchRecord.data(), vchRecord.size());
+}
+
+/** A proof-of-stake block, whose header needs no proof of work to pass the importer's checks */
+static CBlock MakeStakeBlock(int i)
+{
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].scriptSig = CScript() << i << OP_0;
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.resize(1);
+    txCoinStake.vin[0].prevout = COutPoint(uint256S("0x01"), i);
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1].nValue = 1;
+
+    CBlock block;
+    block.nVersion = 7;
+    block.nTime = 1400000000 + i;
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinBase)));
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinStake)));
+    block.prevoutStake = block.vtx[1]->vin[0].prevout;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static std::vector<char> SerializeLegacy(CBlock& block)
+{
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << LEGACY_BLOCK(block);
+    return std::vector<char>(ssBlock.begin(), ssBlock.end());
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_order)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    std::vector<uint256> vHashes;
+    std::vector<uint64_t> vPos;
+    for (int i = 0; i < 50; i++) {
+        CBlock block = MakeStakeBlock(i);
+        std::vector<char> vchRecord = SerializeLegacy(block);
+        // Junk between the records is skipped, as in a partly written block file
+        if (i % 10 == 5)
+            ss << std::string("junk");
+        WriteRecord(ss, vchRecord);
+        vHashes.push_back(block.GetHash());
+        vPos.push_back(ss.size() - vchRecord.size());
+    }
+    // Records that do not deserialize, or fail the context-free checks, are handed out without a block
+    WriteRecord(ss, std::vector<char>(100, (char)0xff));
+    CBlock blockBadMerkle = MakeStakeBlock(50);
+    blockBadMerkle.hashMerkleRoot = uint256();
+    WriteRecord(ss, SerializeLegacy(blockBadMerkle));
+    CBlock blockBadPoW = MakeStakeBlock(51);
+    blockBadPoW.vtx.pop_back();
+    blockBadPoW.prevoutStake.SetNull();
+    blockBadPoW.hashMerkleRoot = BlockMerkleRoot(blockBadPoW);
+    WriteRecord(ss, SerializeLegacy(blockBadPoW));
+
+    FILE* file = tmpfile();
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(ss.data(), 1, ss.size(), file), ss.size());
+    rewind(file);
+
+    CBlockImporter importer(Params(), file, 4);
+    std::shared_ptr<CImportedBlock> pitem;
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        BOOST_REQUIRE(importer.Next(pitem));
+        BOOST_REQUIRE(pitem->pblock);
+        BOOST_CHECK(pitem->pblock->GetHash() == vHashes[i]);
+        BOOST_CHECK_EQUAL(pitem->nPos, vPos[i]);
+        BOOST_CHECK(pitem->vchData.empty());
+    }
+    for (int i = 0; i < 3; i++) {
+        BOOST_REQUIRE(importer.Next(pitem));
+        BOOST_CHECK(!pitem->pblock);
+        BOOST_CHECK(!pitem->strError.empty());
+    }
+    BOOST_CHECK(pitem->strError.find("high-hash") != std::string::npos);
+    BOOST_CHECK(!importer.Next(pitem));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
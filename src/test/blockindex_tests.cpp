@@ -0,0 +1,92 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockindex_arena)
+{
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> vEntries;
+    std::vector<const unsigned char*> vSigs;
+    for (int i = 0; i < 10000; i++) {
+        CBlockHeader header;
+        header.nTime = i;
+        vEntries.push_back(i % 2 ? arena.New() : arena.New(header));
+        vEntries.back()->nHeight = i;
+        std::vector<unsigned char> vchSig(i % 100, (unsigned char)i);
+        vSigs.push_back(arena.StoreBytes(vchSig.data(), vchSig.size()));
+    }
+    // A signature too big to share a chunk
+    std::vector<unsigned char> vchBig(200000, 0xab);
+    const unsigned char* pchBig = arena.StoreBytes(vchBig.data(), vchBig.size());
+
+    // Entries and bytes handed out earlier are not moved by later ones
+    for (int i = 0; i < 10000; i++) {
+        BOOST_CHECK_EQUAL(vEntries[i]->nHeight, i);
+        BOOST_CHECK_EQUAL(vEntries[i]->nTime, i % 2 ? 0U : (unsigned int)i);
+        BOOST_CHECK(std::vector<unsigned char>(vSigs[i], vSigs[i] + i % 100) == std::vector<unsigned char>(i % 100, (unsigned char)i));
+    }
+    BOOST_CHECK(std::vector<unsigned char>(pchBig, pchBig + vchBig.size()) == vchBig);
+
+    CBlockIndexArena::Stats stats = arena.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 10000U);
+    BOOST_CHECK(stats.nEntryUsage >= 10000 * sizeof(CBlockIndex));
+    BOOST_CHECK_EQUAL(stats.nSigBytes, 100 * 4950 + vchBig.size());
+    BOOST_CHECK(stats.nSigUsage >= stats.nSigBytes);
+    BOOST_CHECK_EQUAL(stats.nClamours, 0U);
+
+    arena.NewClamour();
+    arena.Clear();
+    stats = arena.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 0U);
+    BOOST_CHECK_EQUAL(stats.nEntryUsage, 0U);
+    BOOST_CHECK_EQUAL(stats.nSigBytes, 0U);
+    BOOST_CHECK_EQUAL(stats.nClamours, 0U);
+    BOOST_CHECK(arena.New()->pprev == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_side_data)
+{
+    uint256 hash = GetRandHash();
+    CBlockIndex index;
+    index.phashBlock = &hash;
+    BOOST_CHECK(index.GetBlockSig().empty());
+    BOOST_CHECK(index.GetClamours().empty());
+    BOOST_CHECK(index.GetSupport().empty());
+    BOOST_CHECK(index.pclamour == NULL);
+
+    // No support leaves the entry without CLAMour data
+    index.SetSupport(std::vector<uint32_t>());
+    BOOST_CHECK(index.pclamour == NULL);
+
+    std::vector<unsigned char> vchSig(72, 0x30);
+    index.SetBlockSig(vchSig);
+    std::string strHash = hash.GetHex(), strURL = "http://clamour.info";
+    index.AddClamour(CClamour(5, hash, strHash, strURL));
+    index.SetSupport(std::vector<uint32_t>({0x0123abcd}));
+    index.nFlags |= CBlockIndex::BLOCK_SUPPORT_INDEXED;
+    BOOST_CHECK(index.GetBlockSig() == vchSig);
+    BOOST_CHECK(index.GetBlockHeader().vchBlockSig == vchSig);
+
+    // The block tree database keeps them in the entry
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(diskindex.vchBlockSig == vchSig);
+    BOOST_REQUIRE_EQUAL(diskindex.vClamour.size(), 1U);
+    BOOST_CHECK_EQUAL(diskindex.vClamour[0].strURL, strURL);
+    BOOST_CHECK(diskindex.vSupport == index.GetSupport());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
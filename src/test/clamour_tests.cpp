@@ -0,0 +1,92 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "clientversion.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(clamour_tests, BasicTestingSetup)
+
+static CBlock StakeBlockWithSpeech(const std::string& strSpeech)
+{
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vout.resize(1);
+
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.resize(1);
+    txCoinStake.vin[0].prevout = COutPoint(uint256S("01"), 0);
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1].nValue = COIN;
+    txCoinStake.strClamSpeech = strSpeech;
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinBase)));
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinStake)));
+    return block;
+}
+
+static std::vector<uint32_t> Support(const std::string& strSpeech)
+{
+    CBlockIndex index;
+    index.SetSupport(StakeBlockWithSpeech(strSpeech));
+    BOOST_CHECK(index.nFlags & CBlockIndex::BLOCK_SUPPORT_INDEXED);
+    return index.GetSupport();
+}
+
+BOOST_AUTO_TEST_CASE(clamour_support_parse)
+{
+    BOOST_CHECK(Support("").empty());
+    BOOST_CHECK(Support("hello clamour 0123abcd").empty());
+    BOOST_CHECK(Support("clamour").empty());
+    BOOST_CHECK(Support("clamour 0123ABCD").empty());
+    BOOST_CHECK(Support("clamour 0123abc").empty());
+
+    BOOST_CHECK(Support("clamour 0123abcd") == std::vector<uint32_t>({0x0123abcd}));
+    BOOST_CHECK(Support("clamour 0123abcd ffffffff 00000000") == std::vector<uint32_t>({0x0123abcd, 0xffffffff, 0}));
+    // Duplicates count once, and parsing stops at the first malformed id
+    BOOST_CHECK(Support("clamour 0123abcd 0123abcd") == std::vector<uint32_t>({0x0123abcd}));
+    BOOST_CHECK(Support("clamour 0123abcd 0123abcdx 89abcdef") == std::vector<uint32_t>({0x0123abcd}));
+
+    // Only the speech of a coinstake counts
+    CBlock block = StakeBlockWithSpeech("clamour 0123abcd");
+    block.vtx.pop_back();
+    CBlockIndex index;
+    index.SetSupport(block);
+    BOOST_CHECK(index.nFlags & CBlockIndex::BLOCK_SUPPORT_INDEXED);
+    BOOST_CHECK(index.GetSupport().empty());
+}
+
+BOOST_AUTO_TEST_CASE(clamour_support_serialize)
+{
+    uint256 hash = uint256S("02");
+    CBlockIndex index;
+    index.phashBlock = &hash;
+    index.SetSupport(StakeBlockWithSpeech("clamour 0123abcd 89abcdef"));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CDiskBlockIndex(&index);
+    CDiskBlockIndex diskindex;
+    ss >> diskindex;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(diskindex.nFlags & CBlockIndex::BLOCK_SUPPORT_INDEXED);
+    BOOST_CHECK(diskindex.vSupport == index.GetSupport());
+
+    // Entries written before support was indexed have nothing after the block hash
+    CBlockIndex indexOld;
+    indexOld.phashBlock = &hash;
+    CDataStream ssOld(SER_DISK, CLIENT_VERSION);
+    ssOld << CDiskBlockIndex(&indexOld);
+    CDiskBlockIndex diskindexOld;
+    ssOld >> diskindexOld;
+    BOOST_CHECK(ssOld.empty());
+    BOOST_CHECK(!(diskindexOld.nFlags & CBlockIndex::BLOCK_SUPPORT_INDEXED));
+    BOOST_CHECK(diskindexOld.vSupport.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
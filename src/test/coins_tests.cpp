@@ -3,17 +3,20 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "random.h"
 #include "script/standard.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
+#include "txdb.h"
 #include "validation.h"
 #include "consensus/validation.h"
 
-#include <vector>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
@@ -28,6 +31,7 @@ bool operator==(const Coin &a, const Coin &b) {
     if (a.IsSpent() && b.IsSpent()) return true;
     return a.fCoinBase == b.fCoinBase &&
            a.nHeight == b.nHeight &&
+           a.nTime == b.nTime &&
            a.out == b.out;
 }
 
@@ -365,7 +369,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             // Update the expected result to know about the new output coins
             assert(tx.vout.size() == 1);
             const COutPoint outpoint(tx.GetHash(), 0);
-            result[outpoint] = Coin(tx.vout[0], height, CTransaction(tx).IsCoinBase(), CTransaction(tx).IsCoinStake());
+            result[outpoint] = Coin(tx.vout[0], height, CTransaction(tx).IsCoinBase(), CTransaction(tx).IsCoinStake(), tx.nTime);
 
             // Call UpdateCoins on the top cache
             CTxUndo undo;
@@ -468,8 +472,8 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 
 BOOST_AUTO_TEST_CASE(ccoins_serialization)
 {
-    // Good example
-    CDataStream ss1(ParseHex("97f23c835800816115944e077fe7c803cfa57f29b36bf87c1d35"), SER_DISK, CLIENT_VERSION);
+    // Good example, written before coins kept the time of their transaction
+    CDataStream ss1(ParseHex("97f23c835800816115944e077fe7c803cfa57f29b36bf87c1d35"), SER_DISK, CLIENT_VERSION | SERIALIZE_COIN_NO_TIME);
     Coin cc1;
     ss1 >> cc1;
     BOOST_CHECK_EQUAL(cc1.fCoinBase, false);
@@ -478,7 +482,7 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     BOOST_CHECK_EQUAL(HexStr(cc1.out.scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))))));
 
     // Good example
-    CDataStream ss2(ParseHex("8ddf77bbd123008c988f1a4a4de2161e0f50aac7f17e7f9555caa4"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss2(ParseHex("8ddf77bbd123008c988f1a4a4de2161e0f50aac7f17e7f9555caa4"), SER_DISK, CLIENT_VERSION | SERIALIZE_COIN_NO_TIME);
     Coin cc2;
     ss2 >> cc2;
     BOOST_CHECK_EQUAL(cc2.fCoinBase, true);
@@ -487,7 +491,7 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     BOOST_CHECK_EQUAL(HexStr(cc2.out.scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("8c988f1a4a4de2161e0f50aac7f17e7f9555caa4"))))));
 
     // Smallest possible example
-    CDataStream ss3(ParseHex("000006"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss3(ParseHex("000006"), SER_DISK, CLIENT_VERSION | SERIALIZE_COIN_NO_TIME);
     Coin cc3;
     ss3 >> cc3;
     BOOST_CHECK_EQUAL(cc3.fCoinBase, false);
@@ -496,7 +500,7 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     BOOST_CHECK_EQUAL(cc3.out.scriptPubKey.size(), 0);
 
     // scriptPubKey that ends beyond the end of the stream
-    CDataStream ss4(ParseHex("000007"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss4(ParseHex("000007"), SER_DISK, CLIENT_VERSION | SERIALIZE_COIN_NO_TIME);
     try {
         Coin cc4;
         ss4 >> cc4;
@@ -509,13 +513,25 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     uint64_t x = 3000000000ULL;
     tmp << VARINT(x);
     BOOST_CHECK_EQUAL(HexStr(tmp.begin(), tmp.end()), "8a95c0bb00");
-    CDataStream ss5(ParseHex("00008a95c0bb00"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss5(ParseHex("00008a95c0bb00"), SER_DISK, CLIENT_VERSION | SERIALIZE_COIN_NO_TIME);
     try {
         Coin cc5;
         ss5 >> cc5;
         BOOST_CHECK_MESSAGE(false, "We should have thrown");
     } catch (const std::ios_base::failure& e) {
     }
+
+    // The time of the transaction follows the output
+    CDataStream ss6(SER_DISK, CLIENT_VERSION);
+    ss6 << Coin(cc1.out, cc1.nHeight, false, true, 1500000000);
+    BOOST_CHECK_EQUAL(HexStr(ss6.begin(), ss6.end()), "97f23e835800816115944e077fe7c803cfa57f29b36bf87c1d3584ca9fdd00");
+    Coin cc6;
+    ss6 >> cc6;
+    BOOST_CHECK_EQUAL(cc6.fCoinStake, true);
+    BOOST_CHECK_EQUAL(cc6.nHeight, 101999);
+    BOOST_CHECK_EQUAL(cc6.nTime, 1500000000U);
+    BOOST_CHECK(cc6.out == cc1.out);
+    BOOST_CHECK(ss6.empty());
 }
 
 const static COutPoint OUTPOINT;
@@ -709,7 +725,7 @@ void CheckAddCoinBase(CAmount base_value, CAmount cache_value, CAmount modify_va
     try {
         CTxOut output;
         output.nValue = modify_value;
-        test.cache.AddCoin(OUTPOINT, Coin(std::move(output), 1, coinbase, false), coinbase);
+        test.cache.AddCoin(OUTPOINT, Coin(std::move(output), 1, coinbase, false, 0), coinbase);
         test.cache.SelfTest();
         GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
     } catch (std::logic_error& e) {
@@ -848,4 +864,92 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+namespace {
+
+//! Coins database with the per-txout records written before coins kept the time of their transaction
+class CCoinsViewDBUntimed : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBUntimed() : CCoinsViewDB(1 << 20, true) {}
+
+    void WriteUntimed(const COutPoint& outpoint, const Coin& coin)
+    {
+        db.Write(UntimedKey(outpoint), UntimedValue(coin));
+    }
+
+private:
+    struct UntimedKey {
+        COutPoint outpoint;
+        explicit UntimedKey(const COutPoint& outpointIn) : outpoint(outpointIn) {}
+
+        template<typename Stream>
+        void Serialize(Stream& s) const {
+            s << 'C' << outpoint.hash << VARINT(outpoint.n);
+        }
+    };
+
+    struct UntimedValue {
+        Coin coin;
+        explicit UntimedValue(const Coin& coinIn) : coin(coinIn) {}
+
+        template<typename Stream>
+        void Serialize(Stream& s) const {
+            OverrideStream<Stream> os(&s, s.GetType(), s.GetVersion() | SERIALIZE_COIN_NO_TIME);
+            coin.Serialize(os);
+        }
+    };
+};
+
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_time_upgrade, TestingSetup)
+{
+    CCoinsViewDBUntimed coinsdb;
+    uint256 txidA = GetRandHash(), txidB = GetRandHash();
+    CScript script = CScript() << OP_TRUE;
+    coinsdb.WriteUntimed(COutPoint(txidA, 0), Coin(CTxOut(10, script), 5, false, false, 0));
+    coinsdb.WriteUntimed(COutPoint(txidA, 2), Coin(CTxOut(20, script), 5, false, false, 0));
+    coinsdb.WriteUntimed(COutPoint(txidB, 1), Coin(CTxOut(30, script), 7, false, true, 0));
+
+    // Each block holding coins is read once
+    std::vector<int> vHeightsRead;
+    auto getBlockTxTimes = [&](int nHeight, std::map<uint256, unsigned int>& mapTxTime) {
+        vHeightsRead.push_back(nHeight);
+        if (nHeight == 5)
+            mapTxTime[txidA] = 1000;
+        if (nHeight == 7) {
+            mapTxTime[GetRandHash()] = 1;
+            mapTxTime[txidB] = 2000;
+        }
+        return true;
+    };
+    BOOST_CHECK(coinsdb.UpgradeCoinTime(getBlockTxTimes));
+    BOOST_CHECK(vHeightsRead == std::vector<int>({5, 7}));
+
+    Coin coin;
+    BOOST_CHECK(coinsdb.GetCoin(COutPoint(txidA, 2), coin));
+    BOOST_CHECK_EQUAL(coin.nTime, 1000U);
+    BOOST_CHECK_EQUAL(coin.nHeight, 5U);
+    BOOST_CHECK_EQUAL(coin.out.nValue, 20);
+    BOOST_CHECK(coinsdb.GetCoin(COutPoint(txidB, 1), coin));
+    BOOST_CHECK_EQUAL(coin.nTime, 2000U);
+    BOOST_CHECK(coin.IsCoinStake());
+    BOOST_CHECK(!coinsdb.HaveCoin(COutPoint(txidA, 1)));
+
+    std::unique_ptr<CCoinsViewCursor> pcursor(coinsdb.Cursor());
+    size_t nCoins = 0;
+    for (; pcursor->Valid(); pcursor->Next())
+        nCoins++;
+    BOOST_CHECK_EQUAL(nCoins, 3U);
+
+    // Nothing is left to upgrade
+    vHeightsRead.clear();
+    BOOST_CHECK(coinsdb.UpgradeCoinTime(getBlockTxTimes));
+    BOOST_CHECK(vHeightsRead.empty());
+
+    // A coin whose transaction is not in the block at its height fails the upgrade
+    coinsdb.WriteUntimed(COutPoint(GetRandHash(), 0), Coin(CTxOut(40, script), 5, false, false, 0));
+    BOOST_CHECK(!coinsdb.UpgradeCoinTime(getBlockTxTimes));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
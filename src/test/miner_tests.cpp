@@ -10,7 +10,9 @@
 #include "validation.h"
 #include "miner.h"
 #include "policy/policy.h"
+#include "pos.h"
 #include "pubkey.h"
+#include "random.h"
 #include "script/standard.h"
 #include "txmempool.h"
 #include "uint256.h"
@@ -493,4 +495,77 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+/** The fee and sigops recorded for the transactions of a stake template are those of their mempool entries */
+static void CheckStakeTemplateEntries(const CBlockTemplate& blocktemplate)
+{
+    const CBlock& block = blocktemplate.block;
+    BOOST_REQUIRE_EQUAL(blocktemplate.vTxFees.size(), block.vtx.size());
+    BOOST_REQUIRE_EQUAL(blocktemplate.vTxSigOpsCost.size(), block.vtx.size());
+    BOOST_CHECK_EQUAL(blocktemplate.vTxFees[1], 0);
+    for (unsigned int i = 2; i < block.vtx.size(); i++) {
+        CTxMemPool::txiter it = mempool.mapTx.find(block.vtx[i]->GetHash());
+        BOOST_REQUIRE(it != mempool.mapTx.end());
+        BOOST_CHECK_EQUAL(blocktemplate.vTxFees[i], it->GetFee());
+        BOOST_CHECK_EQUAL(blocktemplate.vTxSigOpsCost[i], it->GetSigOpCost());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CreateNewBlock_stake_slots)
+{
+    const CChainParams& chainparams = Params(CBaseChainParams::MAIN);
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    const int64_t nSlot = (chainActive.Tip()->GetBlockTime() + 100 * 16) & ~STAKE_TIMESTAMP_MASK;
+    LOCK(cs_main);
+
+    // An old transaction, one newer than the slot and an old child of the newer one
+    CMutableTransaction txOld, txNew, txChild;
+    txOld.nTime = nSlot - 100;
+    txOld.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txOld.vout.push_back(CTxOut(COIN, scriptPubKey));
+    txNew.nTime = nSlot + 20;
+    txNew.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txNew.vout.push_back(CTxOut(COIN, scriptPubKey));
+    txChild.nTime = nSlot - 50;
+    txChild.vin.push_back(CTxIn(COutPoint(txNew.GetHash(), 0)));
+    txChild.vout.push_back(CTxOut(COIN / 2, scriptPubKey));
+    mempool.addUnchecked(txOld.GetHash(), entry.Fee(CENT).FromTx(txOld));
+    mempool.addUnchecked(txNew.GetHash(), entry.Fee(CENT).FromTx(txNew));
+    mempool.addUnchecked(txChild.GetHash(), entry.Fee(2 * CENT).FromTx(txChild));
+
+    BlockAssembler assembler(chainparams);
+    int64_t nFees = 0;
+    std::unique_ptr<CBlockTemplate> pblocktemplate = assembler.CreateNewBlock(scriptPubKey, true, &nFees, nSlot);
+    BOOST_REQUIRE(pblocktemplate);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == txOld.GetHash());
+    BOOST_CHECK_EQUAL(nFees, CENT);
+    CheckStakeTemplateEntries(*pblocktemplate);
+
+    // Two slots later all of them fit
+    pblocktemplate = assembler.CreateNewBlock(scriptPubKey, true, &nFees, nSlot + 32);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 5U);
+    BOOST_CHECK_EQUAL(nFees, 4 * CENT);
+    CheckStakeTemplateEntries(*pblocktemplate);
+    for (unsigned int i = 2; i < pblocktemplate->block.vtx.size(); i++)
+        BOOST_CHECK(pblocktemplate->block.vtx[i]->nTime <= nSlot + 32);
+
+    // And back at the first slot the reused selection is filtered again
+    pblocktemplate = assembler.CreateNewBlock(scriptPubKey, true, &nFees, nSlot);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK_EQUAL(nFees, CENT);
+    CheckStakeTemplateEntries(*pblocktemplate);
+
+    // A transaction entering the mempool is picked up
+    CMutableTransaction txLater(txOld);
+    txLater.vin[0].prevout.hash = GetRandHash();
+    mempool.addUnchecked(txLater.GetHash(), entry.Fee(CENT).FromTx(txLater));
+    pblocktemplate = assembler.CreateNewBlock(scriptPubKey, true, &nFees, nSlot);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK_EQUAL(nFees, 2 * CENT);
+    CheckStakeTemplateEntries(*pblocktemplate);
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "notary.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(notary_tests, TestingSetup)
+
+static CMutableTransaction SpeechTransaction(const std::string& strSpeech)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.strClamSpeech = strSpeech;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(notary_speech)
+{
+    uint256 hash = uint256S("9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08");
+    uint256 hashNotary;
+
+    BOOST_CHECK(GetNotaryHash(SpeechTransaction("notary " + hash.GetHex()), hashNotary));
+    BOOST_CHECK(hashNotary == hash);
+
+    BOOST_CHECK(!GetNotaryHash(SpeechTransaction(""), hashNotary));
+    BOOST_CHECK(!GetNotaryHash(SpeechTransaction(hash.GetHex()), hashNotary));
+    BOOST_CHECK(!GetNotaryHash(SpeechTransaction("notary  " + hash.GetHex()), hashNotary));
+    BOOST_CHECK(!GetNotaryHash(SpeechTransaction("notary " + hash.GetHex() + " "), hashNotary));
+    BOOST_CHECK(!GetNotaryHash(SpeechTransaction("notary " + hash.GetHex().substr(1)), hashNotary));
+    BOOST_CHECK(!GetNotaryHash(SpeechTransaction("notary 9F86D081884C7D659A2FEAA0C55AD015A3BF4F1B2B0B822CD15D6C15B0F00A08"), hashNotary));
+    BOOST_CHECK(!GetNotaryHash(SpeechTransaction("notary 9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a0g"), hashNotary));
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(SpeechTransaction("")));
+    block.vtx.push_back(MakeTransactionRef(SpeechTransaction("notary " + hash.GetHex())));
+    block.vtx.push_back(MakeTransactionRef(SpeechTransaction("create clamour " + hash.GetHex())));
+    std::vector<CNotaryIndexKey> vKeys = GetBlockNotaryKeys(block);
+    BOOST_REQUIRE_EQUAL(vKeys.size(), 1U);
+    BOOST_CHECK(vKeys[0].hashNotary == hash);
+    BOOST_CHECK(vKeys[0].txid == block.vtx[1]->GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(notary_index_db)
+{
+    uint256 hashA = GetRandHash(), hashB = GetRandHash();
+    std::vector<std::pair<CNotaryIndexKey, int> > vEntries;
+    for (int i = 0; i < 3; i++)
+        vEntries.push_back(std::make_pair(CNotaryIndexKey(hashA, GetRandHash()), 10 + i));
+    vEntries.push_back(std::make_pair(CNotaryIndexKey(hashB, GetRandHash()), 20));
+    BOOST_CHECK(pblocktree->WriteNotaryIndex(vEntries));
+
+    std::vector<std::pair<uint256, int> > vTx;
+    BOOST_CHECK(pblocktree->ReadNotaryIndex(hashA, vTx));
+    BOOST_CHECK_EQUAL(vTx.size(), 3U);
+    vTx.clear();
+    BOOST_CHECK(pblocktree->ReadNotaryIndex(hashB, vTx));
+    BOOST_REQUIRE_EQUAL(vTx.size(), 1U);
+    BOOST_CHECK(vTx[0].first == vEntries[3].first.txid);
+    BOOST_CHECK_EQUAL(vTx[0].second, 20);
+
+    BOOST_CHECK(pblocktree->EraseNotaryIndex(std::vector<CNotaryIndexKey>(1, vEntries[0].first)));
+    vTx.clear();
+    BOOST_CHECK(pblocktree->ReadNotaryIndex(hashA, vTx));
+    BOOST_CHECK_EQUAL(vTx.size(), 2U);
+
+    int nHeight = 0;
+    BOOST_CHECK(pblocktree->WriteNotaryIndexBuild(std::vector<std::pair<CNotaryIndexKey, int> >(), 5));
+    BOOST_CHECK(pblocktree->ReadNotaryIndexBuildHeight(nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 5);
+
+    BOOST_CHECK(pblocktree->WipeNotaryIndex());
+    BOOST_CHECK(pblocktree->ReadNotaryIndexBuildHeight(nHeight));
+    BOOST_CHECK_EQUAL(nHeight, -1);
+    vTx.clear();
+    BOOST_CHECK(pblocktree->ReadNotaryIndex(hashA, vTx));
+    BOOST_CHECK(vTx.empty());
+}
+
+BOOST_AUTO_TEST_CASE(notary_index_build)
+{
+    uint256 hash = GetRandHash();
+    std::vector<std::pair<uint256, int> > vTx;
+
+    // Turning the index on for an existing chain leaves it to be built
+    BOOST_CHECK(InitNotaryIndex(true));
+    BOOST_CHECK(fNotaryIndex);
+    BOOST_CHECK(!IsNotaryIndexComplete());
+    BOOST_CHECK(!FindNotaryTransactions(hash, vTx));
+
+    ThreadNotaryIndex();
+    BOOST_CHECK(IsNotaryIndexComplete());
+    BOOST_CHECK(FindNotaryTransactions(hash, vTx));
+    BOOST_CHECK(vTx.empty());
+
+    // Entries come back most recent first
+    std::vector<std::pair<CNotaryIndexKey, int> > vEntries;
+    for (int i = 0; i < 4; i++)
+        vEntries.push_back(std::make_pair(CNotaryIndexKey(hash, GetRandHash()), i * 7 % 4));
+    BOOST_CHECK(pblocktree->WriteNotaryIndex(vEntries));
+    BOOST_CHECK(FindNotaryTransactions(hash, vTx));
+    BOOST_REQUIRE_EQUAL(vTx.size(), 4U);
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK_EQUAL(vTx[i].second, 3 - i);
+
+    // Turning it off drops it
+    BOOST_CHECK(InitNotaryIndex(false));
+    BOOST_CHECK(!fNotaryIndex);
+    BOOST_CHECK(!FindNotaryTransactions(hash, vTx));
+    BOOST_CHECK(pblocktree->ReadNotaryIndex(hash, vTx));
+    BOOST_CHECK(vTx.empty());
+}
+
+BOOST_AUTO_TEST_CASE(notary_index_pending)
+{
+    uint256 hash = uint256S("9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08");
+    std::vector<std::pair<uint256, int> > vTx;
+    BOOST_CHECK(InitNotaryIndex(true));
+    ThreadNotaryIndex();
+    BOOST_CHECK(IsNotaryIndexComplete());
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(SpeechTransaction("notary " + hash.GetHex())));
+
+    // Connected blocks are found before their entries are written with the block index
+    {
+        LOCK(cs_main);
+        WriteBlockNotaryIndex(block, 7);
+    }
+    BOOST_CHECK(FindNotaryTransactions(hash, vTx));
+    BOOST_REQUIRE_EQUAL(vTx.size(), 1U);
+    BOOST_CHECK(vTx[0].first == block.vtx[0]->GetHash());
+    BOOST_CHECK_EQUAL(vTx[0].second, 7);
+    vTx.clear();
+    BOOST_CHECK(pblocktree->ReadNotaryIndex(hash, vTx));
+    BOOST_CHECK(vTx.empty());
+
+    // A copy of the pending entries finds them without cs_main
+    CPendingNotaryIndex pending;
+    {
+        LOCK(cs_main);
+        pending = pendingNotaryIndex;
+    }
+    BOOST_CHECK(FindNotaryTransactions(hash, pending, vTx));
+    BOOST_REQUIRE_EQUAL(vTx.size(), 1U);
+    BOOST_CHECK(vTx[0].first == block.vtx[0]->GetHash());
+    vTx.clear();
+
+    FlushStateToDisk();
+    BOOST_CHECK(pendingNotaryIndex.IsEmpty());
+    BOOST_CHECK(pblocktree->ReadNotaryIndex(hash, vTx));
+    BOOST_CHECK_EQUAL(vTx.size(), 1U);
+
+    // And disconnected ones are gone before their entries are erased
+    {
+        LOCK(cs_main);
+        EraseBlockNotaryIndex(block);
+    }
+    BOOST_CHECK(FindNotaryTransactions(hash, vTx));
+    BOOST_CHECK(vTx.empty());
+    FlushStateToDisk();
+    BOOST_CHECK(pblocktree->ReadNotaryIndex(hash, vTx));
+    BOOST_CHECK(vTx.empty());
+
+    BOOST_CHECK(InitNotaryIndex(false));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "orphanblocks.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(orphanblocks_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock(const uint256& hashPrev, bool fProofOfStake = false)
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    pblock->nVersion = CBlockHeader::CURRENT_VERSION;
+    pblock->hashPrevBlock = hashPrev;
+    pblock->nNonce = insecure_rand();
+    pblock->nTime = 1500000000;
+    pblock->hashMerkleRoot = GetRandHash();
+    if (fProofOfStake)
+        pblock->prevoutStake = COutPoint(GetRandHash(), 1);
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    pblock->vtx.push_back(MakeTransactionRef(std::move(tx)));
+    if (fProofOfStake) {
+        CMutableTransaction txCoinStake;
+        txCoinStake.vin.push_back(CTxIn(pblock->prevoutStake));
+        txCoinStake.vout.resize(2);
+        txCoinStake.vout[0].SetEmpty();
+        txCoinStake.vout[1].nValue = COIN;
+        pblock->vtx.push_back(MakeTransactionRef(std::move(txCoinStake)));
+    }
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(orphanblocks_chains)
+{
+    COrphanBlockPool pool;
+    uint256 hashParent = GetRandHash();
+    std::shared_ptr<const CBlock> pblockA = MakeBlock(hashParent);
+    std::shared_ptr<const CBlock> pblockB = MakeBlock(pblockA->GetHash(), true);
+    std::shared_ptr<const CBlock> pblockC = MakeBlock(pblockB->GetHash());
+    std::shared_ptr<const CBlock> pblockD = MakeBlock(hashParent);
+
+    BOOST_CHECK(pool.Add(pblockC, 1));
+    BOOST_CHECK(pool.Add(pblockB, 2));
+    BOOST_CHECK(pool.Add(pblockA, 1));
+    BOOST_CHECK(pool.Add(pblockD, 2));
+    BOOST_CHECK(!pool.Add(pblockA, 3));
+    BOOST_CHECK_EQUAL(pool.size(), 4U);
+    BOOST_CHECK(pool.Have(pblockB->GetHash()));
+    BOOST_CHECK(pool.HaveChild(hashParent));
+    BOOST_CHECK(!pool.HaveChild(pblockC->GetHash()));
+    BOOST_CHECK(pool.HaveStake(pblockB->GetProofOfStake()));
+    BOOST_CHECK(!pool.HaveStake(MakeBlock(hashParent, true)->GetProofOfStake()));
+
+    // The chain is waiting for the parent of its first block
+    BOOST_CHECK(pool.GetRoot(pblockC->GetHash()) == pblockA->GetHash());
+    BOOST_CHECK(pool.GetWanted(pblockC->GetHash()) == hashParent);
+    BOOST_CHECK(pool.GetRoot(hashParent) == hashParent);
+
+    COrphanBlockPool::Stats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocks, 4U);
+    BOOST_CHECK_EQUAL(stats.nPeers, 2U);
+    BOOST_CHECK(stats.nUsage > 0);
+
+    // Orphans are handed back as they were received, not copies
+    std::vector<std::shared_ptr<const CBlock> > vBlocks = pool.TakeChildren(hashParent);
+    BOOST_REQUIRE_EQUAL(vBlocks.size(), 2U);
+    BOOST_CHECK(vBlocks[0] == pblockA || vBlocks[1] == pblockA);
+    BOOST_CHECK(vBlocks[0] == pblockD || vBlocks[1] == pblockD);
+    vBlocks = pool.TakeChildren(pblockA->GetHash());
+    BOOST_REQUIRE_EQUAL(vBlocks.size(), 1U);
+    BOOST_CHECK(vBlocks[0] == pblockB);
+    BOOST_CHECK(!pool.HaveStake(pblockB->GetProofOfStake()));
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nConnected, 3U);
+
+    vBlocks = pool.TakeChildren(pblockB->GetHash());
+    BOOST_CHECK_EQUAL(vBlocks.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nUsage, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(orphanblocks_peers)
+{
+    COrphanBlockPool pool;
+    std::vector<uint256> vHashes;
+    for (int i = 0; i < 30; i++) {
+        std::shared_ptr<const CBlock> pblock = MakeBlock(GetRandHash());
+        vHashes.push_back(pblock->GetHash());
+        BOOST_CHECK(pool.Add(pblock, i % 3));
+    }
+
+    BOOST_CHECK_EQUAL(pool.EraseForPeer(1), 10U);
+    BOOST_CHECK_EQUAL(pool.EraseForPeer(1), 0U);
+    BOOST_CHECK_EQUAL(pool.EraseForPeer(5), 0U);
+    for (int i = 0; i < 30; i++)
+        BOOST_CHECK_EQUAL(pool.Have(vHashes[i]), i % 3 != 1);
+
+    COrphanBlockPool::Stats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocks, 20U);
+    BOOST_CHECK_EQUAL(stats.nPeers, 2U);
+    BOOST_CHECK_EQUAL(stats.nPeerErased, 10U);
+}
+
+BOOST_AUTO_TEST_CASE(orphanblocks_limit)
+{
+    COrphanBlockPool pool;
+    std::vector<std::shared_ptr<const CBlock> > vChain;
+    uint256 hashParent = GetRandHash();
+    for (int i = 0; i < 10; i++) {
+        vChain.push_back(MakeBlock(i ? vChain.back()->GetHash() : hashParent));
+        BOOST_CHECK(pool.Add(vChain.back(), 0));
+    }
+    size_t nUsage = pool.GetStats().nUsage;
+
+    // Blocks that other orphans build on are kept, so the chain is cut from its end
+    pool.SetMaxUsage(nUsage / 2);
+    COrphanBlockPool::Stats stats = pool.GetStats();
+    BOOST_CHECK(stats.nUsage <= nUsage / 2);
+    BOOST_CHECK_EQUAL(stats.nEvicted, 10 - stats.nBlocks);
+    for (size_t i = 0; i < vChain.size(); i++)
+        BOOST_CHECK_EQUAL(pool.Have(vChain[i]->GetHash()), i < stats.nBlocks);
+
+    // A block using more than the whole limit is not added
+    pool.SetMaxUsage(1);
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK(!pool.Add(vChain[0], 0));
+
+    pool.SetMaxUsage(nUsage);
+    BOOST_CHECK(pool.Add(vChain[0], 0));
+    pool.Clear();
+    BOOST_CHECK_EQUAL(pool.size(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nUsage, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
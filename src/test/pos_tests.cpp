@@ -0,0 +1,305 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "bignum.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "hash.h"
+#include "key.h"
+#include "pos.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+#include "validation.h"
+
+#include <deque>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pos_tests, BasicTestingSetup)
+
+// The weighted target as the kernel check computed it before CStakeTarget
+static bool BigNumTargetMet(unsigned int nBits, CAmount nValueIn, const uint256& hash)
+{
+    CBigNum bnTarget;
+    bnTarget.SetCompact(nBits);
+    bnTarget *= CBigNum(nValueIn);
+    return !(CBigNum(hash) > bnTarget);
+}
+
+static void CheckStakeTarget(unsigned int nBits, CAmount nValueIn)
+{
+    CStakeTarget target(nBits, nValueIn);
+    std::vector<uint256> vHashes;
+    vHashes.push_back(uint256());
+    vHashes.push_back(ArithToUint256(~arith_uint256()));
+    for (int i = 0; i < 4; i++)
+        vHashes.push_back(GetRandHash());
+    // Hashes right at the boundary of the target
+    arith_uint256 bnTarget = target.GetTarget();
+    vHashes.push_back(ArithToUint256(bnTarget));
+    vHashes.push_back(ArithToUint256(bnTarget + 1));
+    vHashes.push_back(ArithToUint256(bnTarget - 1));
+    vHashes.push_back(ArithToUint256(bnTarget >> 1));
+
+    for (const uint256& hash : vHashes) {
+        BOOST_CHECK_MESSAGE(target.IsMetBy(hash) == BigNumTargetMet(nBits, nValueIn, hash),
+                            strprintf("nBits=%08x nValue=%d hash=%s", nBits, nValueIn, hash.GetHex()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_target_matches_bignum)
+{
+    std::vector<unsigned int> vBits;
+    // Chain limits
+    vBits.push_back(Params(CBaseChainParams::MAIN).GetConsensus().posLimit);
+    vBits.push_back(Params(CBaseChainParams::TESTNET).GetConsensus().powLimit);
+    vBits.push_back(0x1d00ffff);
+    // Every exponent, including the ones that overflow 256 bits, with
+    // boundary, random and negative mantissas
+    for (unsigned int nSize = 0; nSize <= 0x24; nSize++) {
+        vBits.push_back((nSize << 24) | 0x000001);
+        vBits.push_back((nSize << 24) | 0x0000ff);
+        vBits.push_back((nSize << 24) | 0x00ffff);
+        vBits.push_back((nSize << 24) | 0x7fffff);
+        vBits.push_back((nSize << 24) | (insecure_rand() & 0x7fffff));
+        vBits.push_back((nSize << 24) | 0x800000 | (insecure_rand() & 0x7fffff));
+    }
+
+    std::vector<CAmount> vValues = {0, 1, COIN / 100, COIN, 1000 * COIN, 21000000 * COIN, MAX_MONEY, -COIN};
+    for (int i = 0; i < 4; i++)
+        vValues.push_back(((CAmount)insecure_rand() << 31) ^ insecure_rand());
+
+    for (unsigned int nBits : vBits) {
+        for (CAmount nValue : vValues)
+            CheckStakeTarget(nBits, nValue);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_target_overflow)
+{
+    // posLimit weighted by a large output does not fit in 256 bits; every hash meets it
+    CStakeTarget target(0x1E0FFFFF, MAX_MONEY);
+    BOOST_CHECK(target.IsMetBy(ArithToUint256(~arith_uint256())));
+    BOOST_CHECK(target.GetTarget() == ~arith_uint256());
+
+    CStakeTarget targetNegative(0x1E8FFFFF, COIN);
+    BOOST_CHECK(!targetNegative.IsMetBy(uint256()));
+
+    CStakeTarget targetZero(0x1E0FFFFF, 0);
+    BOOST_CHECK(targetZero.IsMetBy(uint256()));
+    BOOST_CHECK(!targetZero.IsMetBy(ArithToUint256(arith_uint256(1))));
+}
+
+// The stake modifier selection as ComputeNextStakeModifier did it before
+// CStakeModifierEngine: sort the window, then hash every candidate each round
+static uint64_t ReferenceStakeModifier(const CBlockIndex* pindexPrev, uint64_t nStakeModifierPrev)
+{
+    const int64_t nInterval = Params().GetConsensus().nModifierInterval;
+    std::vector<int64_t> vSections;
+    int64_t nSelectionInterval = 0;
+    for (int nSection = 0; nSection < 64; nSection++) {
+        vSections.push_back(nInterval * 63 / (63 + ((63 - nSection) * (MODIFIER_INTERVAL_RATIO - 1))));
+        nSelectionInterval += vSections.back();
+    }
+    int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / nInterval) * nInterval - nSelectionInterval;
+    std::vector<std::pair<std::pair<int64_t, uint256>, const CBlockIndex*> > vSorted;
+    for (const CBlockIndex* pindex = pindexPrev; pindex && pindex->GetBlockTime() >= nSelectionIntervalStart; pindex = pindex->pprev)
+        vSorted.push_back(std::make_pair(std::make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()), pindex));
+    std::sort(vSorted.begin(), vSorted.end());
+
+    uint64_t nStakeModifierNew = 0;
+    int64_t nSelectionIntervalStop = nSelectionIntervalStart;
+    std::set<const CBlockIndex*> setSelected;
+    for (int nRound = 0; nRound < std::min(64, (int)vSorted.size()); nRound++) {
+        nSelectionIntervalStop += vSections[nRound];
+        const CBlockIndex* pindexBest = NULL;
+        uint256 hashBest;
+        for (const auto& item : vSorted) {
+            const CBlockIndex* pindex = item.second;
+            if (pindexBest && pindex->GetBlockTime() > nSelectionIntervalStop)
+                break;
+            if (setSelected.count(pindex))
+                continue;
+            CDataStream ss(SER_GETHASH, 0);
+            ss << pindex->hashProof << nStakeModifierPrev;
+            uint256 hashSelection = Hash(ss.begin(), ss.end());
+            if (pindex->IsProofOfStake())
+                hashSelection >>= 32;
+            if (!pindexBest || hashSelection < hashBest) {
+                hashBest = hashSelection;
+                pindexBest = pindex;
+            }
+        }
+        nStakeModifierNew |= ((uint64_t)pindexBest->GetStakeEntropyBit()) << nRound;
+        setSelected.insert(pindexBest);
+    }
+    return nStakeModifierNew;
+}
+
+// A chain of nBlocks on top of pindexFork, with times that mostly but not always increase
+static void ExtendChain(std::deque<CBlockIndex>& vIndex, std::deque<uint256>& vHashes, const CBlockIndex* pindexFork, int nBlocks)
+{
+    CBlockIndex* pindexPrev = const_cast<CBlockIndex*>(pindexFork);
+    for (int i = 0; i < nBlocks; i++) {
+        vIndex.push_back(CBlockIndex());
+        vHashes.push_back(GetRandHash());
+        CBlockIndex& index = vIndex.back();
+        index.phashBlock = &vHashes.back();
+        index.pprev = pindexPrev;
+        index.nHeight = pindexPrev ? pindexPrev->nHeight + 1 : 0;
+        index.nTime = pindexPrev ? pindexPrev->nTime + insecure_rand() % 150 - 30 : 1400000000;
+        index.hashProof = GetRandHash();
+        if (insecure_rand() % 2)
+            index.SetProofOfStake();
+        index.SetStakeEntropyBit(insecure_rand() % 2);
+        index.BuildSkip();
+        pindexPrev = &index;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_engine)
+{
+    std::deque<CBlockIndex> vIndex;
+    std::deque<uint256> vHashes;
+    ExtendChain(vIndex, vHashes, NULL, 2000);
+    const CBlockIndex* pindexTip = &vIndex.back();
+    ExtendChain(vIndex, vHashes, pindexTip->GetAncestor(1500), 300);
+    const CBlockIndex* pindexFork = &vIndex.back();
+
+    CStakeModifierEngine engine;
+    uint64_t nStakeModifier = 0;
+    // Along the chain, then across to the fork and back
+    std::vector<const CBlockIndex*> vPrev;
+    for (int nHeight = 0; nHeight <= pindexTip->nHeight; nHeight += 1 + insecure_rand() % 8)
+        vPrev.push_back(pindexTip->GetAncestor(nHeight));
+    vPrev.push_back(pindexFork);
+    vPrev.push_back(pindexTip);
+    // The same block again reuses every selection hash
+    vPrev.push_back(pindexTip);
+
+    for (const CBlockIndex* pindexPrev : vPrev) {
+        uint64_t nStakeModifierNew = 0;
+        BOOST_CHECK(engine.ComputeModifier(pindexPrev, nStakeModifier, nStakeModifierNew));
+        BOOST_CHECK_EQUAL(nStakeModifierNew, ReferenceStakeModifier(pindexPrev, nStakeModifier));
+        if (pindexPrev != pindexTip)
+            nStakeModifier = nStakeModifierNew;
+    }
+
+    CStakeModifierEngine::Stats stats = engine.GetStats();
+    BOOST_CHECK_EQUAL(stats.nRebuilds, 3U);
+    BOOST_CHECK(stats.nSelectionHashesReused > stats.nSelectionHashes);
+
+    engine.Clear();
+    uint64_t nStakeModifierNew = 0;
+    BOOST_CHECK(engine.ComputeModifier(pindexTip, nStakeModifier, nStakeModifierNew));
+    BOOST_CHECK_EQUAL(engine.GetStats().nRebuilds, 4U);
+}
+
+BOOST_AUTO_TEST_CASE(block_signature_check)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    CMutableTransaction txCoinbase;
+    txCoinbase.vin.resize(1);
+    txCoinbase.vout.resize(1);
+    txCoinbase.vout[0].SetEmpty();
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1] = CTxOut(10 * COIN, GetScriptForRawPubKey(key.GetPubKey()));
+
+    CBlock block;
+    block.nVersion = CBlockHeader::CURRENT_VERSION;
+    block.vtx.push_back(MakeTransactionRef(txCoinbase));
+    block.vtx.push_back(MakeTransactionRef(txCoinStake));
+    BOOST_REQUIRE(block.IsProofOfStake());
+    BOOST_CHECK(!CScriptCheck(block, true)());
+    BOOST_REQUIRE(key.Sign(block.GetHash(), block.vchBlockSig));
+
+    // A valid signature stored in the signature cache is found again, and a
+    // lookup that does not store it takes it out
+    BOOST_CHECK(CScriptCheck(block, true)());
+    BOOST_CHECK(CachingVerifySignature(block.vchBlockSig, key.GetPubKey(), block.GetHash(), false));
+    BOOST_CHECK(CScriptCheck(block, false)());
+
+    // Queued checks are swapped into place
+    std::vector<CScriptCheck> vChecks(1);
+    CScriptCheck check(block, false);
+    check.swap(vChecks.back());
+    BOOST_CHECK(vChecks.back()());
+
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CBlock blockBad(block);
+    BOOST_REQUIRE(keyOther.Sign(block.GetHash(), blockBad.vchBlockSig));
+    BOOST_CHECK(!CScriptCheck(blockBad, true)());
+    blockBad = block;
+    blockBad.vchBlockSig.back() ^= 1;
+    BOOST_CHECK(!CheckBlockSignature(blockBad));
+}
+
+BOOST_AUTO_TEST_CASE(header_stake_check)
+{
+    const Consensus::CParams& params = Params().GetConsensus();
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = params.nProtocolV2Height + 100;
+
+    CKey key;
+    key.MakeNewKey(true);
+    CBlockHeader header;
+    header.nVersion = CBlockHeader::CURRENT_VERSION;
+    header.nTime = 1500000000 & ~STAKE_TIMESTAMP_MASK;
+    header.nBits = 0x1e0fffff;
+    header.prevoutStake = COutPoint(GetRandHash(), 1);
+    BOOST_REQUIRE(key.Sign(header.GetHash(), header.vchBlockSig));
+
+    LOCK(cs_main);
+    CValidationState state;
+    BOOST_CHECK(CheckBlockHeaderStake(header, state, params, &indexPrev));
+
+    // Headers without a canonical signature or off the stake time mask are rejected
+    CBlockHeader headerBad(header);
+    headerBad.vchBlockSig.clear();
+    BOOST_CHECK(!CheckBlockHeaderStake(headerBad, state, params, &indexPrev));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-header-sig");
+    headerBad = header;
+    headerBad.nTime++;
+    state = CValidationState();
+    BOOST_CHECK(!CheckBlockHeaderStake(headerBad, state, params, &indexPrev));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-header-stake-time");
+
+    // A stake used by a connected block is only allowed again on a header with a child
+    CStakeSeen::Stake stake = std::make_pair(header.prevoutStake, header.nTime);
+    setStakeSeen.insert(stake);
+    int nDoS = 0;
+    state = CValidationState();
+    BOOST_CHECK(!CheckBlockHeaderStake(header, state, params, &indexPrev));
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 0);
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "dup-stake");
+    state = CValidationState();
+    BOOST_CHECK(CheckBlockHeaderStake(header, state, params, &indexPrev, true));
+    setStakeSeen.erase(stake);
+
+    // Proof-of-work headers are unsigned, and end at the last proof-of-work block
+    CBlockHeader headerPoW;
+    headerPoW.nVersion = CBlockHeader::CURRENT_VERSION;
+    BOOST_CHECK(!CheckBlockHeaderStake(headerPoW, state, params, &indexPrev));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-header-pow");
+    indexPrev.nHeight = params.LAST_POW_BLOCK - 1;
+    state = CValidationState();
+    BOOST_CHECK(CheckBlockHeaderStake(headerPoW, state, params, &indexPrev));
+    headerPoW.vchBlockSig = header.vchBlockSig;
+    BOOST_CHECK(!CheckBlockHeaderStake(headerPoW, state, params, &indexPrev));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-header-sig");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
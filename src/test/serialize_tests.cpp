@@ -2,6 +2,8 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
+#include "primitives/block.h"
 #include "serialize.h"
 #include "streams.h"
 #include "hash.h"
@@ -365,4 +367,48 @@ BOOST_AUTO_TEST_CASE(class_methods)
     BOOST_CHECK(methodtest3 == methodtest4);
 }
 
+BOOST_AUTO_TEST_CASE(legacy_block)
+{
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vout.resize(1);
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.resize(1);
+    txCoinStake.vin[0].prevout = COutPoint(uint256S("01"), 2);
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1].nValue = 1;
+
+    CBlock block;
+    block.nVersion = 7;
+    block.hashPrevBlock = uint256S("03");
+    block.nTime = 1500000000;
+    block.nBits = 0x1d00ffff;
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinBase)));
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinStake)));
+    block.vchBlockSig.assign(72, 0x30);
+
+    // Same bytes as a CBlockLegacy copy of the block
+    CDataStream ssCopy(SER_DISK, CLIENT_VERSION);
+    ssCopy << CBlockLegacy(block);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << LEGACY_BLOCK(block);
+    BOOST_CHECK(ss.str() == ssCopy.str());
+    BOOST_CHECK_EQUAL(GetSerializeSize(LEGACY_BLOCK(block), SER_DISK, CLIENT_VERSION), ss.size());
+
+    // Reading it back sets prevoutStake from the coinstake and drops any stale cached hash
+    CBlock blockRead;
+    blockRead.blockHash = uint256S("04");
+    blockRead.fChecked = true;
+    ss >> LEGACY_BLOCK(blockRead);
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(blockRead.blockHash.IsNull());
+    BOOST_CHECK(!blockRead.fChecked);
+    BOOST_CHECK(blockRead.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRead.prevoutStake == COutPoint(uint256S("01"), 2));
+    BOOST_CHECK(blockRead.vchBlockSig == block.vchBlockSig);
+    BOOST_CHECK_EQUAL(blockRead.vtx.size(), 2U);
+    BOOST_CHECK(blockRead.vtx[1]->GetHash() == block.vtx[1]->GetHash());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
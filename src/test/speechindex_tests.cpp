@@ -0,0 +1,160 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "random.h"
+#include "speechindex.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(speechindex_tests, TestingSetup)
+
+static CMutableTransaction SpeechTransaction(const std::string& strSpeech)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.strClamSpeech = strSpeech;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(speechindex_tokens)
+{
+    std::vector<std::string> vTokens = GetSpeechTokens(SpeechTransaction("Hello, CLAM world! hello a x1"));
+    std::vector<std::string> vExpected = {"hello", "clam", "world", "x1"};
+    BOOST_CHECK(vTokens == vExpected);
+
+    BOOST_CHECK(GetSpeechTokens(SpeechTransaction("")).empty());
+    BOOST_CHECK(GetSpeechTokens(SpeechTransaction("! ? a")).empty());
+
+    // Long words are cut, and the number of tokens is capped
+    vTokens = GetSpeechTokens(SpeechTransaction(std::string(100, 'z')));
+    BOOST_REQUIRE_EQUAL(vTokens.size(), 1U);
+    BOOST_CHECK_EQUAL(vTokens[0].size(), MAX_SPEECH_TOKEN_LENGTH);
+    std::string strSpeech;
+    for (int i = 0; i < 100; i++)
+        strSpeech += strprintf("w%d ", i);
+    BOOST_CHECK_EQUAL(GetSpeechTokens(SpeechTransaction(strSpeech)).size(), MAX_SPEECH_TOKENS);
+
+    // CLAMour petitions and their support
+    vTokens = GetSpeechTokens(SpeechTransaction("clamour 0123abcd 89abcdef"));
+    vExpected = {"clamour:0123abcd", "clamour:89abcdef", "clamour", "0123abcd", "89abcdef"};
+    BOOST_CHECK(vTokens == vExpected);
+    vTokens = GetSpeechTokens(SpeechTransaction("create clamour 9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08 http://clamour.info"));
+    BOOST_REQUIRE(!vTokens.empty());
+    BOOST_CHECK_EQUAL(vTokens[0], "createclamour:9f86d081");
+}
+
+BOOST_AUTO_TEST_CASE(speechindex_db)
+{
+    uint256 txidA = GetRandHash(), txidB = GetRandHash(), txidC = GetRandHash();
+    std::vector<std::pair<CSpeechIndexKey, unsigned int> > vEntries;
+    vEntries.push_back(std::make_pair(CSpeechIndexKey("clam", 10, txidA), 1));
+    vEntries.push_back(std::make_pair(CSpeechIndexKey("clams", 11, txidB), 2));
+    vEntries.push_back(std::make_pair(CSpeechIndexKey("clamour", 12, txidC), 3));
+    vEntries.push_back(std::make_pair(CSpeechIndexKey("cla", 13, txidC), 4));
+    BOOST_CHECK(pblocktree->WriteSpeechIndex(vEntries));
+
+    // An exact read does not pick up longer tokens
+    std::vector<std::pair<CSpeechIndexKey, unsigned int> > vRead;
+    BOOST_CHECK(pblocktree->ReadSpeechIndex("clam", false, 100, vRead));
+    BOOST_REQUIRE_EQUAL(vRead.size(), 1U);
+    BOOST_CHECK(vRead[0].first.txid == txidA);
+    BOOST_CHECK_EQUAL(vRead[0].first.nHeight, 10U);
+    BOOST_CHECK_EQUAL(vRead[0].second, 1U);
+
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadSpeechIndex("clam", true, 100, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 3U);
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadSpeechIndex("clam", true, 1, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 2U);
+
+    BOOST_CHECK(pblocktree->EraseSpeechIndex(std::vector<CSpeechIndexKey>(1, vEntries[1].first)));
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadSpeechIndex("clam", true, 100, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 2U);
+    pblocktree->CompactSpeechIndex();
+
+    BOOST_CHECK(pblocktree->WipeSpeechIndex());
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadSpeechIndex("cl", true, 100, vRead));
+    BOOST_CHECK(vRead.empty());
+}
+
+BOOST_AUTO_TEST_CASE(speechindex_search)
+{
+    std::vector<CSpeechMatch> vMatches;
+    std::string strError;
+
+    BOOST_CHECK(InitSpeechIndex(true));
+    BOOST_CHECK(!IsSpeechIndexComplete());
+    BOOST_CHECK(!SearchSpeechIndex("hello", vMatches, strError));
+    BOOST_CHECK(BuildSpeechIndex());
+    BOOST_CHECK(IsSpeechIndexComplete());
+
+    CBlock blockA, blockB;
+    blockA.vtx.push_back(MakeTransactionRef(SpeechTransaction("")));
+    blockA.vtx.push_back(MakeTransactionRef(SpeechTransaction("hello world")));
+    blockA.vtx.push_back(MakeTransactionRef(SpeechTransaction("clamour 0123abcd")));
+    blockB.vtx.push_back(MakeTransactionRef(SpeechTransaction("Hello worldwide")));
+    {
+        LOCK(cs_main);
+        WriteBlockSpeechIndex(blockA, 5);
+        WriteBlockSpeechIndex(blockB, 6);
+    }
+
+    // Connected blocks are found before their entries are written with the block index
+    std::vector<std::pair<CSpeechIndexKey, unsigned int> > vRead;
+    BOOST_CHECK(pblocktree->ReadSpeechIndex("hello", false, 100, vRead));
+    BOOST_CHECK(vRead.empty());
+    BOOST_CHECK(SearchSpeechIndex("HELLO", vMatches, strError));
+    BOOST_REQUIRE_EQUAL(vMatches.size(), 2U);
+    BOOST_CHECK(vMatches[0].txid == blockB.vtx[0]->GetHash());
+    BOOST_CHECK_EQUAL(vMatches[0].nHeight, 6);
+    BOOST_CHECK(vMatches[1].txid == blockA.vtx[1]->GetHash());
+    BOOST_CHECK_EQUAL(vMatches[1].nTx, 1U);
+
+    BOOST_CHECK(SearchSpeechIndex("hello world", vMatches, strError));
+    BOOST_REQUIRE_EQUAL(vMatches.size(), 1U);
+    BOOST_CHECK_EQUAL(vMatches[0].nHeight, 5);
+    BOOST_CHECK(SearchSpeechIndex("hello wor*", vMatches, strError));
+    BOOST_CHECK_EQUAL(vMatches.size(), 2U);
+    FlushStateToDisk();
+    BOOST_CHECK(pendingSpeechIndex.IsEmpty());
+    BOOST_CHECK(pblocktree->ReadSpeechIndex("hello", false, 100, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 2U);
+    BOOST_CHECK(SearchSpeechIndex("hello wor*", vMatches, strError));
+    BOOST_CHECK_EQUAL(vMatches.size(), 2U);
+    BOOST_CHECK(SearchSpeechIndex("clamour:0123ABCD", vMatches, strError));
+    BOOST_REQUIRE_EQUAL(vMatches.size(), 1U);
+    BOOST_CHECK_EQUAL(vMatches[0].nTx, 2U);
+    BOOST_CHECK(SearchSpeechIndex("goodbye world", vMatches, strError));
+    BOOST_CHECK(vMatches.empty());
+
+    BOOST_CHECK(!SearchSpeechIndex("wo*", vMatches, strError));
+    BOOST_CHECK(!SearchSpeechIndex(" ! ", vMatches, strError));
+
+    // Disconnecting a block removes its entries, before they are erased from the database
+    {
+        LOCK(cs_main);
+        EraseBlockSpeechIndex(blockB, 6);
+    }
+    BOOST_CHECK(SearchSpeechIndex("hello", vMatches, strError));
+    BOOST_CHECK_EQUAL(vMatches.size(), 1U);
+    FlushStateToDisk();
+    vRead.clear();
+    BOOST_CHECK(pblocktree->ReadSpeechIndex("hello", false, 100, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 1U);
+    BOOST_CHECK(SearchSpeechIndex("hello", vMatches, strError));
+    BOOST_CHECK_EQUAL(vMatches.size(), 1U);
+
+    BOOST_CHECK(InitSpeechIndex(false));
+    BOOST_CHECK(!SearchSpeechIndex("hello", vMatches, strError));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
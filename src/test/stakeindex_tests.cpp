@@ -0,0 +1,109 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "stakeindex.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "validation.h"
+
+#include <memory>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakeindex_tests, TestingSetup)
+
+static uint160 Staker(int n)
+{
+    uint160 staker;
+    if (n)
+        *staker.begin() = n;
+    return staker;
+}
+
+BOOST_AUTO_TEST_CASE(stakeindex_upgrade)
+{
+    // Entries written with little endian heights, which do not sort by height
+    std::vector<unsigned int> vHeights = {1, 256, 255, 2, 65536};
+    for (unsigned int nHeight : vHeights)
+        BOOST_CHECK(pblocktree->Write(std::make_pair('s', nHeight), Staker(nHeight % 250)));
+    BOOST_CHECK(pblocktree->UpgradeStakeIndex());
+
+    std::unique_ptr<CStakeIndexCursor> pcursor(pblocktree->StakeIndexCursor(0));
+    std::vector<unsigned int> vRead;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        unsigned int nHeight;
+        uint160 staker;
+        BOOST_CHECK(pcursor->GetKey(nHeight));
+        BOOST_CHECK(pcursor->GetValue(staker));
+        BOOST_CHECK(staker == Staker(nHeight % 250));
+        vRead.push_back(nHeight);
+    }
+    std::vector<unsigned int> vExpected = {1, 2, 255, 256, 65536};
+    BOOST_CHECK(vRead == vExpected);
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair('s', 1U)));
+
+    uint160 staker;
+    BOOST_CHECK(pblocktree->ReadStakeIndex(255, staker));
+    BOOST_CHECK(staker == Staker(5));
+    BOOST_CHECK(!pblocktree->ReadStakeIndex(3, staker));
+    pcursor.reset(pblocktree->StakeIndexCursor(257));
+    BOOST_REQUIRE(pcursor->Valid());
+    unsigned int nHeight;
+    BOOST_CHECK(pcursor->GetKey(nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 65536U);
+}
+
+BOOST_AUTO_TEST_CASE(stakeindex_stats)
+{
+    // Every tenth block proof-of-work, the others staked by 1 or 2 in turn, then 3 from height 250
+    CHeightIndexUpdates updates;
+    for (int nHeight = 0; nHeight < 300; nHeight++)
+        updates.WriteStakeIndex(nHeight, Staker(nHeight % 10 == 0 ? 0 : nHeight >= 250 ? 3 : 1 + nHeight % 2));
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, std::vector<const CBlockIndex*>(), updates, CPendingNotaryIndex(), CPendingSpeechIndex(), CPendingAddressIndex(), uint256()));
+
+    CStakeIndexStats stats;
+    BOOST_CHECK(GetStakeIndexStats(*pblocktree, 200, 279, {20, 60, 1000}, CHeightIndexUpdates(), stats));
+    BOOST_CHECK_EQUAL(stats.nBlocks, 80);
+    BOOST_CHECK_EQUAL(stats.nStakeBlocks, 72);
+    BOOST_REQUIRE_EQUAL(stats.mapStakers.size(), 3U);
+    BOOST_CHECK(stats.vWindowStakeBlocks == std::vector<int>({18, 54, 72}));
+
+    const CStakerStats& stats2 = stats.mapStakers[Staker(2)];
+    BOOST_CHECK_EQUAL(stats2.nBlocks, 25);
+    BOOST_CHECK_EQUAL(stats2.nFirstHeight, 201);
+    BOOST_CHECK_EQUAL(stats2.nLastHeight, 249);
+    BOOST_CHECK(stats2.vWindowBlocks == std::vector<int>({0, 15, 25}));
+    BOOST_CHECK_EQUAL(stats.mapStakers[Staker(1)].nBlocks, 20);
+    const CStakerStats& stats3 = stats.mapStakers[Staker(3)];
+    BOOST_CHECK_EQUAL(stats3.nBlocks, 27);
+    BOOST_CHECK_EQUAL(stats3.nFirstHeight, 251);
+    BOOST_CHECK_EQUAL(stats3.nLastHeight, 279);
+    BOOST_CHECK(stats3.vWindowBlocks == std::vector<int>({18, 27, 27}));
+
+    // Past the end of the index
+    BOOST_CHECK(GetStakeIndexStats(*pblocktree, 290, 1000, std::vector<int>(), CHeightIndexUpdates(), stats));
+    BOOST_CHECK_EQUAL(stats.nBlocks, 10);
+    BOOST_CHECK_EQUAL(stats.nStakeBlocks, 9);
+    BOOST_CHECK(GetStakeIndexStats(*pblocktree, 10, 5, std::vector<int>(), CHeightIndexUpdates(), stats));
+    BOOST_CHECK_EQUAL(stats.nBlocks, 0);
+
+    // Changes not yet written override the entries read: a block disconnected, one replaced and one connected
+    CHeightIndexUpdates pending;
+    pending.EraseStakeIndex(279);
+    pending.WriteStakeIndex(278, Staker(2));
+    pending.WriteStakeIndex(300, Staker(2));
+    BOOST_CHECK(GetStakeIndexStats(*pblocktree, 270, 300, {2}, pending, stats));
+    BOOST_CHECK_EQUAL(stats.nBlocks, 30);
+    BOOST_CHECK_EQUAL(stats.nStakeBlocks, 27);
+    BOOST_CHECK(stats.vWindowStakeBlocks == std::vector<int>({2}));
+    BOOST_CHECK_EQUAL(stats.mapStakers[Staker(3)].nBlocks, 25);
+    BOOST_CHECK_EQUAL(stats.mapStakers[Staker(3)].nLastHeight, 299);
+    const CStakerStats& stats2Pending = stats.mapStakers[Staker(2)];
+    BOOST_CHECK_EQUAL(stats2Pending.nBlocks, 2);
+    BOOST_CHECK_EQUAL(stats2Pending.nFirstHeight, 278);
+    BOOST_CHECK_EQUAL(stats2Pending.nLastHeight, 300);
+    BOOST_CHECK(stats2Pending.vWindowBlocks == std::vector<int>({1}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "chainparams.h"
+#include "pos.h"
+#include "random.h"
+#include "stakesearch.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+#include "util.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakesearch_tests, BasicTestingSetup)
+
+// Serial reference search using the consensus kernel check
+static bool SerialFindKernel(CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<CStakeCandidate>& vCandidates,
+                             const std::vector<unsigned int>& vTimeSlots, size_t nStart, CStakeKernelHit& hit)
+{
+    for (size_t i = nStart; i < vCandidates.size(); i++) {
+        const CStakeCandidate& candidate = vCandidates[i];
+        Coin coinPrev(CTxOut(candidate.nValue, CScript()), 1, false, false, candidate.nTimeTxPrev);
+        for (unsigned int nTimeTx : vTimeSlots) {
+            uint256 hashProofOfStake;
+            arith_uint256 bnTargetProofOfStake;
+            if (CheckStakeKernelHashV2(pindexPrev, nBits, candidate.nTimeBlockFrom, coinPrev, candidate.prevout, nTimeTx, hashProofOfStake, bnTargetProofOfStake, false)) {
+                hit.nCandidate = i;
+                hit.nTimeTx = nTimeTx;
+                hit.hashProofOfStake = hashProofOfStake;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(stakesearch_matches_serial_kernel_check)
+{
+    const Consensus::CParams& params = Params().GetConsensus();
+    const unsigned int nTime = 1500000000 & ~STAKE_TIMESTAMP_MASK;
+    const unsigned int nBits = 0x1d00ffff;
+
+    CBlockIndex indexPrev;
+    indexPrev.nStakeModifier = insecure_rand() | ((uint64_t)insecure_rand() << 32);
+
+    std::vector<CStakeCandidate> vCandidates;
+    for (int i = 0; i < 2000; i++) {
+        // Some candidates are too young to stake at the earlier slots
+        unsigned int nTimeBlockFrom = nTime - params.nStakeMinAge - (insecure_rand() % 64);
+        vCandidates.push_back(CStakeCandidate(COutPoint(GetRandHash(), insecure_rand() % 3), (1 + insecure_rand() % 100) * COIN / 10, nTimeBlockFrom, nTimeBlockFrom));
+    }
+    std::vector<unsigned int> vTimeSlots;
+    for (unsigned int n = 0; n < 60; n++)
+        vTimeSlots.push_back(nTime - n);
+
+    for (int nThreads = 1; nThreads <= 4; nThreads++) {
+        CStakeKernelSearch stakeSearch(nThreads);
+        size_t nStart = 0;
+        int nHits = 0;
+        while (true) {
+            CStakeKernelHit hitSerial, hit;
+            bool fSerial = SerialFindKernel(&indexPrev, nBits, vCandidates, vTimeSlots, nStart, hitSerial);
+            BOOST_CHECK_EQUAL(stakeSearch.FindKernel(indexPrev.nStakeModifier, nBits, vCandidates, vTimeSlots, params, hit, nStart), fSerial);
+            if (!fSerial)
+                break;
+            BOOST_CHECK_EQUAL(hit.nCandidate, hitSerial.nCandidate);
+            BOOST_CHECK_EQUAL(hit.nTimeTx, hitSerial.nTimeTx);
+            BOOST_CHECK(hit.hashProofOfStake == hitSerial.hashProofOfStake);
+            BOOST_CHECK(hit.prevout == vCandidates[hit.nCandidate].prevout);
+            nStart = hit.nCandidate + 1;
+            nHits++;
+        }
+        BOOST_CHECK(nHits > 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stakesearch_interrupt)
+{
+    const Consensus::CParams& params = Params().GetConsensus();
+    std::vector<CStakeCandidate> vCandidates(10 * STAKE_SEARCH_BATCH_SIZE, CStakeCandidate(COutPoint(GetRandHash(), 0), COIN, 0, 0));
+    std::vector<unsigned int> vTimeSlots(1, params.nStakeMinAge);
+
+    CStakeKernelSearch stakeSearch(2);
+    CStakeKernelHit hit;
+    // Any kernel passes with -cheat, but an interrupted round must not report one
+    ForceSetArg("-cheat", "1");
+    BOOST_CHECK(stakeSearch.FindKernel(0, 0x1c00ffff, vCandidates, vTimeSlots, params, hit));
+    BOOST_CHECK_EQUAL(hit.nCandidate, 0U);
+    BOOST_CHECK(!stakeSearch.FindKernel(0, 0x1c00ffff, vCandidates, vTimeSlots, params, hit, 0, []() { return true; }));
+    ForceSetArg("-cheat", "0");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
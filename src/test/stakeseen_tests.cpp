@@ -0,0 +1,88 @@
+// Copyright (c) 2017 The CLAM developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "random.h"
+#include "stakeseen.h"
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakeseen_tests, BasicTestingSetup)
+
+static CStakeSeen::Stake RandomStake(unsigned int nTime)
+{
+    return std::make_pair(COutPoint(GetRandHash(), insecure_rand() % 4), nTime);
+}
+
+BOOST_AUTO_TEST_CASE(stakeseen_set)
+{
+    CStakeSeen setSeen;
+    CStakeSeen::Stake stake = RandomStake(1000);
+    BOOST_CHECK_EQUAL(setSeen.count(stake), 0U);
+    BOOST_CHECK(setSeen.insert(stake));
+    BOOST_CHECK(!setSeen.insert(stake));
+    BOOST_CHECK_EQUAL(setSeen.count(stake), 1U);
+    BOOST_CHECK_EQUAL(setSeen.size(), 1U);
+
+    // The same prevout at another time is another stake
+    CStakeSeen::Stake stakeLater = std::make_pair(stake.first, stake.second + 16);
+    BOOST_CHECK_EQUAL(setSeen.count(stakeLater), 0U);
+    BOOST_CHECK(setSeen.insert(stakeLater));
+
+    BOOST_CHECK_EQUAL(setSeen.erase(stake), 1U);
+    BOOST_CHECK_EQUAL(setSeen.erase(stake), 0U);
+    BOOST_CHECK_EQUAL(setSeen.count(stakeLater), 1U);
+    setSeen.clear();
+    BOOST_CHECK_EQUAL(setSeen.size(), 0U);
+    BOOST_CHECK_EQUAL(setSeen.count(stakeLater), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(stakeseen_random)
+{
+    // Mixed inserts and erases, through the table growing, agree with a std::set
+    CStakeSeen setSeen;
+    std::set<CStakeSeen::Stake> setExpected;
+    std::vector<CStakeSeen::Stake> vStakes;
+    for (int i = 0; i < 20000; i++) {
+        if (vStakes.empty() || insecure_rand() % 3) {
+            vStakes.push_back(RandomStake(i));
+            BOOST_CHECK(setSeen.insert(vStakes.back()));
+            setExpected.insert(vStakes.back());
+        } else {
+            const CStakeSeen::Stake& stake = vStakes[insecure_rand() % vStakes.size()];
+            BOOST_CHECK_EQUAL(setSeen.erase(stake), setExpected.erase(stake));
+        }
+    }
+    BOOST_CHECK_EQUAL(setSeen.size(), setExpected.size());
+    for (const CStakeSeen::Stake& stake : vStakes)
+        BOOST_CHECK_EQUAL(setSeen.count(stake), setExpected.count(stake));
+    // At most four slots per stake, where a std::set node takes over 80 bytes
+    BOOST_CHECK(setSeen.DynamicMemoryUsage() <= setSeen.size() * 64);
+}
+
+BOOST_AUTO_TEST_CASE(stakeseen_prune)
+{
+    CStakeSeen setSeen;
+    std::vector<CStakeSeen::Stake> vStakes;
+    for (int i = 0; i < 5000; i++) {
+        vStakes.push_back(RandomStake(i));
+        setSeen.insert(vStakes.back());
+    }
+    size_t nUsage = setSeen.DynamicMemoryUsage();
+
+    BOOST_CHECK_EQUAL(setSeen.Prune(0), 0U);
+    BOOST_CHECK_EQUAL(setSeen.Prune(4900), 4900U);
+    BOOST_CHECK_EQUAL(setSeen.size(), 100U);
+    for (int i = 0; i < 5000; i++)
+        BOOST_CHECK_EQUAL(setSeen.count(vStakes[i]), i >= 4900 ? 1U : 0U);
+
+    // The table shrinks to what is left
+    BOOST_CHECK(setSeen.DynamicMemoryUsage() < nUsage);
+    BOOST_CHECK_EQUAL(setSeen.Prune(4900), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -13,18 +13,30 @@
 #include "util.h"
 
 #include <stdint.h>
+#include <algorithm>
+#include <atomic>
 
 #include <boost/thread.hpp>
 
-static const char DB_COIN = 'C';
+static const char DB_COIN = 'T';
+static const char DB_COIN_UNTIMED = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
+static const char DB_NOTARYINDEX = 'n';
+static const char DB_NOTARYINDEX_BUILD = 'N';
+static const char DB_SPEECHINDEX = 'w';
+static const char DB_SPEECHINDEX_BUILD = 'W';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSINDEX_BUILD = 'A';
 static const char DB_BLOCK_INDEX = 'b';
 
 
 static const char DB_HEIGHTINDEX = 'h';
-static const char DB_STAKEINDEX = 's';
+static const char DB_HEIGHTINDEX_BEST_BLOCK = 'H';
+static const char DB_STAKEINDEX = 'S';
+static const char DB_STAKEINDEX_LEGACY = 's';
 static const char DB_OFFSETINDEX = 'o';
 static const char DB_OFFSET_COMPLETE_FLAG = 'O';
 
@@ -40,7 +52,7 @@ namespace {
 struct CoinEntry {
     COutPoint* outpoint;
     char key;
-    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN)  {}
+    CoinEntry(const COutPoint* ptr, char keyIn = DB_COIN) : outpoint(const_cast<COutPoint*>(ptr)), key(keyIn)  {}
 
     template<typename Stream>
     void Serialize(Stream &s) const {
@@ -57,6 +69,24 @@ struct CoinEntry {
     }
 };
 
+//! Coins stored under DB_COIN_UNTIMED, written before coins kept the time of their transaction
+struct UntimedCoin {
+    Coin* coin;
+    UntimedCoin(const Coin* ptr) : coin(const_cast<Coin*>(ptr)) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        OverrideStream<Stream> os(&s, s.GetType(), s.GetVersion() | SERIALIZE_COIN_NO_TIME);
+        coin->Serialize(os);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        OverrideStream<Stream> os(&s, s.GetType(), s.GetVersion() | SERIALIZE_COIN_NO_TIME);
+        coin->Unserialize(os);
+    }
+};
+
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
@@ -185,7 +215,56 @@ void CCoinsViewDBCursor::Next()
     }
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+void CHeightIndexUpdates::WriteHeightIndex(const CHeightTxIndexKey& heightIndex, const std::vector<uint256>& hash)
+{
+    vHeightIndex.push_back(std::make_pair(heightIndex, hash));
+}
+
+void CHeightIndexUpdates::EraseHeightIndex(unsigned int height)
+{
+    vHeightIndex.erase(std::remove_if(vHeightIndex.begin(), vHeightIndex.end(),
+                                      [height](const std::pair<CHeightTxIndexKey, std::vector<uint256> >& entry) { return entry.first.height == height; }),
+                       vHeightIndex.end());
+    setEraseHeightIndex.insert(height);
+}
+
+void CHeightIndexUpdates::WriteStakeIndex(unsigned int height, const uint160& address)
+{
+    mapStakeIndex[height] = address;
+}
+
+void CHeightIndexUpdates::EraseStakeIndex(unsigned int height)
+{
+    mapStakeIndex.erase(height);
+    setEraseStakeIndex.insert(height);
+}
+
+bool CHeightIndexUpdates::IsEmpty() const
+{
+    return setEraseHeightIndex.empty() && setEraseStakeIndex.empty() && vHeightIndex.empty() && mapStakeIndex.empty();
+}
+
+void CHeightIndexUpdates::Clear()
+{
+    setEraseHeightIndex.clear();
+    setEraseStakeIndex.clear();
+    vHeightIndex.clear();
+    mapStakeIndex.clear();
+}
+
+/** Queue the pending changes of an index, erasures first so that keys erased and written again keep the new entry */
+template <typename K, typename V>
+static void WritePendingIndex(CDBBatch& batch, char chPrefix, const CPendingIndex<K, V>& pending)
+{
+    for (const K& key : pending.setErase)
+        batch.Erase(std::make_pair(chPrefix, key));
+    for (const auto& entry : pending.mapWrite)
+        batch.Write(std::make_pair(chPrefix, entry.first), entry.second);
+}
+
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                                  const CHeightIndexUpdates& heightIndexUpdates, const CPendingNotaryIndex& notaryIndex, const CPendingSpeechIndex& speechIndex,
+                                  const CPendingAddressIndex& addressIndex, const uint256& hashHeightIndexBest) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
@@ -195,6 +274,21 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
         CDiskBlockIndex dbi(*it);
         batch.Write(std::make_pair(DB_BLOCK_INDEX, dbi.GetBlockHash()), dbi);
     }
+    // Erasures first, so heights disconnected and connected again end up with the new entries
+    for (unsigned int height : heightIndexUpdates.setEraseHeightIndex)
+        EraseHeightIndex(batch, height);
+    for (const auto& entry : heightIndexUpdates.vHeightIndex)
+        batch.Write(std::make_pair(DB_HEIGHTINDEX, entry.first), entry.second);
+    for (unsigned int height : heightIndexUpdates.setEraseStakeIndex)
+        batch.Erase(std::make_pair(DB_STAKEINDEX, CHeightTxIndexIteratorKey(height)));
+    for (const auto& entry : heightIndexUpdates.mapStakeIndex)
+        batch.Write(std::make_pair(DB_STAKEINDEX, CHeightTxIndexIteratorKey(entry.first)), entry.second);
+    WritePendingIndex(batch, DB_NOTARYINDEX, notaryIndex);
+    WritePendingIndex(batch, DB_SPEECHINDEX, speechIndex);
+    WritePendingIndex(batch, DB_ADDRESSINDEX, addressIndex.entries);
+    WritePendingIndex(batch, DB_ADDRESSUNSPENTINDEX, addressIndex.unspent);
+    if (!hashHeightIndexBest.IsNull())
+        batch.Write(DB_HEIGHTINDEX_BEST_BLOCK, hashHeightIndexBest);
     return WriteBatch(batch, true);
 }
 
@@ -230,6 +324,270 @@ bool CBlockTreeDB::WriteTxOffsetSet() {
 }
 
 
+bool CBlockTreeDB::ReadNotaryIndex(const uint256 &hashNotary, std::vector<std::pair<uint256, int> > &vTx) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_NOTARYINDEX, CNotaryIndexKey(hashNotary, uint256())));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CNotaryIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_NOTARYINDEX || key.second.hashNotary != hashNotary)
+            break;
+        int nHeight;
+        if (!pcursor->GetValue(nHeight))
+            return error("%s: failed to read notary index entry for %s", __func__, key.second.txid.ToString());
+        vTx.push_back(std::make_pair(key.second.txid, nHeight));
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteNotaryIndex(const std::vector<std::pair<CNotaryIndexKey, int> > &vEntries) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CNotaryIndexKey, int> >::const_iterator it=vEntries.begin(); it!=vEntries.end(); it++)
+        batch.Write(std::make_pair(DB_NOTARYINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseNotaryIndex(const std::vector<CNotaryIndexKey> &vKeys) {
+    CDBBatch batch(*this);
+    for (std::vector<CNotaryIndexKey>::const_iterator it=vKeys.begin(); it!=vKeys.end(); it++)
+        batch.Erase(std::make_pair(DB_NOTARYINDEX, *it));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteNotaryIndexBuild(const std::vector<std::pair<CNotaryIndexKey, int> > &vEntries, int nHeight) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CNotaryIndexKey, int> >::const_iterator it=vEntries.begin(); it!=vEntries.end(); it++)
+        batch.Write(std::make_pair(DB_NOTARYINDEX, it->first), it->second);
+    if (nHeight < 0)
+        batch.Erase(DB_NOTARYINDEX_BUILD);
+    else
+        batch.Write(DB_NOTARYINDEX_BUILD, nHeight);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadNotaryIndexBuildHeight(int &nHeight) {
+    nHeight = -1;
+    if (!Exists(DB_NOTARYINDEX_BUILD))
+        return true;
+    return Read(DB_NOTARYINDEX_BUILD, nHeight);
+}
+
+bool CBlockTreeDB::WipeNotaryIndex() {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+
+    pcursor->Seek(DB_NOTARYINDEX);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CNotaryIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_NOTARYINDEX) {
+            batch.Erase(key);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+    batch.Erase(DB_NOTARYINDEX_BUILD);
+
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpeechIndex(const std::string &strToken, bool fPrefix, size_t nMaxEntries, std::vector<std::pair<CSpeechIndexKey, unsigned int> > &vEntries) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_SPEECHINDEX, CSpeechIndexPrefix(strToken)));
+    for (; pcursor->Valid() && vEntries.size() <= nMaxEntries; pcursor->Next()) {
+        std::pair<char, CSpeechIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_SPEECHINDEX)
+            break;
+        if (fPrefix ? key.second.strToken.compare(0, strToken.size(), strToken) != 0 : key.second.strToken != strToken)
+            break;
+        unsigned int nTx;
+        if (!pcursor->GetValue(nTx))
+            return error("%s: failed to read speech index entry for %s", __func__, key.second.txid.ToString());
+        vEntries.push_back(std::make_pair(key.second, nTx));
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteSpeechIndex(const std::vector<std::pair<CSpeechIndexKey, unsigned int> > &vEntries) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CSpeechIndexKey, unsigned int> >::const_iterator it=vEntries.begin(); it!=vEntries.end(); it++)
+        batch.Write(std::make_pair(DB_SPEECHINDEX, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseSpeechIndex(const std::vector<CSpeechIndexKey> &vKeys) {
+    CDBBatch batch(*this);
+    for (std::vector<CSpeechIndexKey>::const_iterator it=vKeys.begin(); it!=vKeys.end(); it++)
+        batch.Erase(std::make_pair(DB_SPEECHINDEX, *it));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteSpeechIndexBuild(const std::vector<std::pair<CSpeechIndexKey, unsigned int> > &vEntries, int nHeight) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CSpeechIndexKey, unsigned int> >::const_iterator it=vEntries.begin(); it!=vEntries.end(); it++)
+        batch.Write(std::make_pair(DB_SPEECHINDEX, it->first), it->second);
+    if (nHeight < 0)
+        batch.Erase(DB_SPEECHINDEX_BUILD);
+    else
+        batch.Write(DB_SPEECHINDEX_BUILD, nHeight);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpeechIndexBuildHeight(int &nHeight) {
+    nHeight = -1;
+    if (!Exists(DB_SPEECHINDEX_BUILD))
+        return true;
+    return Read(DB_SPEECHINDEX_BUILD, nHeight);
+}
+
+bool CBlockTreeDB::WipeSpeechIndex() {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+
+    pcursor->Seek(DB_SPEECHINDEX);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CSpeechIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_SPEECHINDEX) {
+            batch.Erase(key);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+    batch.Erase(DB_SPEECHINDEX_BUILD);
+
+    return WriteBatch(batch);
+}
+
+void CBlockTreeDB::CompactSpeechIndex() {
+    CompactRange(DB_SPEECHINDEX, (char)(DB_SPEECHINDEX + 1));
+}
+
+void CAddressIndexUpdates::Append(const CAddressIndexUpdates& updates)
+{
+    vEntries.insert(vEntries.end(), updates.vEntries.begin(), updates.vEntries.end());
+    vCreated.insert(vCreated.end(), updates.vCreated.begin(), updates.vCreated.end());
+    vSpent.insert(vSpent.end(), updates.vSpent.begin(), updates.vSpent.end());
+}
+
+static void WriteAddressIndexUpdates(CDBBatch& batch, const CAddressIndexUpdates& updates)
+{
+    for (const auto& entry : updates.vEntries)
+        batch.Write(std::make_pair(DB_ADDRESSINDEX, entry.first), entry.second);
+    // Outputs created before those spent, so that outputs spent by later transactions of the same blocks end up erased
+    for (const auto& entry : updates.vCreated)
+        batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, entry.first), entry.second);
+    for (const auto& entry : updates.vSpent)
+        batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, entry.first));
+}
+
+bool CBlockTreeDB::WriteAddressIndexBuild(const CAddressIndexUpdates &updates, int nHeight) {
+    CDBBatch batch(*this);
+    WriteAddressIndexUpdates(batch, updates);
+    if (nHeight < 0)
+        batch.Erase(DB_ADDRESSINDEX_BUILD);
+    else
+        batch.Write(DB_ADDRESSINDEX_BUILD, nHeight);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndexBuildHeight(int &nHeight) {
+    nHeight = -1;
+    if (!Exists(DB_ADDRESSINDEX_BUILD))
+        return true;
+    return Read(DB_ADDRESSINDEX_BUILD, nHeight);
+}
+
+/** Queue the erasure of the entries with prefix chPrefix and key type K, writing the batch whenever it grows large */
+template <typename K>
+static void EraseIndexEntries(CDBWrapper& db, CDBIterator& cursor, CDBBatch& batch, char chPrefix)
+{
+    size_t batch_size = 1 << 24;
+    cursor.Seek(chPrefix);
+    while (cursor.Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, K> key;
+        if (cursor.GetKey(key) && key.first == chPrefix) {
+            batch.Erase(key);
+            if (batch.SizeEstimate() > batch_size) {
+                db.WriteBatch(batch);
+                batch.Clear();
+            }
+            cursor.Next();
+        } else {
+            break;
+        }
+    }
+}
+
+bool CBlockTreeDB::WipeAddressIndex() {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+
+    EraseIndexEntries<CAddressIndexKey>(*this, *pcursor, batch, DB_ADDRESSINDEX);
+    EraseIndexEntries<CAddressUnspentKey>(*this, *pcursor, batch, DB_ADDRESSUNSPENTINDEX);
+    batch.Erase(DB_ADDRESSINDEX_BUILD);
+
+    return WriteBatch(batch);
+}
+
+CAddressIndexCursor *CBlockTreeDB::AddressIndexCursor(const CAddressIndexPrefix &address, unsigned int nHeightStart)
+{
+    CAddressIndexCursor *i = new CAddressIndexCursor(NewIterator(), address);
+    i->pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, std::make_pair(address, CHeightTxIndexIteratorKey(nHeightStart))));
+    i->ReadKey();
+    return i;
+}
+
+void CAddressIndexCursor::ReadKey()
+{
+    // Cache the key, invalidated past the entries of the address so that Valid() and GetKey() return false
+    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp) || keyTmp.first != DB_ADDRESSINDEX || keyTmp.second.address != address)
+        keyTmp.first = 0;
+}
+
+bool CAddressIndexCursor::GetKey(CAddressIndexKey &key) const
+{
+    if (keyTmp.first != DB_ADDRESSINDEX)
+        return false;
+    key = keyTmp.second;
+    return true;
+}
+
+bool CAddressIndexCursor::GetValue(CAmount &nValue) const
+{
+    return pcursor->GetValue(nValue);
+}
+
+bool CAddressIndexCursor::Valid() const
+{
+    return keyTmp.first == DB_ADDRESSINDEX;
+}
+
+void CAddressIndexCursor::Next()
+{
+    pcursor->Next();
+    ReadKey();
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const CAddressIndexPrefix &address, size_t nMaxEntries, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vEntries) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, address));
+    for (; pcursor->Valid() && vEntries.size() <= nMaxEntries; pcursor->Next()) {
+        std::pair<char, CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTINDEX || key.second.address != address)
+            break;
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read address unspent index entry for %s", __func__, key.second.txid.ToString());
+        vEntries.push_back(std::make_pair(key.second, value));
+    }
+    return true;
+}
 
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
@@ -244,10 +602,8 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
 }
 
 
-bool CBlockTreeDB::WriteHeightIndex(const CHeightTxIndexKey &heightIndex, const std::vector<uint256>& hash) {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_HEIGHTINDEX, heightIndex), hash);
-    return WriteBatch(batch);
+bool CBlockTreeDB::ReadHeightIndexBestBlock(uint256& hash) {
+    return Read(DB_HEIGHTINDEX_BEST_BLOCK, hash);
 }
 
 size_t CBlockTreeDB::ReadHeightIndex(size_t low, size_t high, size_t minconf,
@@ -301,10 +657,9 @@ size_t CBlockTreeDB::ReadHeightIndex(size_t low, size_t high, size_t minconf,
     return curheight;
 }
 
-bool CBlockTreeDB::EraseHeightIndex(const unsigned int &height) {
+void CBlockTreeDB::EraseHeightIndex(CDBBatch& batch, unsigned int height) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-    CDBBatch batch(*this);
 
     pcursor->Seek(std::make_pair(DB_HEIGHTINDEX, CHeightTxIndexIteratorKey(height)));
 
@@ -318,8 +673,6 @@ bool CBlockTreeDB::EraseHeightIndex(const unsigned int &height) {
             break;
         }
     }
-
-    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::WipeHeightIndex() {
@@ -344,133 +697,215 @@ bool CBlockTreeDB::WipeHeightIndex() {
 }
 
 
-bool CBlockTreeDB::WriteStakeIndex(unsigned int height, uint160 address) {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_STAKEINDEX, height), address);
-    return WriteBatch(batch);
+bool CBlockTreeDB::ReadStakeIndex(unsigned int height, uint160& address) {
+    return Read(std::make_pair(DB_STAKEINDEX, CHeightTxIndexIteratorKey(height)), address);
 }
 
-bool CBlockTreeDB::ReadStakeIndex(unsigned int height, uint160& address){
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+CStakeIndexCursor *CBlockTreeDB::StakeIndexCursor(unsigned int nHeightStart)
+{
+    CStakeIndexCursor *i = new CStakeIndexCursor(NewIterator());
+    i->pcursor->Seek(std::make_pair(DB_STAKEINDEX, CHeightTxIndexIteratorKey(nHeightStart)));
+    i->ReadKey();
+    return i;
+}
 
-    pcursor->Seek(std::make_pair(DB_STAKEINDEX, height));
+void CStakeIndexCursor::ReadKey()
+{
+    // Cache the key, invalidated past the last entry so that Valid() and GetKey() return false
+    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp) || keyTmp.first != DB_STAKEINDEX)
+        keyTmp.first = 0;
+}
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, CHeightTxIndexKey> key;
-        pcursor->GetKey(key); //note: it's apparently ok if this returns an error https://github.com/bitcoin/bitcoin/issues/7890
-        if (key.first == DB_STAKEINDEX) {
-            pcursor->GetValue(address);
-            return true;
-        }else{
-            return false;
-        }
-    }
-    return false;
+bool CStakeIndexCursor::GetKey(unsigned int &nHeight) const
+{
+    if (keyTmp.first != DB_STAKEINDEX)
+        return false;
+    nHeight = keyTmp.second.height;
+    return true;
 }
-bool CBlockTreeDB::ReadStakeIndex(unsigned int high, unsigned int low, std::vector<uint160> addresses){
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_STAKEINDEX, low));
+bool CStakeIndexCursor::GetValue(uint160 &staker) const
+{
+    return pcursor->GetValue(staker);
+}
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, CHeightTxIndexKey> key;
-        pcursor->GetKey(key); //note: it's apparently ok if this returns an error https://github.com/bitcoin/bitcoin/issues/7890
-        if (key.first == DB_STAKEINDEX && key.second.height < high) {
-            uint160 value;
-            pcursor->GetValue(value);
-            addresses.push_back(value);
-            pcursor->Next();
-        } else {
-            break;
-        }
-    }
+bool CStakeIndexCursor::Valid() const
+{
+    return keyTmp.first == DB_STAKEINDEX;
+}
 
-    return true;
+void CStakeIndexCursor::Next()
+{
+    pcursor->Next();
+    ReadKey();
 }
 
-bool CBlockTreeDB::EraseStakeIndex(unsigned int height) {
+bool CBlockTreeDB::UpgradeStakeIndex() {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_STAKEINDEX_LEGACY);
+    if (!pcursor->Valid())
+        return true;
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    LogPrintf("Upgrading stake index...\n");
+    size_t batch_size = 1 << 24;
+    int nEntries = 0;
     CDBBatch batch(*this);
-
-    pcursor->Seek(std::make_pair(DB_STAKEINDEX, height));
-
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char, CHeightTxIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_HEIGHTINDEX && key.second.height == height) {
+        std::pair<char, unsigned int> key;
+        if (pcursor->GetKey(key) && key.first == DB_STAKEINDEX_LEGACY) {
+            uint160 staker;
+            if (!pcursor->GetValue(staker))
+                return error("%s: cannot parse stake index record", __func__);
+            batch.Write(std::make_pair(DB_STAKEINDEX, CHeightTxIndexIteratorKey(key.second)), staker);
             batch.Erase(key);
+            nEntries++;
+            if (batch.SizeEstimate() > batch_size) {
+                WriteBatch(batch);
+                batch.Clear();
+            }
             pcursor->Next();
         } else {
             break;
         }
     }
-
+    LogPrintf("Upgraded %d stake index entries\n", nEntries);
     return WriteBatch(batch);
 }
 
+/** Shared by the LoadBlockIndexGuts workers; the lock serializes their inserts into the block index */
+struct CBlockIndexLoad
+{
+    boost::function<CBlockIndex*(const uint256&)> insertBlockIndex;
+    boost::mutex cs;
+    std::atomic<bool> fFailed;
+    std::string strError;
+    std::atomic<int> nEntries;
+    std::atomic<int64_t> nDecodeTime;
+    std::atomic<int64_t> nMergeTime;
+
+    explicit CBlockIndexLoad(const boost::function<CBlockIndex*(const uint256&)>& insertBlockIndexIn) :
+        insertBlockIndex(insertBlockIndexIn), fFailed(false), nEntries(0), nDecodeTime(0), nMergeTime(0) {}
+
+    void Fail(const std::string& strErrorIn)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fFailed)
+            strError = strErrorIn;
+        fFailed = true;
+    }
+};
+
+/** Insert decoded entries into the block index */
+static void MergeBlockIndexEntries(CBlockIndexLoad& load, const std::vector<CDiskBlockIndex>& vDiskIndex)
+{
+    int64_t nStart = GetTimeMicros();
+    boost::unique_lock<boost::mutex> lock(load.cs);
+    for (const CDiskBlockIndex& diskindex : vDiskIndex) {
+        // Construct block index object
+        CBlockIndex* pindexNew = load.insertBlockIndex(diskindex.GetBlockHash());
+        pindexNew->pprev          = load.insertBlockIndex(diskindex.hashPrev);
+        pindexNew->pnext          = load.insertBlockIndex(diskindex.hashNext);
+        pindexNew->nHeight        = diskindex.nHeight;
+        pindexNew->nStatus        = diskindex.nStatus;
+        pindexNew->nTx            = diskindex.nTx;
+        pindexNew->nFile          = diskindex.nFile;
+        pindexNew->nDataPos       = diskindex.nDataPos;
+        pindexNew->nUndoPos       = diskindex.nUndoPos;
+        pindexNew->nMint          = diskindex.nMint;
+        pindexNew->nMoneySupply   = diskindex.nMoneySupply;
+        pindexNew->nDigsupply     = diskindex.nDigsupply;
+        pindexNew->nStakeSupply   = diskindex.nStakeSupply;
+        for (const CClamour& clamour : diskindex.vClamour)
+            pindexNew->AddClamour(clamour);
+        pindexNew->SetSupport(diskindex.vSupport);
+        pindexNew->nFlags         = diskindex.nFlags;
+        pindexNew->nStakeModifier = diskindex.nStakeModifier;
+        pindexNew->prevoutStake   = diskindex.prevoutStake;
+        pindexNew->hashProof      = diskindex.hashProof;
+        pindexNew->SetBlockSig(diskindex.vchBlockSig);
+        pindexNew->nVersion       = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime          = diskindex.nTime;
+        pindexNew->nBits          = diskindex.nBits;
+        pindexNew->nNonce         = diskindex.nNonce;
+
+        if (++load.nEntries % 100000 == 0)
+            LogPrintf("Load mapBlockIndex iteration %d\n", load.nEntries);
+    }
+    load.nMergeTime += GetTimeMicros() - nStart;
+}
 
-bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+void CBlockTreeDB::LoadBlockIndexRange(CBlockIndexLoad& load, unsigned int nBegin, unsigned int nEnd)
 {
+    const Consensus::CParams& consensusParams = Params().GetConsensus();
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+    uint256 hashBegin;
+    *hashBegin.begin() = nBegin;
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, hashBegin));
 
-    int counter = 0;
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        if (counter % 100000 == 0)
-            LogPrintf("Load mapBlockIndex iteration %d\n", counter);
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    vDiskIndex.reserve(BLOCK_INDEX_LOAD_BATCH);
+    int64_t nStart = GetTimeMicros();
+    while (pcursor->Valid() && !load.fFailed) {
         boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext          = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nMint          = diskindex.nMint;
-        		pindexNew->nMoneySupply   = diskindex.nMoneySupply;
-        		pindexNew->nDigsupply     = diskindex.nDigsupply;
-        		pindexNew->nStakeSupply   = diskindex.nStakeSupply;
-        		pindexNew->vClamour       = diskindex.vClamour;
-                pindexNew->nFlags         = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake   = diskindex.prevoutStake;
-        		pindexNew->hashProof      = diskindex.hashProof;
-                pindexNew->vchBlockSig    = diskindex.vchBlockSig; 
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-
-                if (!CheckIndexProof(*pindexNew, Params().GetConsensus()))
-                    return error("LoadBlockIndex(): CheckIndexProof failed: %s %s", pindexNew->ToString(), diskindex.GetBlockHash().ToString());
-
-                // NovaCoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(std::make_pair(pindexNew->prevoutStake, pindexNew->nTime));
-
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
-            }
-        } else {
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
             break;
+        vDiskIndex.push_back(CDiskBlockIndex());
+        CDiskBlockIndex& diskindex = vDiskIndex.back();
+        if (!pcursor->GetValue(diskindex)) {
+            load.Fail("LoadBlockIndex() : failed to read value");
+            return;
+        }
+        // Entries are stored without their hash; computing it is the expensive part for old blocks
+        diskindex.GetBlockHash();
+        if (!CheckIndexProof(diskindex, consensusParams)) {
+            load.Fail(strprintf("LoadBlockIndex(): CheckIndexProof failed: height=%d %s", diskindex.nHeight, diskindex.GetBlockHash().ToString()));
+            return;
+        }
+        pcursor->Next();
+
+        if (vDiskIndex.size() == BLOCK_INDEX_LOAD_BATCH) {
+            load.nDecodeTime += GetTimeMicros() - nStart;
+            MergeBlockIndexEntries(load, vDiskIndex);
+            vDiskIndex.clear();
+            nStart = GetTimeMicros();
+        }
+    }
+    load.nDecodeTime += GetTimeMicros() - nStart;
+    MergeBlockIndexEntries(load, vDiskIndex);
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads)
+{
+    // Block hashes are uniformly distributed, so splitting the entries on the first byte of
+    // the key hash gives every worker about the same share to decode and check
+    nThreads = std::max(1, std::min(nThreads, MAX_BLOCK_INDEX_LOAD_THREADS));
+    int64_t nStart = GetTimeMillis();
+    CBlockIndexLoad load(insertBlockIndex);
+    if (nThreads == 1) {
+        LoadBlockIndexRange(load, 0, 256);
+    } else {
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CBlockTreeDB::LoadBlockIndexRange, this, boost::ref(load), 256 * i / nThreads, 256 * (i + 1) / nThreads));
+        try {
+            threadGroup.join_all();
+        } catch (const boost::thread_interrupted&) {
+            // Shutdown interrupted the caller; stop the workers before load goes out of scope
+            boost::this_thread::disable_interruption di;
+            threadGroup.interrupt_all();
+            threadGroup.join_all();
+            throw;
         }
-        counter++;
     }
-    LogPrintf("Load mapBlockIndex finished after iteration %d\n", counter);
+    if (load.fFailed)
+        return error("%s", load.strError);
+
+    LogPrintf("Load mapBlockIndex finished after iteration %d: %dms with %d threads (decode %dms, merge %dms summed over threads)\n",
+        load.nEntries, GetTimeMillis() - nStart, nThreads, load.nDecodeTime / 1000, load.nMergeTime / 1000);
 
     return true;
 }
@@ -534,7 +969,8 @@ public:
 
 /** Upgrade the database from older formats.
  *
- * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout.
+ * Currently implemented: from the per-tx utxo model (0.8..0.14.x) to per-txout,
+ * leaving the coins to UpgradeCoinTime.
  */
 bool CCoinsViewDB::Upgrade() {
     std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
@@ -557,10 +993,11 @@ bool CCoinsViewDB::Upgrade() {
             COutPoint outpoint(key.second, 0);
             for (size_t i = 0; i < old_coins.vout.size(); ++i) {
                 if (!old_coins.vout[i].IsNull() && !old_coins.vout[i].scriptPubKey.IsUnspendable()) {
-                    Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase, old_coins.fCoinStake);
+                    // The time of the transaction is filled in by UpgradeCoinTime
+                    Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase, old_coins.fCoinStake, 0);
                     outpoint.n = i;
-                    CoinEntry entry(&outpoint);
-                    batch.Write(entry, newcoin);
+                    CoinEntry entry(&outpoint, DB_COIN_UNTIMED);
+                    batch.Write(entry, UntimedCoin(&newcoin));
                 }
             }
             batch.Erase(key);
@@ -576,3 +1013,78 @@ bool CCoinsViewDB::Upgrade() {
     db.WriteBatch(batch);
     return true;
 }
+
+bool CCoinsViewDB::HasUntimedCoins() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COIN_UNTIMED);
+    COutPoint outpoint;
+    CoinEntry entry(&outpoint);
+    return pcursor->Valid() && pcursor->GetKey(entry) && entry.key == DB_COIN_UNTIMED;
+}
+
+bool CCoinsViewDB::UpgradeCoinTime(const boost::function<bool(int, std::map<uint256, unsigned int>&)>& getBlockTxTimes) {
+    // The heights of the blocks holding the transactions still without time
+    std::set<int> setHeights;
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    COutPoint outpoint;
+    for (pcursor->Seek(DB_COIN_UNTIMED); pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        CoinEntry entry(&outpoint);
+        Coin coin;
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN_UNTIMED)
+            break;
+        UntimedCoin value(&coin);
+        if (!pcursor->GetValue(value))
+            return error("%s: cannot parse coin record", __func__);
+        setHeights.insert(coin.nHeight);
+    }
+    if (setHeights.empty())
+        return true;
+
+    LogPrintf("Upgrading coins database with transaction times from %u blocks...\n", setHeights.size());
+    int64_t nStart = GetTimeMillis();
+    size_t batch_size = 1 << 24;
+    size_t nCoins = 0;
+    CDBBatch batch(db);
+    for (int nHeight : setHeights) {
+        boost::this_thread::interruption_point();
+        std::map<uint256, unsigned int> mapTxTime;
+        if (!getBlockTxTimes(nHeight, mapTxTime))
+            return error("%s: cannot read the transactions of the block at height %d", __func__, nHeight);
+        for (const auto& txTime : mapTxTime) {
+            // The outputs of a transaction are adjacent
+            outpoint = COutPoint(txTime.first, 0);
+            for (pcursor->Seek(CoinEntry(&outpoint, DB_COIN_UNTIMED)); pcursor->Valid(); pcursor->Next()) {
+                CoinEntry entry(&outpoint);
+                Coin coin;
+                if (!pcursor->GetKey(entry) || entry.key != DB_COIN_UNTIMED || outpoint.hash != txTime.first)
+                    break;
+                UntimedCoin value(&coin);
+                if (!pcursor->GetValue(value))
+                    return error("%s: cannot parse coin record", __func__);
+                if (coin.nHeight != (unsigned int)nHeight)
+                    continue;
+                coin.nTime = txTime.second;
+                batch.Write(CoinEntry(&outpoint), coin);
+                batch.Erase(entry);
+                nCoins++;
+            }
+        }
+        if (batch.SizeEstimate() > batch_size) {
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+    }
+    if (!db.WriteBatch(batch))
+        return false;
+
+    // Every coin was created by a transaction of the block at its height
+    pcursor.reset(db.NewIterator());
+    pcursor->Seek(DB_COIN_UNTIMED);
+    CoinEntry entry(&outpoint);
+    if (pcursor->Valid() && pcursor->GetKey(entry) && entry.key == DB_COIN_UNTIMED)
+        return error("%s: transaction %s not found at the height of its coins", __func__, outpoint.hash.ToString());
+
+    LogPrintf("Upgraded %u coins in %dms\n", nCoins, GetTimeMillis() - nStart);
+    return true;
+}
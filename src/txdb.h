@@ -11,7 +11,9 @@
 #include "chain.h"
 
 #include <map>
+#include <set>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -41,6 +43,12 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Maximum number of threads loading the block index
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! Block index entries a loading thread decodes before inserting them
+static const size_t BLOCK_INDEX_LOAD_BATCH = 1000;
+
+struct CBlockIndexLoad;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -67,6 +75,206 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** Key of a notary index entry: the notarized hash, then the transaction notarizing it */
+struct CNotaryIndexKey
+{
+    uint256 hashNotary;
+    uint256 txid;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashNotary);
+        READWRITE(txid);
+    }
+
+    CNotaryIndexKey() {}
+    CNotaryIndexKey(const uint256& hashNotaryIn, const uint256& txidIn) : hashNotary(hashNotaryIn), txid(txidIn) {}
+
+    friend bool operator<(const CNotaryIndexKey& a, const CNotaryIndexKey& b) { return a.hashNotary != b.hashNotary ? a.hashNotary < b.hashNotary : a.txid < b.txid; }
+};
+
+/**
+ * Key of a speech index entry: a token of a transaction's CLAMspeech, then the
+ * height of its block and its txid. The token is written without a length and
+ * ends with a NUL, so the keys of the tokens sharing a prefix are adjacent.
+ */
+struct CSpeechIndexKey
+{
+    std::string strToken;
+    uint32_t nHeight;
+    uint256 txid;
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s.write(strToken.data(), strToken.size());
+        ser_writedata8(s, 0);
+        ser_writedata32be(s, nHeight);
+        s << txid;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        strToken.clear();
+        for (char c = ser_readdata8(s); c != 0; c = ser_readdata8(s))
+            strToken.push_back(c);
+        nHeight = ser_readdata32be(s);
+        s >> txid;
+    }
+
+    CSpeechIndexKey() : nHeight(0) {}
+    CSpeechIndexKey(const std::string& strTokenIn, uint32_t nHeightIn, const uint256& txidIn) : strToken(strTokenIn), nHeight(nHeightIn), txid(txidIn) {}
+
+    //! the order of the serialized keys
+    friend bool operator<(const CSpeechIndexKey& a, const CSpeechIndexKey& b)
+    {
+        if (a.strToken != b.strToken)
+            return a.strToken < b.strToken;
+        return a.nHeight != b.nHeight ? a.nHeight < b.nHeight : a.txid < b.txid;
+    }
+};
+
+/** Seek key for the speech index entries of the tokens starting with strPrefix */
+struct CSpeechIndexPrefix
+{
+    std::string strPrefix;
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s.write(strPrefix.data(), strPrefix.size());
+    }
+
+    explicit CSpeechIndexPrefix(const std::string& strPrefixIn) : strPrefix(strPrefixIn) {}
+};
+
+/** An address as the address index keys it: its type, then the hash of its key or script */
+struct CAddressIndexPrefix
+{
+    uint8_t nType;
+    uint160 hash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nType);
+        READWRITE(hash);
+    }
+
+    CAddressIndexPrefix() : nType(0) {}
+    CAddressIndexPrefix(uint8_t nTypeIn, const uint160& hashIn) : nType(nTypeIn), hash(hashIn) {}
+
+    friend bool operator==(const CAddressIndexPrefix& a, const CAddressIndexPrefix& b) { return a.nType == b.nType && a.hash == b.hash; }
+    friend bool operator!=(const CAddressIndexPrefix& a, const CAddressIndexPrefix& b) { return !(a == b); }
+    friend bool operator<(const CAddressIndexPrefix& a, const CAddressIndexPrefix& b) { return a.nType != b.nType ? a.nType < b.nType : a.hash < b.hash; }
+};
+
+/**
+ * Key of an address index entry: the address, then the height of the block,
+ * the position of the transaction in it, its txid, and the output paying the
+ * address or the input spending from it. Heights and positions are big
+ * endian, so the entries of an address are in chain order.
+ */
+struct CAddressIndexKey
+{
+    CAddressIndexPrefix address;
+    uint32_t nHeight;
+    uint32_t nTx;
+    uint256 txid;
+    uint32_t nIndex;
+    bool fSpending;
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << address;
+        ser_writedata32be(s, nHeight);
+        ser_writedata32be(s, nTx);
+        s << txid;
+        ser_writedata32be(s, nIndex);
+        ser_writedata8(s, fSpending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> address;
+        nHeight = ser_readdata32be(s);
+        nTx = ser_readdata32be(s);
+        s >> txid;
+        nIndex = ser_readdata32be(s);
+        fSpending = ser_readdata8(s) != 0;
+    }
+
+    CAddressIndexKey() : nHeight(0), nTx(0), nIndex(0), fSpending(false) {}
+    CAddressIndexKey(const CAddressIndexPrefix& addressIn, uint32_t nHeightIn, uint32_t nTxIn, const uint256& txidIn, uint32_t nIndexIn, bool fSpendingIn) :
+        address(addressIn), nHeight(nHeightIn), nTx(nTxIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    friend bool operator<(const CAddressIndexKey& a, const CAddressIndexKey& b)
+    {
+        return std::tie(a.address, a.nHeight, a.nTx, a.txid, a.nIndex, a.fSpending) < std::tie(b.address, b.nHeight, b.nTx, b.txid, b.nIndex, b.fSpending);
+    }
+};
+
+/** Key of an address unspent index entry: the address, then the unspent output */
+struct CAddressUnspentKey
+{
+    CAddressIndexPrefix address;
+    uint256 txid;
+    uint32_t nIndex;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(address);
+        READWRITE(txid);
+        READWRITE(nIndex);
+    }
+
+    CAddressUnspentKey() : nIndex(0) {}
+    CAddressUnspentKey(const CAddressIndexPrefix& addressIn, const uint256& txidIn, uint32_t nIndexIn) : address(addressIn), txid(txidIn), nIndex(nIndexIn) {}
+
+    friend bool operator<(const CAddressUnspentKey& a, const CAddressUnspentKey& b)
+    {
+        return std::tie(a.address, a.txid, a.nIndex) < std::tie(b.address, b.txid, b.nIndex);
+    }
+};
+
+/** An unspent output of the address unspent index, and the height of its block */
+struct CAddressUnspentValue
+{
+    CAmount nValue;
+    CScript scriptPubKey;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nValue);
+        READWRITE(*(CScriptBase*)(&scriptPubKey));
+        READWRITE(nHeight);
+    }
+
+    CAddressUnspentValue() : nValue(0), nHeight(0) {}
+    CAddressUnspentValue(CAmount nValueIn, const CScript& scriptPubKeyIn, int nHeightIn) : nValue(nValueIn), scriptPubKey(scriptPubKeyIn), nHeight(nHeightIn) {}
+};
+
+/**
+ * Changes to the address indexes made by connecting blocks: the entries of
+ * their transactions, and the outputs they create and spend. Spent outputs
+ * keep their value, so disconnecting the blocks can restore them.
+ */
+struct CAddressIndexUpdates
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vCreated;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vSpent;
+
+    void Append(const CAddressIndexUpdates& updates);
+    bool IsEmpty() const { return vEntries.empty() && vCreated.empty() && vSpent.empty(); }
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
@@ -83,6 +291,14 @@ public:
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
+    /**
+     * Record the time of their transaction in the coins written before coins kept it.
+     * getBlockTxTimes returns the time of each transaction of the active chain block
+     * at a height. Returns false on error.
+     */
+    bool UpgradeCoinTime(const boost::function<bool(int, std::map<uint256, unsigned int>&)>& getBlockTxTimes);
+    //! Whether coins are left for UpgradeCoinTime
+    bool HasUntimedCoins();
     size_t EstimateSize() const override;
 };
 
@@ -108,6 +324,124 @@ private:
     friend class CCoinsViewDB;
 };
 
+/** Cursor over the stake index entries of the block tree database, in height order */
+class CStakeIndexCursor
+{
+public:
+    ~CStakeIndexCursor() {}
+
+    bool GetKey(unsigned int &nHeight) const;
+    /** The key id of the staker, null for proof-of-work blocks */
+    bool GetValue(uint160 &staker) const;
+
+    bool Valid() const;
+    void Next();
+
+private:
+    CStakeIndexCursor(CDBIterator* pcursorIn): pcursor(pcursorIn) {}
+    std::unique_ptr<CDBIterator> pcursor;
+    std::pair<char, CHeightTxIndexIteratorKey> keyTmp;
+
+    void ReadKey();
+
+    friend class CBlockTreeDB;
+};
+
+/** Cursor over the address index entries of one address, in chain order */
+class CAddressIndexCursor
+{
+public:
+    ~CAddressIndexCursor() {}
+
+    bool GetKey(CAddressIndexKey &key) const;
+    /** The amount paid to the address, negative for the amount spent from it */
+    bool GetValue(CAmount &nValue) const;
+
+    bool Valid() const;
+    void Next();
+
+private:
+    CAddressIndexCursor(CDBIterator* pcursorIn, const CAddressIndexPrefix& addressIn): pcursor(pcursorIn), address(addressIn) {}
+    std::unique_ptr<CDBIterator> pcursor;
+    CAddressIndexPrefix address;
+    std::pair<char, CAddressIndexKey> keyTmp;
+
+    void ReadKey();
+
+    friend class CBlockTreeDB;
+};
+
+/**
+ * Writes and erasures of the entries of an index made while connecting and
+ * disconnecting blocks, kept in memory until they are written to the block
+ * tree database in the same batch as the dirty block index entries.
+ */
+template <typename K, typename V>
+class CPendingIndex
+{
+public:
+    //! keys whose entries are erased before the writes below are applied
+    std::set<K> setErase;
+    std::map<K, V> mapWrite;
+
+    void Write(const K& key, const V& value) { mapWrite[key] = value; }
+    void Erase(const K& key) { mapWrite.erase(key); setErase.insert(key); }
+
+    /**
+     * Apply the pending changes of the keys from keyBegin on for which fInRange
+     * holds to mapEntries, the entries of those keys read from the database.
+     */
+    template <typename F>
+    void Apply(std::map<K, V>& mapEntries, const K& keyBegin, F fInRange) const
+    {
+        for (auto it = setErase.lower_bound(keyBegin); it != setErase.end() && fInRange(*it); ++it)
+            mapEntries.erase(*it);
+        for (auto it = mapWrite.lower_bound(keyBegin); it != mapWrite.end() && fInRange(it->first); ++it)
+            mapEntries[it->first] = it->second;
+    }
+
+    size_t size() const { return setErase.size() + mapWrite.size(); }
+    bool IsEmpty() const { return setErase.empty() && mapWrite.empty(); }
+    void Clear() { setErase.clear(); mapWrite.clear(); }
+};
+
+typedef CPendingIndex<CNotaryIndexKey, int> CPendingNotaryIndex;
+typedef CPendingIndex<CSpeechIndexKey, unsigned int> CPendingSpeechIndex;
+
+/** The pending changes of the address index and of the address unspent index */
+struct CPendingAddressIndex
+{
+    CPendingIndex<CAddressIndexKey, CAmount> entries;
+    CPendingIndex<CAddressUnspentKey, CAddressUnspentValue> unspent;
+
+    size_t size() const { return entries.size() + unspent.size(); }
+    bool IsEmpty() const { return entries.IsEmpty() && unspent.IsEmpty(); }
+    void Clear() { entries.Clear(); unspent.Clear(); }
+};
+
+/**
+ * Changes to the height keyed indexes (height and stake index) made while
+ * connecting and disconnecting blocks. They are kept in memory and written to
+ * the block tree database in the same batch as the dirty block index entries.
+ */
+class CHeightIndexUpdates
+{
+public:
+    //! heights whose entries are erased before the writes below are applied
+    std::set<unsigned int> setEraseHeightIndex;
+    std::set<unsigned int> setEraseStakeIndex;
+    std::vector<std::pair<CHeightTxIndexKey, std::vector<uint256> > > vHeightIndex;
+    std::map<unsigned int, uint160> mapStakeIndex;
+
+    void WriteHeightIndex(const CHeightTxIndexKey& heightIndex, const std::vector<uint256>& hash);
+    void EraseHeightIndex(unsigned int height);
+    void WriteStakeIndex(unsigned int height, const uint160& address);
+    void EraseStakeIndex(unsigned int height);
+
+    bool IsEmpty() const;
+    void Clear();
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -116,8 +450,13 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+    /** Load the entries whose hash starts with a byte in [nBegin, nEnd) */
+    void LoadBlockIndexRange(CBlockIndexLoad& load, unsigned int nBegin, unsigned int nEnd);
 public:
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    /** Write block file info, block index entries and index updates atomically; hashHeightIndexBest is the last block reflected in the latter */
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo,
+                        const CHeightIndexUpdates& heightIndexUpdates, const CPendingNotaryIndex& notaryIndex, const CPendingSpeechIndex& speechIndex,
+                        const CPendingAddressIndex& addressIndex, const uint256& hashHeightIndexBest);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
@@ -128,12 +467,41 @@ public:
     bool WriteTxOffsetIndex(const std::vector<std::pair<int,int> > &list);
     bool ReadTxOffsetSet ();
     bool WriteTxOffsetSet ();
+    /** Notary index entries map the notary key to the height of the block with the transaction */
+    bool ReadNotaryIndex(const uint256 &hashNotary, std::vector<std::pair<uint256, int> > &vTx);
+    bool WriteNotaryIndex(const std::vector<std::pair<CNotaryIndexKey, int> > &vEntries);
+    bool EraseNotaryIndex(const std::vector<CNotaryIndexKey> &vKeys);
+    /** Write entries of the background build with the height it reached; a negative height marks it complete */
+    bool WriteNotaryIndexBuild(const std::vector<std::pair<CNotaryIndexKey, int> > &vEntries, int nHeight);
+    bool ReadNotaryIndexBuildHeight(int &nHeight);
+    bool WipeNotaryIndex();
+    /**
+     * Speech index entries map the speech key to the position of the transaction
+     * in its block. Reads the entries of strToken, or of all tokens starting with
+     * it, stopping after nMaxEntries + 1.
+     */
+    bool ReadSpeechIndex(const std::string &strToken, bool fPrefix, size_t nMaxEntries, std::vector<std::pair<CSpeechIndexKey, unsigned int> > &vEntries);
+    bool WriteSpeechIndex(const std::vector<std::pair<CSpeechIndexKey, unsigned int> > &vEntries);
+    bool EraseSpeechIndex(const std::vector<CSpeechIndexKey> &vKeys);
+    bool WriteSpeechIndexBuild(const std::vector<std::pair<CSpeechIndexKey, unsigned int> > &vEntries, int nHeight);
+    bool ReadSpeechIndexBuildHeight(int &nHeight);
+    bool WipeSpeechIndex();
+    void CompactSpeechIndex();
+    /** Address index entries map the address index key to the amount paid to or spent from the address */
+    bool WriteAddressIndexBuild(const CAddressIndexUpdates &updates, int nHeight);
+    bool ReadAddressIndexBuildHeight(int &nHeight);
+    bool WipeAddressIndex();
+    /** Iterate the address index entries of an address from height nHeightStart up */
+    CAddressIndexCursor *AddressIndexCursor(const CAddressIndexPrefix &address, unsigned int nHeightStart);
+    /** Read the unspent outputs of an address by txid, stopping after nMaxEntries + 1 */
+    bool ReadAddressUnspentIndex(const CAddressIndexPrefix &address, size_t nMaxEntries, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vEntries);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /** Load the block index entries, decoding and checking them on nThreads threads */
+    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex, int nThreads = 1);
     
     ////////////////////////////////////////////////////////////////////////////// // qtum
-    bool WriteHeightIndex(const CHeightTxIndexKey &heightIndex, const std::vector<uint256>& hash);
+    bool ReadHeightIndexBestBlock(uint256& hash);
 
     /**
      * Iterates through blocks by height, starting from low.
@@ -149,15 +517,18 @@ public:
     size_t ReadHeightIndex(size_t low, size_t high, size_t minconf,
             std::vector<std::vector<uint256>> &blocksOfHashes,
             std::set<uint160> const &addresses);
-    bool EraseHeightIndex(const unsigned int &height);
     bool WipeHeightIndex();
 
 
-    bool WriteStakeIndex(unsigned int height, uint160 address);
+    /** Stake index entries map the height of a block to the key id of its staker */
     bool ReadStakeIndex(unsigned int height, uint160& address);
-    bool ReadStakeIndex(unsigned int high, unsigned int low, std::vector<uint160> addresses);
-    bool EraseStakeIndex(unsigned int height);
-    
+    /** Iterate the stake index from height nHeightStart up */
+    CStakeIndexCursor *StakeIndexCursor(unsigned int nHeightStart);
+    /** Move the stake index from its little endian keys, which do not sort by height */
+    bool UpgradeStakeIndex();
+
+private:
+    void EraseHeightIndex(CDBBatch& batch, unsigned int height);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -5,8 +5,11 @@
 
 #include "validation.h"
 
+#include "addressindex.h"
 #include "arith_uint256.h"
 #include "base58.h"
+#include "blockcache.h"
+#include "blockimport.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
@@ -17,6 +20,7 @@
 #include "consensus/params.h"
 #include "hash.h"
 #include "init.h"
+#include "notary.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -27,6 +31,7 @@
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "speechindex.h"
 #include "timedata.h"
 #include "tinyformat.h"
 #include "txdb.h"
@@ -69,7 +74,9 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
-std::set<std::pair<COutPoint, unsigned int>> setStakeSeen;
+CStakeSeen setStakeSeen;
+/** Stakes of the proof-of-stake headers accepted ahead of their blocks */
+static CStakeSeen setStakeSeenHeaders;
 std::map<std::string, CClamour*> mapClamour;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
@@ -79,12 +86,16 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = true;
+bool fNotaryIndex = DEFAULT_NOTARYINDEX;
+bool fSpeechIndex = DEFAULT_SPEECHINDEX;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
 bool fLogEvents = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+bool fCheckBlockReads = DEFAULT_CHECK_BLOCK_READS;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -99,7 +110,7 @@ CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 CTxMemPool mempool(::minRelayTxFee);
 
 static void CheckBlockIndex(const Consensus::CParams& consensusParams);
-static bool UpdateHashProof(const CBlock& block, CValidationState& state, const Consensus::CParams& consensusParams, CBlockIndex* pindex, CCoinsViewCache& view);
+static bool UpdateHashProof(const CBlock& block, CValidationState& state, const Consensus::CParams& consensusParams, CBlockIndex* pindex, CCoinsViewCache& view, bool fCheckSignature = true);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -169,6 +180,10 @@ namespace {
 
     /** Dirty block file entries. */
     std::set<int> setDirtyFileInfo;
+
+    /** Height and stake index changes not yet written, and the last block they reflect. */
+    CHeightIndexUpdates heightIndexUpdates;
+    uint256 hashHeightIndexBest;
 } // anon namespace
 
 /* Use this class to start tracking transactions that are removed from the
@@ -1108,35 +1123,23 @@ bool GetCoinAge(const CTransaction& tx, CBlockIndex* pindexPrev, CCoinsViewCache
 
     for (const auto& txin : tx.vin)
     {
-        uint256 hashBlock;
-        CTransactionRef txPrevRef;
-
         Coin coinPrev;
         if(!view.GetCoin(txin.prevout, coinPrev)){
             return false;
         }
 
-        if (!GetTransaction(txin.prevout.hash, txPrevRef, Params().GetConsensus(), hashBlock, true))
-            return false;
-        const CTransaction& txPrev = *txPrevRef;
-
         CBlockIndex* blockFrom = pindexPrev->GetAncestor(coinPrev.nHeight);
         if(!blockFrom) {
             return false;
         }
 
-        CBlock block;
-        if (!ReadBlockFromDisk(block, blockFrom, consensusParams))
-            return false;
-
-
-        if (tx.nTime < txPrev.nTime)
+        if (tx.nTime < coinPrev.nTime)
             return false;  // Transaction timestamp violation
-        if (block.GetBlockTime() + consensusParams.nStakeMinAge > tx.nTime)
+        if (blockFrom->GetBlockTime() + consensusParams.nStakeMinAge > tx.nTime)
             continue; // only count coins meeting min age requirement
 
-        int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
-        bnCentSecond += arith_uint256(nValueIn) * (tx.nTime-txPrev.nTime) / CENT;
+        int64_t nValueIn = coinPrev.out.nValue;
+        bnCentSecond += arith_uint256(nValueIn) * (tx.nTime-coinPrev.nTime) / CENT;
 
         //LogPrintf("coin age nValueIn=%d, nTimeDiff=%d, bnCentSecond=%s, bnCentSecond2=%d\n", nValueIn, tx.nTime - txPrev.nTime, bnCentSecond.ToString(), bnCentSecond.GetLow64());
     }
@@ -1206,10 +1209,16 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
     return false;
 }
 
+/** Up to version 6 the block hash is the scrypt proof-of-work hash, which the header caches once computed */
+static uint256 GetHeaderPoWHash(const CBlockHeader& block)
+{
+    return block.nVersion <= 6 ? block.GetHash() : block.GetPoWHash();
+}
+
 bool CheckHeaderPoW(const CBlockHeader& block, const Consensus::CParams& consensusParams)
 {
     // Check for proof of work block header
-    return CheckProofOfWork(block.GetPoWHash(), block.nBits, consensusParams);
+    return CheckProofOfWork(GetHeaderPoWHash(block), block.nBits, consensusParams);
 }
 
 bool CheckHeaderPoS(const CBlockHeader& block, const Consensus::CParams& consensusParams)
@@ -1260,8 +1269,7 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    CBlockLegacy blockLegacy(block);
-    unsigned int nSize = GetSerializeSize(fileout, blockLegacy);
+    unsigned int nSize = GetSerializeSize(fileout, LEGACY_BLOCK(block));
     fileout << FLATDATA(messageStart) << nSize;
 
     // Write block
@@ -1269,12 +1277,12 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockLegacy;
+    fileout << LEGACY_BLOCK(block);
 
     return true;
 }
 
-static bool ReadCBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::CParams& consensusParams)
+static bool ReadCBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::CParams& consensusParams, bool fCheckProof = true)
 {
     block.SetNull();
 
@@ -1285,16 +1293,14 @@ static bool ReadCBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Co
 
     // Read block
     try {
-        CBlockLegacy blockLegacy;
-        filein >> blockLegacy;
-        block = blockLegacy;
+        filein >> LEGACY_BLOCK(block);
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
     }
 
     // Check the header
-    if(!block.IsProofOfStake()) {
+    if(fCheckProof && !block.IsProofOfStake()) {
         //PoS blocks can be loaded out of order from disk, which makes PoS impossible to validate. So, do not validate their headers
         //they will be validated later in CheckBlock and ConnectBlock anyway
         if (!CheckHeaderProof(block, consensusParams))
@@ -1304,63 +1310,92 @@ static bool ReadCBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Co
     return true;
 }
 
+/**
+ * Read the block an index entry points to. Blocks whose scripts were validated
+ * had their proof checked and their hash computed when they were accepted, so
+ * unless -checkblockreads is set the index is trusted for both; for the scrypt
+ * hashed blocks of the early chain that is most of the cost of reading them.
+ * The header is still compared with the index to catch misplaced data.
+ */
+static bool ReadIndexedBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::CParams& consensusParams)
+{
+    bool fTrusted = !fCheckBlockReads && pindex->phashBlock && pindex->IsValid(BLOCK_VALID_SCRIPTS);
+    if (!ReadCBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, !fTrusted))
+        return false;
+
+    if (fTrusted) {
+        uint256 hashPrev = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+        if (block.nVersion != pindex->nVersion || block.hashPrevBlock != hashPrev || block.hashMerkleRoot != pindex->hashMerkleRoot ||
+            block.nTime != pindex->nTime || block.nBits != pindex->nBits || block.nNonce != pindex->nNonce)
+            return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): header doesn't match index for %s at %s",
+                         pindex->ToString(), pindex->GetBlockPos().ToString());
+        block.blockHash = pindex->GetBlockHash();
+        return true;
+    }
+
+    if (block.GetHash() != pindex->GetBlockHash())
+        return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                     pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 /* Some blocks contain thousands of small outputs all owned by the
  * same client, all trying to stake. ReadBlockFromDisk() is called for
  * each of them and it was re-reading the same block over and
- * over. These maps cache the block data to save having to repeatedly
- * read and parse the block data
+ * over. Blocks read on their behalf are kept in a size-bounded LRU
+ * cache and shared between readers instead of being copied.
  */
-static std::map<uint256, CBlock> mapBlockCache;
-static std::map<uint256, int64_t> mapBlockCacheAges;
-static int nBlockCacheCleanInterval = 60 * 5; // clean block cache every 5 minutes
-static int nBlockCacheMaxAge        = 60 * 2; // delete blocks from cache if they weren't accessed in the last 2 minutes
+CBlockCache blockcache;
 
-bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::CParams& consensusParams, bool fUpdateCache)
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const Consensus::CParams& consensusParams, bool fUpdateCache)
 {
-    static int64_t nLastBlockCacheCleanTime = 0;
-
-    int64_t now = GetTime();
-    if (nLastBlockCacheCleanTime < now - nBlockCacheCleanInterval) {
-        LogPrint("cache", "%s:%d cleaning mapBlockCache from size %d\n", __FILE__, __LINE__, mapBlockCacheAges.size());
-        nLastBlockCacheCleanTime = now;
-
-        for (auto it = mapBlockCacheAges.cbegin(), next_it = it; it != mapBlockCacheAges.cend(); it = next_it)
-        {
-            ++next_it;
-            if (it->second < now - nBlockCacheMaxAge) {
-                LogPrint("cache", "%s:%d entry %s is too old %d\n", __FILE__, __LINE__, it->first.GetHex(), now - it->second);
-                mapBlockCache.erase(it->first);
-                mapBlockCacheAges.erase(it->first);
-            }
-        }
+    if (pindex->phashBlock) {
+        pblock = blockcache.Get(*pindex->phashBlock, fUpdateCache);
+        if (pblock)
+            return true;
     }
-    std::map<uint256, CBlock>::iterator mi;
 
-    // if the block is in the cache, use it and update the timestamp
-    // of when it was last used
-    if (pindex->phashBlock && (mi = mapBlockCache.find(*pindex->phashBlock)) != mapBlockCache.end()) {
-        block = mi->second;
-        mapBlockCacheAges[*pindex->phashBlock] = now;
-    } else {
-        if (!pindex->phashBlock)
-            LogPrint("cache", "%s:%d no phashBlock set\n", __FILE__, __LINE__);
-        else
-            LogPrint("cache", "%s:%d block %s not in map\n", __FILE__, __LINE__, pindex->phashBlock->GetHex());
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    if (!ReadIndexedBlockFromDisk(*pblockRead, pindex, consensusParams))
+        return false;
 
-        if (!ReadCBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
-            return false;
+    pblock = pblockRead;
+    if (fUpdateCache && pindex->phashBlock) {
+        LogPrint("cache", "%s: inserting block %s into cache\n", __func__, pindex->phashBlock->GetHex());
+        blockcache.Insert(*pindex->phashBlock, pblock);
+    }
 
-        if (block.GetHash() != pindex->GetBlockHash())
-            return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
-                         pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
 
-        if (fUpdateCache) {
-            LogPrint("cache", "%s:%d inserting block %s into map\n", __FILE__, __LINE__, pindex->phashBlock->GetHex());
-            mapBlockCache[*pindex->phashBlock] = block;
-            mapBlockCacheAges[*pindex->phashBlock] = now;
+bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::CParams& consensusParams, bool fUpdateCache)
+{
+    // Callers that want their own mutable copy only pay for one when the block is cached
+    if (!fUpdateCache) {
+        std::shared_ptr<const CBlock> pblock;
+        if (pindex->phashBlock && (pblock = blockcache.Get(*pindex->phashBlock, false))) {
+            block = *pblock;
+            return true;
         }
+
+        return ReadIndexedBlockFromDisk(block, pindex, consensusParams);
     }
 
+    std::shared_ptr<const CBlock> pblock;
+    if (!ReadBlockFromDisk(pblock, pindex, consensusParams, true))
+        return false;
+    block = *pblock;
+    return true;
+}
+
+bool ReadBlockSupport(CBlockIndex* pindex, const Consensus::CParams& consensusParams)
+{
+    AssertLockHeld(cs_main);
+    std::shared_ptr<const CBlock> pblock;
+    if (!ReadBlockFromDisk(pblock, pindex, consensusParams))
+        return false;
+    pindex->SetSupport(*pblock);
+    setDirtyBlockIndex.insert(pindex);
     return true;
 }
 
@@ -1530,6 +1565,8 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    if (pblock)
+        return CheckBlockSignature(*pblock, cacheStore);
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
     if (!VerifyScript(scriptSig, scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *txdata), &error)) {
@@ -1676,6 +1713,37 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
     return true;
 }
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull())
+        return error("%s: no undo data available", __func__);
+
+    // Open history file to read
+    int nVersion = CLIENT_VERSION | ((pindex->nStatus & BLOCK_UNDO_COINTIME) ? 0 : SERIALIZE_COIN_NO_TIME);
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, nVersion);
+    if (filein.IsNull())
+        return error("%s: OpenUndoFile failed", __func__);
+
+    // Read block
+    uint256 hashChecksum;
+    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    try {
+        verifier << pindex->pprev->GetBlockHash();
+        verifier >> blockundo;
+        filein >> hashChecksum;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    // Verify checksum
+    if (hashChecksum != verifier.GetHash())
+        return error("%s: Checksum mismatch", __func__);
+
+    return true;
+}
+
 namespace {
 
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
@@ -1705,32 +1773,6 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
-{
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Read block
-    uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
-    try {
-        verifier << hashBlock;
-        verifier >> blockundo;
-        filein >> hashChecksum;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-    }
-
-    // Verify checksum
-    if (hashChecksum != verifier.GetHash())
-        return error("%s: Checksum mismatch", __func__);
-
-    return true;
-}
-
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1779,6 +1821,7 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
         if (!alternate.IsSpent()) {
             undo.nHeight = alternate.nHeight;
             undo.fCoinBase = alternate.fCoinBase;
+            undo.nTime = alternate.nTime;
         } else {
             return DISCONNECT_FAILED; // adding output for transaction without known metadata
         }
@@ -1788,7 +1831,41 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+/**
+ * Fill in the transaction time of the coins spent by a block whose undo data
+ * was written before coins kept it, from the blocks that created them.
+ */
+static bool ReadUndoCoinTime(CBlockUndo& blockUndo, const CBlock& block, const CBlockIndex* pindex)
+{
+    std::map<int, std::shared_ptr<const CBlock> > mapBlocksFrom;
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+        for (unsigned int j = 0; j < txundo.vprevout.size() && j < tx.vin.size(); j++) {
+            Coin& coin = txundo.vprevout[j];
+            // ApplyTxInUndo takes the metadata of these from another output of the transaction
+            if (coin.nHeight == 0)
+                continue;
+            std::shared_ptr<const CBlock>& pblockFrom = mapBlocksFrom[coin.nHeight];
+            if (!pblockFrom) {
+                const CBlockIndex* pindexFrom = pindex->GetAncestor(coin.nHeight);
+                if (!pindexFrom || !ReadBlockFromDisk(pblockFrom, pindexFrom, Params().GetConsensus()))
+                    return error("%s: failed to read block at height %d", __func__, coin.nHeight);
+            }
+            const uint256& hashPrev = tx.vin[j].prevout.hash;
+            auto it = std::find_if(pblockFrom->vtx.begin(), pblockFrom->vtx.end(),
+                                   [&hashPrev](const CTransactionRef& txFrom) { return txFrom->GetHash() == hashPrev; });
+            if (it == pblockFrom->vtx.end())
+                return error("%s: transaction %s not found at height %d", __func__, hashPrev.ToString(), coin.nHeight);
+            coin.nTime = (*it)->nTime;
+        }
+    }
+    return true;
+}
+
+/** Like the one declared in validation.h; the undo data read is also copied to pblockundoOut, if given */
+static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean,
+                                        CBlockUndo* pblockundoOut = NULL)
 {
     bool fClean = true;
 
@@ -1798,7 +1875,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
         error("DisconnectBlock(): no undo data available");
         return DISCONNECT_FAILED;
     }
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
+    if (!UndoReadFromDisk(blockUndo, pindex)) {
         error("DisconnectBlock(): failure reading undo data");
         return DISCONNECT_FAILED;
     }
@@ -1806,6 +1883,13 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
         error("DisconnectBlock(): block and undo data inconsistent");
         return DISCONNECT_FAILED;
     }
+    if (!(pindex->nStatus & BLOCK_UNDO_COINTIME) && !ReadUndoCoinTime(blockUndo, block, pindex)) {
+        error("DisconnectBlock(): failure reading the time of the spent coins");
+        return DISCONNECT_FAILED;
+    }
+    // Restoring the inputs below moves the spent coins out of blockUndo
+    if (pblockundoOut)
+        *pblockundoOut = blockUndo;
     
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
@@ -1843,22 +1927,11 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    if(pfClean == NULL){
-        pblocktree->EraseHeightIndex(pindex->nHeight);
-    }
-    pblocktree->EraseStakeIndex(pindex->nHeight);
     //if (pfClean) {
     //    *pfClean = fClean;
     //    return true;
     //}
 
-    if (block.IsProofOfStake()) {
-        CAmount nStakeReward = pindex->nMint;
-
-        if (nStakeReward)
-            GetMainSignals().StakeTransaction(block.vtx[1]->vout[1].scriptPubKey, -nStakeReward);
-    }
-
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -1944,6 +2017,15 @@ public:
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
+/** The stake index entry of a block: the key id of its block signing key, or null for proof-of-work */
+static uint160 GetBlockStaker(const CBlock& block)
+{
+    std::vector<unsigned char> vchPubKey;
+    if (block.IsProofOfStake() && GetBlockPublicKey(block, vchPubKey))
+        return uint160(ToByteVector(CPubKey(vchPubKey).GetID()));
+    return uint160();
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -1959,8 +2041,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     int64_t nTimeStart = GetTimeMicros();
 
-    // Check it again in case a previous version let a bad block in
-    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck))
+    // Check it again in case a previous version let a bad block in. The block
+    // signature of a block not checked before is verified with the scripts below.
+    bool fCheckBlockSig = !block.fChecked && block.IsProofOfStake();
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck, false))
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
     // verify that the view's current state corresponds to the previous block
     uint256 hashPrevBlock = pindex->pprev == NULL ? uint256() : pindex->pprev->GetBlockHash();
@@ -1977,8 +2061,35 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return true;
     }
 
-    // State is filled in by UpdateHashProof
-    if (!UpdateHashProof(block, state, chainparams.GetConsensus(), pindex, view)) {
+    bool fScriptChecks = true;
+    if (!hashAssumeValid.IsNull()) {
+        // We've been configured with the hash of a block which has been externally verified to have a valid history.
+        // A suitable default value is included with the software and updated from time to time.  Because validity
+        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
+        // This setting doesn't force the selection of any particular chain but makes validating some faster by
+        //  effectively caching the result of part of the verification.
+        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
+        if (it != mapBlockIndex.end()) {
+            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
+                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+                pindexBestHeader->nChainWork >= UintToArith256(chainparams.GetConsensus().nMinimumChainWork)) {
+                // This block is a member of the assumed verified chain and an ancestor of the best header.
+                // The equivalent time check discourages hashpower from extorting the network via DOS attack
+                //  into accepting an invalid block through telling users they must manually set assumevalid.
+                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
+                //  it hard to hide the implication of the demand.  This also avoids having release candidates
+                //  that are hardly doing any signature verification at all in testing without having to
+                //  artificially set the default assumed verified block further back.
+                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
+                //  least as good as the expected chain.
+                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
+            }
+        }
+    }
+
+    // State is filled in by UpdateHashProof. The coinstake signature is one of
+    // the script checks below, so it is only verified here when they are skipped.
+    if (!UpdateHashProof(block, state, chainparams.GetConsensus(), pindex, view, !fScriptChecks)) {
         return error("%s: ConnectBlock(): %s", __func__, state.GetRejectReason().c_str());
     }
 
@@ -2009,32 +2120,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     pindex->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
 
 
-    bool fScriptChecks = true;
-    if (!hashAssumeValid.IsNull()) {
-        // We've been configured with the hash of a block which has been externally verified to have a valid history.
-        // A suitable default value is included with the software and updated from time to time.  Because validity
-        //  relative to a piece of software is an objective fact these defaults can be easily reviewed.
-        // This setting doesn't force the selection of any particular chain but makes validating some faster by
-        //  effectively caching the result of part of the verification.
-        BlockMap::const_iterator  it = mapBlockIndex.find(hashAssumeValid);
-        if (it != mapBlockIndex.end()) {
-            if (it->second->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
-                pindexBestHeader->nChainWork >= UintToArith256(chainparams.GetConsensus().nMinimumChainWork)) {
-                // This block is a member of the assumed verified chain and an ancestor of the best header.
-                // The equivalent time check discourages hashpower from extorting the network via DOS attack
-                //  into accepting an invalid block through telling users they must manually set assumevalid.
-                //  Requiring a software change or burying the invalid block, regardless of the setting, makes
-                //  it hard to hide the implication of the demand.  This also avoids having release candidates
-                //  that are hardly doing any signature verification at all in testing without having to
-                //  artificially set the default assumed verified block further back.
-                // The test against nMinimumChainWork prevents the skipping when denied access to any chain at
-                //  least as good as the expected chain.
-                fScriptChecks = (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, chainparams.GetConsensus()) <= 60 * 60 * 24 * 7 * 2);
-            }
-        }
-    }
-
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
 
@@ -2114,6 +2199,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
+    // Start with the block signature, so the workers verify it while the inputs are gathered
+    if (fCheckBlockSig) {
+        CScriptCheck check(block, fJustCheck);
+        if (fScriptChecks && nScriptCheckThreads) {
+            std::vector<CScriptCheck> vChecks(1);
+            check.swap(vChecks.back());
+            control.Add(vChecks);
+        } else if (!check()) {
+            return state.DoS(100, false, REJECT_INVALID, "bad-blk-signature", false, "bad proof-of-stake block signature");
+        }
+    }
 
 
     std::vector<int> prevheights;
@@ -2259,6 +2355,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         pindex->prevoutStake = block.vtx[1]->vin[0].prevout;
         setStakeSeen.insert(std::make_pair(pindex->prevoutStake, pindex->nTime));
     }
+    if (pindex->nHeight % STAKE_SEEN_PRUNE_INTERVAL == 0) {
+        size_t nPruned = setStakeSeen.Prune(GetStakeSeenCutoff(pindex, chainparams.GetConsensus()));
+        LogPrint("bench", "    - Pruned %u stakes from setStakeSeen, %u left\n", nPruned, setStakeSeen.size());
+    }
+
+    // Parse the CLAMour petitions supported by the stake once, and keep them in the block index
+    if (!(pindex->nFlags & CBlockIndex::BLOCK_SUPPORT_INDEXED)) {
+        pindex->SetSupport(block);
+        setDirtyBlockIndex.insert(pindex);
+    }
 
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
@@ -2272,35 +2378,28 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             // update nUndoPos in block index
             pindex->nUndoPos = _pos.nPos;
-            pindex->nStatus |= BLOCK_HAVE_UNDO;
+            pindex->nStatus |= BLOCK_HAVE_UNDO | BLOCK_UNDO_COINTIME;
         }
 
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
     }
 
+    // Buffered, and written with the block index in FlushStateToDisk
     for (const auto& e: heightIndexes)
-    {
-        if (!pblocktree->WriteHeightIndex(e.second.first, e.second.second))
-            return AbortNode(state, "Failed to write height index");
-    }   
-
-    if(block.IsProofOfStake()){
-        // Read the public key from the second output
-        std::vector<unsigned char> vchPubKey;
-        if(GetBlockPublicKey(block, vchPubKey))
-        {
-            uint160 pkh = uint160(ToByteVector(CPubKey(vchPubKey).GetID()));
-            pblocktree->WriteStakeIndex(pindex->nHeight, pkh);
-        }else{
-            pblocktree->WriteStakeIndex(pindex->nHeight, uint160());
-        }
-    }else{
-        pblocktree->WriteStakeIndex(pindex->nHeight, uint160());
-    }
+        heightIndexUpdates.WriteHeightIndex(e.second.first, e.second.second);
+    heightIndexUpdates.WriteStakeIndex(pindex->nHeight, GetBlockStaker(block));
+    hashHeightIndexBest = pindex->GetBlockHash();
     if (fTxIndex)
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
+    if (fNotaryIndex)
+        WriteBlockNotaryIndex(block, pindex->nHeight);
+    if (fSpeechIndex)
+        WriteBlockSpeechIndex(block, pindex->nHeight);
+    if (fAddressIndex)
+        if (!WriteBlockAddressIndex(block, blockundo, pindex->nHeight))
+            return AbortNode(state, "Failed to write address index");
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2313,9 +2412,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
     hashPrevBestCoinBase = block.vtx[0]->GetHash();
 
-    if (nStakeReward)
-        GetMainSignals().StakeTransaction(block.vtx[1]->vout[1].scriptPubKey, nStakeReward);
-
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
 
@@ -2329,7 +2425,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             std::string pid = strHash.substr(0, 8);
             std::map<std::string, CClamour*>::iterator mi = mapClamour.find(pid);
             if (mi == mapClamour.end())
-                pindex->vClamour.push_back(*(mapClamour[pid] = new CClamour(pindex->nHeight, tx->GetHash(), strHash, strURL)));
+                pindex->AddClamour(*(mapClamour[pid] = new CClamour(pindex->nHeight, tx->GetHash(), strHash, strURL)));
             else
                 LogPrintf("duplicate clamour with pid %s: %s\n", pid, tx->strClamSpeech.substr(0, MAX_TX_COMMENT_LEN));
         }
@@ -2388,12 +2484,14 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
     // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
     bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
+    // The index changes buffered for the block index write are taking up a lot of memory.
+    bool fIndexLarge = mode != FLUSH_STATE_NONE && pendingNotaryIndex.size() + pendingSpeechIndex.size() + pendingAddressIndex.size() > MAX_PENDING_INDEX_ENTRIES;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
     // Combine all conditions that result in a full cache flush.
     bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
     // Write blocks and block index to disk.
-    if (fDoFullFlush || fPeriodicWrite) {
+    if (fDoFullFlush || fPeriodicWrite || fIndexLarge) {
         // Depend on nMinDiskSpace to ensure we can write block index
         if (!CheckDiskSpace(0))
             return state.Error("out of disk space");
@@ -2413,9 +2511,13 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
                 vBlocks.push_back(*it);
                 setDirtyBlockIndex.erase(it++);
             }
-            if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+            if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks, heightIndexUpdates, pendingNotaryIndex, pendingSpeechIndex, pendingAddressIndex, hashHeightIndexBest)) {
                 return AbortNode(state, "Failed to write to block index database");
             }
+            heightIndexUpdates.Clear();
+            pendingNotaryIndex.Clear();
+            pendingSpeechIndex.Clear();
+            pendingAddressIndex.Clear();
         }
         // Finally remove any pruned files
         if (fFlushForPrune)
@@ -2452,6 +2554,12 @@ void FlushStateToDisk() {
     FlushStateToDisk(state, FLUSH_STATE_ALWAYS);
 }
 
+void GetPendingStakeIndex(CHeightIndexUpdates& updates) {
+    AssertLockHeld(cs_main);
+    updates.setEraseStakeIndex = heightIndexUpdates.setEraseStakeIndex;
+    updates.mapStakeIndex = heightIndexUpdates.mapStakeIndex;
+}
+
 void PruneAndFlush() {
     CValidationState state;
     fCheckForPruning = true;
@@ -2523,6 +2631,18 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
 
 }
 
+/**
+ * Tell the wallets about the reward of a proof-of-stake block entering or
+ * leaving the active chain. Only ConnectTip and DisconnectTip call this, so
+ * VerifyDB reconnecting and disconnecting blocks leaves the stake ledger alone.
+ */
+static void NotifyStakeReward(const CBlock& block, const CBlockIndex* pindex, bool fConnected)
+{
+    // nMint of a proof-of-stake block is what its coinstake pays beyond its inputs
+    if (block.IsProofOfStake() && pindex->nMint)
+        GetMainSignals().StakeTransaction(block.vtx[1]->vout[1].scriptPubKey, fConnected ? pindex->nMint : -pindex->nMint, pindex);
+}
+
 /** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
 bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams, bool fBare = false)
 {
@@ -2534,14 +2654,27 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         return AbortNode(state, "Failed to read block");
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
+    CBlockUndo blockundo;
     {
         bool fClean=true;
         CCoinsViewCache view(pcoinsTip);
-        if (DisconnectBlock(block, state, pindexDelete, view, &fClean) != DISCONNECT_OK)
+        if (DisconnectBlock(block, state, pindexDelete, view, &fClean, fAddressIndex ? &blockundo : NULL) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
     }
+    NotifyStakeReward(block, pindexDelete, false);
+    // Buffered, and written with the block index in FlushStateToDisk
+    heightIndexUpdates.EraseHeightIndex(pindexDelete->nHeight);
+    heightIndexUpdates.EraseStakeIndex(pindexDelete->nHeight);
+    hashHeightIndexBest = pindexDelete->pprev->GetBlockHash();
+    if (fNotaryIndex)
+        EraseBlockNotaryIndex(block);
+    if (fSpeechIndex)
+        EraseBlockSpeechIndex(block, pindexDelete->nHeight);
+    if (fAddressIndex)
+        if (!EraseBlockAddressIndex(block, blockundo, pindexDelete->nHeight))
+            return AbortNode(state, "Failed to erase address index");
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
@@ -2570,6 +2703,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
+    clamourSupport.BlockDisconnected(pindexDelete);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     for (const auto& tx : block.vtx) {
@@ -2635,6 +2769,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    NotifyStakeReward(blockConnecting, pindexNew, true);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
@@ -2644,6 +2779,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
+    clamourSupport.BlockConnected(pindexNew);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
@@ -3031,8 +3167,8 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.New(block);
+    pindexNew->SetBlockSig(block.vchBlockSig);
 
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
@@ -3215,7 +3351,7 @@ bool CheckFirstCoinstakeOutput(const CBlock& block)
 
 #ifdef ENABLE_WALLET
 // novacoin: attempt to generate suitable proof-of-stake
-bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees, uint32_t nTime)
+bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CStakeKernelHit& hit, const CAmount& nTotalFees, uint32_t nTime)
 {
     // if we are trying to sign
     //    something except proof-of-stake block template
@@ -3249,8 +3385,7 @@ bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& n
         else
             LogPrintf("starting stake\n");
 
-        int64_t nSearchInterval = chainActive.Tip()->nHeight + 1 > Params().GetConsensus().nProtocolV2Height ? 1 : nSearchTime - nLastCoinStakeSearchTime;
-        if (wallet.CreateCoinStake(wallet, pblock->nBits, nSearchInterval, nTotalFees, nTimeBlock, txCoinStake, key))
+        if (wallet.CreateCoinStake(wallet, hit, nTotalFees, nTimeBlock, txCoinStake, key))
         {
             if (txCoinStake.nTime >= std::max(chainActive.Tip()->GetPastTimeLimit( Params().GetConsensus().nProtocolV2Height )+1, PastDrift(chainActive.Tip()->GetBlockTime(), chainActive.Tip()->nHeight+1, Params().GetConsensus())))
             {
@@ -3338,7 +3473,7 @@ bool GetBlockPublicKey(const CBlock& block, std::vector<unsigned char>& vchPubKe
     return false;
 }
 
-bool CheckBlockSignature(const CBlock& block)
+bool CheckBlockSignature(const CBlock& block, bool fCacheStore)
 {
     if (block.IsProofOfWork()){
         return block.vchBlockSig.empty();
@@ -3350,7 +3485,7 @@ bool CheckBlockSignature(const CBlock& block)
         return false;
     }
 
-    return CPubKey(vchPubKey).Verify(block.GetHash(), block.vchBlockSig);
+    return CachingVerifySignature(block.vchBlockSig, CPubKey(vchPubKey), block.GetHash(), fCacheStore);
 }
 
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::CParams& consensusParams, bool fCheckPOW)
@@ -3527,7 +3662,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::C
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
 
-    if (fCheckPOW && fCheckMerkleRoot)
+    if (fCheckPOW && fCheckMerkleRoot && fCheckSig)
         block.fChecked = true;
 
     return true;
@@ -3709,7 +3844,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const Co
 }
 
 
-static bool UpdateHashProof(const CBlock& block, CValidationState& state, const Consensus::CParams& consensusParams, CBlockIndex* pindex, CCoinsViewCache& view)
+static bool UpdateHashProof(const CBlock& block, CValidationState& state, const Consensus::CParams& consensusParams, CBlockIndex* pindex, CCoinsViewCache& view, bool fCheckSignature)
 {
     int nHeight = pindex->nHeight;
     uint256 hash = block.GetHash();
@@ -3731,8 +3866,8 @@ static bool UpdateHashProof(const CBlock& block, CValidationState& state, const
     // Verify hash target and signature of coinstake tx
     if (block.IsProofOfStake())
     {
-        CBigNum bnTargetProofOfStake;
-        if (!CheckProofOfStake(pindex->pprev, state, *block.vtx[1], block.nBits,  hashProof, bnTargetProofOfStake, view, *pblocktree))
+        arith_uint256 bnTargetProofOfStake;
+        if (!CheckProofOfStake(pindex->pprev, state, *block.vtx[1], block.nBits,  hashProof, bnTargetProofOfStake, view, *pblocktree, consensusParams, fCheckSignature))
         {
             return error("UpdateHashProof() : check proof-of-stake failed for block %s", hash.ToString());
         }
@@ -3741,7 +3876,7 @@ static bool UpdateHashProof(const CBlock& block, CValidationState& state, const
     // PoW is checked in CheckBlock()
     if (block.IsProofOfWork())
     {
-        hashProof = block.GetPoWHash();
+        hashProof = GetHeaderPoWHash(block);
     }
     
     // Record proof hash value
@@ -3749,7 +3884,35 @@ static bool UpdateHashProof(const CBlock& block, CValidationState& state, const
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool CheckBlockHeaderStake(const CBlockHeader& block, CValidationState& state, const Consensus::CParams& consensusParams, const CBlockIndex* pindexPrev, bool fAllowDuplicateStake)
+{
+    AssertLockHeld(cs_main);
+    const int nHeight = pindexPrev->nHeight + 1;
+
+    if (block.IsProofOfWork()) {
+        if (nHeight > consensusParams.LAST_POW_BLOCK)
+            return state.DoS(100, false, REJECT_INVALID, "bad-header-pow", false, strprintf("proof-of-work header at height %d", nHeight));
+        if (!block.vchBlockSig.empty())
+            return state.DoS(100, false, REJECT_INVALID, "bad-header-sig", false, "signed proof-of-work header");
+        return true;
+    }
+
+    // The key signing the block is in its coinstake, so only the encoding of the signature can be checked here
+    if (!IsLowDERSignature(block.vchBlockSig, NULL, false))
+        return state.DoS(100, false, REJECT_INVALID, "bad-header-sig", false, "non-canonical block signature");
+
+    // The time of a proof-of-stake block is the time of its coinstake
+    if (!CheckCoinStakeTimestamp(nHeight, block.GetBlockTime(), block.GetBlockTime()))
+        return state.DoS(100, false, REJECT_INVALID, "bad-header-stake-time", false, strprintf("bad stake timestamp %u", block.nTime));
+
+    // Limited duplicity on stake, as for blocks: prevents header flood attack
+    CStakeSeen::Stake stake = std::make_pair(block.prevoutStake, block.nTime);
+    if (!fAllowDuplicateStake && (setStakeSeen.count(stake) || setStakeSeenHeaders.count(stake)))
+        return state.Invalid(false, 0, "dup-stake", strprintf("duplicate proof-of-stake (%s, %d)", stake.first.ToString(), stake.second));
+    return true;
+}
+
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckStake = false, bool fAllowDuplicateStake = false)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3786,9 +3949,18 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 
         if (!ContextualCheckBlockHeader(block, state, chainparams.GetConsensus(), pindexPrev, GetAdjustedTime()))
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
+
+        if (fCheckStake && !CheckBlockHeaderStake(block, state, chainparams.GetConsensus(), pindexPrev, fAllowDuplicateStake))
+            return error("%s: CheckBlockHeaderStake: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
     }
-    if (pindex == NULL)
+    if (pindex == NULL) {
         pindex = AddToBlockIndex(block);
+        if (fCheckStake && block.IsProofOfStake()) {
+            setStakeSeenHeaders.insert(std::make_pair(block.prevoutStake, block.nTime));
+            if (pindex->nHeight % STAKE_SEEN_PRUNE_INTERVAL == 0)
+                setStakeSeenHeaders.Prune(GetStakeSeenCutoff(pindexBestHeader, chainparams.GetConsensus()));
+        }
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3799,13 +3971,16 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 }
 
 // Exposed wrapper for AcceptBlockHeader
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, bool fCheckStake)
 {
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader& header = headers[i];
             CBlockIndex *pindex = NULL; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            // Duplicate stake allowed only when a following header builds on it
+            bool fAllowDuplicateStake = i + 1 < headers.size() && headers[i + 1].hashPrevBlock == header.GetHash();
+            if (!AcceptBlockHeader(header, state, chainparams, &pindex, fCheckStake, fAllowDuplicateStake)) {
                 return false;
             }
             if (ppindex) {
@@ -3913,8 +4088,7 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
 
     // Write block to history file
     try {
-        CBlockLegacy blockLegacy(block);
-        unsigned int nBlockSize = ::GetSerializeSize(blockLegacy, SER_DISK, CLIENT_VERSION);
+        unsigned int nBlockSize = ::GetSerializeSize(LEGACY_BLOCK(block), SER_DISK, CLIENT_VERSION);
         CDiskBlockPos blockPos;
         if (dbp != NULL)
             blockPos = *dbp;
@@ -4035,7 +4209,7 @@ void PruneOneBlockFile(const int fileNumber)
         CBlockIndex* pindex = it->second;
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
-            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~(BLOCK_HAVE_UNDO | BLOCK_UNDO_COINTIME);
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -4206,19 +4380,89 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.New();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
+/**
+ * The height, stake, notary, speech and address index are written with the block index, which
+ * can be ahead of or on another branch than the chain state after a crash.
+ * Erase the entries of blocks not in the active chain, and replay the ones the
+ * active chain has beyond the last block they were written for.
+ */
+static bool RepairHeightIndexes(const CChainParams& chainparams)
+{
+    LOCK(cs_main);
+    uint256 hashBest;
+    // Versions before the block index batch wrote these entries with every block
+    if (!pblocktree->ReadHeightIndexBestBlock(hashBest))
+        return true;
+    BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+    if (mi == mapBlockIndex.end())
+        return error("%s: last indexed block %s not found", __func__, hashBest.ToString());
+
+    const CBlockIndex* pindexBest = mi->second;
+    const CBlockIndex* pindexFork = chainActive.FindFork(pindexBest);
+    int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+    if (pindexBest == chainActive.Tip())
+        return true;
+
+    // The index flags are read before Init*Index, which wipes an index turned off
+    bool fNotary = false, fSpeech = false, fAddress = false;
+    pblocktree->ReadFlag("notaryindex", fNotary);
+    pblocktree->ReadFlag("speechindex", fSpeech);
+    pblocktree->ReadFlag("addressindex", fAddress);
+    // Blocks the background build of the address index has yet to reach are left to it
+    if (fAddress && !LoadAddressIndexBuildHeight())
+        return error("%s: failed to read the address index build height", __func__);
+
+    LogPrintf("%s: indexed up to %s (height %d), chain tip at height %d, fork at height %d\n", __func__,
+              hashBest.ToString(), pindexBest->nHeight, chainActive.Height(), nForkHeight);
+    for (int nHeight = nForkHeight + 1; nHeight <= pindexBest->nHeight; nHeight++) {
+        heightIndexUpdates.EraseHeightIndex(nHeight);
+        heightIndexUpdates.EraseStakeIndex(nHeight);
+    }
+    // The other indexes are keyed by transaction, so the blocks of the other branch are read to erase them
+    for (const CBlockIndex* pindex = pindexBest; (fNotary || fSpeech || fAddress) && pindex != pindexFork; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        if (fNotary)
+            EraseBlockNotaryIndex(block);
+        if (fSpeech)
+            EraseBlockSpeechIndex(block, pindex->nHeight);
+        CBlockUndo blockundo;
+        if (fAddress && pindex->nHeight > 0)
+            if (!UndoReadFromDisk(blockundo, pindex) || !EraseBlockAddressIndex(block, blockundo, pindex->nHeight))
+                return error("%s: failed to erase the address index of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    for (int nHeight = nForkHeight + 1; nHeight <= chainActive.Height(); nHeight++) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, chainActive[nHeight], chainparams.GetConsensus()))
+            return error("%s: failed to read block at height %d", __func__, nHeight);
+        heightIndexUpdates.WriteStakeIndex(nHeight, GetBlockStaker(block));
+        if (fNotary)
+            WriteBlockNotaryIndex(block, nHeight);
+        if (fSpeech)
+            WriteBlockSpeechIndex(block, nHeight);
+        CBlockUndo blockundo;
+        if (fAddress && nHeight > 0)
+            if (!UndoReadFromDisk(blockundo, chainActive[nHeight]) || !WriteBlockAddressIndex(block, blockundo, nHeight))
+                return error("%s: failed to write the address index at height %d", __func__, nHeight);
+    }
+    hashHeightIndexBest = chainActive.Tip()->GetBlockHash();
+    return true;
+}
+
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    int64_t nTimeStart = GetTimeMillis();
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, GetNumCores()))
         return false;
+    int64_t nTimeGuts = GetTimeMillis();
 
     boost::this_thread::interruption_point();
 
@@ -4264,6 +4508,7 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         counter++;
     }
     LogPrintf("LoadBlockIndexDB finished after iteration %d\n", counter);
+    int64_t nTimeChainWork = GetTimeMillis();
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -4300,6 +4545,8 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         }
     }
 
+    int64_t nTimeBlockFiles = GetTimeMillis();
+
     // Check whether we have ever pruned block & undo files
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
     if (fHavePruned)
@@ -4320,8 +4567,34 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         return true;
     chainActive.SetTip(it->second);
 
+    // Only stakes recent enough to be reused on an acceptable fork are tracked
+    unsigned int nStakeSeenCutoff = GetStakeSeenCutoff(chainActive.Tip(), chainparams.GetConsensus());
+    setStakeSeen.clear();
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex) {
+        const CBlockIndex* pindex = item.second;
+        if (pindex->IsProofOfStake() && pindex->nTime >= nStakeSeenCutoff)
+            setStakeSeen.insert(std::make_pair(pindex->prevoutStake, pindex->nTime));
+    }
+    LogPrintf("%s: tracking %u recent stakes (%u bytes)\n", __func__, setStakeSeen.size(), setStakeSeen.DynamicMemoryUsage());
+
+    // Petitions are only registered while connecting blocks, so pick up those of the active chain
+    for (CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
+        BOOST_FOREACH(const CClamour& clamour, pindex->GetClamours()) {
+            std::string pid = clamour.strHash.substr(0, 8);
+            if (!mapClamour.count(pid))
+                mapClamour[pid] = new CClamour(clamour);
+        }
+    }
+
     PruneBlockIndexCandidates();
+    int64_t nTimeTip = GetTimeMillis();
 
+    if (!RepairHeightIndexes(chainparams))
+        return false;
+
+    LogPrintf("%s: loaded in %dms: entries %dms, chain work %dms, block files %dms, best chain %dms, height index %dms\n", __func__,
+        GetTimeMillis() - nTimeStart, nTimeGuts - nTimeStart, nTimeChainWork - nTimeGuts, nTimeBlockFiles - nTimeChainWork,
+        nTimeTip - nTimeBlockFiles, GetTimeMillis() - nTimeTip);
     LogPrintf("%s: hashBestChain=%s height=%d date=%s progress=%f\n", __func__,
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(),
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
@@ -4390,7 +4663,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             CBlockUndo undo;
             CDiskBlockPos pos = pindex->GetUndoPos();
             if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
+                if (!UndoReadFromDisk(undo, pindex))
                     return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
         }
@@ -4483,7 +4756,7 @@ bool RewindBlockIndex(const CChainParams& params)
             // Reduce validity
             pindexIter->nStatus = std::min<unsigned int>(pindexIter->nStatus & BLOCK_VALID_MASK, BLOCK_VALID_TREE) | (pindexIter->nStatus & ~BLOCK_VALID_MASK);
             // Remove have-data flags.
-            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_UNDO_COINTIME);
             // Remove storage location.
             pindexIter->nFile = 0;
             pindexIter->nDataPos = 0;
@@ -4537,15 +4810,22 @@ void UnloadBlockIndex()
     nBlockSequenceId = 1;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
+    heightIndexUpdates.Clear();
+    pendingNotaryIndex.Clear();
+    pendingSpeechIndex.Clear();
+    pendingAddressIndex.Clear();
+    hashHeightIndexBest.SetNull();
     versionbitscache.Clear();
+    clamourSupport.Clear();
     for (int b = 0; b < VERSIONBITS_NUM_BITS; b++) {
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    stakeModifierEngine.Clear();
+    blockIndexArena.Clear();
+    setStakeSeen.clear();
+    setStakeSeenHeaders.clear();
     fHavePruned = false;
 }
 
@@ -4557,6 +4837,19 @@ bool LoadBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
+bool UpgradeCoinTime(CCoinsViewDB* coinsdb, const CChainParams& chainparams)
+{
+    LOCK(cs_main);
+    return coinsdb->UpgradeCoinTime([&chainparams](int nHeight, std::map<uint256, unsigned int>& mapTxTime) {
+        CBlock block;
+        if (nHeight > chainActive.Height() || !ReadBlockFromDisk(block, chainActive[nHeight], chainparams.GetConsensus()))
+            return false;
+        for (const auto& tx : block.vtx)
+            mapTxTime[tx->GetHash()] = tx->nTime;
+        return true;
+    });
+}
+
 bool InitBlockIndex(const CChainParams& chainparams)
 {
     LOCK(cs_main);
@@ -4568,15 +4861,21 @@ bool InitBlockIndex(const CChainParams& chainparams)
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    // A new database has nothing to build; blocks are indexed as they are connected
+    fNotaryIndex = GetBoolArg("-notaryindex", DEFAULT_NOTARYINDEX);
+    pblocktree->WriteFlag("notaryindex", fNotaryIndex);
+    fSpeechIndex = GetBoolArg("-speechindex", DEFAULT_SPEECHINDEX);
+    pblocktree->WriteFlag("speechindex", fSpeechIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
     if (!fReindex) {
         try {
             CBlock &block = const_cast<CBlock&>(chainparams.GenesisBlock());
-            CBlockLegacy blockLegacy(block);
             // Start new block file
-            unsigned int nBlockSize = ::GetSerializeSize(blockLegacy, SER_DISK, CLIENT_VERSION);
+            unsigned int nBlockSize = ::GetSerializeSize(LEGACY_BLOCK(block), SER_DISK, CLIENT_VERSION);
             CDiskBlockPos blockPos;
             CValidationState state;
             if (!FindBlockPos(state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
@@ -4605,49 +4904,22 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        // Blocks are read, deserialized, hashed and checked ahead by the importer's
+        // threads; they are connected here one at a time in file order
+        CBlockImporter importer(chainparams, fileIn, GetImportThreads());
+        std::shared_ptr<CImportedBlock> pitem;
+        while (importer.Next(pitem)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            if (!pitem->pblock) {
+                LogPrintf("%s: %s\n", __func__, pitem->strError);
+                continue;
             }
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                std::shared_ptr<CBlockLegacy> blockLegacy = std::make_shared<CBlockLegacy>();
-
-                blkdat >> *blockLegacy;
-
-                //Convert block structure from old client to one from new client
-                *pblock = *blockLegacy;
-
-                nRewind = blkdat.GetPos();
+                    dbp->nPos = pitem->nPos;
+                std::shared_ptr<CBlock> pblock = pitem->pblock;
+                pitem.reset();
 
                 // detect out of order blocks, and store them for later
                 uint256 hash = pblock->GetHash();
@@ -5067,10 +5339,7 @@ class CMainCleanup
 public:
     CMainCleanup() {}
     ~CMainCleanup() {
-        // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+        // block headers; the entries themselves are freed by blockIndexArena
         mapBlockIndex.clear();
     }
 } instance_of_cmaincleanup;
@@ -15,12 +15,14 @@
 #include "coins.h"
 #include "protocol.h" // For CMessageHeader::MessageStartChars
 #include "script/script_error.h"
+#include "stakeseen.h"
 #include "sync.h"
 #include "versionbits.h"
 
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -35,13 +37,18 @@
 
 using valtype = std::vector<unsigned char>;
 
+class CBlockCache;
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBloomFilter;
 class CChainParams;
+class CCoinsViewDB;
+class CHeightIndexUpdates;
 class CInv;
 class CConnman;
 class CScriptCheck;
+struct CStakeKernelHit;
 class CTxMemPool;
 class CValidationInterface;
 class CValidationState;
@@ -108,6 +115,8 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Write the block index sooner once this many index entries are waiting to be written with it. */
+static const size_t MAX_PENDING_INDEX_ENTRIES = 200000;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -138,7 +147,15 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -checkblockreads */
+static const bool DEFAULT_CHECK_BLOCK_READS = false;
 static const bool DEFAULT_TXINDEX = true;
+/** Default for -notaryindex */
+static const bool DEFAULT_NOTARYINDEX = false;
+/** Default for -speechindex */
+static const bool DEFAULT_SPEECHINDEX = false;
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -mempoolreplacement */
@@ -164,7 +181,7 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
-extern std::set<std::pair<COutPoint, unsigned int>> setStakeSeen;
+extern CStakeSeen setStakeSeen;
 extern int64_t nLastCoinStakeSearchInterval;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
@@ -176,11 +193,18 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fNotaryIndex;
+extern bool fSpeechIndex;
+extern bool fAddressIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Recompute the hash and proof of blocks read from disk even if they were validated before */
+extern bool fCheckBlockReads;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Blocks recently read from disk, shared between readers */
+extern CBlockCache blockcache;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -261,8 +285,9 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  * @param[out] state This may be set to an Error state if any error occurred processing them
  * @param[in]  chainparams The params for the chain we want to connect to
  * @param[out] ppindex If set, the pointer will be set to point to the last new block index object for the given headers
+ * @param[in]  fCheckStake Whether the headers carry their stake and block signature, i.e. were not converted from legacy headers
  */
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex=NULL);
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex=NULL, bool fCheckStake=false);
 
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
@@ -278,6 +303,8 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex(const CChainParams& chainparams);
+/** Record the time of their transaction in the coins of the chainstate written before coins kept it; needs the block index loaded */
+bool UpgradeCoinTime(CCoinsViewDB* coinsdb, const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
@@ -334,6 +361,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Copy the stake index changes not yet written with the block index into updates; requires cs_main */
+void GetPendingStakeIndex(CHeightIndexUpdates& updates);
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 /** Prune block files up to a given height */
@@ -524,8 +553,9 @@ bool SequenceLocks(const CTransaction &tx, int flags, std::vector<int>* prevHeig
 bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp = NULL, bool useExistingLockPoints = false);
 
 /**
- * Closure representing one script verification
- * Note that this stores references to the spending transaction 
+ * Closure representing one script verification, or the signature check of a
+ * proof-of-stake block
+ * Note that this stores references to the spending transaction or the block
  */
 class CScriptCheck
 {
@@ -538,12 +568,16 @@ private:
     bool cacheStore;
     ScriptError error;
     PrecomputedTransactionData *txdata;
+    const CBlock *pblock;
 
 public:
-    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
+    CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(0), pblock(0) {}
     CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
         scriptPubKey(scriptPubKeyIn), amount(amountIn),
-        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn), pblock(0) { }
+    /** Check the block signature of blockIn, which must outlive the check */
+    CScriptCheck(const CBlock& blockIn, bool cacheIn) :
+        amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(0), pblock(&blockIn) { }
 
     bool operator()();
 
@@ -556,6 +590,7 @@ public:
         std::swap(cacheStore, check.cacheStore);
         std::swap(error, check.error);
         std::swap(txdata, check.txdata);
+        std::swap(pblock, check.pblock);
     }
 
     ScriptError GetScriptError() const { return error; }
@@ -565,6 +600,12 @@ public:
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::CParams& consensusParams, bool fUpdateCache = false);
+/** Read a block through the block cache without copying it; fUpdateCache keeps it cached for later readers */
+bool ReadBlockFromDisk(std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const Consensus::CParams& consensusParams, bool fUpdateCache = false);
+/** Read the undo data of a block, checking it against its checksum; spent coins undone from older undo data have no time */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+/** Parse the CLAMour support of a block connected before it was kept in the block index */
+bool ReadBlockSupport(CBlockIndex* pindex, const Consensus::CParams& consensusParams);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -572,7 +613,9 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::CParams& consensusParams, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::CParams& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig=true);
 bool GetBlockPublicKey(const CBlock& block, std::vector<unsigned char>& vchPubKey);
-bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees, uint32_t nTime);
+/** Check the signature of a proof-of-stake block, or that a proof-of-work block has none; fCacheStore keeps a valid signature in the signature cache */
+bool CheckBlockSignature(const CBlock& block, bool fCacheStore = true);
+bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CStakeKernelHit& hit, const CAmount& nTotalFees, uint32_t nTime);
 bool CheckCanonicalBlockSignature(const std::shared_ptr<const CBlock> pblock);
 bool CheckIndexProof(const CBlockIndex& block, const Consensus::CParams& consensusParams);
 
@@ -580,6 +623,9 @@ bool CheckIndexProof(const CBlockIndex& block, const Consensus::CParams& consens
  *  By "context", we mean only the previous block headers, but not the UTXO
  *  set; UTXO-related validity checks are done in ConnectBlock(). */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::CParams& consensusParams, const CBlockIndex* pindexPrev, int64_t nAdjustedTime);
+/** Checks of the stake of a header received ahead of its block: the signature encoding, the stake
+ *  timestamp, and that no other block or header used the stake unless fAllowDuplicateStake */
+bool CheckBlockHeaderStake(const CBlockHeader& block, CValidationState& state, const Consensus::CParams& consensusParams, const CBlockIndex* pindexPrev, bool fAllowDuplicateStake = false);
 bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const Consensus::CParams& consensusParams, const CBlockIndex* pindexPrev);
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
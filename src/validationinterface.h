@@ -35,7 +35,7 @@ class CValidationInterface {
 protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlockIndex *pindex, int posInBlock) {}
-    virtual void StakeTransaction(const CScript& script, int64_t nStakeReward) {}
+    virtual void StakeTransaction(const CScript& script, int64_t nStakeReward, const CBlockIndex* pindex) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual void UpdatedTransaction(const uint256 &hash) {}
     virtual void Inventory(const uint256 &hash) {}
@@ -62,8 +62,8 @@ struct CMainSignals {
      * removal was due to conflict from connected block), or appeared in a
      * disconnected block.*/
     boost::signals2::signal<void (const CTransaction &, const CBlockIndex *pindex, int posInBlock)> SyncTransaction;
-    // Notifies listeners of updated staking reward (passing receiving script, reward amount, and whether the reward is being added or taken away).
-    boost::signals2::signal<void (const CScript &, int64_t)> StakeTransaction;
+    // Notifies listeners of updated staking reward (passing receiving script, reward amount, negative when the reward is being taken away, and the staking block).
+    boost::signals2::signal<void (const CScript &, int64_t, const CBlockIndex *)> StakeTransaction;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
     boost::signals2::signal<void (const uint256 &)> UpdatedTransaction;
     /** Notifies listeners of a new active block chain. */
@@ -11,6 +11,7 @@
 #include "init.h"
 #include "validation.h"
 #include "net.h"
+#include "notary.h"
 #include "policy/policy.h"
 #include "policy/rbf.h"
 #include "rpc/server.h"
@@ -1138,7 +1139,7 @@ UniValue getnotarytransaction(const JSONRPCRequest& request)
         throw runtime_error(
             "getnotarytransaction <notaryid> [multipleResults]\n"
             "Get detailed information about <notaryid>\n"
-            "\nSearching can take a while\n");
+            "\nUses the notary index if the node runs with -notaryindex; otherwise searching can take a while\n");
 
 
     uint256 hash;
@@ -1152,39 +1153,42 @@ UniValue getnotarytransaction(const JSONRPCRequest& request)
            multipleresults =  request.params[1].get_bool();
    }
 
-    UniValue notaryinfo(UniValue::VARR);
-    bool notaryFound = false;
-    int blockstogoback = chainActive.Height() - 362500;
-    
-    const CBlockIndex* pindexFirst = chainActive.Tip();
-    for (int i = 0; pindexFirst && i < blockstogoback; i++)
-    {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindexFirst, Params().GetConsensus()))
-            throw runtime_error("Error: Failed to read block from disk");
-
-        for (const auto& tx : block.vtx) { 
-            if (tx->strClamSpeech == hash.GetHex()) {
-                    UniValue entry(UniValue::VOBJ);
-                notaryFound = true;
-                
-                entry.push_back(Pair("notaryid", hash.GetHex()));
-                entry.push_back(Pair("txid", tx->GetHash().GetHex()));
-                
-                notaryinfo.push_back(entry);
+    std::vector<std::pair<uint256, int> > vTx;
+    if (!FindNotaryTransactions(hash, vTx)) {
+        int blockstogoback = chainActive.Height() - 362500;
 
+        const CBlockIndex* pindexFirst = chainActive.Tip();
+        for (int i = 0; pindexFirst && i < blockstogoback; i++)
+        {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexFirst, Params().GetConsensus()))
+                throw runtime_error("Error: Failed to read block from disk");
+
+            for (const CNotaryIndexKey& key : GetBlockNotaryKeys(block)) {
+                if (key.hashNotary == hash)
+                    vTx.push_back(std::make_pair(key.txid, pindexFirst->nHeight));
             }
-        }
-            
-    if (!multipleresults && notaryFound)    
-        break;
 
-    pindexFirst = pindexFirst->pprev;
+            if (!multipleresults && !vTx.empty())
+                break;
+
+            pindexFirst = pindexFirst->pprev;
+        }
     }
 
-    if (!notaryFound) 
-                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Notary transaction not found");
-    
+    if (vTx.empty()) 
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Notary transaction not found");
+    if (!multipleresults)
+        vTx.resize(1);
+
+    UniValue notaryinfo(UniValue::VARR);
+    for (const auto& tx : vTx) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("notaryid", hash.GetHex()));
+        entry.push_back(Pair("txid", tx.first.GetHex()));
+        entry.push_back(Pair("height", tx.second));
+        notaryinfo.push_back(entry);
+    }
     return notaryinfo; 
 }
 
@@ -1316,46 +1320,98 @@ UniValue getstakedbyaddress(const JSONRPCRequest& request)
         LogPrintf("nMinDepth %d\n", nMinDepth);
     }
 
-    int64_t nAmount = 0;
+    if (!pwalletMain->IsStakeLedgerReady()) {
+        LogPrintf("initializing staking reward ledger\n");
+        pwalletMain->RebuildStakeLedger();
+    }
 
-    // for nMinDepth==1 we can speed things up by using a cached sum of the staking rewards per address
-    if (nMinDepth == 1) {
-        if (!pwalletMain->fAddressRewardsReady) {
-            LogPrintf("initializing staking rewards map\n");
-            pwalletMain->SumStakingRewards();
-        }
+    // Stakes are confirmed once connected, so only deeper minimums look at the tip
+    int nMaxHeight = std::numeric_limits<int>::max();
+    if (nMinDepth > 1) {
+        LOCK(cs_main);
+        nMaxHeight = chainActive.Height() - nMinDepth + 1;
+    }
 
-        if (pwalletMain->mapAddressRewards.count(strAddressParam)) {
-            nAmount = pwalletMain->mapAddressRewards[strAddressParam];
-            LogPrint("stake", "staked amount from cache: %s for %s\n", FormatMoney(nAmount), strAddressParam);
-        } else
-            LogPrint("stake", "staked amount not in cache: %s for %s\n", FormatMoney(nAmount), strAddressParam);
+    CAmount nAmount = pwalletMain->GetStakeRewards(strAddressParam, nMaxHeight);
+    LogPrint("stake", "staked amount from ledger: %s for %s\n", FormatMoney(nAmount), strAddressParam);
 
-        return ValueFromAmount(nAmount);
-    }
+    return ValueFromAmount(nAmount);
+}
 
-    string strAccount;
+UniValue getstakerewards(const JSONRPCRequest& request)
+{
+    if (!EnsureWalletIsAvailable(request.fHelp))
+        return NullUniValue;
 
-    // Tally
-    for (map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it)
-    {
-        const CWalletTx& wtx = (*it).second;
-        if (wtx.IsCoinStake() &&
-            CheckFinalTx(wtx) &&
-            wtx.GetDepthInMainChain() >= nMinDepth &&
-            wtx.tx->vout.size() > 1 &&
-            (fAllAddresses || wtx.tx->vout[1].scriptPubKey == scriptPubKey)) {
-            CAmount allFee;
-            list<COutputEntry> listReceived;
-            list<COutputEntry> listSent;
-            isminefilter filter = ISMINE_SPENDABLE;
-            
-            wtx.GetAmounts(listReceived, listSent, allFee, strAccount, filter);
-            nAmount -= allFee;
-        }
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 4)
+        throw runtime_error(
+            "getstakerewards \"address\" ( fromheight toheight perday )\n"
+            "\nReturns the staking rewards of a wallet address, or of all of them, between two heights.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The clam address that staked, or \"*\" for all wallet addresses\n"
+            "2. fromheight     (numeric, optional, default=0) The lowest height of the stakes to include\n"
+            "3. toheight       (numeric, optional, default=all) The highest height of the stakes to include\n"
+            "4. perday         (boolean, optional, default=false) Also total the rewards per UTC day\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"amount\" : x.xxx,        (numeric) The total reward in " + CURRENCY_UNIT + "\n"
+            "  \"count\" : n,             (numeric) The number of stakes\n"
+            "  \"days\" : [               (array of json objects) With perday, the days with stakes, oldest first\n"
+            "    {\n"
+            "      \"date\" : \"yyyy-mm-dd\", (string) The UTC day\n"
+            "      \"amount\" : x.xxx,      (numeric) The reward of the day in " + CURRENCY_UNIT + "\n"
+            "      \"count\" : n            (numeric) The number of stakes of the day\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakerewards", "\"*\"")
+            + HelpExampleCli("getstakerewards", "\"xLVL9XcEK3YcwU9UdqPp5nSRAvamt1B94e\" 1500000 1600000 true")
+            + HelpExampleRpc("getstakerewards", "\"*\", 1500000, 1600000, true")
+        );
+
+    std::string strAddress = request.params[0].get_str();
+    if (strAddress != "*" && !CBitcoinAddress(strAddress).IsValid())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Clam address");
+
+    int nMinHeight = 0, nMaxHeight = std::numeric_limits<int>::max();
+    if (request.params.size() > 1)
+        nMinHeight = request.params[1].get_int();
+    if (request.params.size() > 2)
+        nMaxHeight = request.params[2].get_int();
+    bool fPerDay = request.params.size() > 3 && request.params[3].get_bool();
+
+    if (!pwalletMain->IsStakeLedgerReady())
+        pwalletMain->RebuildStakeLedger();
+
+    std::vector<std::pair<int, CStakeReward> > vRewards;
+    pwalletMain->ListStakeRewards(strAddress, nMinHeight, nMaxHeight, vRewards);
+
+    CAmount nAmount = 0;
+    std::map<int64_t, std::pair<CAmount, int> > mapDays;
+    for (const std::pair<int, CStakeReward>& item : vRewards) {
+        nAmount += item.second.nReward;
+        std::pair<CAmount, int>& day = mapDays[item.second.nTime / (24 * 60 * 60)];
+        day.first += item.second.nReward;
+        day.second++;
     }
 
-    return ValueFromAmount(nAmount);
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("amount", ValueFromAmount(nAmount)));
+    result.push_back(Pair("count", (int)vRewards.size()));
+    if (fPerDay) {
+        UniValue days(UniValue::VARR);
+        for (const auto& day : mapDays) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("date", DateTimeStrFormat("%Y-%m-%d", day.first * 24 * 60 * 60)));
+            entry.push_back(Pair("amount", ValueFromAmount(day.second.first)));
+            entry.push_back(Pair("count", day.second.second));
+            days.push_back(entry);
+        }
+        result.push_back(Pair("days", days));
+    }
+    return result;
 }
 
 
@@ -2808,6 +2864,63 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     return obj;
 }
 
+static UniValue WalletBalancesToJSON(const CWalletBalances& balances)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("balance",                       ValueFromAmount(balances.nTrusted)));
+    obj.push_back(Pair("unconfirmed_balance",           ValueFromAmount(balances.nUnconfirmed)));
+    obj.push_back(Pair("immature_balance",              ValueFromAmount(balances.nImmature)));
+    obj.push_back(Pair("stake",                         ValueFromAmount(balances.nStake)));
+    obj.push_back(Pair("watchonly_balance",             ValueFromAmount(balances.nWatchOnlyTrusted)));
+    obj.push_back(Pair("watchonly_unconfirmed_balance", ValueFromAmount(balances.nWatchOnlyUnconfirmed)));
+    obj.push_back(Pair("watchonly_immature_balance",    ValueFromAmount(balances.nWatchOnlyImmature)));
+    obj.push_back(Pair("watchonly_stake",               ValueFromAmount(balances.nWatchOnlyStake)));
+    return obj;
+}
+
+UniValue checkwalletbalances(const JSONRPCRequest& request)
+{
+    if (!EnsureWalletIsAvailable(request.fHelp))
+        return NullUniValue;
+
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "checkwalletbalances\n"
+            "Compares the incrementally maintained wallet balances with balances summed over every wallet transaction.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"consistent\": true|false,   (boolean) whether both agree\n"
+            "  \"balances\": {             (object) the balances as maintained\n"
+            "    \"balance\": xxxxxxx,               (numeric) the trusted balance in " + CURRENCY_UNIT + "\n"
+            "    \"unconfirmed_balance\": xxx,       (numeric) the unconfirmed balance in " + CURRENCY_UNIT + "\n"
+            "    \"immature_balance\": xxxxxx,       (numeric) the immature balance in " + CURRENCY_UNIT + "\n"
+            "    \"stake\": xxxxxxx,                 (numeric) the stake balance in " + CURRENCY_UNIT + "\n"
+            "    \"watchonly_balance\": xxxxxxx,     (numeric) the same for watch-only addresses\n"
+            "    \"watchonly_unconfirmed_balance\": xxx,\n"
+            "    \"watchonly_immature_balance\": xxxxxx,\n"
+            "    \"watchonly_stake\": xxxxxxx\n"
+            "  },\n"
+            "  \"scanned\": { ... }          (object) the balances summed over the wallet transactions, as above\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("checkwalletbalances", "")
+            + HelpExampleRpc("checkwalletbalances", "")
+        );
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    CWalletBalances balances = pwalletMain->GetBalances();
+    CWalletBalances balancesScanned = pwalletMain->GetBalancesFullScan();
+    if (balances != balancesScanned)
+        LogPrintf("%s: wallet balances differ from a full scan\n", __func__);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("consistent", balances == balancesScanned));
+    obj.push_back(Pair("balances",   WalletBalancesToJSON(balances)));
+    obj.push_back(Pair("scanned",    WalletBalancesToJSON(balancesScanned)));
+    return obj;
+}
+
 UniValue resendwallettransactions(const JSONRPCRequest& request)
 {
     if (!EnsureWalletIsAvailable(request.fHelp))
@@ -3680,6 +3793,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true,   {"nrequired","keys","account"} },
     { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true,   {"address"} },
     { "wallet",             "backupwallet",             &backupwallet,             true,   {"destination"} },
+    { "wallet",             "checkwalletbalances",      &checkwalletbalances,      false,  {} },
     //{ "wallet",             "bumpfee",                  &bumpfee,                  true,   {"txid", "options"} },
     { "wallet",             "createclamour",            &createclamour,            true,   {"clamourProposal", "url"} },
     { "wallet",             "dumpprivkey",              &dumpprivkey,              true,   {"address"}  },
@@ -3695,6 +3809,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false,  {"account","minconf"} },
     { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false,  {"address","minconf"} },
     { "wallet",             "getstakedbyaddress",       &getstakedbyaddress,       true,   {"address","minconf"} },
+    { "wallet",             "getstakerewards",          &getstakerewards,          true,   {"address","fromheight","toheight","perday"} },
     { "wallet",             "getstaketo",               &getstaketo,               true,   {} },
     { "wallet",             "getrewardto",              &getrewardto,              true,   {} }, 
     { "wallet",             "getcombineany",            &getcombineany,            true,   {} }, 
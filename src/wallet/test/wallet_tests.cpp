@@ -9,8 +9,13 @@
 #include <utility>
 #include <vector>
 
+#include "base58.h"
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
 #include "rpc/server.h"
 #include "test/test_bitcoin.h"
+#include "undo.h"
 #include "validation.h"
 #include "wallet/test/wallet_test_fixture.h"
 
@@ -428,4 +433,270 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+/** Hand-built block index entries on top of the genesis block, any of which can be made the tip */
+class TestIndexChain
+{
+public:
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+
+    TestIndexChain(int nBlocks) : vHashes(nBlocks + 1), vIndex(nBlocks + 1)
+    {
+        AssertLockHeld(cs_main);
+        CBlockIndex* pindexGenesis = chainActive.Genesis();
+        for (int i = 1; i <= nBlocks; i++) {
+            vHashes[i] = GetRandHash();
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].pprev = i > 1 ? &vIndex[i - 1] : pindexGenesis;
+            vIndex[i].nHeight = i;
+            vIndex[i].nTime = pindexGenesis->nTime + i * 60;
+            vIndex[i].nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA;
+            vIndex[i].BuildSkip();
+            mapBlockIndex[vHashes[i]] = &vIndex[i];
+        }
+    }
+
+    ~TestIndexChain()
+    {
+        chainActive.SetTip(chainActive.Genesis());
+        for (size_t i = 1; i < vHashes.size(); i++)
+            mapBlockIndex.erase(vHashes[i]);
+    }
+
+    CBlockIndex* operator[](int nHeight) { return &vIndex[nHeight]; }
+    void SetTip(int nHeight) { chainActive.SetTip(&vIndex[nHeight]); }
+};
+
+BOOST_FIXTURE_TEST_CASE(balances_incremental, TestingSetup)
+{
+    LOCK(cs_main);
+    const int nMaturity = Params().GetConsensus().nCoinbaseMaturity + 10;
+    TestIndexChain chain(nMaturity + 10);
+
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    CScript script = GetScriptForRawPubKey(key.GetPubKey());
+    CWallet wallet;
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    }
+
+    // A coinbase in block 1 and a payment in block 2
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    txCoinBase.vout.push_back(CTxOut(50 * COIN, script));
+    chain.SetTip(1);
+    wallet.SyncTransaction(txCoinBase, chain[1], 0);
+    CMutableTransaction txPay;
+    txPay.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txPay.vout.push_back(CTxOut(10 * COIN, script));
+    chain.SetTip(2);
+    wallet.SyncTransaction(txPay, chain[2], 1);
+    CWalletBalances balances = wallet.GetBalances();
+    BOOST_CHECK(balances == wallet.GetBalancesFullScan());
+    BOOST_CHECK_EQUAL(balances.nImmature, 50 * COIN);
+    BOOST_CHECK_EQUAL(balances.nTrusted, 10 * COIN);
+
+    // The coinbase matures as blocks are connected, without the wallet seeing them
+    for (int nHeight = 3; nHeight <= nMaturity + 1; nHeight++) {
+        chain.SetTip(nHeight);
+        if (nHeight % 50 == 0 || nHeight >= nMaturity - 1)
+            BOOST_CHECK(wallet.GetBalances() == wallet.GetBalancesFullScan());
+    }
+    BOOST_CHECK_EQUAL(wallet.GetBalances().nImmature, 0);
+    BOOST_CHECK_EQUAL(wallet.GetBalances().nTrusted, 60 * COIN);
+
+    // Spending the payment changes what is available of it. Only the credit
+    // cached on the payment is reset here, so its balances must be marked
+    // dirty by the spending transaction.
+    CMutableTransaction txSpend;
+    txSpend.vin.push_back(CTxIn(COutPoint(txPay.GetHash(), 0)));
+    txSpend.vout.push_back(CTxOut(4 * COIN, script));
+    txSpend.vout.push_back(CTxOut(5 * COIN, GetScriptForRawPubKey(keyOther.GetPubKey())));
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(txSpend)));
+    wallet.mapWallet[txPay.GetHash()].fAvailableCreditCached = false;
+    BOOST_CHECK(wallet.GetBalances() == wallet.GetBalancesFullScan());
+    BOOST_CHECK_EQUAL(wallet.GetBalances().nTrusted, 50 * COIN);
+    chain.SetTip(nMaturity + 2);
+    wallet.SyncTransaction(txSpend, chain[nMaturity + 2], 1);
+    BOOST_CHECK(wallet.GetBalances() == wallet.GetBalancesFullScan());
+    BOOST_CHECK_EQUAL(wallet.GetBalances().nTrusted, 54 * COIN);
+
+    // Disconnecting blocks recomputes everything
+    chain.SetTip(nMaturity - 5);
+    balances = wallet.GetBalances();
+    BOOST_CHECK(balances == wallet.GetBalancesFullScan());
+    BOOST_CHECK_EQUAL(balances.nImmature, 50 * COIN);
+
+    // So does marking the wallet dirty, and transactions marked dirty are recomputed
+    wallet.MarkDirty();
+    BOOST_CHECK(wallet.GetBalances() == wallet.GetBalancesFullScan());
+    wallet.mapWallet.begin()->second.MarkDirty();
+    BOOST_CHECK(wallet.GetBalances() == wallet.GetBalancesFullScan());
+}
+
+BOOST_AUTO_TEST_CASE(stake_ledger)
+{
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, key.GetPubKey()));
+    }
+    CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+    std::string strAddress = CBitcoinAddress(key.GetPubKey().GetID()).ToString();
+
+    std::vector<uint256> vHashes(4);
+    std::vector<CBlockIndex> vIndex(4);
+    for (int i = 0; i < 4; i++) {
+        vHashes[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].nHeight = i + 1;
+        vIndex[i].nTime = 1500000000 + i * 43200;
+    }
+
+    // Stakes are not recorded until the ledger has been built
+    GetMainSignals().StakeTransaction(script, COIN, &vIndex[0]);
+    BOOST_CHECK(!pwalletMain->IsStakeLedgerReady());
+    BOOST_CHECK_EQUAL(pwalletMain->GetStakeRewards(strAddress), 0);
+    pwalletMain->RebuildStakeLedger();
+    BOOST_CHECK(pwalletMain->IsStakeLedgerReady());
+
+    for (int i = 1; i < 4; i++)
+        GetMainSignals().StakeTransaction(script, i * COIN, &vIndex[i]);
+    GetMainSignals().StakeTransaction(GetScriptForDestination(keyOther.GetPubKey().GetID()), 7 * COIN, &vIndex[0]);
+    BOOST_CHECK_EQUAL(pwalletMain->GetStakeRewards(strAddress), 6 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetStakeRewards("*"), 6 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetStakeRewards(strAddress, 3), 3 * COIN);
+    BOOST_CHECK_EQUAL(pwalletMain->GetStakeRewards("*", 1), 0);
+
+    std::vector<std::pair<int, CStakeReward> > vRewards;
+    pwalletMain->ListStakeRewards("*", 3, 4, vRewards);
+    BOOST_REQUIRE_EQUAL(vRewards.size(), 2U);
+    BOOST_CHECK_EQUAL(vRewards[0].first, 3);
+    BOOST_CHECK_EQUAL(vRewards[0].second.nReward, 2 * COIN);
+    BOOST_CHECK(vRewards[1].second.hashBlock == vHashes[3]);
+    BOOST_CHECK_EQUAL(vRewards[1].second.nTime, vIndex[3].GetBlockTime());
+
+    // Disconnecting a stake takes its reward away
+    GetMainSignals().StakeTransaction(script, -3 * COIN, &vIndex[3]);
+    BOOST_CHECK_EQUAL(pwalletMain->GetStakeRewards(strAddress), 3 * COIN);
+    pwalletMain->ListStakeRewards(strAddress, 0, std::numeric_limits<int>::max(), vRewards);
+    BOOST_CHECK_EQUAL(vRewards.size(), 2U);
+
+    // Loading the ledger from the wallet database
+    {
+        CWallet wallet;
+        for (const std::pair<int, CStakeReward>& item : vRewards)
+            wallet.LoadStakeReward(strAddress, item.first, item.second);
+        wallet.fAddressRewardsReady = true;
+        BOOST_CHECK_EQUAL(wallet.GetStakeRewards(strAddress), 3 * COIN);
+        BOOST_CHECK_EQUAL(wallet.GetStakeRewards("*", 2), COIN);
+
+        // Its stakes are not in the active chain, so it is rebuilt before use
+        wallet.VerifyStakeLedger();
+        BOOST_CHECK(!wallet.IsStakeLedgerReady());
+        wallet.RebuildStakeLedger();
+        BOOST_CHECK(wallet.IsStakeLedgerReady());
+        BOOST_CHECK_EQUAL(wallet.GetStakeRewards("*"), 0);
+    }
+
+    // Changes that may make earlier stakes ours have it rebuilt as well
+    pwalletMain->MarkDirty();
+    BOOST_CHECK(!pwalletMain->IsStakeLedgerReady());
+}
+
+BOOST_FIXTURE_TEST_CASE(stake_ledger_verifydb, TestingSetup)
+{
+    LOCK(cs_main);
+    const CChainParams& chainparams = Params();
+    CBlockIndex* pindexGenesis = chainActive.Tip();
+    CKey key;
+    key.MakeNewKey(true);
+    CScript script = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    // A signed proof-of-stake block on top of the genesis block, staking a coin of key
+    CBlock block;
+    block.nVersion = 7;
+    block.hashPrevBlock = pindexGenesis->GetBlockHash();
+    block.nTime = pindexGenesis->nTime + 600;
+    block.nBits = pindexGenesis->nBits;
+    CMutableTransaction txCoinBase;
+    txCoinBase.nTime = block.nTime;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+    CMutableTransaction txCoinStake;
+    txCoinStake.nTime = block.nTime;
+    txCoinStake.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1] = CTxOut(11 * COIN, script);
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinBase)));
+    block.vtx.push_back(MakeTransactionRef(std::move(txCoinStake)));
+    block.prevoutStake = block.vtx[1]->vin[0].prevout;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_REQUIRE(key.Sign(block.GetHash(), block.vchBlockSig));
+
+    // Stored like ConnectBlock would, as the tip of the active chain and the coins
+    CDiskBlockPos pos(1, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos, chainparams.MessageStart()));
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    blockundo.vtxundo[0].vprevout.push_back(Coin(CTxOut(10 * COIN, script), 1, false, false, block.nTime - 86400));
+    {
+        CAutoFile fileout(OpenUndoFile(CDiskBlockPos(1, 0)), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << pindexGenesis->GetBlockHash() << blockundo;
+        fileout << blockundo << hasher.GetHash();
+    }
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hashBlock;
+    index.pprev = pindexGenesis;
+    index.nHeight = 1;
+    index.nFile = 1;
+    index.nDataPos = pos.nPos;
+    index.nUndoPos = 0;
+    index.nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_UNDO_COINTIME;
+    index.nMint = COIN;
+    index.prevoutStake = block.prevoutStake;
+    index.SetProofOfStake();
+    mapBlockIndex[hashBlock] = &index;
+    chainActive.SetTip(&index);
+    for (const CTransactionRef& tx : block.vtx)
+        AddCoins(*pcoinsTip, *tx, 1);
+    pcoinsTip->SetBestBlock(hashBlock);
+
+    CWallet wallet;
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    }
+    wallet.fAddressRewardsReady = true;
+    RegisterValidationInterface(&wallet);
+    std::string strAddress = CBitcoinAddress(key.GetPubKey().GetID()).ToString();
+    GetMainSignals().StakeTransaction(script, index.nMint, &index);
+    BOOST_CHECK_EQUAL(wallet.GetStakeRewards(strAddress), COIN);
+
+    // Checking the chain disconnects the block from a copy of the coins; it
+    // stays in the active chain, so its stake stays in the ledger
+    BOOST_CHECK(CVerifyDB().VerifyDB(chainparams, pcoinsTip, 3, 1));
+    BOOST_CHECK_EQUAL(wallet.GetStakeRewards(strAddress), COIN);
+    std::vector<std::pair<int, CStakeReward> > vRewards;
+    wallet.ListStakeRewards(strAddress, 0, std::numeric_limits<int>::max(), vRewards);
+    BOOST_REQUIRE_EQUAL(vRewards.size(), 1U);
+    BOOST_CHECK(vRewards[0].second.hashBlock == hashBlock);
+
+    UnregisterValidationInterface(&wallet);
+    chainActive.SetTip(pindexGenesis);
+    mapBlockIndex.erase(hashBlock);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
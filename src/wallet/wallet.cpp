@@ -17,12 +17,14 @@
 #include "keystore.h"
 #include "validation.h"
 #include "net.h"
+#include "notary.h"
 #include "policy/policy.h"
 #include "pos.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "stakesearch.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "util.h"
@@ -638,6 +640,85 @@ void CWallet::RemoveFromSpends(const uint256& wtxid)
         RemoveFromSpends(txin.prevout, wtxid);
 }
 
+static const CBlockIndex* GetConfirmingBlock(const CWalletTx& wtx)
+{
+    if (wtx.hashUnset() || wtx.nIndex == -1)
+        return NULL;
+    BlockMap::const_iterator mi = mapBlockIndex.find(wtx.hashBlock);
+    return mi == mapBlockIndex.end() ? NULL : mi->second;
+}
+
+bool CWallet::IsSpentInChain(const COutPoint& outpoint) const
+{
+    std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit == mapWallet.end())
+            continue;
+        const CBlockIndex* pindex = GetConfirmingBlock(mit->second);
+        if (pindex && chainActive.Contains(pindex))
+            return true;
+    }
+    return false;
+}
+
+void CWallet::AddToStakeOutputs(const CWalletTx& wtx, unsigned int n, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_wallet);
+
+    COutPoint outpoint(wtx.GetHash(), n);
+    if (IsMine(wtx.tx->vout[n]) == ISMINE_NO || IsSpentInChain(outpoint)) {
+        mapStakeOutputs.erase(outpoint);
+        return;
+    }
+
+    // Same rule as GetBlocksToMaturity(), expressed as a chain height
+    int nMaturityHeight = pindex->nHeight;
+    if (wtx.IsCoinBase())
+        nMaturityHeight += Params().GetConsensus().nCoinbaseMaturity + 9;
+
+    CStakeOutput out(wtx.tx->vout[n].nValue, pindex->nTime, wtx.tx->nTime, nMaturityHeight, pindex);
+    std::map<COutPoint, CStakeOutput>::iterator it = mapStakeOutputs.find(outpoint);
+    if (it == mapStakeOutputs.end())
+        mapStakeOutputs.insert(std::make_pair(outpoint, out));
+    else
+        it->second = out;
+}
+
+/**
+ * Bring the stake outputs created and spent by wtx up to date after it was
+ * added, confirmed, disconnected or abandoned.
+ */
+void CWallet::UpdateStakeOutputs(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+
+    const CBlockIndex* pindex = GetConfirmingBlock(wtx);
+    bool fInChain = pindex && chainActive.Contains(pindex);
+
+    // Outputs spent in the active chain are of no further use to the staker;
+    // if the spend is no longer in the chain, they may stake again
+    if (!wtx.IsCoinPoW()) {
+        BOOST_FOREACH(const CTxIn& txin, wtx.tx->vin) {
+            if (fInChain) {
+                mapStakeOutputs.erase(txin.prevout);
+                continue;
+            }
+            std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(txin.prevout.hash);
+            if (mit == mapWallet.end() || txin.prevout.n >= mit->second.tx->vout.size())
+                continue;
+            const CBlockIndex* pindexPrev = GetConfirmingBlock(mit->second);
+            if (pindexPrev)
+                AddToStakeOutputs(mit->second, txin.prevout.n, pindexPrev);
+        }
+    }
+
+    if (pindex) {
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++)
+            AddToStakeOutputs(wtx, i, pindex);
+    }
+}
+
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
 {
     if (IsCrypted())
@@ -905,8 +986,9 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        fBalancesStale = true;
     }
-    fAddressRewardsReady = false;
+    InvalidateStakeLedger();
 }
 
 bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
@@ -1039,13 +1121,18 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     LogPrintf("AddToWallet %s%s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "  new" : ""), (fUpdated ? "  update" : ""));
 
     // Write to disk
-    if (fInsertedNew || fUpdated)
+    if (fInsertedNew || fUpdated) {
+        // mapWallet has changed even if the write fails
+        MarkBalancesDirty(wtx);
         if (!walletdb.WriteTx(wtx))
             return false;
+    }
 
     // Break debit/credit balance caches:
     wtx.MarkDirty();
 
+    UpdateStakeOutputs(wtx);
+
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -1078,6 +1165,7 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
             }
         }
     }
+    UpdateStakeOutputs(wtx);
 
     return true;
 }
@@ -1667,7 +1755,9 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
             CBlock block;
             if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
                 for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+                    // The staking reward ledger only learns of the stakes of connected blocks
+                    if (AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate) && block.vtx[posInBlock]->IsCoinStake())
+                        InvalidateStakeLedger();
                 }
                 if (!ret) {
                     ret = pindex;
@@ -1784,6 +1874,21 @@ CAmount CWalletTx::GetDebit(const isminefilter& filter) const
     return debit;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+    if (pwallet)
+        pwallet->MarkBalancesDirty(*this);
+}
+
 CAmount CWalletTx::GetCredit(const isminefilter& filter) const
 {
     // Must wait until coinbase is safely deep enough in the chain before valuing it
@@ -2020,95 +2125,162 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+CWalletBalances CWallet::GetTxBalances(const CWalletTx& wtx) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    CWalletBalances balances;
+    int nDepth = wtx.GetDepthInMainChain();
+    if (wtx.IsTrusted()) {
+        balances.nTrusted = wtx.GetAvailableCredit();
+        balances.nWatchOnlyTrusted = wtx.GetAvailableWatchOnlyCredit();
+    } else if (nDepth == 0 && wtx.InMempool()) {
+        balances.nUnconfirmed = wtx.GetAvailableCredit();
+        balances.nWatchOnlyUnconfirmed = wtx.GetAvailableWatchOnlyCredit();
+    }
+    if (wtx.IsCoinPoW() && wtx.GetBlocksToMaturity() > 0 && wtx.IsInMainChain())
+        balances.nImmature = wtx.GetImmatureCredit();
+    balances.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit();
+    // ppcoin: total coins staked (non-spendable until maturity)
+    if (wtx.IsCoinStake() && wtx.GetBlocksToMaturity() > 0 && nDepth > 0) {
+        balances.nStake = CWallet::GetCredit(wtx, ISMINE_SPENDABLE);
+        balances.nWatchOnlyStake = CWallet::GetCredit(wtx, ISMINE_WATCH_ONLY);
     }
+    return balances;
+}
 
-    return nTotal;
+void CWallet::MarkBalancesDirty(const CWalletTx& wtx) const
+{
+    LOCK(cs_wallet);
+    setBalancesDirty.insert(wtx.GetHash());
+    // Whether it spends them changes the available credit of its inputs
+    if (!wtx.IsCoinPoW()) {
+        BOOST_FOREACH(const CTxIn& txin, wtx.tx->vin)
+            setBalancesDirty.insert(txin.prevout.hash);
+    }
 }
 
-CAmount CWallet::GetUnconfirmedBalance() const
+void CWallet::UpdateTxBalances(const uint256& hash) const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
+    std::map<uint256, CTxBalances>::iterator it = mapTxBalances.find(hash);
+    int nMaturityHeightOld = 0;
+    if (it != mapTxBalances.end()) {
+        balancesSettled -= it->second.balances;
+        nMaturityHeightOld = it->second.nMaturityHeight;
+        mapTxBalances.erase(it);
     }
-    return nTotal;
+    setBalancesUnconfirmed.erase(hash);
+
+    std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+    if (mi == mapWallet.end())
+        return;
+    const CWalletTx& wtx = mi->second;
+    int nDepth = wtx.GetDepthInMainChain();
+    if (nDepth == 0) {
+        setBalancesUnconfirmed.insert(hash);
+        return;
+    }
+
+    CTxBalances txBalances;
+    txBalances.balances = GetTxBalances(wtx);
+    int nBlocksToMaturity = nDepth > 0 ? wtx.GetBlocksToMaturity() : 0;
+    txBalances.nMaturityHeight = nBlocksToMaturity > 0 ? nBalancesHeight + nBlocksToMaturity : 0;
+    if (txBalances.balances.IsNull() && txBalances.nMaturityHeight == 0)
+        return;
+    balancesSettled += txBalances.balances;
+    mapTxBalances.insert(std::make_pair(hash, txBalances));
+    if (txBalances.nMaturityHeight != 0 && txBalances.nMaturityHeight != nMaturityHeightOld)
+        mapBalancesMaturity.insert(std::make_pair(txBalances.nMaturityHeight, hash));
 }
 
-CAmount CWallet::GetImmatureBalance() const
+void CWallet::UpdateBalances() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsCoinPoW() && pcoin->GetBlocksToMaturity() > 0 && pcoin->IsInMainChain())
-                nTotal += pcoin->GetImmatureCredit();
-        }
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexBalances && (!pindexTip || pindexTip->GetAncestor(nBalancesHeight) != pindexBalances))
+        fBalancesStale = true;
+    nBalancesHeight = chainActive.Height();
+    pindexBalances = pindexTip;
+
+    if (fBalancesStale) {
+        mapTxBalances.clear();
+        balancesSettled = CWalletBalances();
+        setBalancesUnconfirmed.clear();
+        setBalancesDirty.clear();
+        mapBalancesMaturity.clear();
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            UpdateTxBalances(it->first);
+        fBalancesStale = false;
+        return;
+    }
+
+    // Transactions that matured in the blocks connected since
+    while (!mapBalancesMaturity.empty() && mapBalancesMaturity.begin()->first <= nBalancesHeight) {
+        std::map<uint256, CTxBalances>::const_iterator it = mapTxBalances.find(mapBalancesMaturity.begin()->second);
+        if (it != mapTxBalances.end() && it->second.nMaturityHeight == mapBalancesMaturity.begin()->first)
+            setBalancesDirty.insert(it->first);
+        mapBalancesMaturity.erase(mapBalancesMaturity.begin());
     }
-    return nTotal;
+
+    BOOST_FOREACH(const uint256& hash, setBalancesDirty)
+        UpdateTxBalances(hash);
+    setBalancesDirty.clear();
 }
 
-CAmount CWallet::GetWatchOnlyBalance() const
+CWalletBalances CWallet::GetBalances() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+
+    CWalletBalances balances = balancesSettled;
+    BOOST_FOREACH(const uint256& hash, setBalancesUnconfirmed) {
+        std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        if (it != mapWallet.end())
+            balances += GetTxBalances(it->second);
     }
+    return balances;
+}
 
-    return nTotal;
+CWalletBalances CWallet::GetBalancesFullScan() const
+{
+    LOCK2(cs_main, cs_wallet);
+    CWalletBalances balances;
+    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        balances += GetTxBalances(it->second);
+    return balances;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nTrusted;
+}
+
+CAmount CWallet::GetUnconfirmedBalance() const
+{
+    return GetBalances().nUnconfirmed;
+}
+
+CAmount CWallet::GetImmatureBalance() const
+{
+    return GetBalances().nImmature;
+}
+
+CAmount CWallet::GetWatchOnlyBalance() const
+{
+    return GetBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyImmature;
 }
 
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl *coinControl, bool fIncludeZeroValue, bool fOnlyMature) const
@@ -2193,36 +2365,39 @@ void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, bool fThereCanBe
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        int nHeight = chainActive.Height();
+        for (std::map<COutPoint, CStakeOutput>::const_iterator it = mapStakeOutputs.begin(); it != mapStakeOutputs.end(); ++it)
         {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+            const COutPoint& outpoint = it->first;
+            const CStakeOutput& out = it->second;
 
-            int nDepth = pcoin->GetDepthInMainChain();
-            if (nDepth < 1)
+            if (!chainActive.Contains(out.pindexFrom) || out.nMaturityHeight > nHeight)
+                continue;
+
+            if (!((nMinimumInputValue >= 0 && out.nValue >= nMinimumInputValue) ||
+                  (nMinimumInputValue <  0 && out.nValue < -nMinimumInputValue)) ||
+                (nMaxStakeValue && out.nValue > nMaxStakeValue))
+                continue;
+
+            if (IsSpent(outpoint.hash, outpoint.n) || IsLockedCoin(outpoint.hash, outpoint.n))
                 continue;
 
-            if (pcoin->GetBlocksToMaturity() > 0)
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(outpoint.hash);
+            if (mi == mapWallet.end())
                 continue;
+            const CWalletTx* pcoin = &(*mi).second;
 
             CTxDestination address;
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-                isminetype mine = IsMine(pcoin->tx->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    ((nMinimumInputValue >= 0 && pcoin->tx->vout[i].nValue >= nMinimumInputValue) ||
-                     (nMinimumInputValue <  0 && pcoin->tx->vout[i].nValue < -nMinimumInputValue)) &&
-                    (!nMaxStakeValue || pcoin->tx->vout[i].nValue <= nMaxStakeValue) &&
-                    !IsLockedCoin((*it).first, i) &&
-                    (!setStakeAddresses.size() || (ExtractDestination(pcoin->tx->vout[i].scriptPubKey, address) && setStakeAddresses.count(address)))) {
-                    vCoins.push_back(COutput(pcoin, i, nDepth,
-                                                 ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
-                                                 (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO,
-                                                 (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO));
-                    if (fThereCanBeOnlyOne)
-                        return;
-                }
+            isminetype mine = IsMine(pcoin->tx->vout[outpoint.n]);
+            if (mine != ISMINE_NO &&
+                (!setStakeAddresses.size() || (ExtractDestination(pcoin->tx->vout[outpoint.n].scriptPubKey, address) && setStakeAddresses.count(address)))) {
+                vCoins.push_back(COutput(pcoin, outpoint.n, nHeight - out.pindexFrom->nHeight + 1,
+                                             ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
+                                             (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO,
+                                             (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO));
+                if (fThereCanBeOnlyOne)
+                    return;
             }
-
         }
     }
 }
@@ -2231,19 +2406,10 @@ void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, bool fThereCanBe
 
 bool CWallet::HaveAvailableCoinsForStaking() const
 {
-    const int      nCheckInterval = 60;
-    static int64_t nLastCheckTime;
-    static bool    nLastResult;
+    // Cheap enough to answer straight from the stake outputs every time
     vector<COutput> vCoins;
-    int64_t now = GetTime();
-
-    if (nLastCheckTime < now - nCheckInterval) {
-        AvailableCoinsForStaking(vCoins, true);
-        nLastResult = vCoins.size() > 0;
-        nLastCheckTime = now;
-    }
-
-    return nLastResult;
+    AvailableCoinsForStaking(vCoins, true);
+    return vCoins.size() > 0;
 }
 
 static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
@@ -2295,30 +2461,12 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,uns
 // ppcoin: total coins staked (non-spendable until maturity)
 CAmount CWallet::GetStake() const
 {
-    CAmount nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0) {
-            // LogPrintf("%s: maturing coin worth %s\n", it->first.ToString(), FormatMoney(CWallet::GetCredit(*pcoin, ISMINE_SPENDABLE)));
-            nTotal += CWallet::GetCredit(*pcoin, ISMINE_SPENDABLE);
-        }
-    }
-    return nTotal;
+    return GetBalances().nStake;
 }
 
 CAmount CWallet::GetWatchOnlyStake() const
 {
-    CAmount nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin, ISMINE_WATCH_ONLY);
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyStake;
 }
 
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, vector<COutput> vCoins, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
@@ -3066,10 +3214,12 @@ uint64_t CWallet::GetStakeWeight() const
     uint64_t nWeight = 0;
 
     LOCK2(cs_main, cs_wallet);
+    int nHeight = chainActive.Height();
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
-        if (pcoin.first->GetDepthInMainChain() >= Params().GetConsensus().nCoinbaseMaturity)
-            nWeight += pcoin.first->tx->vout[pcoin.second].nValue;
+        std::map<COutPoint, CStakeOutput>::const_iterator it = mapStakeOutputs.find(COutPoint(pcoin.first->GetHash(), pcoin.second));
+        if (it != mapStakeOutputs.end() && nHeight - it->second.pindexFrom->nHeight + 1 >= Params().GetConsensus().nCoinbaseMaturity)
+            nWeight += it->second.nValue;
     }
 
     return nWeight;
@@ -3077,6 +3227,13 @@ uint64_t CWallet::GetStakeWeight() const
 
 void CWallet::SearchNotaryTransactions(uint256 hash, std::vector<std::pair<std::string, int> >& vTxResults)
 {
+    std::vector<std::pair<uint256, int> > vTx;
+    if (FindNotaryTransactions(hash, vTx)) {
+        for (const auto& tx : vTx)
+            vTxResults.push_back(std::make_pair(tx.first.GetHex(), tx.second));
+        return;
+    }
+
     int blockstogoback = chainActive.Tip()->nHeight - 362500;
     std::string matchingCLAMSpeech = "notary " + hash.GetHex();
     const CChainParams& chainParams = Params();
@@ -3110,21 +3267,12 @@ CClamour* CWallet::GetClamour(std::string pid)
     return pResult;
 }
 
-bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key)
-{
-    const CChainParams& chainParams = Params();
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    arith_uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-
-    struct CMutableTransaction txNew(tx);
-    txNew.vin.clear();
-    txNew.vout.clear();
+static const int nMaxStakeSearchInterval = 60;
 
-    // Mark coin stake transaction
-    CScript scriptEmpty;
-    scriptEmpty.clear();
-    txNew.vout.push_back(CTxOut(0, scriptEmpty));
+bool CWallet::SelectStakeCandidates(uint32_t nTime, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::vector<CStakeCandidate>& vCandidates,
+                                    std::vector<std::pair<const CWalletTx*, unsigned int> >& vCandidateCoins) const
+{
+    const Consensus::CParams& consensusParams = Params().GetConsensus();
 
     // Choose coins to use
     CAmount nBalance = GetBalance();
@@ -3132,9 +3280,6 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (nBalance <= nReserveBalance)
         return false;
 
-    vector<const CWalletTx*> vwtxPrev;
-
-    set<pair<const CWalletTx*,unsigned int> > setCoins;
     CAmount nValueIn = 0;
 
     // Select coins with suitable depth
@@ -3145,113 +3290,152 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (setCoins.empty())
         return false;
 
-    int64_t nCredit = 0;
-    CScript scriptPubKeyKernel;
-    int64_t nBlockTime;
-    uint256 hashProofOfStake;
-    CKeyID stakingkeyID;
+    vCandidates.clear();
+    vCandidateCoins.clear();
+    vCandidates.reserve(setCoins.size());
+    vCandidateCoins.reserve(setCoins.size());
 
+    // Everything the kernel needs is in the stake outputs; no coins or blocks are read
+    LOCK(cs_wallet);
     BOOST_FOREACH(const PAIRTYPE(const CWalletTx*, unsigned int)& pcoin, setCoins)
     {
         COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        Coin coinPrev;
-        if(!pcoinsTip->GetCoin(prevoutStake, coinPrev)){
+        std::map<COutPoint, CStakeOutput>::const_iterator it = mapStakeOutputs.find(prevoutStake);
+        if (it == mapStakeOutputs.end())
             return false;
+        const CStakeOutput& out = it->second;
+
+        int64_t nBlockTime = out.nTimeBlockFrom;
+        if (nBlockTime + consensusParams.nStakeMinAge > nTime - nMaxStakeSearchInterval) {
+            LogPrint("stake", "[STAKE] skip %s:%-3d (%s CLAM) - only %d minutes old (needs to be %d)\n",
+                     pcoin.first->GetHash().ToString(), pcoin.second, FormatMoney(out.nValue),
+                     (nTime - nMaxStakeSearchInterval - nBlockTime) / 60,
+                     consensusParams.nStakeMinAge / 60);
+            continue; // only count coins meeting min age requirement
         }
 
-        CBlockIndex* blockFrom = pindexPrev->GetAncestor(coinPrev.nHeight);
-        if(!blockFrom) {
-            return false;
+        vCandidates.push_back(CStakeCandidate(prevoutStake, out.nValue, out.nTimeBlockFrom, out.nTimeTx));
+        vCandidateCoins.push_back(pcoin);
+    }
+
+    return true;
+}
+
+bool CWallet::GetStakeKernelKey(const CKeyStore& keystore, const CScript& scriptPubKeyKernel, CKey& key, CScript& scriptPubKeyOut, CKeyID& stakingkeyID) const
+{
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+    {
+        LogPrint("stake", "GetStakeKernelKey : failed to parse kernel\n");
+        return false;
+    }
+    if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+    {
+        LogPrint("stake", "GetStakeKernelKey : no support for kernel type=%d\n", whichType);
+        return false;  // only support pay to public key and pay to address
+    }
+    if (whichType == TX_PUBKEYHASH) // pay to address type
+    {
+        stakingkeyID = uint160(vSolutions[0]);
+        // convert to pay to public key type
+        if (!keystore.GetKey(stakingkeyID, key))
+        {
+            LogPrint("stake", "GetStakeKernelKey : failed to get key for kernel type=%d\n", whichType);
+            return false;  // unable to find corresponding public key
+        }
+        scriptPubKeyOut = CScript() << key.GetPubKey().getvch() << OP_CHECKSIG;
+    }
+    if (whichType == TX_PUBKEY)
+    {
+        valtype& vchPubKey = vSolutions[0];
+        stakingkeyID = Hash160(vchPubKey);
+        if (!keystore.GetKey(stakingkeyID, key))
+        {
+            LogPrint("stake", "GetStakeKernelKey : failed to get key for kernel type=%d\n", whichType);
+            return false;  // unable to find corresponding public key
         }
 
-        if(coinPrev.IsSpent()){
-            return false;
+        if (key.GetPubKey() != vchPubKey)
+        {
+            LogPrint("stake", "GetStakeKernelKey : invalid key for kernel type=%d\n", whichType);
+            return false; // keys mismatch
         }
 
-        CBlock block;
-        if (!ReadBlockFromDisk(block, blockFrom, chainParams.GetConsensus(), GetBoolArg("-cacheblocksforstaking", true)))
-            return false;
+        scriptPubKeyOut = scriptPubKeyKernel;
+    }
+    return true;
+}
 
+bool CWallet::HaveStakeKernel(CStakeKernelSearch& stakeSearch, const CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTime,
+                              CStakeKernelHit& hit, const std::function<bool()>& fnInterrupt) const
+{
+    std::set<std::pair<const CWalletTx*,unsigned int> > setCoins;
+    std::vector<CStakeCandidate> vCandidates;
+    std::vector<std::pair<const CWalletTx*, unsigned int> > vCandidateCoins;
+    if (!SelectStakeCandidates(nTime, setCoins, vCandidates, vCandidateCoins))
+        return false;
 
-        static int nMaxStakeSearchInterval = 60;
-        nBlockTime = block.GetBlockTime();
-        if (nBlockTime + chainParams.GetConsensus().nStakeMinAge > txNew.nTime - nMaxStakeSearchInterval) {
-            LogPrint("stake", "[STAKE] skip %s:%-3d (%s CLAM) - only %d minutes old (needs to be %d)\n",
-                     pcoin.first->GetHash().ToString(), pcoin.second, FormatMoney(pcoin.first->tx->vout[pcoin.second].nValue),
-                     (txNew.nTime - nMaxStakeSearchInterval - nBlockTime) / 60,
-                     chainParams.GetConsensus().nStakeMinAge / 60);
-            continue; // only count coins meeting min age requirement
-        }
+    size_t nStart = 0;
+    while (stakeSearch.FindKernel(pindexPrev->nStakeModifier, nBits, vCandidates, std::vector<unsigned int>(1, nTime),
+                                  Params().GetConsensus(), hit, nStart, fnInterrupt))
+    {
+        // Found a kernel; if it can't be used, resume the search after it
+        const PAIRTYPE(const CWalletTx*, unsigned int)& pcoin = vCandidateCoins[hit.nCandidate];
+        nStart = hit.nCandidate + 1;
 
-        bool fKernelFound = false;
-        for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == chainActive.Tip(); n++)
-        {
-            boost::this_thread::interruption_point();
-            // Search backward in time from the given txNew timestamp
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            CBigNum bnTargetProofOfStake;
-            if (CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom->nTime, *pcoin.first, prevoutStake, txNew.nTime - n, hashProofOfStake, bnTargetProofOfStake, fDebug))
-            {
-                // Found a kernel
-                vector<valtype> vSolutions;
-                txnouttype whichType;
-                CScript scriptPubKeyOut;
-                scriptPubKeyKernel = pcoin.first->tx->vout[pcoin.second].scriptPubKey;
-                if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-                {
-                    LogPrint("stake", "CreateCoinStake : failed to parse kernel\n");
-                    break;
-                }
-                if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
-                {
-                    LogPrint("stake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
-                    break;  // only support pay to public key and pay to address
-                }
-                if (whichType == TX_PUBKEYHASH) // pay to address type
-                {
-                    stakingkeyID = uint160(vSolutions[0]);
-                    // convert to pay to public key type
-                    if (!keystore.GetKey(stakingkeyID, key))
-                    {
-                        LogPrint("stake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
-                    scriptPubKeyOut << key.GetPubKey().getvch() << OP_CHECKSIG;
-                }
-                if (whichType == TX_PUBKEY)
-                {
-                    valtype& vchPubKey = vSolutions[0];
-                    stakingkeyID = Hash160(vchPubKey);
-                    if (!keystore.GetKey(stakingkeyID, key))
-                    {
-                        LogPrint("stake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
+        CKey key;
+        CScript scriptPubKeyOut;
+        CKeyID stakingkeyID;
+        if (GetStakeKernelKey(*this, pcoin.first->tx->vout[pcoin.second].scriptPubKey, key, scriptPubKeyOut, stakingkeyID))
+            return true;
+    }
+    return false;
+}
 
-                    if (key.GetPubKey() != vchPubKey)
-                    {
-                        LogPrint("stake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
-                        break; // keys mismatch
-                    }
+bool CWallet::CreateCoinStake(const CKeyStore& keystore, const CStakeKernelHit& hit, const CAmount& nTotalFees, uint32_t nTimeBlock,
+                              CMutableTransaction& tx, CKey& key)
+{
+    struct CMutableTransaction txNew(tx);
+    txNew.vin.clear();
+    txNew.vout.clear();
 
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                }
+    // Mark coin stake transaction
+    CScript scriptEmpty;
+    scriptEmpty.clear();
+    txNew.vout.push_back(CTxOut(0, scriptEmpty));
 
-                txNew.nTime -= n;
-                txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-                nCredit += pcoin.first->tx->vout[pcoin.second].nValue;
-                vwtxPrev.push_back(pcoin.first);
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-                setCoins.erase(pcoin); // don't consider the staking coin for merging later
+    CAmount nBalance = GetBalance();
+    vector<const CWalletTx*> vwtxPrev;
+    set<pair<const CWalletTx*,unsigned int> > setCoins;
+    std::vector<CStakeCandidate> vCandidates;
+    std::vector<std::pair<const CWalletTx*, unsigned int> > vCandidateCoins;
+    if (!SelectStakeCandidates(txNew.nTime, setCoins, vCandidates, vCandidateCoins))
+        return false;
 
-                fKernelFound = true;
-                break;
-            }
-        }
+    // The kernel was found by HaveStakeKernel(), it is only looked up again
+    // here, as the wallet may have spent it since
+    size_t nKernel = 0;
+    while (nKernel < vCandidates.size() && vCandidates[nKernel].prevout != hit.prevout)
+        nKernel++;
+    if (nKernel == vCandidates.size())
+        return false;
+    const PAIRTYPE(const CWalletTx*, unsigned int)& coinKernel = vCandidateCoins[nKernel];
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
-    }
+    CScript scriptPubKeyKernel = coinKernel.first->tx->vout[coinKernel.second].scriptPubKey;
+    CScript scriptPubKeyOut;
+    CKeyID stakingkeyID;
+    if (!GetStakeKernelKey(keystore, scriptPubKeyKernel, key, scriptPubKeyOut, stakingkeyID))
+        return false;
+
+    uint256 hashProofOfStake = hit.hashProofOfStake;
+    int64_t nBlockTime = vCandidates[nKernel].nTimeBlockFrom;
+    txNew.nTime = hit.nTimeTx;
+    txNew.vin.push_back(CTxIn(coinKernel.first->GetHash(), coinKernel.second));
+    int64_t nCredit = coinKernel.first->tx->vout[coinKernel.second].nValue;
+    vwtxPrev.push_back(coinKernel.first);
+    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+    setCoins.erase(coinKernel); // don't consider the staking coin for merging later
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -4029,6 +4213,7 @@ void CWallet::DisableTransaction(const CTransaction &tx)
         }
         CWalletTx& wtx = mapWallet[hash];
         wtx.BindWallet(this);
+        UpdateStakeOutputs(wtx);
         NotifyTransactionChanged(this, hash, CT_DELETED);
     }
 }
@@ -4133,7 +4318,8 @@ void CWallet::ListLockedCoins(std::vector<COutPoint>& vOutpts)
     }
 }
 
-void CWallet::StakeTransaction(const CScript& script, CAmount nStakeReward) {
+void CWallet::StakeTransaction(const CScript& script, CAmount nStakeReward, const CBlockIndex* pindex) {
+    LOCK(cs_wallet);
     if (!fAddressRewardsReady)
         return;
 
@@ -4149,10 +4335,29 @@ void CWallet::StakeTransaction(const CScript& script, CAmount nStakeReward) {
         return;
     }
 
-    mapAddressRewards["*"] += nStakeReward;
-    mapAddressRewards[addr] += nStakeReward;
-    LogPrintf("stake %s for %s; global = %s, address = %s\n",
-              FormatMoney(nStakeReward), addr,
+    // A disconnected stake takes away the reward that was recorded for it
+    std::map<int, CStakeReward>& mapRewards = mapStakeLedger[addr];
+    std::map<int, CStakeReward>::iterator it = mapRewards.find(pindex->nHeight);
+    if (it != mapRewards.end()) {
+        mapAddressRewards["*"] -= it->second.nReward;
+        mapAddressRewards[addr] -= it->second.nReward;
+        mapRewards.erase(it);
+        if (fFileBacked)
+            CWalletDB(strWalletFile).EraseStakeReward(addr, pindex->nHeight);
+    }
+    if (nStakeReward > 0) {
+        CStakeReward reward(nStakeReward, pindex->GetBlockHash(), pindex->GetBlockTime());
+        mapRewards[pindex->nHeight] = reward;
+        mapAddressRewards["*"] += nStakeReward;
+        mapAddressRewards[addr] += nStakeReward;
+        if (fFileBacked)
+            CWalletDB(strWalletFile).WriteStakeReward(addr, pindex->nHeight, reward);
+    }
+    if (mapRewards.empty())
+        mapStakeLedger.erase(addr);
+
+    LogPrintf("stake %s for %s at height %d; global = %s, address = %s\n",
+              FormatMoney(nStakeReward), addr, pindex->nHeight,
               FormatMoney(mapAddressRewards["*"]),
               FormatMoney(mapAddressRewards[addr]));
 
@@ -4169,10 +4374,8 @@ void CWallet::StakeTransaction(const CScript& script, CAmount nStakeReward) {
     }
 }
 
-void CWallet::SumStakingRewards()
+void CWallet::RebuildStakeLedger()
 {
-    mapAddressRewards.clear();
-
     int nWalletTx = 0, nStakeTx = 0;
 
     string strAccount;
@@ -4181,42 +4384,135 @@ void CWallet::SumStakingRewards()
     list<COutputEntry> listReceived;
     list<COutputEntry> listSent;
 
-    LOCK(cs_main);
+    LOCK2(cs_main, cs_wallet);
 
+    std::map<std::string, std::map<int, CStakeReward> > mapLedgerNew;
     typedef std::map<uint256, CWalletTx> TMapWallet;
     BOOST_FOREACH(TMapWallet::value_type& entry, mapWallet)
     {
+        nWalletTx++;
         const CWalletTx& wtx = entry.second;
-        if (wtx.IsCoinStake() &&
-            CheckFinalTx(wtx) &&
-            wtx.GetDepthInMainChain() > 0 &&
-            wtx.tx->vout.size() > 1) {
+        if (!wtx.IsCoinStake() ||
+            !CheckFinalTx(wtx) ||
+            wtx.GetDepthInMainChain() <= 0 ||
+            wtx.tx->vout.size() <= 1)
+            continue;
 
-            if (!ExtractDestination(wtx.tx->vout[1].scriptPubKey, address)) {
-                LogPrintf("can't extract destination\n");
-                continue;
-            }
+        if (!ExtractDestination(wtx.tx->vout[1].scriptPubKey, address)) {
+            LogPrintf("can't extract destination\n");
+            continue;
+        }
 
-            std::string addr(CBitcoinAddress(address).ToString());
-            // this can happen when the stake transaction has multiple outputs, and one of them goes to us
-            if (!::IsMine(*this, address)) {
-                // LogPrintf("staked address %s is not mine in txid %s\n", addr, wtx.GetHash().ToString());
-                continue;
-            }
+        std::string addr(CBitcoinAddress(address).ToString());
+        // this can happen when the stake transaction has multiple outputs, and one of them goes to us
+        if (!::IsMine(*this, address))
+            continue;
 
-            isminefilter filter = ISMINE_SPENDABLE;
-            wtx.GetAmounts(listReceived, listSent, nFee, strAccount, filter);
-            mapAddressRewards["*"] -= nFee;
-            mapAddressRewards[addr] -= nFee;
-            nStakeTx++;
+        const CBlockIndex* pindex = mapBlockIndex[wtx.hashBlock];
+        isminefilter filter = ISMINE_SPENDABLE;
+        wtx.GetAmounts(listReceived, listSent, nFee, strAccount, filter);
+        mapLedgerNew[addr][pindex->nHeight] = CStakeReward(-nFee, wtx.hashBlock, pindex->GetBlockTime());
+        nStakeTx++;
+    }
+
+    if (fFileBacked) {
+        CWalletDB walletdb(strWalletFile);
+        walletdb.TxnBegin();
+        walletdb.EraseStakeLedger();
+        for (const auto& addrRewards : mapStakeLedger)
+            for (const auto& heightReward : addrRewards.second)
+                walletdb.EraseStakeReward(addrRewards.first, heightReward.first);
+        for (const auto& addrRewards : mapLedgerNew)
+            for (const auto& heightReward : addrRewards.second)
+                walletdb.WriteStakeReward(addrRewards.first, heightReward.first, heightReward.second);
+        walletdb.WriteStakeLedger(STAKE_LEDGER_VERSION);
+        walletdb.TxnCommit();
+    }
+
+    mapStakeLedger.swap(mapLedgerNew);
+    mapAddressRewards.clear();
+    for (const auto& addrRewards : mapStakeLedger) {
+        for (const auto& heightReward : addrRewards.second) {
+            mapAddressRewards["*"] += heightReward.second.nReward;
+            mapAddressRewards[addrRewards.first] += heightReward.second.nReward;
         }
-        
-        nWalletTx++;
     }
-    LogPrintf("CWallet::SumStakingRewards() found %d of %d tx to be stakes\n", nStakeTx, nWalletTx);
+    LogPrintf("CWallet::RebuildStakeLedger() found %d of %d tx to be stakes\n", nStakeTx, nWalletTx);
     fAddressRewardsReady = true;
 }
 
+bool CWallet::IsStakeLedgerReady() const
+{
+    LOCK(cs_wallet);
+    return fAddressRewardsReady;
+}
+
+void CWallet::InvalidateStakeLedger()
+{
+    LOCK(cs_wallet);
+    if (!fAddressRewardsReady)
+        return;
+    fAddressRewardsReady = false;
+    if (fFileBacked)
+        CWalletDB(strWalletFile).EraseStakeLedger();
+}
+
+void CWallet::VerifyStakeLedger()
+{
+    LOCK2(cs_main, cs_wallet);
+    for (const auto& addrRewards : mapStakeLedger) {
+        for (const auto& heightReward : addrRewards.second) {
+            const CBlockIndex* pindex = chainActive[heightReward.first];
+            if (!pindex || pindex->GetBlockHash() != heightReward.second.hashBlock) {
+                LogPrintf("%s: stake of %s at height %d is no longer in the active chain\n", __func__, addrRewards.first, heightReward.first);
+                InvalidateStakeLedger();
+                return;
+            }
+        }
+    }
+}
+
+void CWallet::LoadStakeReward(const std::string& strAddress, int nHeight, const CStakeReward& reward)
+{
+    mapStakeLedger[strAddress][nHeight] = reward;
+    mapAddressRewards["*"] += reward.nReward;
+    mapAddressRewards[strAddress] += reward.nReward;
+}
+
+CAmount CWallet::GetStakeRewards(const std::string& strAddress, int nMaxHeight) const
+{
+    LOCK(cs_wallet);
+    std::map<std::string, int64_t>::const_iterator itTotal = mapAddressRewards.find(strAddress);
+    if (itTotal == mapAddressRewards.end())
+        return 0;
+
+    // Take the few stakes above nMaxHeight off the total
+    CAmount nAmount = itTotal->second;
+    std::map<std::string, std::map<int, CStakeReward> >::const_iterator itBegin = mapStakeLedger.begin(), itEnd = mapStakeLedger.end();
+    if (strAddress != "*") {
+        itBegin = mapStakeLedger.find(strAddress);
+        itEnd = itBegin == mapStakeLedger.end() ? itBegin : std::next(itBegin);
+    }
+    for (std::map<std::string, std::map<int, CStakeReward> >::const_iterator it = itBegin; it != itEnd; ++it) {
+        for (std::map<int, CStakeReward>::const_reverse_iterator ri = it->second.rbegin(); ri != it->second.rend() && ri->first > nMaxHeight; ++ri)
+            nAmount -= ri->second.nReward;
+    }
+    return nAmount;
+}
+
+void CWallet::ListStakeRewards(const std::string& strAddress, int nMinHeight, int nMaxHeight, std::vector<std::pair<int, CStakeReward> >& vRewards) const
+{
+    vRewards.clear();
+    LOCK(cs_wallet);
+    for (const auto& addrRewards : mapStakeLedger) {
+        if (strAddress != "*" && addrRewards.first != strAddress)
+            continue;
+        for (std::map<int, CStakeReward>::const_iterator it = addrRewards.second.lower_bound(nMinHeight); it != addrRewards.second.end() && it->first <= nMaxHeight; ++it)
+            vRewards.push_back(*it);
+    }
+    std::sort(vRewards.begin(), vRewards.end(), [](const std::pair<int, CStakeReward>& a, const std::pair<int, CStakeReward>& b) { return a.first < b.first; });
+}
+
 /** @} */ // end of Actions
 
 class CAffectedKeysVisitor : public boost::static_visitor<void> {
@@ -4380,6 +4676,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-change=<addr>", _("Address to send change to"));
     strUsage += HelpMessageOpt("-spendlast=<addr>", _("Avoid spending outputs from given address(es) if possible"));
     strUsage += HelpMessageOpt("-stake=<addr>", _("Stake only outputs at the specified address(es)"));
+    strUsage += HelpMessageOpt("-stakethreads=<n>", strprintf(_("Set the number of stake kernel search threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+                                                               -GetNumCores(), MAX_STAKE_THREADS, DEFAULT_STAKE_THREADS));
     strUsage += HelpMessageOpt("-splitsize=<amt>", _("The target output size when splitting staked outputs"));
     strUsage += HelpMessageOpt("-combinelimit=<amt>", _("The maximum output size when combining staking inputs"));
     strUsage += HelpMessageOpt("-combineany=<true/false>", _("Whether to combine outputs from different addresses when staking"));
@@ -4567,6 +4865,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
             }
         }
     }
+    walletInstance->VerifyStakeLedger();
     walletInstance->SetBroadcastTransactions(GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
 
     {
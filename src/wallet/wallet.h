@@ -23,6 +23,8 @@
 #include "consensus/consensus.h"
 #include <algorithm>
 #include <atomic>
+#include <functional>
+#include <limits>
 #include <map>
 #include <set>
 #include <stdexcept>
@@ -83,6 +85,8 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! version of the staking reward ledger records, a ledger of another version is rebuilt
+static const int STAKE_LEDGER_VERSION = 1;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -95,6 +99,9 @@ class CReserveKey;
 class CScript;
 class CTxMemPool;
 class CWalletTx;
+class CStakeKernelSearch;
+struct CStakeCandidate;
+struct CStakeKernelHit;
 
 /** (client) version numbers for particular wallet features */
 enum WalletFeature
@@ -392,18 +399,8 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    //! Break the debit/credit caches, and the transaction's share of the wallet balances
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -466,7 +463,80 @@ public:
 };
 
 
+/**
+ * Kernel-invariant data of a confirmed wallet output. The wallet keeps one
+ * per output it has seen confirmed so that the staker never has to consult
+ * the coins database or read the block the output was confirmed in.
+ */
+class CStakeOutput
+{
+public:
+    CAmount nValue;
+    unsigned int nTimeBlockFrom;
+    unsigned int nTimeTx;
+    //! first chain height at which the output counts as mature
+    int nMaturityHeight;
+    const CBlockIndex* pindexFrom;
+
+    CStakeOutput(CAmount nValueIn, unsigned int nTimeBlockFromIn, unsigned int nTimeTxIn, int nMaturityHeightIn, const CBlockIndex* pindexFromIn)
+        : nValue(nValueIn), nTimeBlockFrom(nTimeBlockFromIn), nTimeTx(nTimeTxIn), nMaturityHeight(nMaturityHeightIn), pindexFrom(pindexFromIn) {}
+};
 
+/** The wallet balances, as returned by the CWallet::Get*Balance and GetStake getters */
+struct CWalletBalances
+{
+    CAmount nTrusted;
+    CAmount nUnconfirmed;
+    CAmount nImmature;
+    CAmount nStake;
+    CAmount nWatchOnlyTrusted;
+    CAmount nWatchOnlyUnconfirmed;
+    CAmount nWatchOnlyImmature;
+    CAmount nWatchOnlyStake;
+
+    CWalletBalances() : nTrusted(0), nUnconfirmed(0), nImmature(0), nStake(0),
+        nWatchOnlyTrusted(0), nWatchOnlyUnconfirmed(0), nWatchOnlyImmature(0), nWatchOnlyStake(0) {}
+
+    bool IsNull() const { return *this == CWalletBalances(); }
+
+    CWalletBalances& operator+=(const CWalletBalances& b)
+    {
+        nTrusted += b.nTrusted;
+        nUnconfirmed += b.nUnconfirmed;
+        nImmature += b.nImmature;
+        nStake += b.nStake;
+        nWatchOnlyTrusted += b.nWatchOnlyTrusted;
+        nWatchOnlyUnconfirmed += b.nWatchOnlyUnconfirmed;
+        nWatchOnlyImmature += b.nWatchOnlyImmature;
+        nWatchOnlyStake += b.nWatchOnlyStake;
+        return *this;
+    }
+
+    CWalletBalances& operator-=(const CWalletBalances& b)
+    {
+        nTrusted -= b.nTrusted;
+        nUnconfirmed -= b.nUnconfirmed;
+        nImmature -= b.nImmature;
+        nStake -= b.nStake;
+        nWatchOnlyTrusted -= b.nWatchOnlyTrusted;
+        nWatchOnlyUnconfirmed -= b.nWatchOnlyUnconfirmed;
+        nWatchOnlyImmature -= b.nWatchOnlyImmature;
+        nWatchOnlyStake -= b.nWatchOnlyStake;
+        return *this;
+    }
+
+    friend bool operator==(const CWalletBalances& a, const CWalletBalances& b)
+    {
+        return a.nTrusted == b.nTrusted && a.nUnconfirmed == b.nUnconfirmed && a.nImmature == b.nImmature && a.nStake == b.nStake &&
+               a.nWatchOnlyTrusted == b.nWatchOnlyTrusted && a.nWatchOnlyUnconfirmed == b.nWatchOnlyUnconfirmed &&
+               a.nWatchOnlyImmature == b.nWatchOnlyImmature && a.nWatchOnlyStake == b.nWatchOnlyStake;
+    }
+
+    friend bool operator!=(const CWalletBalances& a, const CWalletBalances& b)
+    {
+        return !(a == b);
+    }
+};
 
 /** Private key that includes an expiration date in case it never gets used. */
 class CWalletKey
@@ -619,7 +689,45 @@ private:
     void AddToSpends(const uint256& wtxid);
     void RemoveFromSpends(const uint256& wtxid);
 
-    void StakeTransaction(const CScript& script, CAmount nStakeReward) override;
+    /**
+     * Confirmed outputs that may stake, in the same order mapWallet would
+     * yield them. Entries are added when a transaction is seen in a block and
+     * dropped once the output is spent in a block; whether the block is still
+     * in the active chain and the output still unspent is checked on use.
+     */
+    std::map<COutPoint, CStakeOutput> mapStakeOutputs;
+    bool IsSpentInChain(const COutPoint& outpoint) const;
+    void AddToStakeOutputs(const CWalletTx& wtx, unsigned int n, const CBlockIndex* pindex);
+    void UpdateStakeOutputs(const CWalletTx& wtx);
+
+    void StakeTransaction(const CScript& script, CAmount nStakeReward, const CBlockIndex* pindex) override;
+
+    /**
+     * Balances kept up to date instead of summed over mapWallet on each call.
+     * The share of each confirmed or conflicted transaction is kept in
+     * mapTxBalances, and their sum in balancesSettled. Transactions at depth
+     * 0 depend on the mempool, so theirs is computed on each call. A share is
+     * recomputed when its transaction is marked dirty and when it matures;
+     * all of them are when the wallet is marked dirty or the tip moves other
+     * than by extending the chain it was computed at.
+     */
+    struct CTxBalances
+    {
+        CWalletBalances balances;
+        //! chain height at which the transaction matures, or 0
+        int nMaturityHeight;
+    };
+    mutable std::map<uint256, CTxBalances> mapTxBalances;
+    mutable CWalletBalances balancesSettled;
+    mutable std::set<uint256> setBalancesUnconfirmed;
+    mutable std::set<uint256> setBalancesDirty;
+    mutable std::multimap<int, uint256> mapBalancesMaturity;
+    mutable const CBlockIndex* pindexBalances;
+    mutable int nBalancesHeight;
+    mutable bool fBalancesStale;
+    void UpdateBalances() const;
+    void UpdateTxBalances(const uint256& hash) const;
+    CWalletBalances GetTxBalances(const CWalletTx& wtx) const;
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
@@ -710,11 +818,23 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         fAddressRewardsReady = false;
+        pindexBalances = NULL;
+        nBalancesHeight = 0;
+        fBalancesStale = true;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
     std::list<CAccountingEntry> laccentries;
-    std::map<std::string, int64_t> mapAddressRewards; // a running total of staking rewards collected per address
+    /**
+     * Staking reward ledger: the rewards of our stakes by address and height,
+     * kept in the wallet database and updated as our stakes are connected and
+     * disconnected, so that it is queried without scanning mapWallet or taking
+     * cs_main. mapAddressRewards holds the total per address, and over all of
+     * them under "*". Guarded by cs_wallet. Unless fAddressRewardsReady the
+     * wallet may have missed some stakes, and the ledger is rebuilt on use.
+     */
+    std::map<std::string, std::map<int, CStakeReward> > mapStakeLedger;
+    std::map<std::string, int64_t> mapAddressRewards;
     bool fAddressRewardsReady;
 
     typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
@@ -834,6 +954,10 @@ public:
     CAmount GetImmatureWatchOnlyBalance() const;
     CAmount GetStake() const;
     CAmount GetWatchOnlyStake() const;
+    CWalletBalances GetBalances() const;
+    //! The balances summed over every wallet transaction, to check GetBalances() against
+    CWalletBalances GetBalancesFullScan() const;
+    void MarkBalancesDirty(const CWalletTx& wtx) const;
 
     /**
      * Insert additional inputs into the transaction by
@@ -854,7 +978,16 @@ public:
     void ListAccountCreditDebit(const std::string& strAccount, std::list<CAccountingEntry>& entries);
     std::string SendCLAMSpeech(CWalletTx& wtxNew, std::string clamSpeech, std::string prefix = "", bool fAskFee=false);
     uint64_t GetStakeWeight() const;
-    bool CreateCoinStake(const CKeyStore &keystore, unsigned int nBits, int64_t nSearchInterval, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key);
+    //! select the coins that may stake at nTime, and the kernel data of those old enough to do so
+    bool SelectStakeCandidates(uint32_t nTime, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::vector<CStakeCandidate>& vCandidates,
+                               std::vector<std::pair<const CWalletTx*, unsigned int> >& vCandidateCoins) const;
+    //! the key that signs for a kernel paying to scriptPubKeyKernel, and the coinstake output script paying back to it
+    bool GetStakeKernelKey(const CKeyStore& keystore, const CScript& scriptPubKeyKernel, CKey& key, CScript& scriptPubKeyOut, CKeyID& stakingkeyID) const;
+    //! find one of our outputs that meets the stake target on top of pindexPrev at nTime and that we can sign for, without building a coinstake
+    bool HaveStakeKernel(CStakeKernelSearch& stakeSearch, const CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTime,
+                         CStakeKernelHit& hit, const std::function<bool()>& fnInterrupt) const;
+    //! build the coinstake spending the kernel found by HaveStakeKernel()
+    bool CreateCoinStake(const CKeyStore &keystore, const CStakeKernelHit& hit, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key);
     bool AddAccountingEntry(const CAccountingEntry&);
     bool AddAccountingEntry(const CAccountingEntry&, CWalletDB *pwalletdb);
     template <typename ContainerType>
@@ -1038,7 +1171,18 @@ public:
     /* Set the current HD master key (will reset the chain child index counters) */
     bool SetHDMasterKey(const CPubKey& key);
 
-    void SumStakingRewards();
+    /** Rebuild the staking reward ledger from the stakes in mapWallet */
+    void RebuildStakeLedger();
+    bool IsStakeLedgerReady() const;
+    /** Have the staking reward ledger rebuilt before its next use */
+    void InvalidateStakeLedger();
+    /** Drop the ledger if it has stakes no longer in the active chain, i.e. disconnected while the wallet was not loaded */
+    void VerifyStakeLedger();
+    void LoadStakeReward(const std::string& strAddress, int nHeight, const CStakeReward& reward);
+    /** Total reward of strAddress ("*" for all addresses) staked at or below nMaxHeight */
+    CAmount GetStakeRewards(const std::string& strAddress, int nMaxHeight = std::numeric_limits<int>::max()) const;
+    /** Rewards of strAddress ("*" for all addresses) staked from nMinHeight to nMaxHeight, by height */
+    void ListStakeRewards(const std::string& strAddress, int nMinHeight, int nMaxHeight, std::vector<std::pair<int, CStakeReward> >& vRewards) const;
 };
 
 /** A key allocated from the key pool. */
@@ -529,6 +529,23 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
                 return false;
             }
         }
+        else if (strType == "stakereward")
+        {
+            std::string strAddress;
+            int nHeight;
+            CStakeReward reward;
+            ssKey >> strAddress;
+            ssKey >> nHeight;
+            ssValue >> reward;
+            pwallet->LoadStakeReward(strAddress, nHeight, reward);
+        }
+        else if (strType == "stakeledger")
+        {
+            int nVersion;
+            ssValue >> nVersion;
+            if (nVersion == STAKE_LEDGER_VERSION)
+                pwallet->fAddressRewardsReady = true;
+        }
         else if (strType == "hdchain")
         {
             CHDChain chain;
@@ -1169,6 +1186,29 @@ bool CWalletDB::EraseDestData(const std::string &address, const std::string &key
     return Erase(std::make_pair(std::string("destdata"), std::make_pair(address, key)));
 }
 
+bool CWalletDB::WriteStakeReward(const std::string& strAddress, int nHeight, const CStakeReward& reward)
+{
+    nWalletDBUpdateCounter++;
+    return Write(std::make_pair(std::string("stakereward"), std::make_pair(strAddress, nHeight)), reward);
+}
+
+bool CWalletDB::EraseStakeReward(const std::string& strAddress, int nHeight)
+{
+    nWalletDBUpdateCounter++;
+    return Erase(std::make_pair(std::string("stakereward"), std::make_pair(strAddress, nHeight)));
+}
+
+bool CWalletDB::WriteStakeLedger(int nVersion)
+{
+    nWalletDBUpdateCounter++;
+    return Write(std::string("stakeledger"), nVersion);
+}
+
+bool CWalletDB::EraseStakeLedger()
+{
+    nWalletDBUpdateCounter++;
+    return Erase(std::string("stakeledger"));
+}
 
 bool CWalletDB::WriteHDChain(const CHDChain& chain)
 {
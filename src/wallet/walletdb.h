@@ -112,6 +112,37 @@ public:
     }
 };
 
+/** One of our staking rewards, kept by address and height in the staking reward ledger */
+class CStakeReward
+{
+public:
+    CAmount nReward;
+    uint256 hashBlock;
+    int64_t nTime;
+
+    CStakeReward()
+    {
+        SetNull();
+    }
+    CStakeReward(CAmount nRewardIn, const uint256& hashBlockIn, int64_t nTimeIn) : nReward(nRewardIn), hashBlock(hashBlockIn), nTime(nTimeIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nReward);
+        READWRITE(hashBlock);
+        READWRITE(nTime);
+    }
+
+    void SetNull()
+    {
+        nReward = 0;
+        hashBlock.SetNull();
+        nTime = 0;
+    }
+};
+
 /** Access to the wallet database */
 class CWalletDB : public CDB
 {
@@ -163,6 +194,13 @@ public:
     /// Erase destination data tuple from wallet database
     bool EraseDestData(const std::string &address, const std::string &key);
 
+    /// Write a staking reward of an address at a height to the staking reward ledger
+    bool WriteStakeReward(const std::string& strAddress, int nHeight, const CStakeReward& reward);
+    bool EraseStakeReward(const std::string& strAddress, int nHeight);
+    /// Mark the staking reward ledger complete, or no longer so
+    bool WriteStakeLedger(int nVersion);
+    bool EraseStakeLedger();
+
     CAmount GetAccountCreditDebit(const std::string& strAccount);
     void ListAccountCreditDebit(const std::string& strAccount, std::list<CAccountingEntry>& acentries);
 